@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+# Times a script whose rope temporaries die right away, with the nursery (default) and with
+# every object malloc'ed straight into the old space.
+set -e
+cd "$(dirname "$0")/.."
+for flags in "" --no-nursery; do
+    echo "bench/alloc.dix $flags"
+    time ./dix $flags --gc-stats bench/alloc.dix
+done
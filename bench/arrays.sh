@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+# Times numeric work over typed arrays through the builtin kernels and through element-by-element loops.
+# Float sums may differ in the last digits, the kernels add lane by lane.
+set -e
+cd "$(dirname "$0")/.."
+for script in bench/arrays.dix bench/arrays_loop.dix; do
+    echo "$script"
+    time ./dix -O2 "$script"
+done
@@ -0,0 +1,8 @@
+#!/usr/bin/env bash
+# Times array-sum and array-map loops with their bounds checks eliminated (default) and kept.
+set -e
+cd "$(dirname "$0")/.."
+for flags in "" "--keep-bounds-checks"; do
+    echo "bench/bounds.dix $flags"
+    time ./dix $flags bench/bounds.dix
+done
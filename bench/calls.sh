@@ -0,0 +1,8 @@
+#!/usr/bin/env bash
+# Times a call-heavy script with small helpers inlined (default) and with inlining disabled.
+set -e
+cd "$(dirname "$0")/.."
+for script in bench/calls.dix bench/calls_noinline.dix; do
+    echo "$script"
+    time ./dix "$script"
+done
@@ -0,0 +1,101 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "columns.h"
+#include "vm.h"
+
+// Evaluates the same program over generated rows three ways: batch by batch with run_columns,
+// once per row on the same compiled chunk, and once per row through interpret() with the inputs
+// spliced into the source, which is how a caller without the columnar API would do it.
+
+#define INTERPRETED_ROWS 20000
+
+static const char* program =
+    "var gross := price * (float)(quantity);\n"
+    "gross - gross * discount + (float)(quantity / 3);\n"
+    "quantity * 7 - 3 > 100;\n";
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void report(const char* name, int rows, double elapsed) {
+    printf("%-12s %9d rows in %.3f s (%.1f M rows/s)\n", name, rows, elapsed, rows / elapsed / 1e6);
+}
+
+int main(int argc, char** argv) {
+    int rows = argc > 1 ? atoi(argv[1]) : 1 << 22;
+    float* price = malloc(sizeof(float) * rows);
+    int32_t* quantity = malloc(sizeof(int32_t) * rows);
+    float* discount = malloc(sizeof(float) * rows);
+    float* totals[2] = { malloc(sizeof(float) * rows), malloc(sizeof(float) * rows) };
+    bool* large[2] = { malloc(sizeof(bool) * rows), malloc(sizeof(bool) * rows) };
+    uint32_t seed = 12345;
+    for (int i = 0; i < rows; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        price[i] = (float)(seed >> 16 & 0xffff) / 100.f;
+        quantity[i] = (int32_t)(seed & 0x3f);
+        discount[i] = (float)(seed >> 8 & 0xff) / 1024.f;
+    }
+
+    Column inputs[] = {
+        { "price", VALUE_FLOAT, price },
+        { "quantity", VALUE_INT, quantity },
+        { "discount", VALUE_FLOAT, discount },
+    };
+    ColumnProgram compiled;
+    if (compile_columns(program, inputs, 3, &compiled) != RESULT_OK) return 1;
+    printf("vectorized: %s, %d outputs\n", compiled.vectorized ? "yes" : "no", compiled.output_count);
+
+    Column outputs[] = { { NULL, VALUE_FLOAT, totals[0] }, { NULL, VALUE_BOOL, large[0] } };
+    double start = now_seconds();
+    if (run_columns(&compiled, inputs, outputs, rows) != RESULT_OK) return 1;
+    report("columns", rows, now_seconds() - start);
+
+    start = now_seconds();
+    for (int i = 0; i < rows; ++i) {
+        Value bindings[] = { FLOAT_VALUE(price[i]), INT_VALUE(quantity[i]), FLOAT_VALUE(discount[i]) };
+        Value results[2];
+        if (run_chunk_with(&compiled.chunk, bindings, 3, results, 2) != RESULT_OK) return 1;
+        totals[1][i] = AS_FLOAT(results[0]);
+        large[1][i] = AS_BOOL(results[1]);
+    }
+    report("row chunk", rows, now_seconds() - start);
+    int mismatches = 0;
+    for (int i = 0; i < rows; ++i) {
+        mismatches += totals[0][i] != totals[1][i] || large[0][i] != large[1][i];
+    }
+
+    int interpreted = rows < INTERPRETED_ROWS ? rows : INTERPRETED_ROWS;
+    FILE* sink = fopen("/dev/null", "w");
+    set_vm_output(sink);
+    char source[512];
+    start = now_seconds();
+    for (int i = 0; i < interpreted; ++i) {
+        snprintf(
+            source, sizeof(source), "const price := %#.9g; const quantity := %d; const discount := %#.9g;\n%s",
+            price[i], quantity[i], discount[i], program
+        );
+        if (interpret(source) != RESULT_OK) return 1;
+    }
+    flush_vm_output();
+    report("interpret", interpreted, now_seconds() - start);
+    set_vm_output(stdout);
+    fclose(sink);
+
+    printf("mismatches between columns and rows: %d\n", mismatches);
+    free_column_program(&compiled);
+    free(price);
+    free(quantity);
+    free(discount);
+    for (int i = 0; i < 2; ++i) {
+        free(totals[i]);
+        free(large[i]);
+    }
+    return mismatches != 0;
+}
@@ -0,0 +1,5 @@
+#!/usr/bin/env bash
+# Times one program over columnar inputs batch by batch, once per row on the compiled chunk and through per-row interpret().
+set -e
+cd "$(dirname "$0")/.."
+./bench/columns "${1:-4194304}"
@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "columns.h"
+#include "compiler.h"
+#include "vm.h"
+
+// Checks the strength reductions of -O1 and up against C: division by a constant becomes a multiply-high
+// (OP_IDIV_MAGIC) and multiplication by a power of two a shift (OP_ISHL). Every program runs over whole
+// batches and again once per row, which covers both the lanes and the VM.
+
+#define ROWS (4 * COLUMN_BATCH)
+#define RANDOM_CONSTANTS 2000
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed ^ seed >> 16;
+}
+
+// Edge values first, then multiples of the constant and their neighbours, the rest random.
+static void fill_operands(int32_t* x, int32_t constant) {
+    static const int32_t edges[] = { INT32_MIN, INT32_MIN + 1, -2, -1, 0, 1, 2, INT32_MAX - 1, INT32_MAX };
+    int count = (int)(sizeof(edges) / sizeof(edges[0]));
+    for (int i = 0; i < count; ++i) x[i] = edges[i];
+    for (int i = count; i < ROWS / 2; i += 3) {
+        int32_t multiple = (int32_t)((uint32_t)constant * (next_random() % 65536));
+        x[i] = multiple;
+        x[i + 1] = (int32_t)((uint32_t)multiple + 1);
+        x[i + 2] = (int32_t)((uint32_t)multiple - 1);
+    }
+    for (int i = ROWS / 2; i < ROWS; ++i) x[i] = (int32_t)next_random();
+}
+
+// Runs source over x and counts the rows where it differs from expected(x, constant), printing the first few.
+static int check(const char* source, int32_t constant, int32_t (*expected)(int32_t, int32_t), bool vectorized) {
+    static int32_t x[ROWS];
+    static int32_t results[ROWS];
+    fill_operands(x, constant);
+
+    Column inputs[] = { { "x", VALUE_INT, x } };
+    Column outputs[] = { { NULL, VALUE_INT, results } };
+    ColumnProgram program;
+    InterpretResult result = compile_columns(source, inputs, 1, &program);
+    program.vectorized = program.vectorized && vectorized;
+    if (result == RESULT_OK) result = run_columns(&program, inputs, outputs, ROWS);
+    free_column_program(&program);
+    if (result != RESULT_OK) {
+        printf("cannot run: %s", source);
+        return 1;
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < ROWS; ++i) {
+        int32_t want = expected(x[i], constant);
+        if (results[i] == want) continue;
+        if (++mismatches <= 3) {
+            printf("%s, x = %d: %d, C says %d: %s", vectorized ? "lanes" : "rows", x[i], results[i], want, source);
+        }
+    }
+    return mismatches;
+}
+
+static int32_t divide(int32_t x, int32_t divisor) {
+    return x / divisor;
+}
+
+static int32_t multiply(int32_t x, int32_t factor) {
+    return (int32_t)((uint32_t)x * (uint32_t)factor);
+}
+
+// 0 and -1 can trap, so the VM keeps OP_IDIV for them and they're not checked here.
+static int check_division(int32_t divisor) {
+    char source[64];
+    // the lexer only knows non-negative literals, and INT32_MIN has no positive twin
+    if (divisor == INT32_MIN) snprintf(source, sizeof(source), "print x / (-2147483647 - 1);\n");
+    else snprintf(source, sizeof(source), "print x / (%d);\n", divisor);
+    return check(source, divisor, divide, true) + check(source, divisor, divide, false);
+}
+
+// Only positive powers of two become shifts, other products keep OP_IMUL.
+static int check_shift(int shift) {
+    int32_t factor = (int32_t)(1u << shift);
+    char left[64];
+    char right[64];
+    snprintf(left, sizeof(left), "print x * %d;\n", factor);
+    snprintf(right, sizeof(right), "print %d * x;\n", factor);
+    return check(left, factor, multiply, true) + check(left, factor, multiply, false) +
+           check(right, factor, multiply, true) + check(right, factor, multiply, false);
+}
+
+int main(int argc, char** argv) {
+    int random_constants = argc > 1 ? atoi(argv[1]) : RANDOM_CONSTANTS;
+    set_optimization_level(2);
+
+    int constants = 0;
+    int mismatches = 0;
+    for (int shift = 1; shift < 31; ++shift) {
+        int32_t power = (int32_t)(1u << shift);
+        int32_t divisors[] = { power, -power, power + 1, -power - 1, power - 1, 1 - power };
+        for (int i = 0; i < 6; ++i) {
+            if (divisors[i] != 1 && divisors[i] != -1) mismatches += check_division(divisors[i]);
+        }
+        mismatches += check_shift(shift);
+        constants += 7;
+    }
+    int32_t extremes[] = { INT32_MIN, INT32_MIN + 1, INT32_MAX, 1, 3, -3, 5, -5, 7, -7, 10, -10, 641, -641 };
+    for (size_t i = 0; i < sizeof(extremes) / sizeof(extremes[0]); ++i) {
+        mismatches += check_division(extremes[i]);
+        ++constants;
+    }
+    for (int i = 0; i < random_constants; ++i) {
+        // small divisors are the common case, large ones exercise the wide multipliers
+        uint32_t bits = next_random();
+        int32_t divisor = i % 2 == 0 ? (int32_t)(bits % 2001) - 1000 : (int32_t)bits;
+        if (divisor == 0 || divisor == -1) continue;
+        mismatches += check_division(divisor);
+        ++constants;
+    }
+
+    printf("%d constants over %d rows each, %d mismatches\n", constants, ROWS, mismatches);
+    return mismatches != 0;
+}
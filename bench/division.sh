@@ -0,0 +1,5 @@
+#!/usr/bin/env bash
+# Checks division by constants and multiplication by powers of two at -O2 against C, over edge and random operands.
+set -e
+cd "$(dirname "$0")/.."
+./bench/division "${1:-2000}"
@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+# Times a pipeline of chained generators against the same pipeline building an intermediate array
+# per stage.
+set -e
+cd "$(dirname "$0")/.."
+for script in bench/generators.dix bench/generators_arrays.dix; do
+    echo "$script"
+    time ./dix "$script"
+done
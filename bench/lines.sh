@@ -0,0 +1,15 @@
+#!/usr/bin/env bash
+# Times `wc -l` and lines() over a generated log file of about 250 MB: once with the loop variable only
+# compared, so every line stays a slice of the read buffer, and once with it stored, so every line is
+# copied into a string.
+set -e
+cd "$(dirname "$0")/.."
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+awk 'BEGIN { for (i = 0; i < 4000000; i++) printf "2026-10-19T12:%02d:00 %s request %d served in %d ms\n%s", i % 60, i % 97 ? "INFO" : "ERROR", i, i % 500, i % 1000 ? "" : "\n" }' > "$log"
+echo "wc -l"
+time wc -l < "$log"
+for script in bench/lines.dix bench/lines_owned.dix; do
+    echo "$script"
+    time ./dix "$script" < "$log"
+done
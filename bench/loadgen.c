@@ -0,0 +1,157 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "server.h"
+
+// Load generator for `dix --serve`: every connection runs in its own thread and keeps
+// exactly one request in flight, latencies of all requests are merged for the report.
+
+typedef struct Client {
+    const char* socket_path;
+    const char** expressions;
+    int expression_count;
+    int requests;
+    uint64_t* latencies;
+    int failed;
+} Client;
+
+static const char* default_expressions[] = {
+    "1 + 2 * 3 + 4 - 5 / 1",
+    "(float)7 / 2.0",
+    "-3 * 4 + 100 / 7",
+    "!true",
+};
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static bool transfer(int fd, void* data, size_t length, bool sending) {
+    char* bytes = data;
+    while (length > 0) {
+        ssize_t count = sending ? send(fd, bytes, length, MSG_NOSIGNAL) : recv(fd, bytes, length, 0);
+        if (count <= 0) return false;
+        bytes += count;
+        length -= (size_t)count;
+    }
+    return true;
+}
+
+static void* run_client(void* argument) {
+    Client* client = argument;
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strncpy(address.sun_path, client->socket_path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        client->failed = client->requests;
+        return NULL;
+    }
+
+    char* response = NULL;
+    uint32_t response_capacity = 0;
+    for (int i = 0; i < client->requests; ++i) {
+        const char* expression = client->expressions[i % client->expression_count];
+        RequestHeader request = { .length = (uint32_t)strlen(expression) };
+        ResponseHeader header;
+
+        uint64_t start = now_ns();
+        bool ok = transfer(fd, &request, sizeof(request), true)
+            && transfer(fd, (void*)expression, request.length, true)
+            && transfer(fd, &header, sizeof(header), false);
+        if (ok && header.length > response_capacity) {
+            response_capacity = header.length;
+            response = realloc(response, response_capacity);
+        }
+        ok = ok && transfer(fd, response, header.length, false);
+        client->latencies[i] = now_ns() - start;
+
+        if (!ok) {
+            client->failed += client->requests - i;
+            break;
+        }
+        if (header.result != 0) ++client->failed;
+    }
+
+    free(response);
+    close(fd);
+    return NULL;
+}
+
+static int compare_latencies(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const uint64_t* sorted, int count, double fraction) {
+    int index = (int)(fraction * (count - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <socket> [connections] [requests per connection] [expression...]\n", argv[0]);
+        return 1;
+    }
+
+    int connections = argc > 2 ? atoi(argv[2]) : 4;
+    int requests = argc > 3 ? atoi(argv[3]) : 10000;
+    const char** expressions = default_expressions;
+    int expression_count = sizeof(default_expressions) / sizeof(default_expressions[0]);
+    if (argc > 4) {
+        expressions = (const char**)argv + 4;
+        expression_count = argc - 4;
+    }
+    if (connections <= 0 || requests <= 0) {
+        fprintf(stderr, "loadgen: connections and requests must be positive\n");
+        return 1;
+    }
+
+    int total = connections * requests;
+    uint64_t* latencies = malloc(sizeof(uint64_t) * total);
+    Client* clients = calloc(connections, sizeof(Client));
+    pthread_t* threads = malloc(sizeof(pthread_t) * connections);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < connections; ++i) {
+        clients[i] = (Client){
+            .socket_path = argv[1],
+            .expressions = expressions,
+            .expression_count = expression_count,
+            .requests = requests,
+            .latencies = latencies + (size_t)i * requests,
+        };
+        pthread_create(&threads[i], NULL, run_client, &clients[i]);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < connections; ++i) {
+        pthread_join(threads[i], NULL);
+        failed += clients[i].failed;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    qsort(latencies, total, sizeof(uint64_t), compare_latencies);
+    printf("requests:   %d (%d failed) over %d connections\n", total, failed, connections);
+    printf("throughput: %.0f requests/s\n", total / elapsed);
+    printf("latency:    p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        percentile(latencies, total, 0.50),
+        percentile(latencies, total, 0.99),
+        latencies[total - 1] / 1000.0
+    );
+
+    free(threads);
+    free(clients);
+    free(latencies);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cstring.h"
+#include "map.h"
+#include "value.h"
+
+// Times inserts, hit and miss lookups, iteration and removal on map[string]int maps of growing size,
+// calling the map directly so the numbers are the table's and not the interpreter's. Keys are interned
+// up front, like the literals and runtime strings a script hands to a map.
+
+// misses cycle through this many absent keys
+#define MISS_KEYS (1 << 16)
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void report(const char* name, int entries, int operations, double elapsed) {
+    printf("%-8s %9d entries %6.1f ns/op\n", name, entries, elapsed / operations * 1e9);
+}
+
+static CString** make_keys(const char* prefix, int count) {
+    CString** keys = malloc(sizeof(CString*) * count);
+    char data[32];
+    for (int i = 0; i < count; ++i) {
+        snprintf(data, sizeof(data), "%s%d", prefix, i);
+        keys[i] = create_cstring(data);
+    }
+    return keys;
+}
+
+static void free_keys(CString** keys, int count) {
+    for (int i = 0; i < count; ++i) free_cstring(keys[i]);
+    free(keys);
+}
+
+static int64_t bench(int entries, CString** misses) {
+    CString** keys = make_keys("key", entries);
+    Map* map = new_map(VALUE_INT);
+    int64_t checksum = 0;
+
+    double start = now_seconds();
+    for (int i = 0; i < entries; ++i) map_set(map, keys[i], INT_VALUE(i));
+    report("insert", entries, entries, now_seconds() - start);
+
+    Value value;
+    start = now_seconds();
+    for (int i = 0; i < entries; ++i) {
+        if (map_get(map, keys[i], &value)) checksum += AS_INT(value);
+    }
+    report("hit", entries, entries, now_seconds() - start);
+
+    start = now_seconds();
+    for (int i = 0; i < entries; ++i) checksum += map_get(map, misses[i & (MISS_KEYS - 1)], &value);
+    report("miss", entries, entries, now_seconds() - start);
+
+    start = now_seconds();
+    for (int slot = next_map_slot(map, 0); slot != -1; slot = next_map_slot(map, slot + 1)) {
+        checksum += AS_INT(map_slot_value(map, slot));
+    }
+    report("iterate", entries, entries, now_seconds() - start);
+
+    start = now_seconds();
+    for (int i = 0; i < entries; ++i) checksum += map_remove(map, keys[i]);
+    report("remove", entries, entries, now_seconds() - start);
+
+    // the map belongs to the collector, which never runs here, and no longer refers to the keys
+    free_keys(keys, entries);
+    return checksum;
+}
+
+int main(int argc, char** argv) {
+    int max_entries = argc > 1 ? atoi(argv[1]) : 10000000;
+    CString** misses = make_keys("miss", MISS_KEYS);
+    int64_t checksum = 0;
+    for (int entries = 1000; entries <= max_entries; entries *= 10) {
+        checksum += bench(entries, misses);
+    }
+    free_keys(misses, MISS_KEYS);
+    printf("checksum %lld\n", (long long)checksum);
+    return 0;
+}
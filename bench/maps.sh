@@ -0,0 +1,6 @@
+#!/usr/bin/env bash
+# Times map inserts, hit and miss lookups, iteration and removal from 10^3 up to the given number of entries.
+# The 10^7 map needs about 1 GB.
+set -e
+cd "$(dirname "$0")/.."
+./bench/maps "${1:-10000000}"
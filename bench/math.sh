@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+# Times a numeric loop with the math intrinsics compiled to single instructions and with each of them
+# behind a function call, both print the same results.
+set -e
+cd "$(dirname "$0")/.."
+for script in bench/math.dix bench/math_calls.dix; do
+    echo "$script"
+    time ./dix "$script"
+done
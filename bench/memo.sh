@@ -0,0 +1,11 @@
+#!/usr/bin/env bash
+# Times pure functions called with repeating arguments with their results memoized and the same script
+# without `pure`, then prints the hits, misses and evictions of every result cache. wrapped tail calls
+# doubled and is called with 100 distinct arguments, so both caches should miss exactly 100 times.
+set -e
+cd "$(dirname "$0")/.."
+for script in bench/memo.dix bench/memo_plain.dix; do
+    echo "$script"
+    time ./dix "$script"
+done
+./dix --memo-stats bench/memo.dix 2>&1 >/dev/null
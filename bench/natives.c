@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "native.h"
+#include "value.h"
+#include "vm.h"
+
+// Measures what a call to a registered host function costs: the same counting loop runs with the
+// addition inline, through a native and through a dix function kept out of line, and the per-call
+// cost is the difference to the inline loop.
+
+static const char* add_native(Value* arguments, Value* result) {
+    *result = INT_VALUE(AS_INT(arguments[0]) + AS_INT(arguments[1]));
+    return NULL;
+}
+
+static const char* programs[][2] = {
+    { "inline", "var s := 0; for (var i := 0; i < %d; i = i + 1) { s = s + 1; } print s;" },
+    { "native", "var s := 0; for (var i := 0; i < %d; i = i + 1) { s = add(s, 1); } print s;" },
+    { "function", "noinline func add2(a: int, b: int): int { return a + b; }\n"
+                  "var s := 0; for (var i := 0; i < %d; i = i + 1) { s = add2(s, 1); } print s;" },
+};
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    int calls = argc > 1 ? atoi(argv[1]) : 50000000;
+    register_native("add", add_native, VALUE_INT, 2, (ValueType[]){ VALUE_INT, VALUE_INT });
+
+    FILE* sink = fopen("/dev/null", "w");
+    set_vm_output(sink);
+    double baseline = 0;
+    char source[256];
+    for (int i = 0; i < 3; ++i) {
+        snprintf(source, sizeof(source), programs[i][1], calls);
+        double start = now_seconds();
+        if (interpret(source) != RESULT_OK) return 1;
+        double elapsed = now_seconds() - start;
+        if (i == 0) baseline = elapsed;
+        printf("%-9s %.3f s, %+.2f ns per call\n", programs[i][0], elapsed, (elapsed - baseline) / calls * 1e9);
+    }
+    flush_vm_output();
+    set_vm_output(stdout);
+    fclose(sink);
+    return 0;
+}
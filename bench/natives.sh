@@ -0,0 +1,5 @@
+#!/usr/bin/env bash
+# Times a counting loop with the addition inline, through a registered native and through an out-of-line dix function.
+set -e
+cd "$(dirname "$0")/.."
+./bench/natives "${1:-50000000}"
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+# Times field accesses and method calls on objects of three classes, with inline caches (default) and
+# with every access looked up by name. The profile lists the hits and misses of every cache.
+set -e
+cd "$(dirname "$0")/.."
+for flags in "" --no-inline-caches; do
+    echo "bench/objects.dix $flags"
+    time ./dix $flags bench/objects.dix
+done
+./dix --sample-profile bench/objects.dix 2>&1 >/dev/null | grep "^inline cache"
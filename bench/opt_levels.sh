@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+# Times the loop-heavy scripts at every optimization level.
+set -e
+cd "$(dirname "$0")/.."
+for script in bench/loops.dix bench/divide.dix; do
+    for level in -O0 -O1 -O2; do
+        echo "$script $level"
+        time ./dix "$level" "$script"
+    done
+done
@@ -0,0 +1,6 @@
+#!/usr/bin/env bash
+# Times a log-building script doing 1M string appends.
+set -e
+cd "$(dirname "$0")/.."
+echo "bench/strings.dix"
+time ./dix bench/strings.dix
@@ -1,39 +1,195 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cache.h"
+#include "chunk.h"
+#include "compiler.h"
+#include "gc.h"
 #include "io.h"
+#include "ir.h"
+#include "profiler.h"
+#include "server.h"
 #include "vm.h"
 
 static void repl() {
-    char line[1024];
+    Session session;
+    init_session(&session);
+    LineReader reader;
+    init_line_reader(&reader, STDIN_FILENO, LINE_READER_CAPACITY);
+
+    char* line;
+    int length;
     for (;;) {
         printf(">>> ");
+        fflush(stdout);
+
+        if (!read_line(&reader, &line, &length)) break;
+        printf("\n");
+
+        interpret_in_session(&session, line);
+        flush_vm_output();
+    }
+
+    free_line_reader(&reader);
+    free_session(&session);
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run_batch(bool gc_stats, bool memo_stats) {
+    set_gc_stats(gc_stats);
+    set_memo_stats(memo_stats);
+    ChunkCache cache;
+    init_chunk_cache(&cache, CHUNK_CACHE_CAPACITY);
+    LineReader reader;
+    init_line_reader(&reader, STDIN_FILENO, LINE_READER_CAPACITY);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-        if (fgets(line, sizeof(line), stdin)) {
-            printf("\n");
+    uint64_t evaluated = 0;
+    char* line;
+    int length;
+    while (read_line(&reader, &line, &length)) {
+        if (length == 0) continue;
 
-            interpret(line);
+        CacheEntry* entry = find_cached_chunk(&cache, line, length);
+        if (entry == NULL) {
+            Chunk compiled = { 0 };
+            if (compile_source(line, &compiled) != RESULT_OK) {
+                free_chunk(&compiled);
+                continue;
+            }
+            entry = insert_cached_chunk(&cache, line, length, compiled);
         }
+
+        run_chunk(&entry->chunk);
+        release_cached_chunk(entry);
+        ++evaluated;
     }
+    flush_vm_output();
+
+    double elapsed = seconds_since(&start);
+    uint64_t lookups = cache.hits + cache.misses;
+    fprintf(
+        stderr,
+        "batch: %llu expressions in %.3f s (%.0f expressions/s), cache hit rate %.1f%% (%llu/%llu)\n",
+        (unsigned long long)evaluated,
+        elapsed,
+        elapsed > 0 ? evaluated / elapsed : 0.0,
+        lookups > 0 ? 100.0 * cache.hits / lookups : 0.0,
+        (unsigned long long)cache.hits,
+        (unsigned long long)lookups
+    );
+
+    if (gc_stats) print_gc_stats(stderr);
+    if (memo_stats) print_memo_stats(stderr);
+
+    free_line_reader(&reader);
+    free_chunk_cache(&cache);
 }
 
-static void run_file(const char* file_path) {
+static void run_file(const char* file_path, bool sample_profile, bool gc_stats, bool memo_stats) {
+    if (sample_profile) enable_sampling_profiler();
+    set_gc_stats(gc_stats);
+    set_memo_stats(memo_stats);
+
     char* source = read_file(file_path);
     InterpretResult result = interpret(source);
     free(source);
+    flush_vm_output();
+
+    if (gc_stats) print_gc_stats(stderr);
+    if (memo_stats) print_memo_stats(stderr);
+
+    if (sample_profile) {
+        print_folded_samples(stderr);
+        free_samples();
+    }
 
     if (result == RESULT_COMPILE_ERROR || result == RESULT_RUNTIME_ERROR) exit(1);
 }
 
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [-O0|-O1|-O2] [--emit-ir] [--keep-bounds-checks] [--sample-profile] [--gc-stats] [--memo-stats] [--no-nursery] [--no-inline-caches] [--shortest-floats] <input.dix>\n", program);
+    fprintf(stderr, "       %s [-O0|-O1|-O2] [--gc-stats] [--memo-stats] [--no-nursery] [--no-inline-caches] [--shortest-floats] --batch\n", program);
+    fprintf(stderr, "       %s [-O0|-O1|-O2] [--no-nursery] [--no-inline-caches] --serve <socket>\n", program);
+    exit(1);
+}
+
 int main(int argc, char** argv) {
-    if (argc == 1) {
-        repl();
+    const char* file_path = NULL;
+    bool sample_profile = false;
+    bool gc_stats = false;
+    bool memo_stats = false;
+    bool batch = false;
+    const char* socket_path = NULL;
+    atexit(flush_vm_output);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--sample-profile") == 0) {
+            sample_profile = true;
+        }
+        else if (strcmp(argv[i], "--gc-stats") == 0) {
+            gc_stats = true;
+        }
+        else if (strcmp(argv[i], "--memo-stats") == 0) {
+            memo_stats = true;
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        }
+        else if (strcmp(argv[i], "--no-nursery") == 0) {
+            set_gc_nursery(false);
+        }
+        else if (strcmp(argv[i], "--no-inline-caches") == 0) {
+            set_inline_caches(false);
+        }
+        else if (strcmp(argv[i], "--shortest-floats") == 0) {
+            set_shortest_floats(true);
+        }
+        else if (strcmp(argv[i], "--emit-ir") == 0) {
+            set_emit_ir(true);
+        }
+        else if (strcmp(argv[i], "--keep-bounds-checks") == 0) {
+            set_bounds_check_elimination(false);
+        }
+        else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0) {
+            set_optimization_level(argv[i][2] - '0');
+        }
+        else if (argv[i][0] == '-' || file_path != NULL) {
+            usage(argv[0]);
+        }
+        else {
+            file_path = argv[i];
+        }
     }
-    else if (argc == 2) {
-        run_file(argv[1]);
+
+    if (socket_path != NULL) {
+        if (sample_profile || gc_stats || memo_stats || batch || file_path != NULL) usage(argv[0]);
+        long workers = sysconf(_SC_NPROCESSORS_ONLN);
+        return serve(socket_path, workers > 0 ? (int)workers : 1);
+    }
+    else if (batch) {
+        if (sample_profile || file_path != NULL) usage(argv[0]);
+        run_batch(gc_stats, memo_stats);
+    }
+    else if (file_path == NULL) {
+        if (sample_profile || gc_stats || memo_stats) usage(argv[0]);
+        repl();
     }
     else {
-        fprintf(stderr, "usage: %s <input.dix>\n", argv[0]);
-        return 1;
+        run_file(file_path, sample_profile, gc_stats, memo_stats);
     }
 
     return 0;
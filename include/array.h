@@ -0,0 +1,56 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "object.h"
+#include "value.h"
+
+// Elements are stored unboxed and contiguously: int32_t for int[], float for float[]
+// and one byte per element for bool[].
+typedef struct Array {
+    Obj obj;
+    int length;
+    ValueType element_type;
+    uint8_t data[];
+} Array;
+
+#define ARRAY_INTS(array)   ((int32_t*)(array)->data)
+#define ARRAY_FLOATS(array) ((float*)(array)->data)
+#define ARRAY_BOOLS(array)  ((bool*)(array)->data)
+
+// Functions over arrays and maps that the language provides without a declaration, user functions
+// with the same name take precedence. The ones starting with $ cannot be named in source, `for (k in m)`
+// walks the slots of a map with them. Over a generator $next becomes $resume, compiled to OP_RESUME,
+// and $key becomes $view when the loop only prints or compares its variable, so lines stay borrowed.
+typedef enum ArrayBuiltin {
+    BUILTIN_LEN,
+    BUILTIN_SUM,
+    BUILTIN_MIN,
+    BUILTIN_MAX,
+    BUILTIN_DOT,
+    BUILTIN_SCALE,
+    BUILTIN_ADD,
+    BUILTIN_MUL,
+    BUILTIN_PREFIX_SUM,
+    BUILTIN_HAS,
+    BUILTIN_REMOVE,
+    BUILTIN_NEXT_SLOT,
+    BUILTIN_SLOT_KEY,
+    BUILTIN_SLOT_VIEW,
+    BUILTIN_RESUME,
+    BUILTIN_LINES,
+    BUILTIN_COUNT,
+} ArrayBuiltin;
+
+// Bytes taken by an array object including its header.
+size_t array_size(ValueType element_type, int length);
+// Zero-filled. Allocates but never collects.
+Array* new_array(ValueType element_type, int length);
+
+// Returns the builtin called name or -1.
+int find_array_builtin(const char* name, int length);
+const char* array_builtin_name(ArrayBuiltin builtin);
+int array_builtin_arity(ArrayBuiltin builtin);
+// Takes the arguments in call order and returns NULL, or the message of the runtime error it hit.
+// Allocates but never collects.
+const char* call_array_builtin(ArrayBuiltin builtin, Value* arguments, Value* result);
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "chunk.h"
+
+#define CHUNK_CACHE_CAPACITY 1024
+
+typedef struct CacheEntry {
+    char* source;
+    int length;
+    uint32_t hash;
+    Chunk chunk;
+    int references;
+    bool evicted;
+
+    struct CacheEntry* next_in_bucket;
+    struct CacheEntry* newer;
+    struct CacheEntry* older;
+} CacheEntry;
+
+// Compiled chunks keyed by their source text, evicting the least recently used entry.
+typedef struct ChunkCache {
+    int count;
+    int capacity;
+    int bucket_count;
+    CacheEntry** buckets;
+
+    CacheEntry* newest;
+    CacheEntry* oldest;
+
+    uint64_t hits;
+    uint64_t misses;
+} ChunkCache;
+
+void init_chunk_cache(ChunkCache* cache, int capacity);
+void free_chunk_cache(ChunkCache* cache);
+
+// Returned entries are retained and stay valid until released, even if evicted meanwhile.
+CacheEntry* find_cached_chunk(ChunkCache* cache, const char* source, int length);
+CacheEntry* insert_cached_chunk(ChunkCache* cache, const char* source, int length, Chunk chunk);
+void release_cached_chunk(CacheEntry* entry);
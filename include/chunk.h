@@ -1,16 +1,56 @@
 #pragma once
 #include <stdint.h>
+#include "class.h"
 #include "value.h"
 
+// Function bodies live inline in the chunk's code, calls refer to them by index.
+typedef struct Function {
+    char* name;
+    int length;
+    int arity;
+    int entry;
+    int end;
+} Function;
+
 typedef struct Chunk {
     int count;
     int capacity;
     uint8_t* code;
     int* lines;
     ValueArray constant_pool;
+    // the VM reserves this many globals before running the code
+    int global_count;
+
+    int function_count;
+    int function_capacity;
+    Function* functions;
+
+    int class_count;
+    int class_capacity;
+    Class** classes;
+    // classes with the same fields in the same order share a shape of this tree
+    Shape* shapes;
+    uint32_t shape_count;
+
+    int cache_count;
+    int cache_capacity;
+    InlineCache* caches;
+
+    // compile-time strings interned while compiling into the chunk, one reference each
+    int string_count;
+    int string_capacity;
+    CString** strings;
 } Chunk;
 
 void write_chunk(Chunk* chunk, uint8_t byte, int line);
 void free_chunk(Chunk* chunk);
 
 int add_constant(Chunk* chunk, Value value);
+int add_function(Chunk* chunk, const char* name, int length, int arity, int entry);
+void truncate_functions(Chunk* chunk, int count);
+// Returns the class index, its shape holds fields in declaration order.
+int add_class(Chunk* chunk, CString* name, CString** fields, int field_count);
+void truncate_classes(Chunk* chunk, int count);
+int add_inline_cache(Chunk* chunk, InlineCacheKind kind, CString* name, int offset);
+// Returns the function whose code contains offset, or NULL for top-level code.
+Function* function_at(Chunk* chunk, int offset);
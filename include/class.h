@@ -0,0 +1,89 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cstring.h"
+#include "object.h"
+#include "value.h"
+
+// Polymorphic sites remember this many shapes or classes, a site that sees more goes megamorphic
+// and looks the others up by name on every access.
+#define INLINE_CACHE_ENTRIES 4
+
+// Hidden class: the fields of an instance in layout order. Adding a field to a shape always leads
+// to the same child, so classes declaring the same fields in the same order share one shape.
+typedef struct Shape {
+    struct Shape* parent;
+    CString* field;  // the last one, NULL for the empty root
+    int field_count;
+    uint32_t id;
+    int transition_count;
+    int transition_capacity;
+    struct Shape** transitions;
+} Shape;
+
+typedef struct Method {
+    CString* name;
+    int function;
+} Method;
+
+typedef struct Class {
+    CString* name;
+    uint32_t id;
+    Shape* shape;
+    int method_count;
+    int method_capacity;
+    Method* methods;
+} Class;
+
+// Fields are stored inline at the offsets given by the shape.
+typedef struct Instance {
+    Obj obj;
+    int field_count;
+    Class* klass;
+    Shape* shape;
+    Value fields[];
+} Instance;
+
+typedef enum InlineCacheKind {
+    CACHE_GET_FIELD,
+    CACHE_SET_FIELD,
+    CACHE_INVOKE,
+} InlineCacheKind;
+
+// One per field access or method call site. Entries pack a shape id (class id for calls) above the
+// field offset (function index), so workers sharing a chunk never read a torn entry. Racing fills
+// may drop an entry, never corrupt one.
+typedef struct InlineCache {
+    InlineCacheKind kind;
+    CString* name;
+    int offset;  // of the instruction
+    atomic_int count;
+    atomic_bool megamorphic;
+    _Atomic uint64_t entries[INLINE_CACHE_ENTRIES];
+    // plain increments through atomics, concurrent workers may lose counts but never tear them
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+} InlineCache;
+
+// The root of a shape tree, every shape in it is freed with free_shape_tree().
+Shape* new_root_shape();
+// Returns the child of shape with field appended, numbering a new one from next_id.
+Shape* add_shape_field(Shape* shape, CString* field, uint32_t* next_id);
+void free_shape_tree(Shape* shape);
+// Returns the offset of the field called name or -1.
+int find_field(Shape* shape, CString* name);
+
+Class* new_class(CString* name, uint32_t id, Shape* shape);
+void add_method(Class* klass, CString* name, int function);
+void free_class(Class* klass);
+// Returns the function index of the method called name or -1.
+int find_method(Class* klass, CString* name);
+
+// Bytes taken by an instance including its header.
+size_t instance_size(int field_count);
+// Fields start out as NONE. Allocates but never collects.
+Instance* new_instance(Class* klass);
+
+const char* inline_cache_state(InlineCache* cache);
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+#include "chunk.h"
+#include "value.h"
+#include "vm.h"
+
+// Rows are evaluated in batches of this many lanes, every instruction runs once per batch.
+#define COLUMN_BATCH 1024
+
+// One bool, int32_t or float per row. Inputs are bound by name at compile time and by position at run time,
+// outputs are filled in the order the program prints them.
+typedef struct Column {
+    const char* name;
+    ValueType type;
+    void* data;
+} Column;
+
+// Inputs are const globals of the program, its top-level bare expressions and print statements are the outputs.
+typedef struct ColumnProgram {
+    Chunk chunk;
+    int input_count;
+    ValueType* input_types;
+    int output_count;
+    ValueType* output_types;
+    int global_count;
+    int stack_depth;
+    // straight-line code runs over whole batches, anything else runs the VM once per row
+    bool vectorized;
+} ColumnProgram;
+
+// The program is freed with free_column_program() whether or not it compiled.
+InterpretResult compile_columns(const char* source, const Column* inputs, int input_count, ColumnProgram* program);
+InterpretResult run_columns(ColumnProgram* program, const Column* inputs, Column* outputs, int rows);
+void free_column_program(ColumnProgram* program);
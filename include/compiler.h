@@ -3,4 +3,10 @@
 #include "chunk.h"
 #include "parser.h"
 
-bool compile(ASTNode* ast, Chunk* chunk);
+// 0 compiles the tree as is, 1 inlines and folds it and goes through the optimized SSA IR,
+// 2 adds common subexpression elimination and loop-invariant code motion. Default is 1.
+void set_optimization_level(int level);
+// Prints the IR of every compiled program to stdout.
+void set_emit_ir(bool enabled);
+
+bool compile(ASTNode* ast, Chunk* chunk, bool echo);
@@ -1,11 +1,42 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
+#include "object.h"
 
+#define STRING_TABLE_MAX_LOAD 0.75
+
+// Strings are immutable and carry their hash, so lookups in hashed containers never rescan them.
 typedef struct CString {
+    Obj obj;
     int length;
+    uint32_t hash;
+    // compile-time strings only, how many chunks hold the string
+    int references;
     char data[];
 } CString;
 
 CString* create_cstring(const char* data);
 void free_cstring(CString* cstring);
 bool cstrings_equal(CString* str1, CString* str2);
+uint32_t hash_string(const char* data, int length);
+
+// Permanent strings for the compiler: unique per content and shared by all threads. Every one interned
+// is referenced until the chunk that takes it with take_interned_cstrings() releases it.
+CString* intern_cstring(const char* data, int length);
+CString* concat_cstrings(CString* left, CString* right);
+// Appends the strings this thread interned since the last call to *strings, one reference each.
+void take_interned_cstrings(CString*** strings, int* count, int* capacity);
+// Frees the strings no chunk references anymore.
+void release_cstrings(CString** strings, int count);
+
+// Strings built at run time reuse an equal old string. Otherwise they start out in the nursery, and
+// only old strings are interned, weakly, in the calling thread's table. They never reuse a permanent
+// string, which another thread may free with its chunk. Permanent strings and young duplicates are
+// not their twins, so compare with cstrings_equal.
+CString* intern_runtime_cstring(const char* data, int length);
+CString* concat_runtime_cstrings(CString* left, CString* right);
+// Called by the collector for a young string that survived: returns the old string with its content,
+// so duplicates built in the nursery collapse into one.
+CString* tenure_runtime_cstring(CString* young);
+// Called by the collector, drops the string from the weak table before freeing it.
+void free_runtime_cstring(CString* cstring);
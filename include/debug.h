@@ -6,3 +6,4 @@
 void print_tokens(TokenArray* token_array);
 void print_ast(ASTNode* root, int indent);
 void disassemble_chunk(Chunk* chunk);
+void disassemble_chunk_from(Chunk* chunk, int offset);
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "object.h"
+#include "value.h"
+
+// The first cycle starts once this much has been allocated, later ones after the heap doubles.
+#define GC_INITIAL_THRESHOLD (1 << 20)
+#define GC_HEAP_GROW_FACTOR 2
+// Objects traced or swept per safepoint while a cycle is running, more than one so the
+// collector always outpaces the program.
+#define GC_STEP_WORK 64
+// Pause histogram buckets are powers of two in microseconds, the last one collects the rest.
+#define GC_PAUSE_BUCKETS 16
+// New objects are bump-allocated in a per-thread nursery, larger ones go straight to the old space.
+#define GC_NURSERY_SIZE (256 * 1024)
+#define GC_NURSERY_MAX_OBJECT (GC_NURSERY_SIZE / 16)
+
+// Each thread collects its own heap, roots are the VM's value stack and globals.
+void set_gc_roots(Value* stack, Value** stack_top, Value* globals, int global_count);
+
+// Never collects, so unrooted values stay valid until the next gc_safepoint.
+void* allocate_object(size_t size, ObjType type);
+// Skips the nursery, for objects that must not move.
+void* allocate_tenured_object(size_t size, ObjType type);
+// Runs whatever collection work is due. Minor collections move young objects, so every live value
+// must be reachable from the roots here and C locals holding values are stale afterwards.
+void gc_safepoint();
+// Called once a run has dropped its roots: finishes the work that still reads references of its
+// objects, the remembered set and any marking, so the compile-time strings they hold may be freed.
+void gc_settle();
+
+// Weak tables call this when they hand out an object the collector may already consider dead.
+void revive_object(Obj* object);
+
+void mark_object(Obj* object);
+void mark_value(Value value);
+// Records old-to-young references and keeps the tri-color invariant when a reference to child
+// is stored into parent after parent was created.
+void write_barrier(Obj* parent, Value child);
+
+// Without the nursery every object is allocated in the old space, for comparing allocators.
+void set_gc_nursery(bool enabled);
+void set_gc_stats(bool enabled);
+void print_gc_stats(FILE* file);
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "io.h"
+#include "object.h"
+#include "value.h"
+
+// A suspended call of a generator function: where it resumes and the stack slots it had when it
+// yielded, its arguments before the first resumption. Resuming pushes the slots back into a fresh
+// frame, yielding copies them out again, so once the slot buffer is large enough neither allocates.
+typedef struct Generator {
+    Obj obj;
+    ValueType yield_type;
+    int resume;    // code offset to continue at, -1 once the body has finished
+    bool running;  // its frame is on the stack, resuming it again would run the same state twice
+    Value value;   // the last value yielded
+    int count;
+    int capacity;
+    Value* slots;
+    // set for the generators lines() returns, which run no code and yield slices of line
+    LineReader* reader;
+    Slice line;
+} Generator;
+
+// Generators start out old like maps, young slot values are remembered through the write barrier.
+// Allocates but never collects.
+Generator* new_generator(ValueType yield_type, int resume, const Value* arguments, int count);
+// Yields the lines of fd, closing it once they ran out unless it is stdin. Allocates but never collects.
+Generator* new_line_generator(int fd);
+// Bytes taken by the generator and its slots.
+size_t generator_size(Generator* generator);
+// Called by the collector.
+void free_generator(Generator* generator);
+
+// Stores the frame of a yield. Only grows the slot buffer when the frame is deeper than ever before.
+void save_generator(Generator* generator, int resume, Value value, const Value* slots, int count);
+// Reads the next line into value, or finishes the generator and returns false at the end of the input.
+bool next_line(Generator* generator);
+// Drops the saved slots of a finished generator so whatever they refer to can be collected.
+void finish_generator(Generator* generator);
@@ -0,0 +1,36 @@
+#pragma once
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_INTRINSIC_ARITY 3
+
+// Math functions the language provides without a declaration, each compiled to one instruction. abs, min
+// and max are typed like arithmetic and stay int when all arguments are, the others take floats. User
+// functions and natives with the same name take precedence, min and max with one argument are the array
+// reductions.
+typedef enum MathIntrinsic {
+    INTRINSIC_SQRT,
+    INTRINSIC_ABS,
+    INTRINSIC_MIN,
+    INTRINSIC_MAX,
+    INTRINSIC_FLOOR,
+    INTRINSIC_FMA,
+    INTRINSIC_SIN,
+    INTRINSIC_COS,
+    INTRINSIC_TAN,
+    INTRINSIC_COUNT,
+} MathIntrinsic;
+
+// Shared by the VM, the columnar kernels and constant folding so all of them agree. Integer abs wraps like
+// negation does, float min and max return the second operand when either is NaN, as minss and maxss do.
+#define INT_ABS(a) ((int32_t)((a) < 0 ? 0u - (uint32_t)(a) : (uint32_t)(a)))
+#define MIN_OF(a, b) ((a) < (b) ? (a) : (b))
+#define MAX_OF(a, b) ((a) > (b) ? (a) : (b))
+
+// Returns the intrinsic called name or -1.
+int find_intrinsic(const char* name, int length);
+const char* intrinsic_name(MathIntrinsic intrinsic);
+int intrinsic_arity(MathIntrinsic intrinsic);
+// True for the intrinsics with an int version, the others convert int arguments to float.
+bool intrinsic_has_int(MathIntrinsic intrinsic);
@@ -1,3 +1,39 @@
 #pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define OUTPUT_BUFFER_CAPACITY 8192
+#define LINE_READER_CAPACITY (1 << 16)
+// lines() streams files that may be gigabytes long, larger reads mean fewer system calls
+#define LINE_STREAM_CAPACITY (1 << 20)
+
+typedef struct OutputBuffer {
+    FILE* file;
+    bool shortest_floats;
+    int count;
+    char data[OUTPUT_BUFFER_CAPACITY];
+} OutputBuffer;
+
+// Reads newline-delimited input through one reusable buffer that grows to fit the longest line.
+typedef struct LineReader {
+    int fd;
+    bool eof;
+    int start;
+    int scanned;
+    int end;
+    int capacity;
+    char* buffer;
+} LineReader;
 
 char* read_file(const char* file_path);
+
+void init_line_reader(LineReader* reader, int fd, int capacity);
+bool read_line(LineReader* reader, char** line, int* length);
+void free_line_reader(LineReader* reader);
+
+void write_bytes(OutputBuffer* output, const char* bytes, int length);
+void write_char(OutputBuffer* output, char c);
+void write_int(OutputBuffer* output, int32_t value);
+void write_float(OutputBuffer* output, float value);
+void flush_output(OutputBuffer* output);
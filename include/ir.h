@@ -0,0 +1,136 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include "lexer.h"
+#include "parser.h"
+#include "value.h"
+
+// Typed SSA form of one function (or of top-level code) built from an analyzed AST. Locals become
+// SSA values, globals stay memory accessed by IR_GLOAD/IR_GSTORE. Values are instruction indices.
+typedef enum IROp {
+    IR_CONST,
+    IR_PARAM,
+    IR_PHI,
+    IR_GLOAD,
+    IR_GSTORE,
+    IR_BINARY,
+    IR_UNARY,
+    IR_CAST,
+    // only produced by strength reduction: a left shift by the immediate in index and a truncating
+    // division through the magic multiplier operand, with the shift and correction packed in index
+    IR_SHL,
+    IR_DIV_MAGIC,
+    // a MathIntrinsic in index, as pure as IR_BINARY
+    IR_INTRINSIC,
+    IR_CALL,
+    // a host function, its index in the native table in index
+    IR_CALL_NATIVE,
+    IR_PRINT,
+    // arrays: a zero-filled one of the operand's length, a literal of the operands, an element load
+    // from (array, index) and a store of (array, index, value); builtins keep their id in index
+    IR_NEW_ARRAY,
+    IR_ARRAY,
+    IR_LOAD_ELEMENT,
+    IR_STORE_ELEMENT,
+    IR_BUILTIN,
+    // element accesses proven in bounds, and the (array, start, bound) guard of a loop preheader that
+    // stops the program when counting from start up to bound would run past the end of the array
+    IR_LOAD_UNCHECKED,
+    IR_STORE_UNCHECKED,
+    IR_GUARD_LENGTH,
+    // objects: a new instance of class index from its field values, and field reads, field writes and
+    // method calls through the inline caches, with the field or method name in constant
+    IR_NEW_OBJECT,
+    IR_GET_FIELD,
+    IR_SET_FIELD,
+    IR_INVOKE,
+    // maps: a literal of (key, value) operand pairs, a lookup of (map, key) that stops the program when
+    // the key is missing and a store of (map, key, value)
+    IR_MAP,
+    IR_MAP_GET,
+    IR_MAP_SET,
+    // generators: a resumption of (generator, slot) that is 0 when it yielded and -1 once it finished,
+    // and a yield of the operand, both run code that may store globals like calls do
+    IR_RESUME,
+    IR_YIELD,
+    // terminators
+    IR_JUMP,
+    IR_BRANCH,
+    IR_RETURN,
+    IR_TAIL_CALL,
+} IROp;
+
+typedef struct IRInstr {
+    IROp op;
+    ValueType type;      // type of the result, VALUE_NONE when nothing is produced
+    TokenType token;     // operator of IR_BINARY and IR_UNARY
+    Value constant;      // IR_CONST, the name of field accesses and method calls
+    int index;           // parameter, global slot, function index, builtin or class
+    int block;
+    int line;
+    bool removed;
+    int targets[2];      // IR_JUMP uses the first, IR_BRANCH jumps to the first when true
+    int count;
+    int capacity;
+    int* operands;       // phi operands follow the order of the block's predecessors
+} IRInstr;
+
+typedef struct IRBlock {
+    int count;
+    int capacity;
+    int* instrs;         // phis first, terminator last
+
+    int pred_count;
+    int pred_capacity;
+    int* preds;
+
+    bool sealed;
+    bool removed;
+    int* definitions;    // local slot -> current SSA value while the block is built
+    int incomplete_count;
+    int incomplete_capacity;
+    int* incomplete;     // pairs of (local slot, phi) waiting for the block to be sealed
+} IRBlock;
+
+typedef struct IRFunction {
+    const char* name;
+    int length;
+    int arity;
+    bool is_generator;   // returns without a value finish the generator
+
+    int count;
+    int capacity;
+    IRInstr* instrs;
+
+    int block_count;
+    int block_capacity;
+    IRBlock* blocks;
+    int* layout;         // block order for emission, loops keep their condition at the bottom
+    int* forward;        // value -> value that replaced it, resolved lazily
+} IRFunction;
+
+// Builds the top-level code of a program (functions are skipped) or a single function declaration.
+void lower_program(IRFunction* function, ASTNode* program, bool echo);
+void lower_function(IRFunction* function, ASTNode* declaration);
+void free_ir(IRFunction* function);
+
+// Level 1 propagates copies and constants and removes dead code, level 2 adds
+// common subexpression elimination and loop-invariant code motion. Both drop the bounds checks of
+// element accesses indexed by a loop counter that provably stays below the array's length.
+void optimize_ir(IRFunction* function, int level);
+// Keeps every bounds check, for measuring what their elimination gains.
+void set_bounds_check_elimination(bool enabled);
+
+// Creates an instruction at position in block, for passes that expand one instruction into several.
+int insert_ir_instr(IRFunction* function, int block, int position, IROp op, ValueType type, int line);
+void add_ir_operand(IRFunction* function, int value, int operand);
+// Returns the shared constant of the entry block holding value, creating it when missing.
+int add_ir_constant(IRFunction* function, Value value, int line);
+int resolve_value(IRFunction* function, int value);
+int successor_count(IRFunction* function, int block);
+int successor(IRFunction* function, int block, int index);
+int terminator(IRFunction* function, int block);
+bool has_side_effects(IRInstr* instr);
+void split_critical_edges(IRFunction* function);
+
+void dump_ir(IRFunction* function, FILE* file);
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+// Bulk operations over unboxed array elements. On x86-64 they run as AVX2 kernels when the CPU
+// has AVX2, everything else goes through the scalar loops, which also finish the tails.
+// Integer results wrap like the VM's arithmetic. Float reductions and scans add lane by lane,
+// so their rounding can differ from a left-to-right loop.
+int32_t sum_ints(const int32_t* values, int count);
+float sum_floats(const float* values, int count);
+// count must be positive
+int32_t min_ints(const int32_t* values, int count);
+float min_floats(const float* values, int count);
+int32_t max_ints(const int32_t* values, int count);
+float max_floats(const float* values, int count);
+int32_t dot_ints(const int32_t* a, const int32_t* b, int count);
+float dot_floats(const float* a, const float* b, int count);
+
+// out may alias the inputs
+void scale_ints(int32_t* out, const int32_t* values, int32_t factor, int count);
+void scale_floats(float* out, const float* values, float factor, int count);
+void add_ints(int32_t* out, const int32_t* a, const int32_t* b, int count);
+void add_floats(float* out, const float* a, const float* b, int count);
+void mul_ints(int32_t* out, const int32_t* a, const int32_t* b, int count);
+void mul_floats(float* out, const float* a, const float* b, int count);
+// inclusive: out[i] is the sum of values[0..i]
+void prefix_sum_ints(int32_t* out, const int32_t* values, int count);
+void prefix_sum_floats(float* out, const float* values, int count);
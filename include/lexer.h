@@ -47,16 +47,25 @@ typedef enum {
     TOKEN_FLOAT,           // float
     TOKEN_FOR,             // for
     TOKEN_FUNC,            // func
+    TOKEN_GEN,             // gen
     TOKEN_IF,              // if
+    TOKEN_IN,              // in
+    TOKEN_INLINE,          // inline
     TOKEN_INT,             // int
+    TOKEN_MAP,             // map
+    TOKEN_NOINLINE,        // noinline
     TOKEN_NULL,            // null
+    TOKEN_OBJECT,          // object
     TOKEN_OR,              // or
     TOKEN_PRINT,           // print
+    TOKEN_PURE,            // pure
     TOKEN_RETURN,          // return
+    TOKEN_STRING,          // string
     TOKEN_THIS,            // this
     TOKEN_TRUE,            // true
     TOKEN_VAR,             // var
     TOKEN_WHILE,           // while
+    TOKEN_YIELD,           // yield
 
     TOKEN_ERROR,           // ERROR
 } TokenType;
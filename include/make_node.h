@@ -7,3 +7,33 @@ ASTNode* make_node_binary(int line, ASTNode* left, TokenType op, ASTNode* right)
 ASTNode* make_node_unary(int line, TokenType op, ASTNode* right);
 ASTNode* make_node_literal(int line, Value value);
 ASTNode* make_node_cast(int line, ValueType target_type, ASTNode* expression);
+ASTNode* make_node_variable(int line, Token name);
+ASTNode* make_node_assignment(int line, Token name, ASTNode* value);
+ASTNode* make_node_var_decl(int line, Token name, bool is_const, ValueType declared_type, ASTNode* initializer);
+ASTNode* make_node_print(int line, ASTNode* expression);
+ASTNode* make_node_expression_statement(int line, ASTNode* expression);
+ASTNode* make_node_block(int line);
+ASTNode* make_node_if(int line, ASTNode* condition, ASTNode* then_branch, ASTNode* else_branch);
+ASTNode* make_node_while(int line, ASTNode* condition, ASTNode* body);
+ASTNode* make_node_for(int line, ASTNode* initializer, ASTNode* condition, ASTNode* increment, ASTNode* body);
+ASTNode* make_node_function(int line, Token name);
+ASTNode* make_node_call(int line, Token name);
+ASTNode* make_node_return(int line, ASTNode* value);
+ASTNode* make_node_yield(int line, ASTNode* value);
+ASTNode* make_node_array(int line, ValueType element_type, ASTNode* length);
+ASTNode* make_node_subscript(int line, ASTNode* array, ASTNode* index);
+ASTNode* make_node_subscript_assignment(int line, ASTNode* array, ASTNode* index, ASTNode* value);
+ASTNode* make_node_class(int line, Token name);
+ASTNode* make_node_get_field(int line, ASTNode* object, Token name);
+ASTNode* make_node_set_field(int line, ASTNode* object, Token name, ASTNode* value);
+ASTNode* make_node_invoke(int line, ASTNode* object, Token name);
+ASTNode* make_node_map(int line, ValueType value_type);
+
+void append_to_block(ASTNode* block, ASTNode* statement);
+void append_parameter(ASTNode* function, Token name, ValueType type);
+void append_argument(ASTNode* call, ASTNode* argument);
+void append_element(ASTNode* array, ASTNode* element);
+void append_field(ASTNode* klass, Token name, ValueType type);
+void append_method(ASTNode* klass, ASTNode* method);
+void append_invoke_argument(ASTNode* invoke, ASTNode* argument);
+void append_entry(ASTNode* map, ASTNode* key, ASTNode* value);
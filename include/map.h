@@ -0,0 +1,49 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cstring.h"
+#include "object.h"
+#include "value.h"
+
+#define MAP_MAX_LOAD 0.75
+
+// Values are stored unboxed next to their key, so a lookup touches one slot of two words.
+typedef struct MapSlot {
+    CString* key;  // NULL when empty, a tombstone once removed
+    union {
+        bool bool_;
+        int32_t int_;
+        float float_;
+        CString* string_;
+    } as;
+} MapSlot;
+
+// String keys in open addressing with linear probing over a power-of-two slot array, like the
+// string tables. used counts tombstones too, so probe sequences always end at an empty slot.
+typedef struct Map {
+    Obj obj;
+    ValueType value_type;
+    int count;
+    int used;
+    int capacity;
+    MapSlot* slots;
+} Map;
+
+// Maps start out old and only keep old strings, so they never hold references into the nursery.
+// Allocates but never collects.
+Map* new_map(ValueType value_type);
+// Bytes taken by the map and its slots.
+size_t map_size(Map* map);
+// Called by the collector.
+void free_map(Map* map);
+
+// False when the key is missing.
+bool map_get(Map* map, CString* key, Value* value);
+// String values may be ropes. Allocates but never collects.
+void map_set(Map* map, CString* key, Value value);
+bool map_remove(Map* map, CString* key);
+// Returns the first slot at or after start that holds a key, -1 past the last one.
+int next_map_slot(Map* map, int start);
+Value map_slot_key(Map* map, int slot);
+Value map_slot_value(Map* map, int slot);
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "value.h"
+
+// Every pure function gets a set-associative cache of MEMO_SETS * MEMO_WAYS results keyed by its
+// argument values, a full set gives up its least recently used entry.
+#define MEMO_SETS 256
+#define MEMO_WAYS 4
+
+typedef struct MemoEntry {
+    uint64_t used;   // tick of the last fill or hit, 0 while the entry is empty
+    uint64_t claim;  // tick of the call that is computing the result, 0 once it is filled
+    Value result;
+} MemoEntry;
+
+typedef struct MemoCache {
+    int arity;
+    uint64_t tick;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    MemoEntry entries[MEMO_SETS * MEMO_WAYS];
+    Value keys[];  // arity arguments per entry
+} MemoCache;
+
+MemoCache* new_memo_cache(int arity);
+void free_memo_cache(MemoCache* cache);
+// Returns true with the cached result for the arguments. Otherwise the arguments claim an entry,
+// which memo_fill() completes once the call returns, unless other arguments took it over meanwhile.
+bool memo_lookup(MemoCache* cache, const Value* arguments, Value* result, MemoEntry** entry, uint64_t* claim);
+void memo_fill(MemoEntry* entry, uint64_t claim, Value result);
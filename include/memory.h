@@ -7,3 +7,6 @@
     (type*)reallocate(pointer, sizeof(type) * (old_count), sizeof(type) * (new_count))
 
 void* reallocate(void* pointer, size_t old_size, size_t new_size);
+// Bytes currently held through reallocate by the calling thread, memory released with plain free()
+// is never subtracted, so the count errs on the high side.
+size_t allocated_bytes();
@@ -0,0 +1,28 @@
+#pragma once
+#include "value.h"
+
+#define MAX_NATIVES 256
+#define MAX_NATIVE_PARAMS 8
+
+// A host function called in place: arguments points at the first argument on the VM stack, already
+// converted to the declared parameter types. String arguments may be ropes, flatten_string() turns them
+// into a CString. Returns NULL, or the message of a runtime error. Natives may allocate, the collector
+// only runs after they returned.
+typedef const char* (*NativeFn)(Value* arguments, Value* result);
+
+typedef struct NativeFunction {
+    const char* name;  // not copied
+    NativeFn function;
+    ValueType return_type;  // VALUE_NONE when the native has no result
+    int arity;
+    ValueType param_types[MAX_NATIVE_PARAMS];
+} NativeFunction;
+
+// Makes a host function callable by name. Natives are process-wide and must be registered before the
+// programs using them are compiled, registration is not thread-safe. User functions and classes with the
+// same name take precedence. Returns the native's index, or -1 when the name is taken, the table is full
+// or a type cannot cross the boundary.
+int register_native(const char* name, NativeFn function, ValueType return_type, int arity, const ValueType* param_types);
+// Returns the native called name or -1.
+int find_native(const char* name, int length);
+const NativeFunction* native_function(int index);
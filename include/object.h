@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+typedef enum ObjType {
+    OBJ_STRING,
+    OBJ_ROPE,
+    OBJ_ARRAY,
+    OBJ_INSTANCE,
+    OBJ_MAP,
+    OBJ_GENERATOR,
+} ObjType;
+
+// Collection alternates between two whites: the sweep frees objects still in the previous one,
+// everything allocated after marking ends already wears the current one and survives.
+// Gray objects are black ones still waiting on the collector's worklist.
+typedef enum ObjColor {
+    COLOR_PERMANENT,  // compile-time strings, shared by all threads and never collected
+    COLOR_WHITE_A,
+    COLOR_WHITE_B,
+    COLOR_BLACK,
+    COLOR_YOUNG,      // still in the nursery, only minor collections look at it
+    COLOR_FORWARDED,  // a nursery object already copied out, next points to the copy
+} ObjColor;
+
+// Header of every heap object, old objects are linked into their thread's heap.
+typedef struct Obj {
+    struct Obj* next;
+    uint8_t type;
+    uint8_t color;
+    // an old object holding young references, queued for the next minor collection
+    uint8_t remembered;
+} Obj;
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+#include "intrinsic.h"
+#include "lexer.h"
+#include "parser.h"
+#include "value.h"
+
+// Functions whose body is a single `return expression;` no larger than this many nodes are inlined.
+#define INLINE_NODE_BUDGET 16
+// How many extra nodes duplicating a side-effect free argument may cost when a parameter is used more than once.
+#define INLINE_DUPLICATION_BUDGET 8
+
+// Runs on an analyzed tree: inlines small non-recursive functions at their call sites and folds constants.
+void optimize_ast(ASTNode* program);
+
+// Constant evaluation shared by the AST and IR passes, false when the result is left to run time.
+bool fold_binary_constants(TokenType op, Value a, Value b, Value* result);
+bool fold_unary_constant(TokenType op, Value value, Value* result);
+bool fold_cast_constant(ValueType target, Value value, Value* result);
+// Arguments already have the intrinsic's type, which is also the type of the result.
+bool fold_intrinsic_constants(MathIntrinsic intrinsic, ValueType type, const Value* arguments, Value* result);
@@ -7,8 +7,40 @@ typedef enum ASTNodeType {
     AST_NODE_UNARY,
     AST_NODE_LITERAL,
     AST_NODE_CAST,
+    AST_NODE_VARIABLE,
+    AST_NODE_ASSIGNMENT,
+    AST_NODE_VAR_DECL,
+    AST_NODE_PRINT,
+    AST_NODE_EXPRESSION_STATEMENT,
+    AST_NODE_BLOCK,
+    AST_NODE_IF,
+    AST_NODE_WHILE,
+    AST_NODE_FOR,
+    AST_NODE_FUNCTION,
+    AST_NODE_CALL,
+    AST_NODE_RETURN,
+    AST_NODE_ARRAY,
+    AST_NODE_SUBSCRIPT,
+    AST_NODE_SUBSCRIPT_ASSIGNMENT,
+    AST_NODE_CLASS,
+    AST_NODE_GET_FIELD,
+    AST_NODE_SET_FIELD,
+    AST_NODE_INVOKE,
+    AST_NODE_MAP,
+    AST_NODE_YIELD,
 } ASTNodeType;
 
+typedef enum InlineHint {
+    INLINE_DEFAULT,
+    INLINE_ALWAYS,
+    INLINE_NEVER,
+} InlineHint;
+
+typedef struct Parameter {
+    Token name;
+    ValueType type;
+} Parameter;
+
 typedef struct ASTNode {
     ASTNodeType type;
     ValueType inferred_type;
@@ -32,6 +64,156 @@ typedef struct ASTNode {
             ValueType target_type;
             struct ASTNode* expression;
         } cast;
+
+        struct {
+            Token name;
+            int slot;
+            bool is_global;
+        } variable;
+
+        struct {
+            Token name;
+            int slot;
+            bool is_global;
+            struct ASTNode* value;
+        } assignment;
+
+        struct {
+            Token name;
+            int slot;
+            bool is_global;
+            bool is_const;
+            ValueType declared_type;
+            struct ASTNode* initializer;
+        } var_decl;
+
+        struct {
+            struct ASTNode* expression;
+        } print;
+
+        struct {
+            struct ASTNode* expression;
+        } expression_statement;
+
+        struct {
+            struct ASTNode** statements;
+            int count;
+            int capacity;
+            int local_count;
+        } block;
+
+        struct {
+            struct ASTNode* condition;
+            struct ASTNode* then_branch;
+            struct ASTNode* else_branch;
+        } if_;
+
+        struct {
+            struct ASTNode* condition;
+            struct ASTNode* body;
+        } while_;
+
+        struct {
+            struct ASTNode* initializer;
+            struct ASTNode* condition;
+            struct ASTNode* increment;
+            struct ASTNode* body;
+            int local_count;
+        } for_;
+
+        struct {
+            Token name;
+            Parameter* params;
+            int arity;
+            int capacity;
+            ValueType return_type;
+            InlineHint hint;
+            bool is_pure;  // results are memoized, the analyzer checks the body has no effects
+            struct ASTNode* body;
+            int index;
+        } function;
+
+        struct {
+            Token name;
+            struct ASTNode** arguments;
+            int count;
+            int capacity;
+            int index;
+            int builtin;  // ArrayBuiltin when no user function has the name, -1 otherwise
+            int class_index;  // the class constructed when the name is a class, -1 otherwise
+            int native;  // the host function registered under the name, -1 otherwise
+            int intrinsic;  // MathIntrinsic compiled to a single instruction, -1 otherwise
+            bool is_tail;
+        } call;
+
+        struct {
+            struct ASTNode* value;
+        } return_;
+
+        struct {
+            struct ASTNode* value;
+        } yield_;
+
+        // `int[n]` when length is set, a literal `[a, b, c]` otherwise
+        struct {
+            ValueType element_type;
+            struct ASTNode* length;
+            struct ASTNode** elements;
+            int count;
+            int capacity;
+        } array;
+
+        struct {
+            struct ASTNode* array;
+            struct ASTNode* index;
+        } subscript;
+
+        struct {
+            struct ASTNode* array;
+            struct ASTNode* index;
+            struct ASTNode* value;
+        } subscript_assignment;
+
+        // methods are function nodes whose first parameter is `this`
+        struct {
+            Token name;
+            Parameter* fields;
+            int field_count;
+            int field_capacity;
+            struct ASTNode** methods;
+            int method_count;
+            int method_capacity;
+            int index;
+        } class_;
+
+        struct {
+            struct ASTNode* object;
+            Token name;
+        } get_field;
+
+        struct {
+            struct ASTNode* object;
+            Token name;
+            struct ASTNode* value;
+        } set_field;
+
+        struct {
+            struct ASTNode* object;
+            Token name;
+            struct ASTNode** arguments;
+            int count;
+            int capacity;
+            int function;  // a method with this name, whose signature all of them share, -1 until resolved
+        } invoke;
+
+        // `map[string]int{"a": 1}`, keys and values pair up by position
+        struct {
+            ValueType value_type;
+            struct ASTNode** keys;
+            struct ASTNode** values;
+            int count;
+            int capacity;
+        } map;
     };
 } ASTNode;
 
@@ -0,0 +1,21 @@
+#pragma once
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "chunk.h"
+#include "vm.h"
+
+#define PROFILER_INTERVAL_USEC 1000
+#define PROFILER_BUFFER_CAPACITY (1 << 16)
+// deeper stacks keep their innermost frames
+#define PROFILER_MAX_DEPTH 32
+
+void enable_sampling_profiler();
+void begin_sampling(const uint8_t* const* ip, const CallFrame* frames, const int* frame_count, Chunk* chunk);
+void end_sampling();
+// Raised by the signal handler once the buffer is half full, the interpreter then drains it at its next safepoint.
+extern volatile sig_atomic_t samples_pending;
+void drain_samples();
+void print_folded_samples(FILE* file);
+void free_samples();
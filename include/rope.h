@@ -0,0 +1,24 @@
+#pragma once
+#include <stdbool.h>
+#include "cstring.h"
+#include "object.h"
+#include "value.h"
+
+// Shorter concatenations are interned right away, a rope would cost more than copying them.
+#define ROPE_MIN_LENGTH 64
+
+// A lazy concatenation, children are VALUE_STRING or VALUE_ROPE values.
+// Once flattened the interned result is kept and the children are dropped.
+typedef struct Rope {
+    Obj obj;
+    int length;
+    CString* flat;
+    Value left;
+    Value right;
+} Rope;
+
+// Both arguments are strings or ropes, so is the result. These allocate but never collect.
+Value concat_strings(Value left, Value right);
+CString* flatten_string(Value value);
+// Either side may also be a slice.
+bool strings_equal(Value left, Value right);
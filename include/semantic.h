@@ -1,4 +1,71 @@
 #pragma once
+#include <stdbool.h>
 #include "parser.h"
+#include "value.h"
 
-bool analyze(ASTNode* root);
+// past the first 256, globals are reached through the wide GLOAD_W and GSTORE_W
+#define MAX_GLOBALS 65536
+#define MAX_LOCALS 256
+#define MAX_FUNCTIONS 256
+#define MAX_CLASSES 256
+
+// Global names are copied, so a table can outlive the source it was built from (REPL sessions).
+typedef struct GlobalSymbol {
+    char* name;
+    int length;
+    ValueType type;
+    bool is_const;
+} GlobalSymbol;
+
+// Functions have their own namespace, a symbol's index is the function's index in the chunk.
+typedef struct FunctionSymbol {
+    char* name;
+    int length;
+    int arity;
+    ValueType* param_types;
+    ValueType return_type;
+    bool is_pure;
+} FunctionSymbol;
+
+typedef struct FieldSymbol {
+    char* name;
+    int length;
+    ValueType type;
+} FieldSymbol;
+
+typedef struct MethodSymbol {
+    char* name;
+    int length;
+    int function;  // named Class.method among the functions, `this` is its first parameter
+} MethodSymbol;
+
+// Fields and methods are looked up by name on whatever instance turns up at run time, so every
+// class declaring a name gives it the same type, or the same signature for methods.
+// A symbol's index is the class's index in the chunk.
+typedef struct ClassSymbol {
+    char* name;
+    int length;
+    int field_count;
+    FieldSymbol* fields;
+    int method_count;
+    MethodSymbol* methods;
+} ClassSymbol;
+
+typedef struct SymbolTable {
+    int count;
+    int capacity;
+    GlobalSymbol* globals;
+
+    int function_count;
+    int function_capacity;
+    FunctionSymbol* functions;
+
+    int class_count;
+    int class_capacity;
+    ClassSymbol* classes;
+} SymbolTable;
+
+bool analyze(ASTNode* root, SymbolTable* globals);
+
+void truncate_symbol_table(SymbolTable* table, int count, int function_count, int class_count);
+void free_symbol_table(SymbolTable* table);
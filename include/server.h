@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+#define SERVER_MAX_REQUEST_LENGTH (16 << 20)
+#define SERVER_LISTEN_BACKLOG 128
+#define SERVER_MAX_EVENTS 64
+
+// Frames use native byte order, clients are always on the same host.
+// A request is a RequestHeader followed by `length` bytes of source code,
+// a response is a ResponseHeader followed by `length` bytes of printed output.
+typedef struct RequestHeader {
+    uint32_t length;
+} RequestHeader;
+
+typedef struct ResponseHeader {
+    uint32_t result;
+    uint32_t length;
+} ResponseHeader;
+
+int serve(const char* socket_path, int worker_count);
@@ -1,19 +1,56 @@
 #pragma once
 #include <stdbool.h>
+#include "cstring.h"
+#include "io.h"
 
 typedef enum ValueType {
     VALUE_NONE,
     VALUE_BOOL,
     VALUE_INT,
     VALUE_FLOAT,
+    VALUE_STRING,
+    // run-time representation of a concatenated string, the type system only knows VALUE_STRING
+    VALUE_ROPE,
+    // run-time view of a line in a reader's buffer, only handed to loops that print or compare it
+    VALUE_SLICE,
+    // arrays of unboxed elements, in the same order as their element types
+    VALUE_BOOL_ARRAY,
+    VALUE_INT_ARRAY,
+    VALUE_FLOAT_ARRAY,
+    // instances of any class, fields and methods are looked up by name through their shape
+    VALUE_OBJECT,
+    // maps from strings to unboxed values, in the same order as their value types
+    VALUE_BOOL_MAP,
+    VALUE_INT_MAP,
+    VALUE_FLOAT_MAP,
+    VALUE_STRING_MAP,
+    // suspended generator functions, in the same order as the types they yield
+    VALUE_BOOL_GENERATOR,
+    VALUE_INT_GENERATOR,
+    VALUE_FLOAT_GENERATOR,
+    VALUE_STRING_GENERATOR,
 } ValueType;
 
+struct Rope;
+struct Slice;
+struct Array;
+struct Instance;
+struct Map;
+struct Generator;
+
 typedef struct Value {
     ValueType type;
     union {
         bool bool_;
         int int_;
         float float_;
+        CString* string_;  // always interned
+        struct Rope* rope_;
+        struct Slice* slice_;
+        struct Array* array_;
+        struct Instance* instance_;
+        struct Map* map_;
+        struct Generator* generator_;
     } as;
 } Value;
 
@@ -21,14 +58,54 @@ typedef struct Value {
 #define BOOL_VALUE(value)  ((Value){ .type = VALUE_BOOL, { .bool_ = value } })
 #define INT_VALUE(value)   ((Value){ .type = VALUE_INT, { .int_ = value } })
 #define FLOAT_VALUE(value) ((Value){ .type = VALUE_FLOAT, { .float_ = value } })
+#define STRING_VALUE(value) ((Value){ .type = VALUE_STRING, { .string_ = value } })
+#define ROPE_VALUE(value)  ((Value){ .type = VALUE_ROPE, { .rope_ = value } })
+#define SLICE_VALUE(value) ((Value){ .type = VALUE_SLICE, { .slice_ = value } })
+#define ARRAY_VALUE(value) ((Value){ .type = ARRAY_TYPE_OF((value)->element_type), { .array_ = value } })
+#define OBJECT_VALUE(value) ((Value){ .type = VALUE_OBJECT, { .instance_ = value } })
+#define MAP_VALUE(value)   ((Value){ .type = MAP_TYPE_OF((value)->value_type), { .map_ = value } })
+#define GENERATOR_VALUE(value) ((Value){ .type = GENERATOR_TYPE_OF((value)->yield_type), { .generator_ = value } })
 
 #define AS_BOOL(value)     ((value).as.bool_)
 #define AS_INT(value)      ((value).as.int_)
 #define AS_FLOAT(value)    ((value).as.float_)
+#define AS_STRING(value)   ((value).as.string_)
+#define AS_ROPE(value)     ((value).as.rope_)
+#define AS_SLICE(value)    ((value).as.slice_)
+#define AS_ARRAY(value)    ((value).as.array_)
+#define AS_INSTANCE(value) ((value).as.instance_)
+#define AS_MAP(value)      ((value).as.map_)
+#define AS_GENERATOR(value) ((value).as.generator_)
 
 #define IS_BOOL(value)     ((value).type == VALUE_BOOL)
 #define IS_INT(value)      ((value).type == VALUE_INT)
 #define IS_FLOAT(value)    ((value).type == VALUE_FLOAT)
+#define IS_STRING(value)   ((value).type == VALUE_STRING)
+#define IS_ROPE(value)     ((value).type == VALUE_ROPE)
+#define IS_SLICE(value)    ((value).type == VALUE_SLICE)
+#define IS_ARRAY(value)    IS_ARRAY_TYPE((value).type)
+#define IS_OBJECT(value)   ((value).type == VALUE_OBJECT)
+#define IS_MAP(value)      IS_MAP_TYPE((value).type)
+#define IS_GENERATOR(value) IS_GENERATOR_TYPE((value).type)
+
+#define IS_ARRAY_TYPE(type)     ((type) >= VALUE_BOOL_ARRAY && (type) <= VALUE_FLOAT_ARRAY)
+#define ARRAY_TYPE_OF(element)  ((ValueType)((element) - VALUE_BOOL + VALUE_BOOL_ARRAY))
+#define ELEMENT_TYPE_OF(array)  ((ValueType)((array) - VALUE_BOOL_ARRAY + VALUE_BOOL))
+
+#define IS_MAP_TYPE(type)       ((type) >= VALUE_BOOL_MAP && (type) <= VALUE_STRING_MAP)
+#define MAP_TYPE_OF(value_type) ((ValueType)((value_type) - VALUE_BOOL + VALUE_BOOL_MAP))
+#define MAP_VALUE_TYPE_OF(map)  ((ValueType)((map) - VALUE_BOOL_MAP + VALUE_BOOL))
+
+#define IS_GENERATOR_TYPE(type)       ((type) >= VALUE_BOOL_GENERATOR && (type) <= VALUE_STRING_GENERATOR)
+#define GENERATOR_TYPE_OF(yield_type) ((ValueType)((yield_type) - VALUE_BOOL + VALUE_BOOL_GENERATOR))
+#define YIELD_TYPE_OF(generator)      ((ValueType)((generator) - VALUE_BOOL_GENERATOR + VALUE_BOOL))
+
+// Bytes borrowed from a buffer, valid until its owner moves on. Not a heap object, the collector
+// ignores slices.
+typedef struct Slice {
+    const char* data;
+    int length;
+} Slice;
 
 typedef struct {
     int count;
@@ -37,6 +114,7 @@ typedef struct {
 } ValueArray;
 
 void print_value(Value value);
+void write_value(OutputBuffer* output, Value value);
 
 void push_to_value_array(ValueArray* array, Value value);
 void free_value_array(ValueArray* array);
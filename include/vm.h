@@ -1,8 +1,20 @@
 #pragma once
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include "chunk.h"
+#include "memo.h"
+#include "semantic.h"
 
-#define VM_STACK_CAPACITY 256
+#define VM_FRAMES_CAPACITY 256
+// one frame addresses at most 256 slots (u8 operands), the stack fits a good share of full frames
+#define VM_FRAME_SLOTS 256
+#define VM_STACK_CAPACITY (VM_FRAMES_CAPACITY * 64)
+
+// OP_IDIV_MAGIC operand: arithmetic shift of the high product word and the dividend correction
+#define DIV_MAGIC_SHIFT 0x1f
+#define DIV_MAGIC_ADD 0x20
+#define DIV_MAGIC_SUB 0x40
 
 // TODO: true/false values were pushed on the stack using BIPUSH as 1/0.
 // With this, the information about being a boolean was discarded.
@@ -19,6 +31,17 @@ typedef enum OpCode {
     OP_BIPUSH,
     OP_SIPUSH,
     OP_LOADC,
+    // wide forms of LOADC, GLOAD and GSTORE take a two byte index
+    OP_LOADC_W,
+    OP_POP,
+    OP_POPN,
+    OP_RESERVE,
+    OP_LOAD,
+    OP_STORE,
+    OP_GLOAD,
+    OP_GSTORE,
+    OP_GLOAD_W,
+    OP_GSTORE_W,
     OP_IADD,
     OP_FADD,
     OP_ISUB,
@@ -29,13 +52,142 @@ typedef enum OpCode {
     OP_FDIV,
     OP_INEG,
     OP_FNEG,
+    OP_ISHL,
+    OP_IDIV_MAGIC,
+    // math intrinsics replace their arguments with the result, FFMA computes a * b + c rounded once
+    OP_FSQRT,
+    OP_IABS,
+    OP_FABS,
+    OP_IMIN,
+    OP_FMIN,
+    OP_IMAX,
+    OP_FMAX,
+    OP_FFLOOR,
+    OP_FFMA,
+    OP_FSIN,
+    OP_FCOS,
+    OP_FTAN,
+    OP_SCONCAT,
     OP_TRUE,
     OP_FALSE,
     OP_NOT,
+    OP_IEQ,
+    OP_INE,
+    OP_ILT,
+    OP_ILE,
+    OP_IGT,
+    OP_IGE,
+    OP_FEQ,
+    OP_FNE,
+    OP_FLT,
+    OP_FLE,
+    OP_FGT,
+    OP_FGE,
+    OP_BEQ,
+    OP_BNE,
+    // equality of interned strings compares pointers, ropes of equal length are flattened first
+    OP_SEQ,
+    OP_SNE,
+    // NEWARRAY <element type> pops the length, ARRAY <element type> <count> collects a literal's elements
+    OP_NEWARRAY,
+    OP_ARRAY,
+    // loads pop the array and the index, stores also the value, both check the index
+    OP_BALOAD,
+    OP_IALOAD,
+    OP_FALOAD,
+    OP_BASTORE,
+    OP_IASTORE,
+    OP_FASTORE,
+    // element accesses the compiler proved in bounds, <array slot> <index slot> operands, stores pop the value
+    OP_BALOAD_UNCHECKED,
+    OP_IALOAD_UNCHECKED,
+    OP_FALOAD_UNCHECKED,
+    OP_BASTORE_UNCHECKED,
+    OP_IASTORE_UNCHECKED,
+    OP_FASTORE_UNCHECKED,
+    // pops the bound, the start and the array, fails when start < bound and the array is shorter than bound
+    OP_GUARD_LENGTH,
+    // BUILTIN <ArrayBuiltin> replaces its arguments with the result
+    OP_BUILTIN,
+    // NEW <class> replaces the field values with the instance
+    OP_NEW,
+    // field accesses and method calls take a 16-bit inline cache index, INVOKE is followed by the
+    // argument count, not counting the receiver pushed before the arguments
+    OP_GET_FIELD,
+    OP_SET_FIELD,
+    OP_INVOKE,
+    // MAP <value type> <count> collects a literal's key/value pairs, MAP_GET pops the key and the map,
+    // MAP_SET also the value
+    OP_MAP,
+    OP_MAP_GET,
+    OP_MAP_SET,
+    // jumps with a signed 16-bit offset, relative to the next instruction
+    OP_JUMP,
+    OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
+    OP_IJEQ,
+    OP_IJNE,
+    OP_IJLT,
+    OP_IJLE,
+    OP_IJGT,
+    OP_IJGE,
+    OP_FJEQ,
+    OP_FJNE,
+    OP_FJLT,
+    OP_FJLE,
+    OP_FJGT,
+    OP_FJGE,
+    OP_FJNLT,
+    OP_FJNLE,
+    OP_FJNGT,
+    OP_FJNGE,
+    // loop back-edges with an unsigned 8-bit backward offset
+    OP_LOOP,
+    OP_LOOP_TRUE,
+    OP_LOOP_IEQ,
+    OP_LOOP_INE,
+    OP_LOOP_ILT,
+    OP_LOOP_ILE,
+    OP_LOOP_IGT,
+    OP_LOOP_IGE,
+    OP_LOOP_FEQ,
+    OP_LOOP_FNE,
+    OP_LOOP_FLT,
+    OP_LOOP_FLE,
+    OP_LOOP_FGT,
+    OP_LOOP_FGE,
     OP_PRINT,
+    OP_CALL,
+    OP_TAIL_CALL,
+    // CALL_NATIVE <native> hands the host function its arguments where they are on the stack and
+    // replaces them with the result, none for natives without one
+    OP_CALL_NATIVE,
+    // MEMO <function> opens a pure function: a cached result for its arguments is returned at once,
+    // otherwise the frame remembers the cache entry that its return fills
+    OP_MEMO,
+    // GENERATOR <yield type> opens a generator function: the call returns a generator holding the
+    // arguments, and the body only runs when RESUME pops a slot and continues the generator below it
+    // in a frame of its own. YIELD leaves that frame with 0 and FINISH with -1 in place of the
+    // generator, the slot numbers a for-in over a map would see.
+    OP_GENERATOR,
+    OP_RESUME,
+    OP_YIELD,
+    OP_FINISH,
     OP_RETURN,
+    OP_RETURN_VOID,
 } OpCode;
 
+// Frames are preallocated in one array, slots points at the callee's first argument on the value stack.
+typedef struct CallFrame {
+    const uint8_t* return_ip;
+    Value* slots;
+    MemoEntry* memo;  // the entry a pure function's result goes to, NULL otherwise
+    uint64_t memo_claim;
+    // the entry of the pure caller that tail called into this frame, filled with the same result
+    MemoEntry* caller_memo;
+    uint64_t caller_memo_claim;
+} CallFrame;
+
 typedef enum InterpretResult {
     RESULT_OK,
     RESULT_PARSE_ERROR,
@@ -44,4 +196,35 @@ typedef enum InterpretResult {
     RESULT_RUNTIME_ERROR,
 } InterpretResult;
 
+// State that outlives a single REPL line: new code is appended to the session chunk,
+// so constants emitted by earlier lines keep their pool indices, and declared globals
+// keep both their slots and their values.
+typedef struct Session {
+    Chunk chunk;
+    SymbolTable globals;
+} Session;
+
+// Compiles standalone source in which bare expression statements print their value.
+InterpretResult compile_source(const char* source, Chunk* chunk);
+// Forgets the run's globals afterwards, so any thread may free the chunk once this returns.
+InterpretResult run_chunk(Chunk* chunk);
+// Runs a chunk with its first globals bound, collecting the values it prints instead of writing them.
+// Fails unless exactly result_count values were printed. Call forget_run() before the chunk is freed.
+InterpretResult run_chunk_with(Chunk* chunk, const Value* bindings, int binding_count, Value* results, int result_count);
+// Drops what the last run left in this thread's globals and collector.
+void forget_run();
 InterpretResult interpret(const char* source);
+
+void init_session(Session* session);
+void free_session(Session* session);
+InterpretResult interpret_in_session(Session* session, const char* source);
+
+void flush_vm_output();
+void set_vm_output(FILE* file);
+void set_shortest_floats(bool enabled);
+// Without inline caches every field access and method call looks its name up.
+void set_inline_caches(bool enabled);
+// Sums the hits, misses and evictions of every pure function's result cache over the runs that follow,
+// printing them also forgets them.
+void set_memo_stats(bool enabled);
+void print_memo_stats(FILE* file);
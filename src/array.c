@@ -0,0 +1,160 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "array.h"
+#include "gc.h"
+#include "generator.h"
+#include "kernels.h"
+#include "map.h"
+#include "rope.h"
+
+typedef struct BuiltinInfo {
+    const char* name;
+    int arity;
+} BuiltinInfo;
+
+static const BuiltinInfo builtins[BUILTIN_COUNT] = {
+    [BUILTIN_LEN]        = { "len", 1 },
+    [BUILTIN_SUM]        = { "sum", 1 },
+    [BUILTIN_MIN]        = { "min", 1 },
+    [BUILTIN_MAX]        = { "max", 1 },
+    [BUILTIN_DOT]        = { "dot", 2 },
+    [BUILTIN_SCALE]      = { "scale", 2 },
+    [BUILTIN_ADD]        = { "add", 2 },
+    [BUILTIN_MUL]        = { "mul", 2 },
+    [BUILTIN_PREFIX_SUM] = { "prefix_sum", 1 },
+    [BUILTIN_HAS]        = { "has", 2 },
+    [BUILTIN_REMOVE]     = { "remove", 2 },
+    [BUILTIN_NEXT_SLOT]  = { "$next", 2 },
+    [BUILTIN_SLOT_KEY]   = { "$key", 2 },
+    [BUILTIN_SLOT_VIEW]  = { "$view", 2 },
+    [BUILTIN_RESUME]     = { "$resume", 2 },
+    [BUILTIN_LINES]      = { "lines", 1 },
+};
+
+static size_t element_size(ValueType element_type) {
+    return element_type == VALUE_BOOL ? sizeof(bool) : sizeof(int32_t);
+}
+
+size_t array_size(ValueType element_type, int length) {
+    return sizeof(Array) + element_size(element_type) * length;
+}
+
+Array* new_array(ValueType element_type, int length) {
+    Array* array = allocate_object(array_size(element_type, length), OBJ_ARRAY);
+    array->length = length;
+    array->element_type = element_type;
+    memset(array->data, 0, element_size(element_type) * length);
+    return array;
+}
+
+int find_array_builtin(const char* name, int length) {
+    for (int i = 0; i < BUILTIN_COUNT; ++i) {
+        if ((int)strlen(builtins[i].name) == length && memcmp(builtins[i].name, name, length) == 0) return i;
+    }
+    return -1;
+}
+
+const char* array_builtin_name(ArrayBuiltin builtin) {
+    return builtins[builtin].name;
+}
+
+int array_builtin_arity(ArrayBuiltin builtin) {
+    return builtins[builtin].arity;
+}
+
+static void call_map_builtin(ArrayBuiltin builtin, Value* arguments, Value* result) {
+    Map* map = AS_MAP(arguments[0]);
+    switch (builtin) {
+        case BUILTIN_LEN:       *result = INT_VALUE(map->count); break;
+        case BUILTIN_HAS: {
+            Value value;
+            *result = BOOL_VALUE(map_get(map, flatten_string(arguments[1]), &value));
+        } break;
+        case BUILTIN_REMOVE:    *result = BOOL_VALUE(map_remove(map, flatten_string(arguments[1]))); break;
+        case BUILTIN_NEXT_SLOT: *result = INT_VALUE(next_map_slot(map, AS_INT(arguments[1]))); break;
+        default:                *result = map_slot_key(map, AS_INT(arguments[1])); break;
+    }
+}
+
+// `lines("-")` reads stdin.
+static const char* open_lines(Value path, Value* result) {
+    CString* name = flatten_string(path);
+    int fd = strcmp(name->data, "-") == 0 ? STDIN_FILENO : open(name->data, O_RDONLY);
+    if (fd < 0) return "cannot open file";
+    Generator* generator = new_line_generator(fd);
+    *result = GENERATOR_VALUE(generator);
+    return NULL;
+}
+
+const char* call_array_builtin(ArrayBuiltin builtin, Value* arguments, Value* result) {
+    if (builtin == BUILTIN_LINES) return open_lines(arguments[0], result);
+    // resuming runs code and is an instruction of its own, $key reads what the generator yielded last
+    // and copies a line that escapes the loop out of the reader's buffer
+    if (IS_GENERATOR(arguments[0])) {
+        Value value = AS_GENERATOR(arguments[0])->value;
+        if (builtin == BUILTIN_SLOT_KEY && IS_SLICE(value)) {
+            value = STRING_VALUE(intern_runtime_cstring(AS_SLICE(value)->data, AS_SLICE(value)->length));
+        }
+        *result = value;
+        return NULL;
+    }
+    if (IS_MAP(arguments[0])) {
+        call_map_builtin(builtin, arguments, result);
+        return NULL;
+    }
+    Array* array = AS_ARRAY(arguments[0]);
+    // the second argument of dot, add and mul is an array of the same type
+    Array* other = builtins[builtin].arity == 2 && IS_ARRAY(arguments[1]) ? AS_ARRAY(arguments[1]) : NULL;
+    bool floats = array->element_type == VALUE_FLOAT;
+    int length = array->length;
+    if (other != NULL && other->length != length) return "array lengths differ";
+
+    switch (builtin) {
+        case BUILTIN_LEN: *result = INT_VALUE(length); break;
+        case BUILTIN_SUM: {
+            if (floats) *result = FLOAT_VALUE(sum_floats(ARRAY_FLOATS(array), length));
+            else *result = INT_VALUE(sum_ints(ARRAY_INTS(array), length));
+        } break;
+        case BUILTIN_MIN: {
+            if (length == 0) return "min of an empty array";
+            if (floats) *result = FLOAT_VALUE(min_floats(ARRAY_FLOATS(array), length));
+            else *result = INT_VALUE(min_ints(ARRAY_INTS(array), length));
+        } break;
+        case BUILTIN_MAX: {
+            if (length == 0) return "max of an empty array";
+            if (floats) *result = FLOAT_VALUE(max_floats(ARRAY_FLOATS(array), length));
+            else *result = INT_VALUE(max_ints(ARRAY_INTS(array), length));
+        } break;
+        case BUILTIN_DOT: {
+            if (floats) *result = FLOAT_VALUE(dot_floats(ARRAY_FLOATS(array), ARRAY_FLOATS(other), length));
+            else *result = INT_VALUE(dot_ints(ARRAY_INTS(array), ARRAY_INTS(other), length));
+        } break;
+        case BUILTIN_SCALE: {
+            Array* out = new_array(array->element_type, length);
+            if (floats) scale_floats(ARRAY_FLOATS(out), ARRAY_FLOATS(array), AS_FLOAT(arguments[1]), length);
+            else scale_ints(ARRAY_INTS(out), ARRAY_INTS(array), AS_INT(arguments[1]), length);
+            *result = ARRAY_VALUE(out);
+        } break;
+        case BUILTIN_ADD: {
+            Array* out = new_array(array->element_type, length);
+            if (floats) add_floats(ARRAY_FLOATS(out), ARRAY_FLOATS(array), ARRAY_FLOATS(other), length);
+            else add_ints(ARRAY_INTS(out), ARRAY_INTS(array), ARRAY_INTS(other), length);
+            *result = ARRAY_VALUE(out);
+        } break;
+        case BUILTIN_MUL: {
+            Array* out = new_array(array->element_type, length);
+            if (floats) mul_floats(ARRAY_FLOATS(out), ARRAY_FLOATS(array), ARRAY_FLOATS(other), length);
+            else mul_ints(ARRAY_INTS(out), ARRAY_INTS(array), ARRAY_INTS(other), length);
+            *result = ARRAY_VALUE(out);
+        } break;
+        case BUILTIN_PREFIX_SUM: {
+            Array* out = new_array(array->element_type, length);
+            if (floats) prefix_sum_floats(ARRAY_FLOATS(out), ARRAY_FLOATS(array), length);
+            else prefix_sum_ints(ARRAY_INTS(out), ARRAY_INTS(array), length);
+            *result = ARRAY_VALUE(out);
+        } break;
+        default: break;
+    }
+    return NULL;
+}
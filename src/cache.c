@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "chunk.h"
+#include "cstring.h"
+#include "memory.h"
+
+static CacheEntry** find_slot(ChunkCache* cache, const char* source, int length, uint32_t hash) {
+    CacheEntry** slot = &cache->buckets[hash & (cache->bucket_count - 1)];
+    while (*slot != NULL) {
+        CacheEntry* entry = *slot;
+        if (entry->hash == hash && entry->length == length && memcmp(entry->source, source, length) == 0) {
+            break;
+        }
+        slot = &entry->next_in_bucket;
+    }
+    return slot;
+}
+
+static void unlink_entry(ChunkCache* cache, CacheEntry* entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+static void link_as_newest(ChunkCache* cache, CacheEntry* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) cache->newest->newer = entry;
+    cache->newest = entry;
+    if (cache->oldest == NULL) cache->oldest = entry;
+}
+
+static void free_entry(CacheEntry* entry) {
+    free_chunk(&entry->chunk);
+    free(entry->source);
+    free(entry);
+}
+
+static void evict_oldest(ChunkCache* cache) {
+    CacheEntry* entry = cache->oldest;
+    CacheEntry** slot = find_slot(cache, entry->source, entry->length, entry->hash);
+    *slot = entry->next_in_bucket;
+    unlink_entry(cache, entry);
+    --cache->count;
+
+    if (entry->references > 0) entry->evicted = true;
+    else free_entry(entry);
+}
+
+void init_chunk_cache(ChunkCache* cache, int capacity) {
+    int bucket_count = 8;
+    while (bucket_count < capacity) bucket_count *= 2;
+
+    *cache = (ChunkCache){ 0 };
+    cache->capacity = capacity;
+    cache->bucket_count = bucket_count;
+    cache->buckets = GROW_ARRAY(CacheEntry*, NULL, 0, bucket_count);
+    memset(cache->buckets, 0, sizeof(CacheEntry*) * bucket_count);
+}
+
+void free_chunk_cache(ChunkCache* cache) {
+    CacheEntry* entry = cache->newest;
+    while (entry != NULL) {
+        CacheEntry* older = entry->older;
+        free_entry(entry);
+        entry = older;
+    }
+    free(cache->buckets);
+    *cache = (ChunkCache){ 0 };
+}
+
+CacheEntry* find_cached_chunk(ChunkCache* cache, const char* source, int length) {
+    CacheEntry* entry = *find_slot(cache, source, length, hash_string(source, length));
+    if (entry == NULL) {
+        ++cache->misses;
+        return NULL;
+    }
+
+    ++cache->hits;
+    ++entry->references;
+    if (entry != cache->newest) {
+        unlink_entry(cache, entry);
+        link_as_newest(cache, entry);
+    }
+    return entry;
+}
+
+CacheEntry* insert_cached_chunk(ChunkCache* cache, const char* source, int length, Chunk chunk) {
+    if (cache->count == cache->capacity) evict_oldest(cache);
+
+    CacheEntry* entry = reallocate(NULL, 0, sizeof(CacheEntry));
+    entry->source = reallocate(NULL, 0, length);
+    memcpy(entry->source, source, length);
+    entry->length = length;
+    entry->hash = hash_string(source, length);
+    entry->chunk = chunk;
+    entry->references = 1;
+    entry->evicted = false;
+
+    CacheEntry** slot = find_slot(cache, source, length, entry->hash);
+    entry->next_in_bucket = *slot;
+    *slot = entry;
+    link_as_newest(cache, entry);
+    ++cache->count;
+    return entry;
+}
+
+void release_cached_chunk(CacheEntry* entry) {
+    --entry->references;
+    if (entry->references == 0 && entry->evicted) free_entry(entry);
+}
@@ -1,5 +1,7 @@
 #include <stdlib.h>
+#include <string.h>
 #include "chunk.h"
+#include "cstring.h"
 #include "memory.h"
 #include "value.h"
 
@@ -21,11 +23,32 @@ void free_chunk(Chunk* chunk) {
     free(chunk->lines);
 
     free_value_array(&chunk->constant_pool);
+    truncate_functions(chunk, 0);
+    free(chunk->functions);
+    truncate_classes(chunk, 0);
+    free(chunk->classes);
+    free_shape_tree(chunk->shapes);
+    free(chunk->caches);
+    release_cstrings(chunk->strings, chunk->string_count);
+    free(chunk->strings);
 
     chunk->count = 0;
     chunk->capacity = 0;
+    chunk->global_count = 0;
     chunk->code = NULL;
     chunk->lines = NULL;
+    chunk->function_capacity = 0;
+    chunk->functions = NULL;
+    chunk->class_capacity = 0;
+    chunk->classes = NULL;
+    chunk->shapes = NULL;
+    chunk->shape_count = 0;
+    chunk->cache_count = 0;
+    chunk->cache_capacity = 0;
+    chunk->caches = NULL;
+    chunk->string_count = 0;
+    chunk->string_capacity = 0;
+    chunk->strings = NULL;
 }
 
 int add_constant(Chunk* chunk, Value value) {
@@ -33,3 +56,79 @@ int add_constant(Chunk* chunk, Value value) {
     push_to_value_array(&chunk->constant_pool, value);
     return index;
 }
+
+int add_function(Chunk* chunk, const char* name, int length, int arity, int entry) {
+    if (chunk->function_capacity < chunk->function_count + 1) {
+        int old_capacity = chunk->function_capacity;
+        chunk->function_capacity = GROW_CAPACITY(old_capacity);
+        chunk->functions = GROW_ARRAY(Function, chunk->functions, old_capacity, chunk->function_capacity);
+    }
+
+    Function* function = &chunk->functions[chunk->function_count];
+    function->name = malloc(length);
+    memcpy(function->name, name, length);
+    function->length = length;
+    function->arity = arity;
+    function->entry = entry;
+    function->end = entry;
+    return chunk->function_count++;
+}
+
+void truncate_functions(Chunk* chunk, int count) {
+    for (int i = count; i < chunk->function_count; ++i) {
+        free(chunk->functions[i].name);
+    }
+    chunk->function_count = count;
+}
+
+int add_class(Chunk* chunk, CString* name, CString** fields, int field_count) {
+    if (chunk->class_capacity < chunk->class_count + 1) {
+        int old_capacity = chunk->class_capacity;
+        chunk->class_capacity = GROW_CAPACITY(old_capacity);
+        chunk->classes = GROW_ARRAY(Class*, chunk->classes, old_capacity, chunk->class_capacity);
+    }
+    if (chunk->shapes == NULL) chunk->shapes = new_root_shape();
+
+    Shape* shape = chunk->shapes;
+    for (int i = 0; i < field_count; ++i) {
+        shape = add_shape_field(shape, fields[i], &chunk->shape_count);
+    }
+    chunk->classes[chunk->class_count] = new_class(name, chunk->class_count, shape);
+    return chunk->class_count++;
+}
+
+// Shapes stay in the tree, a later class with the same fields reuses them.
+void truncate_classes(Chunk* chunk, int count) {
+    for (int i = count; i < chunk->class_count; ++i) {
+        free_class(chunk->classes[i]);
+    }
+    chunk->class_count = count;
+}
+
+int add_inline_cache(Chunk* chunk, InlineCacheKind kind, CString* name, int offset) {
+    if (chunk->cache_capacity < chunk->cache_count + 1) {
+        int old_capacity = chunk->cache_capacity;
+        chunk->cache_capacity = GROW_CAPACITY(old_capacity);
+        chunk->caches = GROW_ARRAY(InlineCache, chunk->caches, old_capacity, chunk->cache_capacity);
+    }
+    InlineCache* cache = &chunk->caches[chunk->cache_count];
+    cache->kind = kind;
+    cache->name = name;
+    cache->offset = offset;
+    atomic_init(&cache->count, 0);
+    atomic_init(&cache->megamorphic, false);
+    for (int i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+        atomic_init(&cache->entries[i], 0);
+    }
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    return chunk->cache_count++;
+}
+
+Function* function_at(Chunk* chunk, int offset) {
+    for (int i = 0; i < chunk->function_count; ++i) {
+        Function* function = &chunk->functions[i];
+        if (offset >= function->entry && offset < function->end) return function;
+    }
+    return NULL;
+}
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include "class.h"
+#include "gc.h"
+#include "memory.h"
+
+static Shape* new_shape(Shape* parent, CString* field, uint32_t id) {
+    Shape* shape = malloc(sizeof(Shape));
+    shape->parent = parent;
+    shape->field = field;
+    shape->field_count = parent == NULL ? 0 : parent->field_count + 1;
+    shape->id = id;
+    shape->transition_count = 0;
+    shape->transition_capacity = 0;
+    shape->transitions = NULL;
+    return shape;
+}
+
+Shape* new_root_shape() {
+    return new_shape(NULL, NULL, 0);
+}
+
+// Names are interned by the compiler, so they compare by address.
+Shape* add_shape_field(Shape* shape, CString* field, uint32_t* next_id) {
+    for (int i = 0; i < shape->transition_count; ++i) {
+        if (shape->transitions[i]->field == field) return shape->transitions[i];
+    }
+    if (shape->transition_capacity < shape->transition_count + 1) {
+        int old_capacity = shape->transition_capacity;
+        shape->transition_capacity = GROW_CAPACITY(old_capacity);
+        shape->transitions = GROW_ARRAY(Shape*, shape->transitions, old_capacity, shape->transition_capacity);
+    }
+    Shape* child = new_shape(shape, field, ++*next_id);
+    shape->transitions[shape->transition_count++] = child;
+    return child;
+}
+
+void free_shape_tree(Shape* shape) {
+    if (shape == NULL) return;
+    for (int i = 0; i < shape->transition_count; ++i) {
+        free_shape_tree(shape->transitions[i]);
+    }
+    free(shape->transitions);
+    free(shape);
+}
+
+int find_field(Shape* shape, CString* name) {
+    for (; shape->parent != NULL; shape = shape->parent) {
+        if (shape->field == name) return shape->field_count - 1;
+    }
+    return -1;
+}
+
+Class* new_class(CString* name, uint32_t id, Shape* shape) {
+    Class* klass = malloc(sizeof(Class));
+    klass->name = name;
+    klass->id = id;
+    klass->shape = shape;
+    klass->method_count = 0;
+    klass->method_capacity = 0;
+    klass->methods = NULL;
+    return klass;
+}
+
+void add_method(Class* klass, CString* name, int function) {
+    if (klass->method_capacity < klass->method_count + 1) {
+        int old_capacity = klass->method_capacity;
+        klass->method_capacity = GROW_CAPACITY(old_capacity);
+        klass->methods = GROW_ARRAY(Method, klass->methods, old_capacity, klass->method_capacity);
+    }
+    klass->methods[klass->method_count++] = (Method){ name, function };
+}
+
+void free_class(Class* klass) {
+    free(klass->methods);
+    free(klass);
+}
+
+int find_method(Class* klass, CString* name) {
+    for (int i = 0; i < klass->method_count; ++i) {
+        if (klass->methods[i].name == name) return klass->methods[i].function;
+    }
+    return -1;
+}
+
+size_t instance_size(int field_count) {
+    return sizeof(Instance) + sizeof(Value) * field_count;
+}
+
+Instance* new_instance(Class* klass) {
+    int field_count = klass->shape->field_count;
+    Instance* instance = allocate_object(instance_size(field_count), OBJ_INSTANCE);
+    instance->field_count = field_count;
+    instance->klass = klass;
+    instance->shape = klass->shape;
+    for (int i = 0; i < field_count; ++i) {
+        instance->fields[i] = NONE_VALUE();
+    }
+    return instance;
+}
+
+const char* inline_cache_state(InlineCache* cache) {
+    if (atomic_load_explicit(&cache->megamorphic, memory_order_relaxed)) return "megamorphic";
+    switch (atomic_load_explicit(&cache->count, memory_order_relaxed)) {
+        case 0: return "uninitialized";
+        case 1: return "monomorphic";
+        default: return "polymorphic";
+    }
+}
@@ -0,0 +1,539 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "columns.h"
+#include "compiler.h"
+#include "cstring.h"
+#include "intrinsic.h"
+#include "lexer.h"
+#include "memory.h"
+#include "parser.h"
+#include "semantic.h"
+#include "value.h"
+#include "vm.h"
+
+typedef union Lanes {
+    bool bools[COLUMN_BATCH];
+    int32_t ints[COLUMN_BATCH];
+    float floats[COLUMN_BATCH];
+} Lanes;
+
+// Column stack of one batch. An entry either points at its own scratch lanes or aliases an input column,
+// inputs are never written, so loads of own lanes copy and loads of inputs just share the pointer.
+typedef struct Batch {
+    const Lanes** stack;
+    Lanes* scratch;
+    const Lanes** globals;
+    Lanes* global_scratch;
+    int lanes;
+} Batch;
+
+static bool is_scalar(ValueType type) {
+    return type == VALUE_BOOL || type == VALUE_INT || type == VALUE_FLOAT;
+}
+
+static size_t element_size(ValueType type) {
+    return type == VALUE_BOOL ? sizeof(bool) : sizeof(int32_t);
+}
+
+static void column_error(const char* message, const char* detail) {
+    fprintf(stderr, "columns: %s%s\n", message, detail);
+}
+
+static bool declare_inputs(SymbolTable* table, const Column* inputs, int input_count) {
+    if (input_count > MAX_GLOBALS) {
+        column_error("too many input columns", "");
+        return false;
+    }
+    table->globals = GROW_ARRAY(GlobalSymbol, NULL, 0, input_count);
+    table->capacity = input_count;
+    for (int i = 0; i < input_count; ++i) {
+        if (!is_scalar(inputs[i].type)) {
+            column_error("input columns hold bool, int or float values: ", inputs[i].name);
+            return false;
+        }
+        int length = (int)strlen(inputs[i].name);
+        for (int j = 0; j < i; ++j) {
+            if (table->globals[j].length == length && memcmp(table->globals[j].name, inputs[i].name, length) == 0) {
+                column_error("duplicate input column: ", inputs[i].name);
+                return false;
+            }
+        }
+        GlobalSymbol* symbol = &table->globals[table->count++];
+        symbol->name = malloc(length);
+        memcpy(symbol->name, inputs[i].name, length);
+        symbol->length = length;
+        symbol->type = inputs[i].type;
+        symbol->is_const = true;
+    }
+    return true;
+}
+
+// Top-level bare expressions and print statements, in the order compile() emits their OP_PRINT.
+static bool collect_outputs(ASTNode* program, ColumnProgram* columns) {
+    columns->output_types = malloc(sizeof(ValueType) * program->block.count);
+    for (int i = 0; i < program->block.count; ++i) {
+        ASTNode* statement = program->block.statements[i];
+        ValueType type;
+        if (statement->type == AST_NODE_EXPRESSION_STATEMENT && statement->inferred_type != VALUE_NONE) {
+            type = statement->expression_statement.expression->inferred_type;
+        }
+        else if (statement->type == AST_NODE_PRINT) {
+            type = statement->print.expression->inferred_type;
+        }
+        else {
+            continue;
+        }
+        if (!is_scalar(type)) {
+            fprintf(stderr, "[line %d] error: output columns hold bool, int or float values\n", statement->line);
+            return false;
+        }
+        columns->output_types[columns->output_count++] = type;
+    }
+    return true;
+}
+
+// Straight-line top-level code over scalar values runs batch by batch, forward jumps only skip function bodies.
+static bool vectorizable(ColumnProgram* program) {
+    Chunk* chunk = &program->chunk;
+    const uint8_t* ip = chunk->code;
+    int depth = 0;
+    int prints = 0;
+    for (;;) {
+        switch (*ip++) {
+            case OP_NOP:
+            case OP_B2I:
+            case OP_B2F:
+            case OP_I2B:
+            case OP_I2F:
+            case OP_F2B:
+            case OP_F2I:
+            case OP_INEG:
+            case OP_FNEG:
+            case OP_NOT:
+            case OP_FSQRT:
+            case OP_IABS:
+            case OP_FABS:
+            case OP_FFLOOR:
+            case OP_FSIN:
+            case OP_FCOS:
+            case OP_FTAN:
+                break;
+            case OP_ISHL:
+                ++ip;
+                break;
+            case OP_BIPUSH:
+            case OP_LOAD:
+                ++ip;
+                ++depth;
+                break;
+            case OP_SIPUSH:
+                ip += 2;
+                ++depth;
+                break;
+            case OP_LOADC:
+                if (!is_scalar(chunk->constant_pool.values[*ip++].type)) return false;
+                ++depth;
+                break;
+            case OP_TRUE:
+            case OP_FALSE:
+                ++depth;
+                break;
+            case OP_POP:
+                --depth;
+                break;
+            case OP_POPN:
+                depth -= *ip++;
+                break;
+            case OP_RESERVE:
+                depth += *ip++;
+                break;
+            case OP_STORE:
+                ++ip;
+                --depth;
+                break;
+            case OP_GLOAD:
+                if (*ip >= program->global_count) program->global_count = *ip + 1;
+                ++ip;
+                ++depth;
+                break;
+            case OP_GSTORE:
+                if (*ip < program->input_count) return false;
+                if (*ip >= program->global_count) program->global_count = *ip + 1;
+                ++ip;
+                --depth;
+                break;
+            case OP_IADD:
+            case OP_FADD:
+            case OP_ISUB:
+            case OP_FSUB:
+            case OP_IMUL:
+            case OP_FMUL:
+            case OP_IDIV:
+            case OP_FDIV:
+            case OP_IEQ:
+            case OP_INE:
+            case OP_ILT:
+            case OP_ILE:
+            case OP_IGT:
+            case OP_IGE:
+            case OP_FEQ:
+            case OP_FNE:
+            case OP_FLT:
+            case OP_FLE:
+            case OP_FGT:
+            case OP_FGE:
+            case OP_BEQ:
+            case OP_BNE:
+            case OP_IMIN:
+            case OP_FMIN:
+            case OP_IMAX:
+            case OP_FMAX:
+                --depth;
+                break;
+            case OP_FFMA:
+                depth -= 2;
+                break;
+            case OP_IDIV_MAGIC:
+                ++ip;
+                --depth;
+                break;
+            case OP_PRINT:
+                --depth;
+                ++prints;
+                break;
+            case OP_JUMP: {
+                int16_t offset = (int16_t)(ip[0] << 8 | ip[1]);
+                if (offset < 0) return false;
+                ip += 2 + offset;
+            } break;
+            case OP_RETURN_VOID:
+                return prints == program->output_count;
+            default:
+                return false;
+        }
+        if (depth > program->stack_depth) program->stack_depth = depth;
+    }
+}
+
+InterpretResult compile_columns(const char* source, const Column* inputs, int input_count, ColumnProgram* program) {
+    *program = (ColumnProgram){ .input_count = input_count, .global_count = input_count };
+    SymbolTable globals = { 0 };
+    if (!declare_inputs(&globals, inputs, input_count)) {
+        free_symbol_table(&globals);
+        return RESULT_COMPILE_ERROR;
+    }
+    program->input_types = malloc(sizeof(ValueType) * input_count);
+    for (int i = 0; i < input_count; ++i) program->input_types[i] = inputs[i].type;
+
+    TokenArray tokens = lex(source);
+    ASTNode* ast = NULL;
+    InterpretResult result = RESULT_OK;
+    if (!parse(&tokens, &ast)) result = RESULT_PARSE_ERROR;
+    else if (!analyze(ast, &globals)) result = RESULT_ANALYZE_ERROR;
+    else if (!collect_outputs(ast, program) || !compile(ast, &program->chunk, true)) result = RESULT_COMPILE_ERROR;
+    else program->vectorized = vectorizable(program);
+    program->chunk.global_count = globals.count;
+    take_interned_cstrings(&program->chunk.strings, &program->chunk.string_count, &program->chunk.string_capacity);
+
+    free_ast(ast);
+    free_tokens(&tokens);
+    free_symbol_table(&globals);
+    return result;
+}
+
+static void broadcast(Lanes* lanes, Value value, int n) {
+    switch (value.type) {
+        case VALUE_BOOL:  for (int i = 0; i < n; ++i) lanes->bools[i] = AS_BOOL(value); break;
+        case VALUE_INT:   for (int i = 0; i < n; ++i) lanes->ints[i] = AS_INT(value); break;
+        default:          for (int i = 0; i < n; ++i) lanes->floats[i] = AS_FLOAT(value); break;
+    }
+}
+
+#define LANES_UNARY(out, expression) \
+    do { \
+        const Lanes* a = stack[top - 1]; \
+        Lanes* result = &scratch[top - 1]; \
+        for (int i = 0; i < n; ++i) result->out[i] = (expression); \
+        stack[top - 1] = result; \
+    } while (false)
+// bools are narrower than their result, walking backwards keeps in-place widening from clobbering unread lanes
+#define LANES_WIDEN(out, expression) \
+    do { \
+        const Lanes* a = stack[top - 1]; \
+        Lanes* result = &scratch[top - 1]; \
+        for (int i = n - 1; i >= 0; --i) result->out[i] = (expression); \
+        stack[top - 1] = result; \
+    } while (false)
+#define LANES_BINARY(out, expression) \
+    do { \
+        const Lanes* b = stack[--top]; \
+        const Lanes* a = stack[top - 1]; \
+        Lanes* result = &scratch[top - 1]; \
+        for (int i = 0; i < n; ++i) result->out[i] = (expression); \
+        stack[top - 1] = result; \
+    } while (false)
+
+// Same instruction semantics as run() in vm.c, each one applied to all lanes of the batch.
+// Returns false after reporting a runtime error in any lane.
+static bool run_batch(ColumnProgram* program, Batch* batch, Column* outputs, int start) {
+    const uint8_t* ip = program->chunk.code;
+    const Lanes** stack = batch->stack;
+    Lanes* scratch = batch->scratch;
+    int n = batch->lanes;
+    int top = 0;
+    int output = 0;
+    for (;;) {
+        switch (*ip++) {
+            case OP_NOP: break;
+            case OP_B2I: LANES_WIDEN(ints, a->bools[i] ? 1 : 0); break;
+            case OP_B2F: LANES_WIDEN(floats, a->bools[i] ? 1.f : 0.f); break;
+            case OP_I2B: LANES_UNARY(bools, a->ints[i] != 0); break;
+            case OP_I2F: LANES_UNARY(floats, (float)a->ints[i]); break;
+            case OP_F2B: LANES_UNARY(bools, a->floats[i] != 0.f); break;
+            case OP_F2I: LANES_UNARY(ints, (int32_t)a->floats[i]); break;
+            case OP_BIPUSH: {
+                broadcast(&scratch[top], INT_VALUE((int8_t)*ip++), n);
+                stack[top] = &scratch[top];
+                ++top;
+            } break;
+            case OP_SIPUSH: {
+                broadcast(&scratch[top], INT_VALUE((int16_t)(ip[0] << 8 | ip[1])), n);
+                ip += 2;
+                stack[top] = &scratch[top];
+                ++top;
+            } break;
+            case OP_LOADC: {
+                broadcast(&scratch[top], program->chunk.constant_pool.values[*ip++], n);
+                stack[top] = &scratch[top];
+                ++top;
+            } break;
+            case OP_TRUE:
+            case OP_FALSE: {
+                broadcast(&scratch[top], BOOL_VALUE(ip[-1] == OP_TRUE), n);
+                stack[top] = &scratch[top];
+                ++top;
+            } break;
+            case OP_POP: --top; break;
+            case OP_POPN: top -= *ip++; break;
+            case OP_RESERVE: {
+                for (int count = *ip++; count > 0; --count, ++top) stack[top] = &scratch[top];
+            } break;
+            case OP_LOAD: {
+                uint8_t slot = *ip++;
+                if (stack[slot] == &scratch[slot]) {
+                    memcpy(&scratch[top], &scratch[slot], n * sizeof(int32_t));
+                    stack[top] = &scratch[top];
+                }
+                else {
+                    stack[top] = stack[slot];
+                }
+                ++top;
+            } break;
+            case OP_STORE: {
+                uint8_t slot = *ip++;
+                --top;
+                if (stack[top] == &scratch[top]) {
+                    memcpy(&scratch[slot], &scratch[top], n * sizeof(int32_t));
+                    stack[slot] = &scratch[slot];
+                }
+                else {
+                    stack[slot] = stack[top];
+                }
+            } break;
+            case OP_GLOAD: {
+                uint8_t global = *ip++;
+                const Lanes* lanes = batch->globals[global];
+                if (global >= program->input_count && lanes == &batch->global_scratch[global - program->input_count]) {
+                    memcpy(&scratch[top], lanes, n * sizeof(int32_t));
+                    stack[top] = &scratch[top];
+                }
+                else {
+                    stack[top] = lanes;
+                }
+                ++top;
+            } break;
+            case OP_GSTORE: {
+                uint8_t global = *ip++;
+                Lanes* own = &batch->global_scratch[global - program->input_count];
+                --top;
+                if (stack[top] == &scratch[top]) {
+                    memcpy(own, &scratch[top], n * sizeof(int32_t));
+                    batch->globals[global] = own;
+                }
+                else {
+                    batch->globals[global] = stack[top];
+                }
+            } break;
+            case OP_IADD: LANES_BINARY(ints, a->ints[i] + b->ints[i]); break;
+            case OP_FADD: LANES_BINARY(floats, a->floats[i] + b->floats[i]); break;
+            case OP_ISUB: LANES_BINARY(ints, a->ints[i] - b->ints[i]); break;
+            case OP_FSUB: LANES_BINARY(floats, a->floats[i] - b->floats[i]); break;
+            case OP_IMUL: LANES_BINARY(ints, a->ints[i] * b->ints[i]); break;
+            case OP_FMUL: LANES_BINARY(floats, a->floats[i] * b->floats[i]); break;
+            case OP_IDIV: {
+                const Lanes* divisor = stack[top - 1];
+                const Lanes* dividend = stack[top - 2];
+                for (int i = 0; i < n; ++i) {
+                    if (divisor->ints[i] == 0) {
+                        column_error("runtime error: division by zero", "");
+                        return false;
+                    }
+                    if (dividend->ints[i] == INT32_MIN && divisor->ints[i] == -1) {
+                        column_error("runtime error: integer overflow in division", "");
+                        return false;
+                    }
+                }
+                LANES_BINARY(ints, a->ints[i] / b->ints[i]);
+            } break;
+            case OP_FDIV: LANES_BINARY(floats, a->floats[i] / b->floats[i]); break;
+            case OP_INEG: LANES_UNARY(ints, -a->ints[i]); break;
+            case OP_FNEG: LANES_UNARY(floats, -a->floats[i]); break;
+            case OP_ISHL: {
+                uint8_t shift = *ip++;
+                LANES_UNARY(ints, (int32_t)((uint32_t)a->ints[i] << shift));
+            } break;
+            case OP_IDIV_MAGIC: {
+                uint8_t mode = *ip++;
+                const Lanes* b = stack[--top];
+                const Lanes* a = stack[top - 1];
+                Lanes* result = &scratch[top - 1];
+                for (int i = 0; i < n; ++i) {
+                    int32_t dividend = a->ints[i];
+                    uint32_t high = (uint32_t)(((int64_t)dividend * b->ints[i]) >> 32);
+                    if (mode & DIV_MAGIC_ADD) high += (uint32_t)dividend;
+                    else if (mode & DIV_MAGIC_SUB) high -= (uint32_t)dividend;
+                    int32_t quotient = (int32_t)high >> (mode & DIV_MAGIC_SHIFT);
+                    result->ints[i] = quotient + (int32_t)((uint32_t)quotient >> 31);
+                }
+                stack[top - 1] = result;
+            } break;
+            case OP_FSQRT: LANES_UNARY(floats, sqrtf(a->floats[i])); break;
+            case OP_IABS: LANES_UNARY(ints, INT_ABS(a->ints[i])); break;
+            case OP_FABS: LANES_UNARY(floats, fabsf(a->floats[i])); break;
+            case OP_IMIN: LANES_BINARY(ints, MIN_OF(a->ints[i], b->ints[i])); break;
+            case OP_FMIN: LANES_BINARY(floats, MIN_OF(a->floats[i], b->floats[i])); break;
+            case OP_IMAX: LANES_BINARY(ints, MAX_OF(a->ints[i], b->ints[i])); break;
+            case OP_FMAX: LANES_BINARY(floats, MAX_OF(a->floats[i], b->floats[i])); break;
+            case OP_FFLOOR: LANES_UNARY(floats, floorf(a->floats[i])); break;
+            case OP_FFMA: {
+                const Lanes* c = stack[--top];
+                const Lanes* b = stack[--top];
+                const Lanes* a = stack[top - 1];
+                Lanes* result = &scratch[top - 1];
+                for (int i = 0; i < n; ++i) result->floats[i] = fmaf(a->floats[i], b->floats[i], c->floats[i]);
+                stack[top - 1] = result;
+            } break;
+            case OP_FSIN: LANES_UNARY(floats, sinf(a->floats[i])); break;
+            case OP_FCOS: LANES_UNARY(floats, cosf(a->floats[i])); break;
+            case OP_FTAN: LANES_UNARY(floats, tanf(a->floats[i])); break;
+            case OP_NOT: LANES_UNARY(bools, !a->bools[i]); break;
+            case OP_IEQ: LANES_BINARY(bools, a->ints[i] == b->ints[i]); break;
+            case OP_INE: LANES_BINARY(bools, a->ints[i] != b->ints[i]); break;
+            case OP_ILT: LANES_BINARY(bools, a->ints[i] < b->ints[i]); break;
+            case OP_ILE: LANES_BINARY(bools, a->ints[i] <= b->ints[i]); break;
+            case OP_IGT: LANES_BINARY(bools, a->ints[i] > b->ints[i]); break;
+            case OP_IGE: LANES_BINARY(bools, a->ints[i] >= b->ints[i]); break;
+            case OP_FEQ: LANES_BINARY(bools, a->floats[i] == b->floats[i]); break;
+            case OP_FNE: LANES_BINARY(bools, a->floats[i] != b->floats[i]); break;
+            case OP_FLT: LANES_BINARY(bools, a->floats[i] < b->floats[i]); break;
+            case OP_FLE: LANES_BINARY(bools, a->floats[i] <= b->floats[i]); break;
+            case OP_FGT: LANES_BINARY(bools, a->floats[i] > b->floats[i]); break;
+            case OP_FGE: LANES_BINARY(bools, a->floats[i] >= b->floats[i]); break;
+            case OP_BEQ: LANES_BINARY(bools, a->bools[i] == b->bools[i]); break;
+            case OP_BNE: LANES_BINARY(bools, a->bools[i] != b->bools[i]); break;
+            case OP_PRINT: {
+                Column* column = &outputs[output++];
+                size_t size = element_size(column->type);
+                memcpy((uint8_t*)column->data + start * size, stack[--top], n * size);
+            } break;
+            case OP_JUMP: {
+                int16_t offset = (int16_t)(ip[0] << 8 | ip[1]);
+                ip += 2 + offset;
+            } break;
+            default:
+                // OP_RETURN_VOID, vectorizable() admits nothing else
+                return true;
+        }
+    }
+}
+
+static Value element_value(const Column* column, int row) {
+    switch (column->type) {
+        case VALUE_BOOL: return BOOL_VALUE(((const bool*)column->data)[row]);
+        case VALUE_INT:  return INT_VALUE(((const int32_t*)column->data)[row]);
+        default:         return FLOAT_VALUE(((const float*)column->data)[row]);
+    }
+}
+
+static void set_element(Column* column, int row, Value value) {
+    switch (column->type) {
+        case VALUE_BOOL: ((bool*)column->data)[row] = AS_BOOL(value); break;
+        case VALUE_INT:  ((int32_t*)column->data)[row] = AS_INT(value); break;
+        default:         ((float*)column->data)[row] = AS_FLOAT(value); break;
+    }
+}
+
+static InterpretResult run_rows(ColumnProgram* program, const Column* inputs, Column* outputs, int rows) {
+    Value* bindings = malloc(sizeof(Value) * program->input_count);
+    Value* results = malloc(sizeof(Value) * program->output_count);
+    InterpretResult result = RESULT_OK;
+    for (int row = 0; row < rows && result == RESULT_OK; ++row) {
+        for (int i = 0; i < program->input_count; ++i) bindings[i] = element_value(&inputs[i], row);
+        result = run_chunk_with(&program->chunk, bindings, program->input_count, results, program->output_count);
+        if (result != RESULT_OK) break;
+        for (int i = 0; i < program->output_count; ++i) set_element(&outputs[i], row, results[i]);
+    }
+    forget_run();
+    free(bindings);
+    free(results);
+    return result;
+}
+
+InterpretResult run_columns(ColumnProgram* program, const Column* inputs, Column* outputs, int rows) {
+    for (int i = 0; i < program->input_count; ++i) {
+        if (inputs[i].type != program->input_types[i]) {
+            column_error("input column type differs from the compiled one: ", inputs[i].name);
+            return RESULT_RUNTIME_ERROR;
+        }
+    }
+    for (int i = 0; i < program->output_count; ++i) {
+        if (outputs[i].type != program->output_types[i]) {
+            column_error("output column type differs from the printed value", "");
+            return RESULT_RUNTIME_ERROR;
+        }
+    }
+    if (!program->vectorized) return run_rows(program, inputs, outputs, rows);
+
+    int own_globals = program->global_count - program->input_count;
+    Batch batch = {
+        .stack = malloc(sizeof(const Lanes*) * program->stack_depth),
+        .scratch = malloc(sizeof(Lanes) * program->stack_depth),
+        .globals = malloc(sizeof(const Lanes*) * program->global_count),
+        .global_scratch = malloc(sizeof(Lanes) * own_globals),
+    };
+    for (int i = 0; i < own_globals; ++i) batch.globals[program->input_count + i] = &batch.global_scratch[i];
+    InterpretResult result = RESULT_OK;
+    for (int start = 0; start < rows && result == RESULT_OK; start += COLUMN_BATCH) {
+        batch.lanes = rows - start < COLUMN_BATCH ? rows - start : COLUMN_BATCH;
+        for (int i = 0; i < program->input_count; ++i) {
+            size_t size = element_size(inputs[i].type);
+            batch.globals[i] = (const Lanes*)((const uint8_t*)inputs[i].data + start * size);
+        }
+        if (!run_batch(program, &batch, outputs, start)) result = RESULT_RUNTIME_ERROR;
+    }
+    free(batch.stack);
+    free(batch.scratch);
+    free(batch.globals);
+    free(batch.global_scratch);
+    return result;
+}
+
+void free_column_program(ColumnProgram* program) {
+    free_chunk(&program->chunk);
+    free(program->input_types);
+    free(program->output_types);
+    *program = (ColumnProgram){ 0 };
+}
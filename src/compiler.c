@@ -1,19 +1,43 @@
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
 #include "compiler.h"
+#include "cstring.h"
+#include "intrinsic.h"
+#include "ir.h"
+#include "memory.h"
+#include "optimizer.h"
 #include "parser.h"
 #include "value.h"
 #include "vm.h"
 
 typedef struct Compiler {
     Chunk* chunk;
+    ASTNode* program;
+    int line;
+    bool echo;
+    bool generator;  // compiling a generator function, whose returns finish it instead
+    bool had_error;
+    bool constants_full;
 } Compiler;
 
-static Compiler compiler = { 0 };
+// Jump target: either an already emitted offset (loop head) or a list of forward jumps to patch.
+typedef struct Label {
+    bool bound;
+    int offset;
+    int count;
+    int capacity;
+    int* sites;
+} Label;
+
+static _Thread_local Compiler compiler = { 0 };
 
 static void traverse_ast(ASTNode* node);
 
 static void emit_byte(uint8_t byte) {
-    write_chunk(compiler.chunk, byte, 0);
+    write_chunk(compiler.chunk, byte, compiler.line);
 }
 
 static void emit_bytes(uint8_t byte1, uint8_t byte2) {
@@ -21,20 +45,265 @@ static void emit_bytes(uint8_t byte1, uint8_t byte2) {
     emit_byte(byte2);
 }
 
-static uint8_t push_constant(Value value) {
+static void error(const char* message) {
+    fprintf(stderr, "[line %d] error: %s\n", compiler.line, message);
+    compiler.had_error = true;
+}
+
+static int emit_jump(uint8_t op) {
+    emit_byte(op);
+    emit_bytes(0xFF, 0xFF);
+    return compiler.chunk->count - 2;
+}
+
+static void patch_jump(int site) {
+    int jump = compiler.chunk->count - (site + 2);
+    if (jump > INT16_MAX) {
+        error("jump too large");
+        return;
+    }
+    compiler.chunk->code[site] = (uint8_t)((jump >> 8) & 0xFF);
+    compiler.chunk->code[site + 1] = (uint8_t)(jump & 0xFF);
+}
+
+// Backward jump: use the 1-byte form when the loop body is short enough and a short opcode exists.
+static void emit_backward(uint8_t long_op, uint8_t short_op, int target) {
+    int distance = compiler.chunk->count + 2 - target;
+    if (short_op != OP_NOP && distance <= UINT8_MAX) {
+        emit_bytes(short_op, (uint8_t)distance);
+        return;
+    }
+
+    int jump = target - (compiler.chunk->count + 3);
+    if (jump < INT16_MIN) {
+        error("jump too large");
+        jump = 0;
+    }
+    emit_byte(long_op);
+    emit_bytes((uint8_t)((jump >> 8) & 0xFF), (uint8_t)(jump & 0xFF));
+}
+
+static void jump_to(Label* label, uint8_t long_op, uint8_t short_op) {
+    if (label->bound) {
+        emit_backward(long_op, short_op, label->offset);
+        return;
+    }
+    if (label->count + 1 > label->capacity) {
+        int old_capacity = label->capacity;
+        label->capacity = GROW_CAPACITY(old_capacity);
+        label->sites = GROW_ARRAY(int, label->sites, old_capacity, label->capacity);
+    }
+    label->sites[label->count++] = emit_jump(long_op);
+}
+
+static void bind_label(Label* label) {
+    for (int i = 0; i < label->count; ++i) {
+        patch_jump(label->sites[i]);
+    }
+    free(label->sites);
+    *label = (Label){ .bound = true, .offset = compiler.chunk->count };
+}
+
+static bool values_identical(Value a, Value b) {
+    if (a.type != b.type) return false;
+    switch (a.type) {
+        case VALUE_BOOL:  return AS_BOOL(a) == AS_BOOL(b);
+        case VALUE_INT:   return AS_INT(a) == AS_INT(b);
+        case VALUE_FLOAT: return memcmp(&AS_FLOAT(a), &AS_FLOAT(b), sizeof(float)) == 0;
+        case VALUE_STRING: return AS_STRING(a) == AS_STRING(b);
+        default:          return true;
+    }
+}
+
+static int push_constant(Value value) {
+    // chunks can grow line by line in the REPL, so reuse constants instead of exhausting the pool
+    ValueArray* pool = &compiler.chunk->constant_pool;
+    for (int i = 0; i < pool->count && i <= UINT16_MAX; ++i) {
+        if (values_identical(pool->values[i], value)) return i;
+    }
+
     int index = add_constant(compiler.chunk, value);
-    if (index > UINT8_MAX) {
+    if (index > UINT16_MAX) {
+        compiler.constants_full = true;
         return 0;
     }
-    return (uint8_t)index;
+    return index;
 }
 
-static void binary(ASTNode* node) {
+// Indices past a byte take the wide form of the instruction, with the index in two bytes.
+static void emit_indexed(OpCode narrow, OpCode wide, int index) {
+    if (index <= UINT8_MAX) {
+        emit_bytes(narrow, (uint8_t)index);
+        return;
+    }
+    emit_byte(wide);
+    emit_bytes((uint8_t)(index >> 8), (uint8_t)index);
+}
+
+static void emit_load_constant(Value value) {
+    emit_indexed(OP_LOADC, OP_LOADC_W, push_constant(value));
+}
+
+static void emit_constant(Value value) {
+    switch (value.type) {
+        case VALUE_BOOL: {
+            emit_byte(AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+        } break;
+        case VALUE_INT: {
+            int32_t number = AS_INT(value);
+            if (number >= INT8_MIN && number <= INT8_MAX) {
+                emit_bytes(OP_BIPUSH, (int8_t)number);
+            }
+            else if (number >= INT16_MIN && number <= INT16_MAX) {
+                emit_byte(OP_SIPUSH);
+                emit_bytes((uint8_t)((number >> 8) & 0xFF), (uint8_t)(number & 0xFF));
+            }
+            else {
+                emit_load_constant(value);
+            }
+        } break;
+        case VALUE_FLOAT:
+        case VALUE_STRING: {
+            emit_load_constant(value);
+        } break;
+        default: break;
+    }
+}
+
+static bool is_comparison(TokenType op) {
+    switch (op) {
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_BANG_EQUAL:
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL: return true;
+        default:                  return false;
+    }
+}
+
+static int comparison_index(TokenType op) {
+    switch (op) {
+        case TOKEN_EQUAL_EQUAL:   return 0;
+        case TOKEN_BANG_EQUAL:    return 1;
+        case TOKEN_LESS:          return 2;
+        case TOKEN_LESS_EQUAL:    return 3;
+        case TOKEN_GREATER:       return 4;
+        default:                  return 5;
+    }
+}
+
+static TokenType negate_comparison(TokenType op) {
+    switch (op) {
+        case TOKEN_EQUAL_EQUAL:   return TOKEN_BANG_EQUAL;
+        case TOKEN_BANG_EQUAL:    return TOKEN_EQUAL_EQUAL;
+        case TOKEN_LESS:          return TOKEN_GREATER_EQUAL;
+        case TOKEN_LESS_EQUAL:    return TOKEN_GREATER;
+        case TOKEN_GREATER:       return TOKEN_LESS_EQUAL;
+        default:                  return TOKEN_LESS;
+    }
+}
+
+// Jumps to label when comparing the two int or float operands on the stack gives jump_when.
+static void compare_jump(TokenType op, ValueType operands, bool jump_when, Label* label) {
+    static const uint8_t int_jumps[] = { OP_IJEQ, OP_IJNE, OP_IJLT, OP_IJLE, OP_IJGT, OP_IJGE };
+    static const uint8_t int_loops[] = {
+        OP_LOOP_IEQ, OP_LOOP_INE, OP_LOOP_ILT, OP_LOOP_ILE, OP_LOOP_IGT, OP_LOOP_IGE
+    };
+    static const uint8_t float_jumps[] = { OP_FJEQ, OP_FJNE, OP_FJLT, OP_FJLE, OP_FJGT, OP_FJGE };
+    static const uint8_t float_loops[] = {
+        OP_LOOP_FEQ, OP_LOOP_FNE, OP_LOOP_FLT, OP_LOOP_FLE, OP_LOOP_FGT, OP_LOOP_FGE
+    };
+    static const uint8_t float_negated_jumps[] = { 0, 0, OP_FJNLT, OP_FJNLE, OP_FJNGT, OP_FJNGE };
+
+    bool ordered = op != TOKEN_EQUAL_EQUAL && op != TOKEN_BANG_EQUAL;
+    if (operands == VALUE_FLOAT && !jump_when && ordered) {
+        // !(a < b) is not a >= b when NaN is involved
+        jump_to(label, float_negated_jumps[comparison_index(op)], OP_NOP);
+        return;
+    }
+    if (!jump_when) op = negate_comparison(op);
+    int index = comparison_index(op);
+    if (operands == VALUE_INT) jump_to(label, int_jumps[index], int_loops[index]);
+    else jump_to(label, float_jumps[index], float_loops[index]);
+}
+
+// Compiles a boolean expression as control flow: jumps to label when it evaluates to jump_when,
+// falls through otherwise. and/or/! never materialize a bool and comparisons fuse with the branch.
+static void condition(ASTNode* node, bool jump_when, Label* label) {
+    if (node->type == AST_NODE_LITERAL && node->literal.type == VALUE_BOOL) {
+        if (node->literal.as.bool_ == jump_when) jump_to(label, OP_JUMP, OP_LOOP);
+        return;
+    }
+    if (node->type == AST_NODE_UNARY && node->unary.op == TOKEN_BANG) {
+        condition(node->unary.right, !jump_when, label);
+        return;
+    }
+    if (node->type == AST_NODE_BINARY && (node->binary.op == TOKEN_AND || node->binary.op == TOKEN_OR)) {
+        // "a and b" jumps when false as soon as a is false, "a or b" jumps when true as soon as a is true
+        bool short_circuits = (node->binary.op == TOKEN_AND) != jump_when;
+        if (short_circuits) {
+            condition(node->binary.left, jump_when, label);
+            condition(node->binary.right, jump_when, label);
+        }
+        else {
+            Label skip = { 0 };
+            condition(node->binary.left, !jump_when, &skip);
+            condition(node->binary.right, jump_when, label);
+            bind_label(&skip);
+        }
+        return;
+    }
+
+    ValueType operands = node->type == AST_NODE_BINARY ? node->binary.left->inferred_type : VALUE_NONE;
+    if (node->type == AST_NODE_BINARY && is_comparison(node->binary.op) &&
+        (operands == VALUE_INT || operands == VALUE_FLOAT)) {
+        traverse_ast(node->binary.left);
+        traverse_ast(node->binary.right);
+        compare_jump(node->binary.op, operands, jump_when, label);
+        return;
+    }
+
+    traverse_ast(node);
+    if (jump_when) jump_to(label, OP_JUMP_IF_TRUE, OP_LOOP_TRUE);
+    else jump_to(label, OP_JUMP_IF_FALSE, OP_NOP);
+}
+
+static void logical(ASTNode* node) {
+    // "a and b" is b when a holds, false otherwise; "a or b" is b when a fails, true otherwise
+    bool is_and = node->binary.op == TOKEN_AND;
+    Label short_circuit = { 0 };
+    condition(node->binary.left, !is_and, &short_circuit);
+    traverse_ast(node->binary.right);
+    int end = emit_jump(OP_JUMP);
+    bind_label(&short_circuit);
+    emit_byte(is_and ? OP_FALSE : OP_TRUE);
+    patch_jump(end);
+}
+
+static void emit_comparison(TokenType op, ValueType operands) {
+    static const uint8_t int_ops[] = { OP_IEQ, OP_INE, OP_ILT, OP_ILE, OP_IGT, OP_IGE };
+    static const uint8_t float_ops[] = { OP_FEQ, OP_FNE, OP_FLT, OP_FLE, OP_FGT, OP_FGE };
+
+    int index = comparison_index(op);
+    switch (operands) {
+        case VALUE_INT:   emit_byte(int_ops[index]); break;
+        case VALUE_FLOAT: emit_byte(float_ops[index]); break;
+        case VALUE_BOOL:  emit_byte(op == TOKEN_EQUAL_EQUAL ? OP_BEQ : OP_BNE); break;
+        case VALUE_STRING: emit_byte(op == TOKEN_EQUAL_EQUAL ? OP_SEQ : OP_SNE); break;
+        default: break;
+    }
+}
+
+static void comparison(ASTNode* node) {
     traverse_ast(node->binary.left);
     traverse_ast(node->binary.right);
+    emit_comparison(node->binary.op, node->binary.left->inferred_type);
+}
 
-    if (node->inferred_type == VALUE_INT) {
-        switch (node->binary.op) {
+static void emit_arithmetic(TokenType op, ValueType type) {
+    if (type == VALUE_INT) {
+        switch (op) {
             case TOKEN_PLUS:     emit_byte(OP_IADD); break;
             case TOKEN_MINUS:    emit_byte(OP_ISUB); break;
             case TOKEN_ASTERISK: emit_byte(OP_IMUL); break;
@@ -42,8 +311,8 @@ static void binary(ASTNode* node) {
             default: break;
         }
     }
-    else if (node->inferred_type == VALUE_FLOAT) {
-        switch (node->binary.op) {
+    else if (type == VALUE_FLOAT) {
+        switch (op) {
             case TOKEN_PLUS:     emit_byte(OP_FADD); break;
             case TOKEN_MINUS:    emit_byte(OP_FSUB); break;
             case TOKEN_ASTERISK: emit_byte(OP_FMUL); break;
@@ -51,59 +320,49 @@ static void binary(ASTNode* node) {
             default: break;
         }
     }
+    else if (type == VALUE_STRING && op == TOKEN_PLUS) {
+        emit_byte(OP_SCONCAT);
+    }
     else {
         // invalid operands
     }
 }
 
-static void unary(ASTNode* node) {
-    traverse_ast(node->unary.right);
-
-    if (node->unary.op == TOKEN_MINUS) {
-        if (node->inferred_type == VALUE_INT) emit_byte(OP_INEG);
-        else if (node->inferred_type == VALUE_FLOAT) emit_byte(OP_FNEG);
-        else return;  // invalid operand
+static void binary(ASTNode* node) {
+    if (node->binary.op == TOKEN_AND || node->binary.op == TOKEN_OR) {
+        logical(node);
+        return;
     }
-    else if (node->unary.op == TOKEN_BANG) {
-        emit_byte(OP_NOT);
+    if (is_comparison(node->binary.op)) {
+        comparison(node);
+        return;
     }
-}
 
-static void boolean(ASTNode* node) {
-    if (node->literal.as.bool_ == true) {
-        emit_byte(OP_TRUE);
-    }
-    else {
-        emit_byte(OP_FALSE);
-    }
+    traverse_ast(node->binary.left);
+    traverse_ast(node->binary.right);
+    emit_arithmetic(node->binary.op, node->inferred_type);
 }
 
-static void integer(ASTNode* node) {
-    int32_t value = node->literal.as.int_;
-    if (value >= INT8_MIN && value <= INT8_MAX) {
-        emit_bytes(OP_BIPUSH, (int8_t)value);
-    }
-    else if (value >= INT16_MIN && value <= INT16_MAX) {
-        emit_byte(OP_SIPUSH);
-        uint8_t high = (uint8_t)((value >> 8) & 0xFF);
-        uint8_t low = (uint8_t)(value & 0xFF);
-        emit_bytes(high, low);
+static void emit_unary(TokenType op, ValueType type) {
+    if (op == TOKEN_MINUS) {
+        if (type == VALUE_INT) emit_byte(OP_INEG);
+        else if (type == VALUE_FLOAT) emit_byte(OP_FNEG);
+        else return;  // invalid operand
     }
-    else if (value >= INT32_MIN && value <= INT32_MAX) {
-        emit_bytes(OP_LOADC, push_constant(INT_VALUE(value)));
+    else if (op == TOKEN_BANG) {
+        emit_byte(OP_NOT);
     }
 }
 
-static void floating(ASTNode* node) {
-    emit_bytes(OP_LOADC, push_constant(FLOAT_VALUE(node->literal.as.float_)));
+static void unary(ASTNode* node) {
+    traverse_ast(node->unary.right);
+    emit_unary(node->unary.op, node->inferred_type);
 }
 
-static void cast(ASTNode* node) {
-    traverse_ast(node->cast.expression);
-
-    switch (node->cast.target_type) {
+static void emit_cast(ValueType from, ValueType to) {
+    switch (to) {
         case VALUE_BOOL: {
-            switch (node->cast.expression->inferred_type) {
+            switch (from) {
                 case VALUE_BOOL: break;
                 case VALUE_INT: emit_byte(OP_I2B); break;
                 case VALUE_FLOAT: emit_byte(OP_F2B); break;
@@ -111,7 +370,7 @@ static void cast(ASTNode* node) {
             }
         } break;
         case VALUE_INT: {
-            switch (node->cast.expression->inferred_type) {
+            switch (from) {
                 case VALUE_BOOL: emit_byte(OP_B2I); break;
                 case VALUE_INT: break;
                 case VALUE_FLOAT: emit_byte(OP_F2I); break;
@@ -119,7 +378,7 @@ static void cast(ASTNode* node) {
             }
         } break;
         case VALUE_FLOAT: {
-            switch (node->cast.expression->inferred_type) {
+            switch (from) {
                 case VALUE_BOOL: emit_byte(OP_B2F); break;
                 case VALUE_INT: emit_byte(OP_I2F); break;
                 case VALUE_FLOAT: break;
@@ -130,7 +389,293 @@ static void cast(ASTNode* node) {
     }
 }
 
+static void cast(ASTNode* node) {
+    traverse_ast(node->cast.expression);
+    emit_cast(node->cast.expression->inferred_type, node->cast.target_type);
+}
+
+static void default_value(ValueType type) {
+    switch (type) {
+        case VALUE_BOOL:  emit_byte(OP_FALSE); break;
+        case VALUE_INT:   emit_bytes(OP_BIPUSH, 0); break;
+        case VALUE_FLOAT: emit_load_constant(FLOAT_VALUE(0.f)); break;
+        case VALUE_STRING: emit_load_constant(STRING_VALUE(intern_cstring("", 0))); break;
+        case VALUE_BOOL_ARRAY:
+        case VALUE_INT_ARRAY:
+        case VALUE_FLOAT_ARRAY: {
+            emit_bytes(OP_BIPUSH, 0);
+            emit_bytes(OP_NEWARRAY, (uint8_t)ELEMENT_TYPE_OF(type));
+        } break;
+        case VALUE_BOOL_MAP:
+        case VALUE_INT_MAP:
+        case VALUE_FLOAT_MAP:
+        case VALUE_STRING_MAP: emit_bytes(OP_MAP, (uint8_t)MAP_VALUE_TYPE_OF(type)); emit_byte(0); break;
+        default: break;
+    }
+}
+
+static void variable(ASTNode* node) {
+    if (node->variable.is_global) emit_indexed(OP_GLOAD, OP_GLOAD_W, node->variable.slot);
+    else emit_bytes(OP_LOAD, (uint8_t)node->variable.slot);
+}
+
+static void assignment(ASTNode* node) {
+    traverse_ast(node->assignment.value);
+    if (node->assignment.is_global) emit_indexed(OP_GSTORE, OP_GSTORE_W, node->assignment.slot);
+    else emit_bytes(OP_STORE, (uint8_t)node->assignment.slot);
+}
+
+// Locals live in their stack slot right after the initializer is evaluated, globals are stored away.
+static void var_decl(ASTNode* node) {
+    if (node->var_decl.initializer != NULL) traverse_ast(node->var_decl.initializer);
+    else default_value(node->inferred_type);
+
+    if (node->var_decl.is_global) {
+        emit_indexed(OP_GSTORE, OP_GSTORE_W, node->var_decl.slot);
+    }
+}
+
+static void pop_locals(int locals) {
+    if (locals == 1) emit_byte(OP_POP);
+    else if (locals > 1) emit_bytes(OP_POPN, (uint8_t)locals);
+}
+
+static void block(ASTNode* node) {
+    // only top-level expression statements echo their value, never ones nested in loops or branches
+    bool top_level = node == compiler.program && compiler.echo;
+    for (int i = 0; i < node->block.count; ++i) {
+        ASTNode* statement = node->block.statements[i];
+        if (top_level && statement->type == AST_NODE_EXPRESSION_STATEMENT &&
+            statement->inferred_type != VALUE_NONE) {
+            traverse_ast(statement->expression_statement.expression);
+            emit_byte(OP_PRINT);
+        }
+        else {
+            traverse_ast(statement);
+        }
+    }
+
+    pop_locals(node->block.local_count);
+}
+
+static void if_statement(ASTNode* node) {
+    Label else_branch = { 0 };
+    condition(node->if_.condition, false, &else_branch);
+    traverse_ast(node->if_.then_branch);
+
+    if (node->if_.else_branch == NULL) {
+        bind_label(&else_branch);
+        return;
+    }
+    int end = emit_jump(OP_JUMP);
+    bind_label(&else_branch);
+    traverse_ast(node->if_.else_branch);
+    patch_jump(end);
+}
+
+// Loops are laid out with the condition at the bottom, so each iteration runs a single
+// (usually fused, 1-byte offset) conditional back-edge instead of a test plus a jump.
+static void loop_condition(ASTNode* condition_node, int entry, int top) {
+    patch_jump(entry);
+    Label head = { .bound = true, .offset = top };
+    if (condition_node == NULL) jump_to(&head, OP_JUMP, OP_LOOP);
+    else condition(condition_node, true, &head);
+}
+
+static void while_statement(ASTNode* node) {
+    int entry = emit_jump(OP_JUMP);
+    int top = compiler.chunk->count;
+    traverse_ast(node->while_.body);
+    loop_condition(node->while_.condition, entry, top);
+}
+
+static void for_statement(ASTNode* node) {
+    if (node->for_.initializer != NULL) traverse_ast(node->for_.initializer);
+
+    int entry = emit_jump(OP_JUMP);
+    int top = compiler.chunk->count;
+    traverse_ast(node->for_.body);
+    if (node->for_.increment != NULL) traverse_ast(node->for_.increment);
+    loop_condition(node->for_.condition, entry, top);
+
+    pop_locals(node->for_.local_count);
+}
+
+// Methods are named Class.method in the chunk, the way the analyzer declared them.
+static int add_declared_function(ASTNode* node, ASTNode* klass, int entry) {
+    Token* name = &node->function.name;
+    if (klass == NULL) return add_function(compiler.chunk, name->start, name->length, node->function.arity, entry);
+
+    Token* class_name = &klass->class_.name;
+    int length = class_name->length + 1 + name->length;
+    char* qualified = malloc(length);
+    memcpy(qualified, class_name->start, class_name->length);
+    qualified[class_name->length] = '.';
+    memcpy(qualified + class_name->length + 1, name->start, name->length);
+    int index = add_function(compiler.chunk, qualified, length, node->function.arity, entry);
+    free(qualified);
+    return index;
+}
+
+// Pure functions start by looking their arguments up in their result cache.
+static void emit_memo(ASTNode* node, int index) {
+    if (!node->function.is_pure) return;
+    compiler.line = node->line;
+    emit_bytes(OP_MEMO, (uint8_t)index);
+}
+
+// Generator functions start by handing their caller a generator that runs the rest on resumption.
+static void emit_generator(ASTNode* node) {
+    if (!IS_GENERATOR_TYPE(node->function.return_type)) return;
+    compiler.line = node->line;
+    emit_bytes(OP_GENERATOR, (uint8_t)YIELD_TYPE_OF(node->function.return_type));
+}
+
+// The body is emitted in place and jumped over, so REPL lines can keep appending to one chunk.
+static void function(ASTNode* node, ASTNode* klass) {
+    int skip = emit_jump(OP_JUMP);
+    int index = add_declared_function(node, klass, compiler.chunk->count);
+    emit_memo(node, index);
+    emit_generator(node);
+
+    compiler.generator = IS_GENERATOR_TYPE(node->function.return_type);
+    traverse_ast(node->function.body);
+    // functions with a result are checked to return on every path, generators may run off the end
+    if (compiler.generator) emit_byte(OP_FINISH);
+    else if (node->function.return_type == VALUE_NONE) emit_byte(OP_RETURN_VOID);
+    compiler.generator = false;
+
+    compiler.chunk->functions[index].end = compiler.chunk->count;
+    patch_jump(skip);
+}
+
+// abs, min and max have an int and a float instruction, picked by the type of the result.
+static uint8_t intrinsic_op(MathIntrinsic intrinsic, ValueType type) {
+    bool ints = type == VALUE_INT;
+    switch (intrinsic) {
+        case INTRINSIC_SQRT:  return OP_FSQRT;
+        case INTRINSIC_ABS:   return ints ? OP_IABS : OP_FABS;
+        case INTRINSIC_MIN:   return ints ? OP_IMIN : OP_FMIN;
+        case INTRINSIC_MAX:   return ints ? OP_IMAX : OP_FMAX;
+        case INTRINSIC_FLOOR: return OP_FFLOOR;
+        case INTRINSIC_FMA:   return OP_FFMA;
+        case INTRINSIC_SIN:   return OP_FSIN;
+        case INTRINSIC_COS:   return OP_FCOS;
+        case INTRINSIC_TAN:   return OP_FTAN;
+        default:              return OP_NOP;
+    }
+}
+
+static void call(ASTNode* node) {
+    for (int i = 0; i < node->call.count; ++i) {
+        traverse_ast(node->call.arguments[i]);
+    }
+    if (node->call.builtin == BUILTIN_RESUME) emit_byte(OP_RESUME);
+    else if (node->call.builtin != -1) emit_bytes(OP_BUILTIN, (uint8_t)node->call.builtin);
+    else if (node->call.class_index != -1) emit_bytes(OP_NEW, (uint8_t)node->call.class_index);
+    else if (node->call.native != -1) emit_bytes(OP_CALL_NATIVE, (uint8_t)node->call.native);
+    else if (node->call.intrinsic != -1) emit_byte(intrinsic_op(node->call.intrinsic, node->inferred_type));
+    else emit_bytes(node->call.is_tail ? OP_TAIL_CALL : OP_CALL, (uint8_t)node->call.index);
+}
+
+// Every field access and method call site gets an inline cache of its own.
+static void emit_cached(uint8_t op, InlineCacheKind kind, CString* name) {
+    int cache = add_inline_cache(compiler.chunk, kind, name, compiler.chunk->count);
+    if (cache > UINT16_MAX) {
+        error("too many field accesses and method calls");
+        cache = 0;
+    }
+    emit_byte(op);
+    emit_bytes((uint8_t)(cache >> 8), (uint8_t)(cache & 0xFF));
+}
+
+static CString* intern_name(Token* name) {
+    return intern_cstring(name->start, name->length);
+}
+
+static void get_field(ASTNode* node) {
+    traverse_ast(node->get_field.object);
+    emit_cached(OP_GET_FIELD, CACHE_GET_FIELD, intern_name(&node->get_field.name));
+}
+
+static void set_field(ASTNode* node) {
+    traverse_ast(node->set_field.object);
+    traverse_ast(node->set_field.value);
+    compiler.line = node->line;
+    emit_cached(OP_SET_FIELD, CACHE_SET_FIELD, intern_name(&node->set_field.name));
+}
+
+// The receiver goes first and becomes the method's `this`.
+static void invoke(ASTNode* node) {
+    traverse_ast(node->invoke.object);
+    for (int i = 0; i < node->invoke.count; ++i) {
+        traverse_ast(node->invoke.arguments[i]);
+    }
+    compiler.line = node->line;
+    emit_cached(OP_INVOKE, CACHE_INVOKE, intern_name(&node->invoke.name));
+    emit_byte((uint8_t)node->invoke.count);
+}
+
+static uint8_t element_op(ValueType element_type, bool store, bool checked) {
+    uint8_t op;
+    switch (element_type) {
+        case VALUE_BOOL: op = store ? OP_BASTORE : OP_BALOAD; break;
+        case VALUE_INT:  op = store ? OP_IASTORE : OP_IALOAD; break;
+        default:         op = store ? OP_FASTORE : OP_FALOAD; break;
+    }
+    return checked ? op : (uint8_t)(op - OP_BALOAD + OP_BALOAD_UNCHECKED);
+}
+
+static void array(ASTNode* node) {
+    if (node->array.length != NULL) {
+        traverse_ast(node->array.length);
+        emit_bytes(OP_NEWARRAY, (uint8_t)node->array.element_type);
+        return;
+    }
+    for (int i = 0; i < node->array.count; ++i) {
+        traverse_ast(node->array.elements[i]);
+    }
+    emit_byte(OP_ARRAY);
+    emit_bytes((uint8_t)node->array.element_type, (uint8_t)node->array.count);
+}
+
+static void map(ASTNode* node) {
+    for (int i = 0; i < node->map.count; ++i) {
+        traverse_ast(node->map.keys[i]);
+        traverse_ast(node->map.values[i]);
+    }
+    emit_byte(OP_MAP);
+    emit_bytes((uint8_t)node->map.value_type, (uint8_t)node->map.count);
+}
+
+static void subscript(ASTNode* node) {
+    traverse_ast(node->subscript.array);
+    traverse_ast(node->subscript.index);
+    if (IS_MAP_TYPE(node->subscript.array->inferred_type)) emit_byte(OP_MAP_GET);
+    else emit_byte(element_op(node->inferred_type, false, true));
+}
+
+static void subscript_assignment(ASTNode* node) {
+    traverse_ast(node->subscript_assignment.array);
+    traverse_ast(node->subscript_assignment.index);
+    traverse_ast(node->subscript_assignment.value);
+    if (IS_MAP_TYPE(node->subscript_assignment.array->inferred_type)) emit_byte(OP_MAP_SET);
+    else emit_byte(element_op(node->subscript_assignment.value->inferred_type, true, true));
+}
+
+static void return_statement(ASTNode* node) {
+    ASTNode* value = node->return_.value;
+    if (value == NULL) {
+        emit_byte(compiler.generator ? OP_FINISH : OP_RETURN_VOID);
+        return;
+    }
+    traverse_ast(value);
+    // a tail call never comes back here, the callee returns straight to our caller
+    if (value->type != AST_NODE_CALL || !value->call.is_tail) emit_byte(OP_RETURN);
+}
+
 void traverse_ast(ASTNode* node) {
+    compiler.line = node->line;
     switch (node->type) {
         case AST_NODE_BINARY: {
             binary(node);
@@ -139,32 +684,852 @@ void traverse_ast(ASTNode* node) {
             unary(node);
         } break;
         case AST_NODE_LITERAL: {
-            switch (node->literal.type) {
-                case VALUE_BOOL: {
-                    boolean(node);
-                } break;
-                case VALUE_INT: {
-                    integer(node);
-                } break;
-                case VALUE_FLOAT: {
-                    floating(node);
-                } break;
-                default: break;
-            }
+            emit_constant(node->literal);
         } break;
         case AST_NODE_CAST: {
             cast(node); 
         } break;
+        case AST_NODE_VARIABLE: {
+            variable(node);
+        } break;
+        case AST_NODE_ASSIGNMENT: {
+            assignment(node);
+        } break;
+        case AST_NODE_VAR_DECL: {
+            var_decl(node);
+        } break;
+        case AST_NODE_PRINT: {
+            traverse_ast(node->print.expression);
+            emit_byte(OP_PRINT);
+        } break;
+        case AST_NODE_EXPRESSION_STATEMENT: {
+            traverse_ast(node->expression_statement.expression);
+            emit_byte(OP_POP);
+        } break;
+        case AST_NODE_BLOCK: {
+            block(node);
+        } break;
+        case AST_NODE_IF: {
+            if_statement(node);
+        } break;
+        case AST_NODE_WHILE: {
+            while_statement(node);
+        } break;
+        case AST_NODE_FOR: {
+            for_statement(node);
+        } break;
+        case AST_NODE_FUNCTION: {
+            function(node, NULL);
+        } break;
+        case AST_NODE_CLASS: {
+            for (int i = 0; i < node->class_.method_count; ++i) {
+                function(node->class_.methods[i], node);
+            }
+        } break;
+        case AST_NODE_GET_FIELD: {
+            get_field(node);
+        } break;
+        case AST_NODE_SET_FIELD: {
+            set_field(node);
+        } break;
+        case AST_NODE_INVOKE: {
+            invoke(node);
+        } break;
+        case AST_NODE_CALL: {
+            call(node);
+        } break;
+        case AST_NODE_RETURN: {
+            return_statement(node);
+        } break;
+        case AST_NODE_YIELD: {
+            traverse_ast(node->yield_.value);
+            emit_byte(OP_YIELD);
+        } break;
+        case AST_NODE_ARRAY: {
+            array(node);
+        } break;
+        case AST_NODE_MAP: {
+            map(node);
+        } break;
+        case AST_NODE_SUBSCRIPT: {
+            subscript(node);
+        } break;
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            subscript_assignment(node);
+        } break;
         default: break;
     }
 }
 
-bool compile(ASTNode* ast, Chunk* chunk) {
+// Where an IR value is found when an instruction needs it as an operand.
+typedef enum ValueHome {
+    HOME_NONE,      // no result, or a result nobody reads (popped right away)
+    HOME_CONSTANT,  // pushed again at every use
+    HOME_SLOT,      // stored to a frame slot after it is computed
+    HOME_DEFERRED,  // computed in place when its only user is emitted
+} ValueHome;
+
+typedef struct IRCodegen {
+    IRFunction* function;
+    ValueHome* homes;
+    int* slots;
+    int* use_counts;
+    int* users;          // the last user, the only one for values used once
+    int* user_operands;  // operand index of the value in that user
+    Label* labels;
+    int slot_count;
+} IRCodegen;
+
+static _Thread_local IRCodegen codegen = { 0 };
+
+static int optimization_level = 1;
+static bool emits_ir = false;
+
+void set_optimization_level(int level) {
+    optimization_level = level;
+}
+
+void set_emit_ir(bool enabled) {
+    emits_ir = enabled;
+}
+
+static IRInstr* ir_instr(int value) {
+    return &codegen.function->instrs[value];
+}
+
+static bool is_root(int value) {
+    IRInstr* instr = ir_instr(value);
+    if (instr->removed) return false;
+    if (instr->op == IR_CONST || instr->op == IR_PHI || instr->op == IR_PARAM) return false;
+    return codegen.homes[value] != HOME_DEFERRED;
+}
+
+// Instructions whose order against each other is observable: memory, output, calls and traps.
+static bool is_ordered(IRInstr* instr) {
+    switch (instr->op) {
+        case IR_GLOAD:
+        case IR_GSTORE:
+        case IR_CALL:
+        case IR_CALL_NATIVE:
+        case IR_PRINT:
+        case IR_NEW_ARRAY:
+        case IR_LOAD_ELEMENT:
+        case IR_STORE_ELEMENT:
+        case IR_BUILTIN:
+        case IR_LOAD_UNCHECKED:
+        case IR_STORE_UNCHECKED:
+        case IR_GUARD_LENGTH:
+        case IR_NEW_OBJECT:
+        case IR_GET_FIELD:
+        case IR_SET_FIELD:
+        case IR_INVOKE:
+        case IR_MAP_GET:
+        case IR_MAP_SET:
+        case IR_RESUME:
+        case IR_YIELD: return true;
+        case IR_BINARY: return instr->type == VALUE_INT && instr->token == TOKEN_SLASH;
+        default:        return false;
+    }
+}
+
+static void count_uses() {
+    IRFunction* function = codegen.function;
+    for (int block = 0; block < function->block_count; ++block) {
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) continue;
+        for (int i = 0; i < target->count; ++i) {
+            IRInstr* instr = ir_instr(target->instrs[i]);
+            if (instr->removed) continue;
+            for (int j = 0; j < instr->count; ++j) {
+                int operand = resolve_value(function, instr->operands[j]);
+                instr->operands[j] = operand;
+                ++codegen.use_counts[operand];
+                codegen.users[operand] = target->instrs[i];
+                codegen.user_operands[operand] = j;
+            }
+        }
+    }
+}
+
+// A value used once by a later instruction of its block is computed right where that user
+// needs it, so expression trees run on the operand stack without slot traffic. Ordered values
+// only move when every ordered instruction they would cross is evaluated after them anyway.
+static bool can_defer(int value, int* block_positions, bool* ordered_trees) {
+    IRInstr* instr = ir_instr(value);
+    if (instr->op == IR_PHI || instr->op == IR_PARAM || codegen.use_counts[value] != 1) return false;
+
+    int user = codegen.users[value];
+    IRInstr* user_instr = ir_instr(user);
+    IRBlock* block = &codegen.function->blocks[instr->block];
+    if (user_instr->op == IR_PHI) {
+        // computed by the phi copies at the end of its own block, which must be the incoming edge
+        int pred = codegen.function->blocks[user_instr->block].preds[codegen.user_operands[value]];
+        if (pred != instr->block) return false;
+        for (int i = block_positions[value] + 1; i < block->count && ordered_trees[value]; ++i) {
+            if (is_ordered(ir_instr(block->instrs[i]))) return false;
+        }
+        return true;
+    }
+    if (user_instr->block != instr->block) return false;
+    if (!ordered_trees[value]) return true;
+
+    for (int i = block_positions[value] + 1; i < block_positions[user]; ++i) {
+        int between = block->instrs[i];
+        if (!is_ordered(ir_instr(between))) continue;
+
+        int step = between;
+        while (codegen.homes[step] == HOME_DEFERRED && codegen.users[step] != user) step = codegen.users[step];
+        bool later_operand = codegen.homes[step] == HOME_DEFERRED &&
+            codegen.user_operands[step] > codegen.user_operands[value];
+        if (!later_operand) return false;
+    }
+    return true;
+}
+
+static void assign_homes(int* block_positions, bool* ordered_trees) {
+    IRFunction* function = codegen.function;
+    for (int block = 0; block < function->block_count; ++block) {
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) continue;
+
+        for (int i = 0; i < target->count; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = ir_instr(value);
+            block_positions[value] = i;
+
+            if (instr->op == IR_CONST) codegen.homes[value] = HOME_CONSTANT;
+            else if (instr->op == IR_PHI || instr->op == IR_PARAM) codegen.homes[value] = HOME_SLOT;
+            else if (instr->type == VALUE_NONE || codegen.use_counts[value] == 0) codegen.homes[value] = HOME_NONE;
+            else codegen.homes[value] = HOME_SLOT;
+
+            ordered_trees[value] = is_ordered(instr);
+            for (int j = 0; j < instr->count && instr->op != IR_PHI; ++j) {
+                int operand = instr->operands[j];
+                if (ir_instr(operand)->block == block && ordered_trees[operand]) ordered_trees[value] = true;
+            }
+        }
+
+        // users are decided before the values they consume
+        for (int i = target->count - 1; i >= 0; --i) {
+            int value = target->instrs[i];
+            if (codegen.homes[value] == HOME_SLOT && can_defer(value, block_positions, ordered_trees)) {
+                codegen.homes[value] = HOME_DEFERRED;
+            }
+        }
+    }
+}
+
+#define WORD_BITS 64
+#define HAS_BIT(set, bit) (((set)[(bit) / WORD_BITS] >> ((bit) % WORD_BITS)) & 1)
+#define SET_BIT(set, bit) ((set)[(bit) / WORD_BITS] |= (uint64_t)1 << ((bit) % WORD_BITS))
+#define CLEAR_BIT(set, bit) ((set)[(bit) / WORD_BITS] &= ~((uint64_t)1 << ((bit) % WORD_BITS)))
+
+typedef struct Liveness {
+    int words;
+    uint64_t* live_in;
+    uint64_t* live_out;
+} Liveness;
+
+static uint64_t* live_in_of(Liveness* liveness, int block) {
+    return &liveness->live_in[(size_t)block * liveness->words];
+}
+
+static uint64_t* live_out_of(Liveness* liveness, int block) {
+    return &liveness->live_out[(size_t)block * liveness->words];
+}
+
+static int pred_index(int block, int target) {
+    IRBlock* successor_block = &codegen.function->blocks[target];
+    int pred = 0;
+    while (successor_block->preds[pred] != block) ++pred;
+    return pred;
+}
+
+// Slot values only, phi operands are live out of the predecessor that provides them.
+static void compute_liveness(Liveness* liveness) {
+    IRFunction* function = codegen.function;
+    int words = (function->count + WORD_BITS - 1) / WORD_BITS;
+    liveness->words = words;
+    liveness->live_in = calloc((size_t)words * function->block_count, sizeof(uint64_t));
+    liveness->live_out = calloc((size_t)words * function->block_count, sizeof(uint64_t));
+    uint64_t* scratch = malloc(sizeof(uint64_t) * words);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int l = function->block_count - 1; l >= 0; --l) {
+            int block = function->layout[l];
+            IRBlock* target = &function->blocks[block];
+            if (target->removed) continue;
+
+            memset(scratch, 0, sizeof(uint64_t) * words);
+            for (int k = 0; k < successor_count(function, block); ++k) {
+                int next = successor(function, block, k);
+                uint64_t* next_in = live_in_of(liveness, next);
+                for (int w = 0; w < words; ++w) scratch[w] |= next_in[w];
+
+                IRBlock* successor_block = &function->blocks[next];
+                int pred = pred_index(block, next);
+                for (int i = 0; i < successor_block->count; ++i) {
+                    IRInstr* phi = ir_instr(successor_block->instrs[i]);
+                    if (phi->op != IR_PHI) break;
+                    if (codegen.homes[phi->operands[pred]] == HOME_SLOT) SET_BIT(scratch, phi->operands[pred]);
+                }
+            }
+            memcpy(live_out_of(liveness, block), scratch, sizeof(uint64_t) * words);
+
+            for (int i = 0; i < target->count; ++i) CLEAR_BIT(scratch, target->instrs[i]);
+            for (int i = 0; i < target->count; ++i) {
+                IRInstr* instr = ir_instr(target->instrs[i]);
+                if (instr->op == IR_PHI) continue;
+                for (int j = 0; j < instr->count; ++j) {
+                    int operand = instr->operands[j];
+                    if (codegen.homes[operand] == HOME_SLOT && ir_instr(operand)->block != block) SET_BIT(scratch, operand);
+                }
+            }
+            uint64_t* in = live_in_of(liveness, block);
+            if (memcmp(in, scratch, sizeof(uint64_t) * words) != 0) {
+                memcpy(in, scratch, sizeof(uint64_t) * words);
+                changed = true;
+            }
+        }
+    }
+    free(scratch);
+}
+
+// Slot values read when the root is emitted, through the deferred values computed with it.
+static void collect_uses(int value, int* uses, int* count) {
+    IRInstr* instr = ir_instr(value);
+    for (int i = 0; i < instr->count; ++i) {
+        int operand = instr->operands[i];
+        if (codegen.homes[operand] == HOME_SLOT) uses[(*count)++] = operand;
+        else if (codegen.homes[operand] == HOME_DEFERRED) collect_uses(operand, uses, count);
+    }
+}
+
+static void collect_root_uses(int block, int value, int* uses, int* count) {
+    *count = 0;
+    collect_uses(value, uses, count);
+    IRInstr* instr = ir_instr(value);
+    if (instr->op != IR_JUMP) return;
+
+    // deferred phi operands are computed by the copies right before the jump
+    int target = instr->targets[0];
+    IRBlock* successor_block = &codegen.function->blocks[target];
+    int pred = pred_index(block, target);
+    for (int i = 0; i < successor_block->count; ++i) {
+        IRInstr* phi = ir_instr(successor_block->instrs[i]);
+        if (phi->op != IR_PHI) break;
+        if (codegen.homes[phi->operands[pred]] == HOME_DEFERRED) collect_uses(phi->operands[pred], uses, count);
+    }
+}
+
+// Follows single-use chains into phis, a value written to the same slot as its phi needs no copy.
+static int preferred_slot(int value) {
+    IRInstr* instr = ir_instr(value);
+    for (int step = value, i = 0; i < 4 && codegen.use_counts[step] == 1; ++i) {
+        step = codegen.users[step];
+        if (ir_instr(step)->op != IR_PHI) break;
+        if (codegen.slots[step] != -1) return codegen.slots[step];
+    }
+    if (instr->op == IR_PHI) {
+        for (int i = 0; i < instr->count; ++i) {
+            int operand = instr->operands[i];
+            if (codegen.homes[operand] == HOME_SLOT && codegen.slots[operand] != -1) return codegen.slots[operand];
+        }
+    }
+    return -1;
+}
+
+static bool assign_slot(int value, int* occupied) {
+    int slot = preferred_slot(value);
+    if (slot == -1 || occupied[slot] != -1) {
+        slot = 0;
+        while (slot < UINT8_MAX && occupied[slot] != -1) ++slot;
+    }
+    if (slot >= UINT8_MAX) return false;
+
+    codegen.slots[value] = slot;
+    occupied[slot] = value;
+    if (slot + 1 > codegen.slot_count) codegen.slot_count = slot + 1;
+    return true;
+}
+
+static int* reverse_postorder(int* count) {
+    IRFunction* function = codegen.function;
+    int* order = malloc(sizeof(int) * function->block_count);
+    int* stack = malloc(sizeof(int) * function->block_count);
+    int* next = calloc(function->block_count, sizeof(int));
+    bool* visited = calloc(function->block_count, sizeof(bool));
+    int post_count = 0;
+    int top = 0;
+
+    stack[top++] = 0;
+    visited[0] = true;
+    while (top > 0) {
+        int block = stack[top - 1];
+        if (next[block] < successor_count(function, block)) {
+            int target = successor(function, block, next[block]++);
+            if (!visited[target]) {
+                visited[target] = true;
+                stack[top++] = target;
+            }
+            continue;
+        }
+        order[post_count++] = block;
+        --top;
+    }
+    for (int i = 0; i < post_count / 2; ++i) {
+        int swap = order[i];
+        order[i] = order[post_count - 1 - i];
+        order[post_count - 1 - i] = swap;
+    }
+
+    free(visited);
+    free(next);
+    free(stack);
+    *count = post_count;
+    return order;
+}
+
+// Slots are handed out in dominance order: a value only avoids the slots of values live where it
+// is defined, which in SSA form is enough for no two live values to share a slot. Parameters
+// keep the slots the caller put them in.
+static bool allocate_slots(int arity) {
+    IRFunction* function = codegen.function;
+    Liveness liveness;
+    compute_liveness(&liveness);
+    for (int value = 0; value < function->count; ++value) codegen.slots[value] = -1;
+    codegen.slot_count = arity;
+
+    int block_count;
+    int* order = reverse_postorder(&block_count);
+    int operand_count = 0;
+    for (int value = 0; value < function->count; ++value) operand_count += ir_instr(value)->count;
+    int* uses = malloc(sizeof(int) * (operand_count + 1));
+    int* deaths = malloc(sizeof(int) * (function->count + 1));
+    int* death_starts = malloc(sizeof(int) * (function->count + 1));
+    int* death_ends = malloc(sizeof(int) * (function->count + 1));
+    uint64_t* live = malloc(sizeof(uint64_t) * liveness.words);
+    int occupied[UINT8_MAX + 1];
+    bool fits = true;
+
+    for (int b = 0; b < block_count && fits; ++b) {
+        int block = order[b];
+        IRBlock* target = &function->blocks[block];
+        for (int i = 0; i <= UINT8_MAX; ++i) occupied[i] = -1;
+
+        uint64_t* in = live_in_of(&liveness, block);
+        for (int value = 0; value < function->count; ++value) {
+            if (HAS_BIT(in, value) && codegen.slots[value] != -1) occupied[codegen.slots[value]] = value;
+        }
+
+        // walking backwards, a slot value dies at its last use unless it is live out
+        memcpy(live, live_out_of(&liveness, block), sizeof(uint64_t) * liveness.words);
+        int death_count = 0;
+        for (int i = target->count - 1; i >= 0; --i) {
+            int value = target->instrs[i];
+            death_starts[i] = death_count;
+            if (is_root(value)) {
+                int use_count;
+                collect_root_uses(block, value, uses, &use_count);
+                for (int j = 0; j < use_count; ++j) {
+                    if (HAS_BIT(live, uses[j])) continue;
+                    SET_BIT(live, uses[j]);
+                    deaths[death_count++] = uses[j];
+                }
+            }
+            death_ends[i] = death_count;
+        }
+
+        for (int i = 0; i < target->count && fits; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = ir_instr(value);
+            if (instr->op == IR_PARAM) {
+                codegen.slots[value] = instr->index;
+                occupied[instr->index] = value;
+                continue;
+            }
+            if (instr->op == IR_PHI) {
+                fits = assign_slot(value, occupied);
+                continue;
+            }
+
+            // operands are on the stack before the result is stored, so their slots can be reused
+            for (int j = death_starts[i]; j < death_ends[i]; ++j) {
+                int dead = deaths[j];
+                if (occupied[codegen.slots[dead]] == dead) occupied[codegen.slots[dead]] = -1;
+            }
+            if (is_root(value) && codegen.homes[value] == HOME_SLOT) fits = assign_slot(value, occupied);
+        }
+    }
+
+    free(live);
+    free(death_ends);
+    free(death_starts);
+    free(deaths);
+    free(uses);
+    free(order);
+    free(liveness.live_in);
+    free(liveness.live_out);
+    return fits;
+}
+
+static void emit_ir_instr(int value);
+
+static void emit_ir_value(int value) {
+    switch (codegen.homes[value]) {
+        case HOME_CONSTANT: emit_constant(ir_instr(value)->constant); break;
+        case HOME_SLOT:     emit_bytes(OP_LOAD, (uint8_t)codegen.slots[value]); break;
+        case HOME_DEFERRED: emit_ir_instr(value); break;
+        default: break;
+    }
+}
+
+static void emit_ir_operands(IRInstr* instr) {
+    for (int i = 0; i < instr->count; ++i) {
+        emit_ir_value(instr->operands[i]);
+    }
+}
+
+// Accesses proven in bounds read the array and the index straight from their slots, anything
+// else still goes through the operand stack and the checked instruction.
+static bool emit_unchecked(IRInstr* instr) {
+    int array = instr->operands[0];
+    int index = instr->operands[1];
+    if (codegen.homes[array] != HOME_SLOT || codegen.homes[index] != HOME_SLOT) return false;
+
+    bool store = instr->op == IR_STORE_UNCHECKED;
+    if (store) emit_ir_value(instr->operands[2]);
+    compiler.line = instr->line;
+    emit_byte(element_op(store ? ir_instr(instr->operands[2])->type : instr->type, store, false));
+    emit_bytes((uint8_t)codegen.slots[array], (uint8_t)codegen.slots[index]);
+    return true;
+}
+
+static void emit_ir_instr(int value) {
+    IRInstr* instr = ir_instr(value);
+    if ((instr->op == IR_LOAD_UNCHECKED || instr->op == IR_STORE_UNCHECKED) && emit_unchecked(instr)) return;
+    emit_ir_operands(instr);
+    compiler.line = instr->line;
+
+    switch (instr->op) {
+        case IR_GLOAD:  emit_indexed(OP_GLOAD, OP_GLOAD_W, instr->index); break;
+        case IR_GSTORE: emit_indexed(OP_GSTORE, OP_GSTORE_W, instr->index); break;
+        case IR_BINARY: {
+            ValueType operands = ir_instr(instr->operands[0])->type;
+            if (is_comparison(instr->token)) emit_comparison(instr->token, operands);
+            else emit_arithmetic(instr->token, instr->type);
+        } break;
+        case IR_UNARY:  emit_unary(instr->token, instr->type); break;
+        case IR_CAST:   emit_cast(ir_instr(instr->operands[0])->type, instr->type); break;
+        case IR_SHL:    emit_bytes(OP_ISHL, (uint8_t)instr->index); break;
+        case IR_DIV_MAGIC: emit_bytes(OP_IDIV_MAGIC, (uint8_t)instr->index); break;
+        case IR_INTRINSIC: emit_byte(intrinsic_op(instr->index, instr->type)); break;
+        case IR_CALL:   emit_bytes(OP_CALL, (uint8_t)instr->index); break;
+        case IR_CALL_NATIVE: emit_bytes(OP_CALL_NATIVE, (uint8_t)instr->index); break;
+        case IR_PRINT:  emit_byte(OP_PRINT); break;
+        case IR_NEW_ARRAY: emit_bytes(OP_NEWARRAY, (uint8_t)ELEMENT_TYPE_OF(instr->type)); break;
+        case IR_ARRAY: {
+            emit_byte(OP_ARRAY);
+            emit_bytes((uint8_t)ELEMENT_TYPE_OF(instr->type), (uint8_t)instr->count);
+        } break;
+        case IR_LOAD_ELEMENT:
+        case IR_LOAD_UNCHECKED: emit_byte(element_op(instr->type, false, true)); break;
+        case IR_STORE_ELEMENT:
+        case IR_STORE_UNCHECKED: emit_byte(element_op(ir_instr(instr->operands[2])->type, true, true)); break;
+        case IR_GUARD_LENGTH: emit_byte(OP_GUARD_LENGTH); break;
+        case IR_BUILTIN: emit_bytes(OP_BUILTIN, (uint8_t)instr->index); break;
+        case IR_NEW_OBJECT: emit_bytes(OP_NEW, (uint8_t)instr->index); break;
+        case IR_GET_FIELD: emit_cached(OP_GET_FIELD, CACHE_GET_FIELD, AS_STRING(instr->constant)); break;
+        case IR_SET_FIELD: emit_cached(OP_SET_FIELD, CACHE_SET_FIELD, AS_STRING(instr->constant)); break;
+        case IR_INVOKE: {
+            emit_cached(OP_INVOKE, CACHE_INVOKE, AS_STRING(instr->constant));
+            emit_byte((uint8_t)(instr->count - 1));
+        } break;
+        case IR_MAP: {
+            emit_byte(OP_MAP);
+            emit_bytes((uint8_t)MAP_VALUE_TYPE_OF(instr->type), (uint8_t)(instr->count / 2));
+        } break;
+        case IR_MAP_GET: emit_byte(OP_MAP_GET); break;
+        case IR_MAP_SET: emit_byte(OP_MAP_SET); break;
+        case IR_RESUME: emit_byte(OP_RESUME); break;
+        case IR_YIELD:  emit_byte(OP_YIELD); break;
+        default: break;
+    }
+}
+
+static void emit_ir_branch(int condition, bool jump_when, Label* label) {
+    IRInstr* instr = ir_instr(condition);
+    if (codegen.homes[condition] == HOME_DEFERRED) {
+        if (instr->op == IR_UNARY && instr->token == TOKEN_BANG) {
+            emit_ir_branch(instr->operands[0], !jump_when, label);
+            return;
+        }
+        ValueType operands = instr->op == IR_BINARY ? ir_instr(instr->operands[0])->type : VALUE_NONE;
+        if (instr->op == IR_BINARY && is_comparison(instr->token) &&
+            (operands == VALUE_INT || operands == VALUE_FLOAT)) {
+            emit_ir_operands(instr);
+            compiler.line = instr->line;
+            compare_jump(instr->token, operands, jump_when, label);
+            return;
+        }
+    }
+    emit_ir_value(condition);
+    if (jump_when) jump_to(label, OP_JUMP_IF_TRUE, OP_LOOP_TRUE);
+    else jump_to(label, OP_JUMP_IF_FALSE, OP_NOP);
+}
+
+// Phis of the target are assigned in parallel: every incoming value is pushed before any slot is written.
+static void emit_phi_copies(int block, int target) {
+    IRBlock* successor_block = &codegen.function->blocks[target];
+    int pred = 0;
+    while (successor_block->preds[pred] != block) ++pred;
+
+    int copies = 0;
+    for (int i = 0; i < successor_block->count; ++i) {
+        int phi = successor_block->instrs[i];
+        if (ir_instr(phi)->op != IR_PHI) break;
+        int operand = ir_instr(phi)->operands[pred];
+        if (codegen.homes[operand] == HOME_SLOT && codegen.slots[operand] == codegen.slots[phi]) continue;
+        emit_ir_value(operand);
+        ++copies;
+    }
+    for (int i = successor_block->count - 1; i >= 0 && copies > 0; --i) {
+        int phi = successor_block->instrs[i];
+        if (ir_instr(phi)->op != IR_PHI) continue;
+        int operand = ir_instr(phi)->operands[pred];
+        if (codegen.homes[operand] == HOME_SLOT && codegen.slots[operand] == codegen.slots[phi]) continue;
+        emit_bytes(OP_STORE, (uint8_t)codegen.slots[phi]);
+        --copies;
+    }
+}
+
+static void emit_ir_terminator(int block, int value, int next) {
+    IRInstr* instr = ir_instr(value);
+    compiler.line = instr->line;
+    switch (instr->op) {
+        case IR_JUMP: {
+            int target = instr->targets[0];
+            emit_phi_copies(block, target);
+            if (target != next) jump_to(&codegen.labels[target], OP_JUMP, OP_LOOP);
+        } break;
+        case IR_BRANCH: {
+            int if_true = instr->targets[0];
+            int if_false = instr->targets[1];
+            if (if_true == next) {
+                emit_ir_branch(instr->operands[0], false, &codegen.labels[if_false]);
+            }
+            else {
+                emit_ir_branch(instr->operands[0], true, &codegen.labels[if_true]);
+                if (if_false != next) jump_to(&codegen.labels[if_false], OP_JUMP, OP_LOOP);
+            }
+        } break;
+        case IR_RETURN: {
+            if (instr->count == 0) {
+                emit_byte(codegen.function->is_generator ? OP_FINISH : OP_RETURN_VOID);
+                break;
+            }
+            emit_ir_operands(instr);
+            emit_byte(OP_RETURN);
+        } break;
+        case IR_TAIL_CALL: {
+            emit_ir_operands(instr);
+            emit_bytes(OP_TAIL_CALL, (uint8_t)instr->index);
+        } break;
+        default: break;
+    }
+}
+
+static bool prepare_ir_function(IRFunction* function, int arity) {
+    split_critical_edges(function);
+
+    int count = function->count;
+    codegen = (IRCodegen){
+        .function = function,
+        .homes = calloc(count, sizeof(ValueHome)),
+        .slots = calloc(count, sizeof(int)),
+        .use_counts = calloc(count, sizeof(int)),
+        .users = calloc(count, sizeof(int)),
+        .user_operands = calloc(count, sizeof(int)),
+        .labels = calloc(function->block_count, sizeof(Label)),
+    };
+
+    int* block_positions = calloc(count, sizeof(int));
+    bool* ordered_trees = calloc(count, sizeof(bool));
+    count_uses();
+    assign_homes(block_positions, ordered_trees);
+    free(ordered_trees);
+    free(block_positions);
+
+    return allocate_slots(arity);
+}
+
+static void finish_ir_function() {
+    for (int i = 0; i < codegen.function->block_count; ++i) free(codegen.labels[i].sites);
+    free(codegen.homes);
+    free(codegen.slots);
+    free(codegen.use_counts);
+    free(codegen.users);
+    free(codegen.user_operands);
+    free(codegen.labels);
+    codegen = (IRCodegen){ 0 };
+}
+
+static void emit_ir_function(int arity) {
+    IRFunction* function = codegen.function;
+    for (int l = 0; l < function->block_count; ++l) {
+        int block = function->layout[l];
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) continue;
+
+        bind_label(&codegen.labels[block]);
+        if (l == 0 && codegen.slot_count > arity) emit_bytes(OP_RESERVE, (uint8_t)(codegen.slot_count - arity));
+
+        int next = -1;
+        for (int n = l + 1; n < function->block_count && next == -1; ++n) {
+            if (!function->blocks[function->layout[n]].removed) next = function->layout[n];
+        }
+
+        for (int i = 0; i < target->count; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = ir_instr(value);
+            if (!is_root(value)) continue;
+            if (instr->op >= IR_JUMP) {
+                emit_ir_terminator(block, value, next);
+                continue;
+            }
+
+            emit_ir_instr(value);
+            if (codegen.homes[value] == HOME_SLOT) emit_bytes(OP_STORE, (uint8_t)codegen.slots[value]);
+            // calls always leave a value, none for void functions
+            else if (instr->type != VALUE_NONE || instr->op == IR_CALL || instr->op == IR_CALL_NATIVE ||
+                     instr->op == IR_INVOKE) emit_byte(OP_POP);
+        }
+    }
+}
+
+static bool compile_ir_function(IRFunction* function, int arity) {
+    optimize_ir(function, optimization_level);
+    if (emits_ir) dump_ir(function, stdout);
+
+    bool fits = prepare_ir_function(function, arity);
+    if (fits) emit_ir_function(arity);
+    finish_ir_function();
+    free_ir(function);
+    return fits;
+}
+
+static bool compile_ir_declaration(ASTNode* node, ASTNode* klass) {
+    Chunk* chunk = compiler.chunk;
+    int index = add_declared_function(node, klass, chunk->count);
+    emit_memo(node, index);
+    emit_generator(node);
+    IRFunction function;
+    lower_function(&function, node);
+    bool fits = compile_ir_function(&function, node->function.arity);
+    chunk->functions[index].end = chunk->count;
+    return fits;
+}
+
+// Lowers the program to SSA, optimizes it and emits the script followed by its functions and methods.
+// False when some function needs more slots than a frame addresses or the constants don't
+// fit the pool, nothing is emitted then.
+static bool compile_ir(ASTNode* program) {
+    Chunk* chunk = compiler.chunk;
+    int start = chunk->count;
+    int constants_start = chunk->constant_pool.count;
+    int functions_start = chunk->function_count;
+    int caches_start = chunk->cache_count;
+
+    IRFunction function;
+    lower_program(&function, program, compiler.echo);
+    bool fits = compile_ir_function(&function, 0);
+
+    for (int i = 0; i < program->block.count && fits; ++i) {
+        ASTNode* node = program->block.statements[i];
+        if (node->type == AST_NODE_FUNCTION) {
+            fits = compile_ir_declaration(node, NULL);
+        }
+        else if (node->type == AST_NODE_CLASS) {
+            for (int j = 0; j < node->class_.method_count && fits; ++j) {
+                fits = compile_ir_declaration(node->class_.methods[j], node);
+            }
+        }
+    }
+
+    if (!fits || compiler.constants_full) {
+        chunk->count = start;
+        chunk->constant_pool.count = constants_start;
+        truncate_functions(chunk, functions_start);
+        chunk->cache_count = caches_start;
+        compiler.constants_full = false;
+        return false;
+    }
+    return true;
+}
+
+// -O0 still shows the IR, but the tree is compiled directly.
+static void dump_unoptimized_ir(ASTNode* program) {
+    IRFunction function;
+    lower_program(&function, program, compiler.echo);
+    dump_ir(&function, stdout);
+    free_ir(&function);
+
+    for (int i = 0; i < program->block.count; ++i) {
+        ASTNode* node = program->block.statements[i];
+        if (node->type == AST_NODE_FUNCTION) {
+            lower_function(&function, node);
+            dump_ir(&function, stdout);
+            free_ir(&function);
+        }
+        for (int j = 0; node->type == AST_NODE_CLASS && j < node->class_.method_count; ++j) {
+            lower_function(&function, node->class_.methods[j]);
+            dump_ir(&function, stdout);
+            free_ir(&function);
+        }
+    }
+}
+
+// Classes exist before any code runs, each with its shape and the function index of every method.
+static void declare_classes(ASTNode* program) {
+    for (int i = 0; i < program->block.count; ++i) {
+        ASTNode* node = program->block.statements[i];
+        if (node->type != AST_NODE_CLASS) continue;
+
+        CString** fields = malloc(sizeof(CString*) * (node->class_.field_count + 1));
+        for (int j = 0; j < node->class_.field_count; ++j) {
+            fields[j] = intern_name(&node->class_.fields[j].name);
+        }
+        int index = add_class(compiler.chunk, intern_name(&node->class_.name), fields, node->class_.field_count);
+        free(fields);
+        for (int j = 0; j < node->class_.method_count; ++j) {
+            ASTNode* method = node->class_.methods[j];
+            add_method(compiler.chunk->classes[index], intern_name(&method->function.name), method->function.index);
+        }
+    }
+}
+
+bool compile(ASTNode* ast, Chunk* chunk, bool echo) {
     compiler.chunk = chunk;
+    compiler.program = ast;
+    compiler.echo = echo;
+    compiler.had_error = false;
+    compiler.constants_full = false;
+    declare_classes(ast);
+
+    if (optimization_level >= 1) {
+        optimize_ast(ast);
+        if (compile_ir(ast)) return !compiler.had_error;
+    }
+    else if (emits_ir) {
+        dump_unoptimized_ir(ast);
+    }
 
     traverse_ast(ast);
 
-    emit_bytes(OP_PRINT, OP_RETURN);
+    emit_byte(OP_RETURN_VOID);
 
-    return true;
+    if (compiler.constants_full) error("too many constants");
+    return !compiler.had_error;
 }
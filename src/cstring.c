@@ -1,15 +1,49 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cstring.h"
+#include "gc.h"
+#include "memory.h"
 
-CString* create_cstring(const char* data) {
-    int len = strlen(data);
-    CString* cstring = malloc(sizeof(CString) + (len + 1) * sizeof(char));
+// Open addressing with linear probing, capacity is a power of two.
+// count includes tombstones, so probe sequences always end at an empty slot.
+typedef struct StringTable {
+    int count;
+    int capacity;
+    CString** entries;
+} StringTable;
+
+static pthread_mutex_t permanent_lock = PTHREAD_MUTEX_INITIALIZER;
+static StringTable permanent = { 0 };
+static _Thread_local StringTable runtime = { 0 };
+
+// permanent strings interned by this thread's compilation, not yet taken by its chunk
+static _Thread_local CString** interned = NULL;
+static _Thread_local int interned_count = 0;
+static _Thread_local int interned_capacity = 0;
+
+// marks a slot whose string was collected, lookups probe past it and inserts reuse it
+static CString tombstone = { 0 };
+#define TOMBSTONE (&tombstone)
+
+static CString* allocate_cstring(int length, uint32_t hash) {
+    CString* cstring = malloc(sizeof(CString) + (length + 1) * sizeof(char));
     if (cstring == NULL) {
         fprintf(stderr, "error: cannot allocate memory for CString\n");
         exit(1);
     }
+    cstring->obj = (Obj){ .next = NULL, .type = OBJ_STRING, .color = COLOR_PERMANENT };
+    cstring->length = length;
+    cstring->hash = hash;
+    cstring->references = 0;
+    cstring->data[length] = '\0';
+    return cstring;
+}
+
+CString* create_cstring(const char* data) {
+    int len = strlen(data);
+    CString* cstring = allocate_cstring(len, hash_string(data, len));
     memcpy(cstring->data, data, len);
     return cstring;
 }
@@ -19,5 +53,200 @@ void free_cstring(CString* cstring) {
 }
 
 bool cstrings_equal(CString* str1, CString* str2) {
-    return str1->length == str2->length && memcmp(str1->data, str2->data, str1->length) == 0;
+    if (str1 == str2) return true;
+    return str1->length == str2->length && str1->hash == str2->hash
+        && memcmp(str1->data, str2->data, str1->length) == 0;
+}
+
+// FNV-1a consumes bytes one at a time, so a hash can be extended with the bytes that follow.
+static uint32_t extend_hash(uint32_t hash, const char* data, int length) {
+    for (int i = 0; i < length; ++i) {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+uint32_t hash_string(const char* data, int length) {
+    return extend_hash(2166136261u, data, length);
+}
+
+// Rehashing also drops tombstones, the table only doubles when live strings fill half of it.
+static void grow_table(StringTable* table) {
+    int live = 0;
+    for (int i = 0; i < table->capacity; ++i) {
+        if (table->entries[i] != NULL && table->entries[i] != TOMBSTONE) ++live;
+    }
+    int capacity = table->capacity;
+    if (live + 1 > capacity * STRING_TABLE_MAX_LOAD / 2) capacity = GROW_CAPACITY(capacity);
+
+    CString** entries = GROW_ARRAY(CString*, NULL, 0, capacity);
+    memset(entries, 0, sizeof(CString*) * capacity);
+    table->count = 0;
+    for (int i = 0; i < table->capacity; ++i) {
+        CString* entry = table->entries[i];
+        if (entry == NULL || entry == TOMBSTONE) continue;
+
+        int index = entry->hash & (capacity - 1);
+        while (entries[index] != NULL) index = (index + 1) & (capacity - 1);
+        entries[index] = entry;
+        ++table->count;
+    }
+    reallocate(table->entries, sizeof(CString*) * table->capacity, 0);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+// Content is given in two pieces so concatenations are looked up before anything is allocated.
+// Returns the existing string or the free slot it belongs in.
+static CString** find_entry(StringTable* table, const char* head, int head_length,
+                            const char* tail, int tail_length, uint32_t hash) {
+    int length = head_length + tail_length;
+    int index = hash & (table->capacity - 1);
+    CString** free_slot = NULL;
+    for (;;) {
+        CString** entry = &table->entries[index];
+        if (*entry == NULL) return free_slot != NULL ? free_slot : entry;
+        if (*entry == TOMBSTONE) {
+            if (free_slot == NULL) free_slot = entry;
+        }
+        else if ((*entry)->hash == hash && (*entry)->length == length
+                 && memcmp((*entry)->data, head, head_length) == 0
+                 && memcmp((*entry)->data + head_length, tail, tail_length) == 0) {
+            return entry;
+        }
+        index = (index + 1) & (table->capacity - 1);
+    }
+}
+
+static bool is_string(CString** entry) {
+    return *entry != NULL && *entry != TOMBSTONE;
+}
+
+static void fill_entry(StringTable* table, CString** entry, CString* cstring,
+                       const char* head, int head_length, const char* tail, int tail_length) {
+    memcpy(cstring->data, head, head_length);
+    memcpy(cstring->data + head_length, tail, tail_length);
+    if (*entry == NULL) ++table->count;
+    *entry = cstring;
+}
+
+static CString* intern_permanent(const char* head, int head_length, const char* tail, int tail_length, uint32_t hash) {
+    pthread_mutex_lock(&permanent_lock);
+    if (permanent.count + 1 > permanent.capacity * STRING_TABLE_MAX_LOAD) grow_table(&permanent);
+
+    CString** entry = find_entry(&permanent, head, head_length, tail, tail_length, hash);
+    if (!is_string(entry)) {
+        CString* cstring = allocate_cstring(head_length + tail_length, hash);
+        fill_entry(&permanent, entry, cstring, head, head_length, tail, tail_length);
+    }
+    CString* result = *entry;
+    ++result->references;
+    pthread_mutex_unlock(&permanent_lock);
+
+    if (interned_capacity < interned_count + 1) {
+        int old_capacity = interned_capacity;
+        interned_capacity = GROW_CAPACITY(old_capacity);
+        interned = GROW_ARRAY(CString*, interned, old_capacity, interned_capacity);
+    }
+    interned[interned_count++] = result;
+    return result;
+}
+
+void take_interned_cstrings(CString*** strings, int* count, int* capacity) {
+    if (interned_count == 0) return;
+    if (*capacity < *count + interned_count) {
+        int old_capacity = *capacity;
+        while (*capacity < *count + interned_count) *capacity = GROW_CAPACITY(*capacity);
+        *strings = GROW_ARRAY(CString*, *strings, old_capacity, *capacity);
+    }
+    memcpy(*strings + *count, interned, sizeof(CString*) * interned_count);
+    *count += interned_count;
+    interned_count = 0;
+}
+
+void release_cstrings(CString** strings, int count) {
+    pthread_mutex_lock(&permanent_lock);
+    for (int i = 0; i < count; ++i) {
+        CString* cstring = strings[i];
+        if (--cstring->references > 0) continue;
+
+        int index = cstring->hash & (permanent.capacity - 1);
+        while (permanent.entries[index] != cstring) index = (index + 1) & (permanent.capacity - 1);
+        permanent.entries[index] = TOMBSTONE;
+        free_cstring(cstring);
+    }
+    pthread_mutex_unlock(&permanent_lock);
+}
+
+static CString* find_runtime(const char* head, int head_length, const char* tail, int tail_length, uint32_t hash) {
+    if (runtime.capacity == 0) return NULL;
+    CString** entry = find_entry(&runtime, head, head_length, tail, tail_length, hash);
+    if (!is_string(entry)) return NULL;
+    revive_object(&(*entry)->obj);
+    return *entry;
+}
+
+static void insert_runtime(CString* cstring) {
+    if (runtime.count + 1 > runtime.capacity * STRING_TABLE_MAX_LOAD) grow_table(&runtime);
+    CString** entry = find_entry(&runtime, cstring->data, cstring->length, "", 0, cstring->hash);
+    if (*entry == NULL) ++runtime.count;
+    *entry = cstring;
+}
+
+static CString* intern_runtime(const char* head, int head_length, const char* tail, int tail_length, uint32_t hash) {
+    CString* existing = find_runtime(head, head_length, tail, tail_length, hash);
+    if (existing != NULL) return existing;
+
+    int length = head_length + tail_length;
+    CString* cstring = allocate_object(sizeof(CString) + length + 1, OBJ_STRING);
+    cstring->length = length;
+    cstring->hash = hash;
+    memcpy(cstring->data, head, head_length);
+    memcpy(cstring->data + head_length, tail, tail_length);
+    cstring->data[length] = '\0';
+    // nursery strings join the table once they survive a minor collection
+    if (cstring->obj.color != COLOR_YOUNG) insert_runtime(cstring);
+    return cstring;
+}
+
+CString* intern_cstring(const char* data, int length) {
+    return intern_permanent(data, length, "", 0, hash_string(data, length));
+}
+
+CString* concat_cstrings(CString* left, CString* right) {
+    if (left->length == 0) return right;
+    if (right->length == 0) return left;
+    uint32_t hash = extend_hash(left->hash, right->data, right->length);
+    return intern_permanent(left->data, left->length, right->data, right->length, hash);
+}
+
+CString* intern_runtime_cstring(const char* data, int length) {
+    return intern_runtime(data, length, "", 0, hash_string(data, length));
+}
+
+CString* concat_runtime_cstrings(CString* left, CString* right) {
+    if (left->length == 0) return right;
+    if (right->length == 0) return left;
+    uint32_t hash = extend_hash(left->hash, right->data, right->length);
+    return intern_runtime(left->data, left->length, right->data, right->length, hash);
+}
+
+CString* tenure_runtime_cstring(CString* young) {
+    CString* existing = find_runtime(young->data, young->length, "", 0, young->hash);
+    if (existing != NULL) return existing;
+
+    CString* cstring = allocate_tenured_object(sizeof(CString) + young->length + 1, OBJ_STRING);
+    cstring->length = young->length;
+    cstring->hash = young->hash;
+    memcpy(cstring->data, young->data, young->length + 1);
+    insert_runtime(cstring);
+    return cstring;
+}
+
+void free_runtime_cstring(CString* cstring) {
+    int index = cstring->hash & (runtime.capacity - 1);
+    while (runtime.entries[index] != cstring) index = (index + 1) & (runtime.capacity - 1);
+    runtime.entries[index] = TOMBSTONE;
+    reallocate(cstring, sizeof(CString) + cstring->length + 1, 0);
 }
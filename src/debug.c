@@ -1,6 +1,8 @@
 #include <stdio.h>
+#include "array.h"
 #include "chunk.h"
 #include "debug.h"
+#include "native.h"
 #include "parser.h"
 #include "value.h"
 #include "vm.h"
@@ -24,6 +26,87 @@ static int push2byte_instruction(const char* name, Chunk* chunk, int offset) {
     return offset + 3;
 }
 
+static int byte_instruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t operand = chunk->code[offset + 1];
+    printf("%-8s %d\n", name, operand);
+    return offset + 2;
+}
+
+static int jump_instruction(const char* name, Chunk* chunk, int offset) {
+    int16_t jump = (int16_t)(chunk->code[offset + 1] << 8 | chunk->code[offset + 2]);
+    printf("%-8s %d -> %04d\n", name, jump, offset + 3 + jump);
+    return offset + 3;
+}
+
+static int loop_instruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t jump = chunk->code[offset + 1];
+    printf("%-8s %d -> %04d\n", name, jump, offset + 2 - jump);
+    return offset + 2;
+}
+
+static int slots_instruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-8s %d %d\n", name, chunk->code[offset + 1], chunk->code[offset + 2]);
+    return offset + 3;
+}
+
+static int call_instruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t index = chunk->code[offset + 1];
+    Function* function = &chunk->functions[index];
+    printf("%-8s %d '%.*s'\n", name, index, function->length, function->name);
+    return offset + 2;
+}
+
+static int native_instruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t index = chunk->code[offset + 1];
+    printf("%-8s %d '%s'\n", name, index, native_function(index)->name);
+    return offset + 2;
+}
+
+static int new_instruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t index = chunk->code[offset + 1];
+    CString* class_name = chunk->classes[index]->name;
+    printf("%-8s %d '%.*s'\n", name, index, class_name->length, class_name->data);
+    return offset + 2;
+}
+
+// Shows the cache index and the name it looks up, INVOKE also its argument count.
+static int cached_instruction(const char* name, Chunk* chunk, int offset) {
+    int index = chunk->code[offset + 1] << 8 | chunk->code[offset + 2];
+    CString* member = chunk->caches[index].name;
+    if (chunk->code[offset] != OP_INVOKE) {
+        printf("%-8s %d '%.*s'\n", name, index, member->length, member->data);
+        return offset + 3;
+    }
+    printf("%-8s %d '%.*s' (%d args)\n", name, index, member->length, member->data, chunk->code[offset + 3]);
+    return offset + 4;
+}
+
+static const char* element_name(uint8_t type) {
+    switch (type) {
+        case VALUE_BOOL:  return "bool";
+        case VALUE_INT:   return "int";
+        case VALUE_FLOAT: return "float";
+        case VALUE_STRING: return "string";
+        default:          return "?";
+    }
+}
+
+static int newarray_instruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-8s %s\n", name, element_name(chunk->code[offset + 1]));
+    return offset + 2;
+}
+
+static int array_instruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-8s %s %d\n", name, element_name(chunk->code[offset + 1]), chunk->code[offset + 2]);
+    return offset + 3;
+}
+
+static int builtin_instruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t builtin = chunk->code[offset + 1];
+    printf("%-8s %d '%s'\n", name, builtin, array_builtin_name(builtin));
+    return offset + 2;
+}
+
 static int const_instruction(const char* name, Chunk* chunk, int offset) {
     uint8_t index = chunk->code[offset + 1];
     printf("%-8s %d '", name, index);
@@ -32,6 +115,19 @@ static int const_instruction(const char* name, Chunk* chunk, int offset) {
     return offset + 2;
 }
 
+static int wide_const_instruction(const char* name, Chunk* chunk, int offset) {
+    int index = chunk->code[offset + 1] << 8 | chunk->code[offset + 2];
+    printf("%-8s %d '", name, index);
+    print_value(chunk->constant_pool.values[index]);
+    printf("'\n");
+    return offset + 3;
+}
+
+static int wide_instruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-8s %d\n", name, chunk->code[offset + 1] << 8 | chunk->code[offset + 2]);
+    return offset + 3;
+}
+
 static int disassemble_instruction(Chunk* chunk, int offset) {
     printf("%04d ", offset);
     if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {
@@ -52,6 +148,16 @@ static int disassemble_instruction(Chunk* chunk, int offset) {
         case OP_BIPUSH: return push1byte_instruction("bipush", chunk, offset);
         case OP_SIPUSH: return push2byte_instruction("sipush", chunk, offset);
         case OP_LOADC:  return const_instruction("loadc", chunk, offset);
+        case OP_LOADC_W: return wide_const_instruction("loadc_w", chunk, offset);
+        case OP_POP:    return simple_instruction("pop", offset);
+        case OP_POPN:   return byte_instruction("popn", chunk, offset);
+        case OP_RESERVE: return byte_instruction("reserve", chunk, offset);
+        case OP_LOAD:   return byte_instruction("load", chunk, offset);
+        case OP_STORE:  return byte_instruction("store", chunk, offset);
+        case OP_GLOAD:  return byte_instruction("gload", chunk, offset);
+        case OP_GSTORE: return byte_instruction("gstore", chunk, offset);
+        case OP_GLOAD_W: return wide_instruction("gload_w", chunk, offset);
+        case OP_GSTORE_W: return wide_instruction("gstore_w", chunk, offset);
         case OP_IADD:   return simple_instruction("iadd", offset);
         case OP_FADD:   return simple_instruction("fadd", offset);
         case OP_ISUB:   return simple_instruction("isub", offset);
@@ -62,11 +168,107 @@ static int disassemble_instruction(Chunk* chunk, int offset) {
         case OP_FDIV:   return simple_instruction("fdiv", offset);
         case OP_INEG:   return simple_instruction("ineg", offset);
         case OP_FNEG:   return simple_instruction("fneg", offset);
+        case OP_ISHL:   return byte_instruction("ishl", chunk, offset);
+        case OP_IDIV_MAGIC: return byte_instruction("idiv_magic", chunk, offset);
+        case OP_FSQRT:  return simple_instruction("fsqrt", offset);
+        case OP_IABS:   return simple_instruction("iabs", offset);
+        case OP_FABS:   return simple_instruction("fabs", offset);
+        case OP_IMIN:   return simple_instruction("imin", offset);
+        case OP_FMIN:   return simple_instruction("fmin", offset);
+        case OP_IMAX:   return simple_instruction("imax", offset);
+        case OP_FMAX:   return simple_instruction("fmax", offset);
+        case OP_FFLOOR: return simple_instruction("ffloor", offset);
+        case OP_FFMA:   return simple_instruction("ffma", offset);
+        case OP_FSIN:   return simple_instruction("fsin", offset);
+        case OP_FCOS:   return simple_instruction("fcos", offset);
+        case OP_FTAN:   return simple_instruction("ftan", offset);
+        case OP_SCONCAT: return simple_instruction("sconcat", offset);
         case OP_TRUE:   return simple_instruction("true", offset);
         case OP_FALSE:  return simple_instruction("false", offset);
         case OP_NOT:    return simple_instruction("not", offset);
+        case OP_IEQ:    return simple_instruction("ieq", offset);
+        case OP_INE:    return simple_instruction("ine", offset);
+        case OP_ILT:    return simple_instruction("ilt", offset);
+        case OP_ILE:    return simple_instruction("ile", offset);
+        case OP_IGT:    return simple_instruction("igt", offset);
+        case OP_IGE:    return simple_instruction("ige", offset);
+        case OP_FEQ:    return simple_instruction("feq", offset);
+        case OP_FNE:    return simple_instruction("fne", offset);
+        case OP_FLT:    return simple_instruction("flt", offset);
+        case OP_FLE:    return simple_instruction("fle", offset);
+        case OP_FGT:    return simple_instruction("fgt", offset);
+        case OP_FGE:    return simple_instruction("fge", offset);
+        case OP_BEQ:    return simple_instruction("beq", offset);
+        case OP_BNE:    return simple_instruction("bne", offset);
+        case OP_SEQ:    return simple_instruction("seq", offset);
+        case OP_SNE:    return simple_instruction("sne", offset);
+        case OP_NEWARRAY: return newarray_instruction("newarray", chunk, offset);
+        case OP_ARRAY:  return array_instruction("array", chunk, offset);
+        case OP_BALOAD: return simple_instruction("baload", offset);
+        case OP_IALOAD: return simple_instruction("iaload", offset);
+        case OP_FALOAD: return simple_instruction("faload", offset);
+        case OP_BASTORE: return simple_instruction("bastore", offset);
+        case OP_IASTORE: return simple_instruction("iastore", offset);
+        case OP_FASTORE: return simple_instruction("fastore", offset);
+        case OP_BALOAD_UNCHECKED: return slots_instruction("ubaload", chunk, offset);
+        case OP_IALOAD_UNCHECKED: return slots_instruction("uiaload", chunk, offset);
+        case OP_FALOAD_UNCHECKED: return slots_instruction("ufaload", chunk, offset);
+        case OP_BASTORE_UNCHECKED: return slots_instruction("ubastore", chunk, offset);
+        case OP_IASTORE_UNCHECKED: return slots_instruction("uiastore", chunk, offset);
+        case OP_FASTORE_UNCHECKED: return slots_instruction("ufastore", chunk, offset);
+        case OP_GUARD_LENGTH: return simple_instruction("guardlen", offset);
+        case OP_BUILTIN: return builtin_instruction("builtin", chunk, offset);
+        case OP_NEW:    return new_instruction("new", chunk, offset);
+        case OP_GET_FIELD: return cached_instruction("getfield", chunk, offset);
+        case OP_SET_FIELD: return cached_instruction("setfield", chunk, offset);
+        case OP_INVOKE: return cached_instruction("invoke", chunk, offset);
+        case OP_MAP:    return array_instruction("map", chunk, offset);
+        case OP_MAP_GET: return simple_instruction("mapget", offset);
+        case OP_MAP_SET: return simple_instruction("mapset", offset);
+        case OP_JUMP:   return jump_instruction("jump", chunk, offset);
+        case OP_JUMP_IF_FALSE: return jump_instruction("jfalse", chunk, offset);
+        case OP_JUMP_IF_TRUE:  return jump_instruction("jtrue", chunk, offset);
+        case OP_IJEQ:   return jump_instruction("ijeq", chunk, offset);
+        case OP_IJNE:   return jump_instruction("ijne", chunk, offset);
+        case OP_IJLT:   return jump_instruction("ijlt", chunk, offset);
+        case OP_IJLE:   return jump_instruction("ijle", chunk, offset);
+        case OP_IJGT:   return jump_instruction("ijgt", chunk, offset);
+        case OP_IJGE:   return jump_instruction("ijge", chunk, offset);
+        case OP_FJEQ:   return jump_instruction("fjeq", chunk, offset);
+        case OP_FJNE:   return jump_instruction("fjne", chunk, offset);
+        case OP_FJLT:   return jump_instruction("fjlt", chunk, offset);
+        case OP_FJLE:   return jump_instruction("fjle", chunk, offset);
+        case OP_FJGT:   return jump_instruction("fjgt", chunk, offset);
+        case OP_FJGE:   return jump_instruction("fjge", chunk, offset);
+        case OP_FJNLT:  return jump_instruction("fjnlt", chunk, offset);
+        case OP_FJNLE:  return jump_instruction("fjnle", chunk, offset);
+        case OP_FJNGT:  return jump_instruction("fjngt", chunk, offset);
+        case OP_FJNGE:  return jump_instruction("fjnge", chunk, offset);
+        case OP_LOOP:   return loop_instruction("loop", chunk, offset);
+        case OP_LOOP_TRUE: return loop_instruction("ltrue", chunk, offset);
+        case OP_LOOP_IEQ:  return loop_instruction("lieq", chunk, offset);
+        case OP_LOOP_INE:  return loop_instruction("line", chunk, offset);
+        case OP_LOOP_ILT:  return loop_instruction("lilt", chunk, offset);
+        case OP_LOOP_ILE:  return loop_instruction("lile", chunk, offset);
+        case OP_LOOP_IGT:  return loop_instruction("ligt", chunk, offset);
+        case OP_LOOP_IGE:  return loop_instruction("lige", chunk, offset);
+        case OP_LOOP_FEQ:  return loop_instruction("lfeq", chunk, offset);
+        case OP_LOOP_FNE:  return loop_instruction("lfne", chunk, offset);
+        case OP_LOOP_FLT:  return loop_instruction("lflt", chunk, offset);
+        case OP_LOOP_FLE:  return loop_instruction("lfle", chunk, offset);
+        case OP_LOOP_FGT:  return loop_instruction("lfgt", chunk, offset);
+        case OP_LOOP_FGE:  return loop_instruction("lfge", chunk, offset);
         case OP_PRINT:  return simple_instruction("print", offset);
+        case OP_CALL:   return call_instruction("call", chunk, offset);
+        case OP_TAIL_CALL: return call_instruction("tcall", chunk, offset);
+        case OP_MEMO:   return call_instruction("memo", chunk, offset);
+        case OP_GENERATOR: return newarray_instruction("gen", chunk, offset);
+        case OP_RESUME: return simple_instruction("resume", offset);
+        case OP_YIELD:  return simple_instruction("yield", offset);
+        case OP_FINISH: return simple_instruction("finish", offset);
+        case OP_CALL_NATIVE: return native_instruction("ncall", chunk, offset);
         case OP_RETURN: return simple_instruction("return", offset);
+        case OP_RETURN_VOID: return simple_instruction("vreturn", offset);
         default: {
             printf("debug::disassemble_instruction: unknown opcode: %d\n", instruction);
             return offset + 1;
@@ -99,6 +301,7 @@ void print_tokens(TokenArray* token_array) {
 }
 
 void print_ast(ASTNode* root, int indent) {
+    if (root == NULL) return;
     for (int i = 0; i < indent; ++i) printf("  ");
 
     switch (root->type) {
@@ -122,11 +325,138 @@ void print_ast(ASTNode* root, int indent) {
                 case VALUE_BOOL: value_type = "bool"; break;
                 case VALUE_INT: value_type = "int"; break;
                 case VALUE_FLOAT: value_type = "float"; break;
+                case VALUE_STRING: value_type = "string"; break;
                 default: break;
             }
             printf("Cast: %s\n", value_type);
             print_ast(root->cast.expression, indent + 1);
         } break;
+        case AST_NODE_VARIABLE: {
+            printf("Variable: %.*s\n", root->variable.name.length, root->variable.name.start);
+        } break;
+        case AST_NODE_ASSIGNMENT: {
+            printf("Assignment: %.*s\n", root->assignment.name.length, root->assignment.name.start);
+            print_ast(root->assignment.value, indent + 1);
+        } break;
+        case AST_NODE_VAR_DECL: {
+            printf(
+                "%s: %.*s\n",
+                root->var_decl.is_const ? "ConstDecl" : "VarDecl",
+                root->var_decl.name.length,
+                root->var_decl.name.start
+            );
+            if (root->var_decl.initializer != NULL) print_ast(root->var_decl.initializer, indent + 1);
+        } break;
+        case AST_NODE_PRINT: {
+            printf("Print\n");
+            print_ast(root->print.expression, indent + 1);
+        } break;
+        case AST_NODE_EXPRESSION_STATEMENT: {
+            printf("ExpressionStatement\n");
+            print_ast(root->expression_statement.expression, indent + 1);
+        } break;
+        case AST_NODE_BLOCK: {
+            printf("Block\n");
+            for (int i = 0; i < root->block.count; ++i) {
+                print_ast(root->block.statements[i], indent + 1);
+            }
+        } break;
+        case AST_NODE_IF: {
+            printf("If\n");
+            print_ast(root->if_.condition, indent + 1);
+            print_ast(root->if_.then_branch, indent + 1);
+            print_ast(root->if_.else_branch, indent + 1);
+        } break;
+        case AST_NODE_WHILE: {
+            printf("While\n");
+            print_ast(root->while_.condition, indent + 1);
+            print_ast(root->while_.body, indent + 1);
+        } break;
+        case AST_NODE_FOR: {
+            printf("For\n");
+            print_ast(root->for_.initializer, indent + 1);
+            print_ast(root->for_.condition, indent + 1);
+            print_ast(root->for_.increment, indent + 1);
+            print_ast(root->for_.body, indent + 1);
+        } break;
+        case AST_NODE_FUNCTION: {
+            const char* hints[] = { "", "inline ", "noinline " };
+            printf("Function: %s%s%.*s(", root->function.is_pure ? "pure " : "", hints[root->function.hint],
+                   root->function.name.length, root->function.name.start);
+            for (int i = 0; i < root->function.arity; ++i) {
+                Parameter* param = &root->function.params[i];
+                printf("%s%.*s", i > 0 ? ", " : "", param->name.length, param->name.start);
+            }
+            printf(")\n");
+            print_ast(root->function.body, indent + 1);
+        } break;
+        case AST_NODE_CLASS: {
+            printf("Class: %.*s(", root->class_.name.length, root->class_.name.start);
+            for (int i = 0; i < root->class_.field_count; ++i) {
+                Parameter* field = &root->class_.fields[i];
+                printf("%s%.*s", i > 0 ? ", " : "", field->name.length, field->name.start);
+            }
+            printf(")\n");
+            for (int i = 0; i < root->class_.method_count; ++i) {
+                print_ast(root->class_.methods[i], indent + 1);
+            }
+        } break;
+        case AST_NODE_GET_FIELD: {
+            printf("GetField: %.*s\n", root->get_field.name.length, root->get_field.name.start);
+            print_ast(root->get_field.object, indent + 1);
+        } break;
+        case AST_NODE_SET_FIELD: {
+            printf("SetField: %.*s\n", root->set_field.name.length, root->set_field.name.start);
+            print_ast(root->set_field.object, indent + 1);
+            print_ast(root->set_field.value, indent + 1);
+        } break;
+        case AST_NODE_INVOKE: {
+            printf("Invoke: %.*s\n", root->invoke.name.length, root->invoke.name.start);
+            print_ast(root->invoke.object, indent + 1);
+            for (int i = 0; i < root->invoke.count; ++i) {
+                print_ast(root->invoke.arguments[i], indent + 1);
+            }
+        } break;
+        case AST_NODE_CALL: {
+            printf("%s: %.*s\n", root->call.is_tail ? "TailCall" : "Call", root->call.name.length, root->call.name.start);
+            for (int i = 0; i < root->call.count; ++i) {
+                print_ast(root->call.arguments[i], indent + 1);
+            }
+        } break;
+        case AST_NODE_RETURN: {
+            printf("Return\n");
+            print_ast(root->return_.value, indent + 1);
+        } break;
+        case AST_NODE_YIELD: {
+            printf("Yield\n");
+            print_ast(root->yield_.value, indent + 1);
+        } break;
+        case AST_NODE_ARRAY: {
+            if (root->array.length != NULL) printf("NewArray: %s\n", element_name(root->array.element_type));
+            else printf("ArrayLiteral\n");
+            print_ast(root->array.length, indent + 1);
+            for (int i = 0; i < root->array.count; ++i) {
+                print_ast(root->array.elements[i], indent + 1);
+            }
+        } break;
+        case AST_NODE_MAP: {
+            printf("MapLiteral: %s\n", element_name(root->map.value_type));
+            for (int i = 0; i < root->map.count; ++i) {
+                print_ast(root->map.keys[i], indent + 1);
+                print_ast(root->map.values[i], indent + 1);
+            }
+        } break;
+        case AST_NODE_SUBSCRIPT: {
+            printf("Subscript\n");
+            print_ast(root->subscript.array, indent + 1);
+            print_ast(root->subscript.index, indent + 1);
+        } break;
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            printf("SubscriptAssignment\n");
+            print_ast(root->subscript_assignment.array, indent + 1);
+            print_ast(root->subscript_assignment.index, indent + 1);
+            print_ast(root->subscript_assignment.value, indent + 1);
+        } break;
         default: {
             printf("Unknown: %d\n", root->type);
         } break;
@@ -134,7 +464,10 @@ void print_ast(ASTNode* root, int indent) {
 }
 
 void disassemble_chunk(Chunk* chunk) {
-    int offset = 0;
+    disassemble_chunk_from(chunk, 0);
+}
+
+void disassemble_chunk_from(Chunk* chunk, int offset) {
     while (offset < chunk->count) {
         offset = disassemble_instruction(chunk, offset);
     }
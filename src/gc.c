@@ -0,0 +1,489 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "array.h"
+#include "class.h"
+#include "cstring.h"
+#include "gc.h"
+#include "generator.h"
+#include "map.h"
+#include "memory.h"
+#include "object.h"
+#include "rope.h"
+#include "value.h"
+
+typedef enum GCPhase {
+    GC_IDLE,
+    GC_MARK,
+    GC_SWEEP,
+} GCPhase;
+
+typedef struct GCStats {
+    bool enabled;
+    uint64_t cycles;
+    uint64_t minor_collections;
+    uint64_t young_bytes;
+    uint64_t promoted_objects;
+    uint64_t promoted_bytes;
+    uint64_t steps;
+    uint64_t freed_objects;
+    uint64_t freed_bytes;
+    uint64_t total_pause_ns;
+    uint64_t max_pause_ns;
+    uint64_t pauses[GC_PAUSE_BUCKETS];
+} GCStats;
+
+// New objects are bump-allocated here. A minor collection copies the survivors out to the old
+// space and rewinds top, the dead ones are never visited.
+typedef struct Nursery {
+    uint8_t* start;
+    uint8_t* top;
+    uint8_t* end;
+} Nursery;
+
+// The old space is collected incrementally tri-color: marking blackens objects a few at a time
+// through the gray worklist, then the roots are rescanned at once since stack and global stores
+// have no barrier, then the sweep frees the previous white a few objects at a time.
+// Marking only ever sees old objects, the nursery is emptied when a cycle starts and again before
+// the final rescan.
+typedef struct Heap {
+    Nursery nursery;
+    bool nursery_full;
+    // old objects holding young references, the extra roots of a minor collection
+    int remembered_count;
+    int remembered_capacity;
+    Obj** remembered;
+    // copied ropes and instances whose own references still point into the nursery
+    int promoted_count;
+    int promoted_capacity;
+    Obj** promoted;
+
+    Obj* objects;
+    GCPhase phase;
+    uint8_t white;
+    size_t threshold;
+
+    int gray_count;
+    int gray_capacity;
+    Obj** gray;
+
+    Obj** sweeping;
+
+    Value* stack;
+    Value** stack_top;
+    Value* globals;
+    int global_count;
+
+    GCStats stats;
+} Heap;
+
+static bool nursery_enabled = true;
+static _Thread_local Heap heap = { .white = COLOR_WHITE_A, .threshold = GC_INITIAL_THRESHOLD };
+
+static uint8_t other_white(uint8_t white) {
+    return white == COLOR_WHITE_A ? COLOR_WHITE_B : COLOR_WHITE_A;
+}
+
+void set_gc_roots(Value* stack, Value** stack_top, Value* globals, int global_count) {
+    heap.stack = stack;
+    heap.stack_top = stack_top;
+    heap.globals = globals;
+    heap.global_count = global_count;
+}
+
+static void push_object(Obj*** objects, int* count, int* capacity, Obj* object) {
+    if (*capacity < *count + 1) {
+        int old_capacity = *capacity;
+        *capacity = GROW_CAPACITY(old_capacity);
+        *objects = GROW_ARRAY(Obj*, *objects, old_capacity, *capacity);
+    }
+    (*objects)[(*count)++] = object;
+}
+
+static bool is_young(Value value) {
+    if (IS_STRING(value)) return AS_STRING(value)->obj.color == COLOR_YOUNG;
+    if (IS_ROPE(value)) return AS_ROPE(value)->obj.color == COLOR_YOUNG;
+    if (IS_ARRAY(value)) return AS_ARRAY(value)->obj.color == COLOR_YOUNG;
+    if (IS_OBJECT(value)) return AS_INSTANCE(value)->obj.color == COLOR_YOUNG;
+    return false;
+}
+
+void mark_object(Obj* object) {
+    // young objects are promoted before marking ends and marked then
+    if (object == NULL || object->color != heap.white) return;
+    object->color = COLOR_BLACK;
+    // strings and arrays hold no references, only ropes, instances, maps and generators have to be traced
+    if (object->type == OBJ_STRING || object->type == OBJ_ARRAY) return;
+    push_object(&heap.gray, &heap.gray_count, &heap.gray_capacity, object);
+}
+
+void mark_value(Value value) {
+    if (IS_STRING(value)) mark_object(&AS_STRING(value)->obj);
+    else if (IS_ROPE(value)) mark_object(&AS_ROPE(value)->obj);
+    else if (IS_ARRAY(value)) mark_object(&AS_ARRAY(value)->obj);
+    else if (IS_OBJECT(value)) mark_object(&AS_INSTANCE(value)->obj);
+    else if (IS_MAP(value)) mark_object(&AS_MAP(value)->obj);
+    else if (IS_GENERATOR(value)) mark_object(&AS_GENERATOR(value)->obj);
+}
+
+void write_barrier(Obj* parent, Value child) {
+    // young parents are scanned in full by every minor collection
+    if (parent->color == COLOR_YOUNG) return;
+    if (!parent->remembered && is_young(child)) {
+        parent->remembered = true;
+        push_object(&heap.remembered, &heap.remembered_count, &heap.remembered_capacity, parent);
+    }
+    if (heap.phase == GC_MARK && parent->color == COLOR_BLACK) mark_value(child);
+}
+
+void revive_object(Obj* object) {
+    if (heap.phase == GC_MARK) mark_object(object);
+    else if (heap.phase == GC_SWEEP && object->color == other_white(heap.white)) object->color = heap.white;
+}
+
+// A map is traced in one step however large it is.
+static void trace_map(Map* map) {
+    bool strings = map->value_type == VALUE_STRING;
+    for (int i = next_map_slot(map, 0); i != -1; i = next_map_slot(map, i + 1)) {
+        mark_object(&map->slots[i].key->obj);
+        if (strings) mark_object(&map->slots[i].as.string_->obj);
+    }
+}
+
+static void trace_object(Obj* object) {
+    if (object->type == OBJ_MAP) {
+        trace_map((Map*)object);
+        return;
+    }
+    if (object->type == OBJ_GENERATOR) {
+        Generator* generator = (Generator*)object;
+        mark_value(generator->value);
+        for (int i = 0; i < generator->count; ++i) {
+            mark_value(generator->slots[i]);
+        }
+        return;
+    }
+    if (object->type == OBJ_INSTANCE) {
+        Instance* instance = (Instance*)object;
+        for (int i = 0; i < instance->field_count; ++i) {
+            mark_value(instance->fields[i]);
+        }
+        return;
+    }
+    Rope* rope = (Rope*)object;
+    mark_value(rope->left);
+    mark_value(rope->right);
+    if (rope->flat != NULL) mark_object(&rope->flat->obj);
+}
+
+static void mark_roots() {
+    if (heap.stack == NULL) return;
+    for (Value* slot = heap.stack; slot < *heap.stack_top; ++slot) {
+        mark_value(*slot);
+    }
+    for (int i = 0; i < heap.global_count; ++i) {
+        mark_value(heap.globals[i]);
+    }
+}
+
+// Returns where a nursery object lives after the minor collection, copying it out on first sight.
+// Young strings collapse into an old string with the same content when one exists.
+static Obj* evacuate(Obj* object) {
+    if (object->color == COLOR_FORWARDED) return object->next;
+    if (object->color != COLOR_YOUNG) return object;
+
+    Obj* tenured;
+    if (object->type == OBJ_STRING) {
+        CString* string = (CString*)object;
+        tenured = &tenure_runtime_cstring(string)->obj;
+        heap.stats.promoted_bytes += sizeof(CString) + string->length + 1;
+    }
+    else if (object->type == OBJ_ARRAY) {
+        Array* array = (Array*)object;
+        size_t size = array_size(array->element_type, array->length);
+        tenured = allocate_tenured_object(size, OBJ_ARRAY);
+        memcpy(tenured + 1, object + 1, size - sizeof(Obj));
+        heap.stats.promoted_bytes += size;
+    }
+    else if (object->type == OBJ_INSTANCE) {
+        size_t size = instance_size(((Instance*)object)->field_count);
+        tenured = allocate_tenured_object(size, OBJ_INSTANCE);
+        memcpy(tenured + 1, object + 1, size - sizeof(Obj));
+        push_object(&heap.promoted, &heap.promoted_count, &heap.promoted_capacity, tenured);
+        heap.stats.promoted_bytes += size;
+    }
+    else {
+        tenured = allocate_tenured_object(sizeof(Rope), OBJ_ROPE);
+        memcpy(tenured + 1, object + 1, sizeof(Rope) - sizeof(Obj));
+        push_object(&heap.promoted, &heap.promoted_count, &heap.promoted_capacity, tenured);
+        heap.stats.promoted_bytes += sizeof(Rope);
+    }
+    ++heap.stats.promoted_objects;
+    object->color = COLOR_FORWARDED;
+    object->next = tenured;
+    return tenured;
+}
+
+static void evacuate_value(Value* slot) {
+    if (IS_STRING(*slot)) *slot = STRING_VALUE((CString*)evacuate(&AS_STRING(*slot)->obj));
+    else if (IS_ROPE(*slot)) *slot = ROPE_VALUE((Rope*)evacuate(&AS_ROPE(*slot)->obj));
+    else if (IS_ARRAY(*slot)) *slot = ARRAY_VALUE((Array*)evacuate(&AS_ARRAY(*slot)->obj));
+    else if (IS_OBJECT(*slot)) *slot = OBJECT_VALUE((Instance*)evacuate(&AS_INSTANCE(*slot)->obj));
+}
+
+// The barrier marks what an old rope now points to while marking runs, promotion is a store like any other.
+static void evacuate_rope(Rope* rope) {
+    evacuate_value(&rope->left);
+    evacuate_value(&rope->right);
+    write_barrier(&rope->obj, rope->left);
+    write_barrier(&rope->obj, rope->right);
+    if (rope->flat != NULL) {
+        rope->flat = (CString*)evacuate(&rope->flat->obj);
+        write_barrier(&rope->obj, STRING_VALUE(rope->flat));
+    }
+}
+
+static void evacuate_references(Obj* object) {
+    if (object->type == OBJ_ROPE) {
+        evacuate_rope((Rope*)object);
+        return;
+    }
+    if (object->type == OBJ_GENERATOR) {
+        Generator* generator = (Generator*)object;
+        evacuate_value(&generator->value);
+        write_barrier(&generator->obj, generator->value);
+        for (int i = 0; i < generator->count; ++i) {
+            evacuate_value(&generator->slots[i]);
+            write_barrier(&generator->obj, generator->slots[i]);
+        }
+        return;
+    }
+    Instance* instance = (Instance*)object;
+    for (int i = 0; i < instance->field_count; ++i) {
+        evacuate_value(&instance->fields[i]);
+        write_barrier(&instance->obj, instance->fields[i]);
+    }
+}
+
+// Promotes everything reachable from the roots and the remembered set, then rewinds the nursery.
+static void collect_nursery() {
+    heap.nursery_full = false;
+    if (heap.nursery.top == heap.nursery.start) return;
+    ++heap.stats.minor_collections;
+
+    if (heap.stack != NULL) {
+        for (Value* slot = heap.stack; slot < *heap.stack_top; ++slot) {
+            evacuate_value(slot);
+        }
+        for (int i = 0; i < heap.global_count; ++i) {
+            evacuate_value(&heap.globals[i]);
+        }
+    }
+    // only ropes, instances and generators hold references that can be young, so only they get remembered
+    for (int i = 0; i < heap.remembered_count; ++i) {
+        heap.remembered[i]->remembered = false;
+        evacuate_references(heap.remembered[i]);
+    }
+    heap.remembered_count = 0;
+    while (heap.promoted_count > 0) {
+        evacuate_references(heap.promoted[--heap.promoted_count]);
+    }
+
+    heap.stats.young_bytes += heap.nursery.top - heap.nursery.start;
+    heap.nursery.top = heap.nursery.start;
+}
+
+static void drain_gray(int budget) {
+    while (heap.gray_count > 0 && budget-- > 0) {
+        trace_object(heap.gray[--heap.gray_count]);
+    }
+}
+
+static void free_object(Obj* object) {
+    switch (object->type) {
+        case OBJ_STRING: {
+            CString* string = (CString*)object;
+            heap.stats.freed_bytes += sizeof(CString) + string->length + 1;
+            free_runtime_cstring(string);
+        } break;
+        case OBJ_ROPE: {
+            heap.stats.freed_bytes += sizeof(Rope);
+            reallocate(object, sizeof(Rope), 0);
+        } break;
+        case OBJ_ARRAY: {
+            Array* array = (Array*)object;
+            size_t size = array_size(array->element_type, array->length);
+            heap.stats.freed_bytes += size;
+            reallocate(object, size, 0);
+        } break;
+        case OBJ_INSTANCE: {
+            size_t size = instance_size(((Instance*)object)->field_count);
+            heap.stats.freed_bytes += size;
+            reallocate(object, size, 0);
+        } break;
+        case OBJ_MAP: {
+            heap.stats.freed_bytes += map_size((Map*)object);
+            free_map((Map*)object);
+        } break;
+        case OBJ_GENERATOR: {
+            heap.stats.freed_bytes += generator_size((Generator*)object);
+            free_generator((Generator*)object);
+        } break;
+        default: break;
+    }
+    ++heap.stats.freed_objects;
+}
+
+static void finish_marking() {
+    collect_nursery();
+    mark_roots();
+    drain_gray(INT32_MAX);
+
+    heap.white = other_white(heap.white);
+    heap.phase = GC_SWEEP;
+    heap.sweeping = &heap.objects;
+}
+
+static void sweep(int budget) {
+    uint8_t dead = other_white(heap.white);
+    while (*heap.sweeping != NULL && budget-- > 0) {
+        Obj* object = *heap.sweeping;
+        if (object->color == dead) {
+            *heap.sweeping = object->next;
+            free_object(object);
+        }
+        else {
+            object->color = heap.white;
+            heap.sweeping = &object->next;
+        }
+    }
+    if (*heap.sweeping != NULL) return;
+
+    heap.phase = GC_IDLE;
+    size_t threshold = allocated_bytes() * GC_HEAP_GROW_FACTOR;
+    heap.threshold = threshold > GC_INITIAL_THRESHOLD ? threshold : GC_INITIAL_THRESHOLD;
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void record_pause(uint64_t pause_ns) {
+    GCStats* stats = &heap.stats;
+    ++stats->steps;
+    stats->total_pause_ns += pause_ns;
+    if (pause_ns > stats->max_pause_ns) stats->max_pause_ns = pause_ns;
+
+    int bucket = 0;
+    for (uint64_t limit = 1000; pause_ns >= limit && bucket < GC_PAUSE_BUCKETS - 1; limit *= 2) ++bucket;
+    ++stats->pauses[bucket];
+}
+
+static void collect_step() {
+    switch (heap.phase) {
+        case GC_IDLE: {
+            ++heap.stats.cycles;
+            collect_nursery();
+            heap.phase = GC_MARK;
+            mark_roots();
+        } break;
+        case GC_MARK: {
+            drain_gray(GC_STEP_WORK);
+            if (heap.gray_count == 0) finish_marking();
+        } break;
+        case GC_SWEEP: {
+            sweep(GC_STEP_WORK);
+        } break;
+    }
+}
+
+void gc_settle() {
+    collect_nursery();
+    if (heap.phase == GC_MARK) finish_marking();
+}
+
+void gc_safepoint() {
+    bool major = heap.phase != GC_IDLE || allocated_bytes() > heap.threshold;
+    if (!heap.nursery_full && !major) return;
+    uint64_t start = heap.stats.enabled ? now_ns() : 0;
+
+    if (heap.nursery_full) collect_nursery();
+    if (major) collect_step();
+
+    if (heap.stats.enabled) record_pause(now_ns() - start);
+}
+
+void* allocate_tenured_object(size_t size, ObjType type) {
+    Obj* object = reallocate(NULL, 0, size);
+    object->type = type;
+    // objects born during marking are never traced, their references go through write_barrier
+    object->color = heap.phase == GC_MARK ? COLOR_BLACK : heap.white;
+    object->remembered = false;
+    object->next = heap.objects;
+    heap.objects = object;
+    return object;
+}
+
+void* allocate_object(size_t size, ObjType type) {
+    size_t aligned = (size + 7) & ~(size_t)7;
+    if (!nursery_enabled || aligned > GC_NURSERY_MAX_OBJECT) return allocate_tenured_object(size, type);
+
+    Nursery* nursery = &heap.nursery;
+    if (nursery->start == NULL) {
+        nursery->start = reallocate(NULL, 0, GC_NURSERY_SIZE);
+        nursery->top = nursery->start;
+        nursery->end = nursery->start + GC_NURSERY_SIZE;
+    }
+    // a full nursery waits for the next safepoint, until then objects go to the old space
+    if (nursery->top + aligned > nursery->end) {
+        heap.nursery_full = true;
+        return allocate_tenured_object(size, type);
+    }
+
+    Obj* object = (Obj*)nursery->top;
+    nursery->top += aligned;
+    object->type = type;
+    object->color = COLOR_YOUNG;
+    object->remembered = false;
+    object->next = NULL;
+    return object;
+}
+
+void set_gc_nursery(bool enabled) {
+    nursery_enabled = enabled;
+}
+
+void set_gc_stats(bool enabled) {
+    heap.stats.enabled = enabled;
+}
+
+void print_gc_stats(FILE* file) {
+    GCStats* stats = &heap.stats;
+    fprintf(
+        file,
+        "gc: %llu cycles, %llu steps, %llu objects (%.1f MB) freed, pauses %.3f ms total, %.1f us max\n",
+        (unsigned long long)stats->cycles,
+        (unsigned long long)stats->steps,
+        (unsigned long long)stats->freed_objects,
+        stats->freed_bytes / (1024.0 * 1024.0),
+        stats->total_pause_ns / 1e6,
+        stats->max_pause_ns / 1e3
+    );
+    fprintf(
+        file,
+        "gc: %llu minor collections, %.1f MB allocated young, %llu objects (%.1f MB) promoted\n",
+        (unsigned long long)stats->minor_collections,
+        stats->young_bytes / (1024.0 * 1024.0),
+        (unsigned long long)stats->promoted_objects,
+        stats->promoted_bytes / (1024.0 * 1024.0)
+    );
+    for (int i = 0; i < GC_PAUSE_BUCKETS; ++i) {
+        if (stats->pauses[i] == 0) continue;
+        if (i == GC_PAUSE_BUCKETS - 1) fprintf(file, "gc:   >= %6d us: %llu\n", 1 << (i - 1), (unsigned long long)stats->pauses[i]);
+        else fprintf(file, "gc:   <  %6d us: %llu\n", 1 << i, (unsigned long long)stats->pauses[i]);
+    }
+}
@@ -0,0 +1,96 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "gc.h"
+#include "generator.h"
+#include "memory.h"
+
+static void store_slots(Generator* generator, const Value* slots, int count) {
+    generator->count = count;
+    if (count == 0) return;
+    if (count > generator->capacity) {
+        int capacity = generator->capacity;
+        while (capacity < count) capacity = GROW_CAPACITY(capacity);
+        generator->slots = GROW_ARRAY(Value, generator->slots, generator->capacity, capacity);
+        generator->capacity = capacity;
+    }
+    memcpy(generator->slots, slots, sizeof(Value) * count);
+    for (int i = 0; i < count; ++i) {
+        write_barrier(&generator->obj, slots[i]);
+    }
+}
+
+Generator* new_generator(ValueType yield_type, int resume, const Value* arguments, int count) {
+    Generator* generator = allocate_tenured_object(sizeof(Generator), OBJ_GENERATOR);
+    generator->yield_type = yield_type;
+    generator->resume = resume;
+    generator->running = false;
+    generator->value = NONE_VALUE();
+    generator->count = 0;
+    generator->capacity = 0;
+    generator->slots = NULL;
+    generator->reader = NULL;
+    store_slots(generator, arguments, count);
+    return generator;
+}
+
+Generator* new_line_generator(int fd) {
+    Generator* generator = new_generator(VALUE_STRING, 0, NULL, 0);
+    generator->reader = GROW_ARRAY(LineReader, NULL, 0, 1);
+    init_line_reader(generator->reader, fd, LINE_STREAM_CAPACITY);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return generator;
+}
+
+// Releases the buffer through reallocate, which counted it, and closes the file.
+static void close_reader(Generator* generator) {
+    LineReader* reader = generator->reader;
+    if (reader == NULL) return;
+    if (reader->fd != STDIN_FILENO) close(reader->fd);
+    reallocate(reader->buffer, reader->capacity, 0);
+    reallocate(reader, sizeof(LineReader), 0);
+    generator->reader = NULL;
+}
+
+size_t generator_size(Generator* generator) {
+    size_t size = sizeof(Generator) + sizeof(Value) * generator->capacity;
+    if (generator->reader != NULL) size += sizeof(LineReader) + generator->reader->capacity;
+    return size;
+}
+
+void free_generator(Generator* generator) {
+    close_reader(generator);
+    reallocate(generator->slots, sizeof(Value) * generator->capacity, 0);
+    reallocate(generator, sizeof(Generator), 0);
+}
+
+void save_generator(Generator* generator, int resume, Value value, const Value* slots, int count) {
+    generator->resume = resume;
+    generator->running = false;
+    generator->value = value;
+    write_barrier(&generator->obj, value);
+    store_slots(generator, slots, count);
+}
+
+// The slice points into the reader's buffer and is overwritten by the next line.
+bool next_line(Generator* generator) {
+    char* line;
+    int length;
+    if (!read_line(generator->reader, &line, &length)) {
+        finish_generator(generator);
+        return false;
+    }
+    generator->line = (Slice){ line, length };
+    generator->value = SLICE_VALUE(&generator->line);
+    return true;
+}
+
+void finish_generator(Generator* generator) {
+    close_reader(generator);
+    generator->resume = -1;
+    generator->running = false;
+    generator->value = NONE_VALUE();
+    generator->count = 0;
+}
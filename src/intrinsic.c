@@ -0,0 +1,39 @@
+#include <string.h>
+#include "intrinsic.h"
+
+typedef struct IntrinsicInfo {
+    const char* name;
+    int arity;
+    bool has_int;
+} IntrinsicInfo;
+
+static const IntrinsicInfo intrinsics[INTRINSIC_COUNT] = {
+    [INTRINSIC_SQRT]  = { "sqrt", 1, false },
+    [INTRINSIC_ABS]   = { "abs", 1, true },
+    [INTRINSIC_MIN]   = { "min", 2, true },
+    [INTRINSIC_MAX]   = { "max", 2, true },
+    [INTRINSIC_FLOOR] = { "floor", 1, false },
+    [INTRINSIC_FMA]   = { "fma", 3, false },
+    [INTRINSIC_SIN]   = { "sin", 1, false },
+    [INTRINSIC_COS]   = { "cos", 1, false },
+    [INTRINSIC_TAN]   = { "tan", 1, false },
+};
+
+int find_intrinsic(const char* name, int length) {
+    for (int i = 0; i < INTRINSIC_COUNT; ++i) {
+        if ((int)strlen(intrinsics[i].name) == length && memcmp(intrinsics[i].name, name, length) == 0) return i;
+    }
+    return -1;
+}
+
+const char* intrinsic_name(MathIntrinsic intrinsic) {
+    return intrinsics[intrinsic].name;
+}
+
+int intrinsic_arity(MathIntrinsic intrinsic) {
+    return intrinsics[intrinsic].arity;
+}
+
+bool intrinsic_has_int(MathIntrinsic intrinsic) {
+    return intrinsics[intrinsic].has_int;
+}
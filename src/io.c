@@ -1,6 +1,11 @@
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "io.h"
+#include "memory.h"
 
 char* read_file(const char* file_path) {
     FILE* file = fopen(file_path, "rb");
@@ -26,3 +31,412 @@ char* read_file(const char* file_path) {
 
     return content;
 }
+
+void init_line_reader(LineReader* reader, int fd, int capacity) {
+    *reader = (LineReader){ 0 };
+    reader->fd = fd;
+    reader->capacity = capacity;
+    reader->buffer = GROW_ARRAY(char, NULL, 0, reader->capacity);
+}
+
+// Returns the next line without its newline. The line is NUL-terminated in place and stays
+// valid until the following call.
+bool read_line(LineReader* reader, char** line, int* length) {
+    for (;;) {
+        char* from = reader->buffer + reader->scanned;
+        char* newline = memchr(from, '\n', reader->end - reader->scanned);
+        if (newline != NULL || (reader->eof && reader->start < reader->end)) {
+            char* stop = newline != NULL ? newline : reader->buffer + reader->end;
+            *stop = '\0';
+            *line = reader->buffer + reader->start;
+            *length = (int)(stop - *line);
+
+            reader->start = newline != NULL ? (int)(stop - reader->buffer) + 1 : reader->end;
+            reader->scanned = reader->start;
+            return true;
+        }
+        if (reader->eof) return false;
+        reader->scanned = reader->end;
+
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->scanned -= reader->start;
+            reader->start = 0;
+        }
+        // one byte is always kept free for the terminator of an unterminated last line
+        if (reader->capacity - reader->end < 2) {
+            int old_capacity = reader->capacity;
+            reader->capacity = GROW_CAPACITY(old_capacity);
+            reader->buffer = GROW_ARRAY(char, reader->buffer, old_capacity, reader->capacity);
+        }
+
+        ssize_t count = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end - 1);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) reader->eof = true;
+        else reader->end += (int)count;
+    }
+}
+
+void free_line_reader(LineReader* reader) {
+    free(reader->buffer);
+    *reader = (LineReader){ 0 };
+}
+
+#define BIGINT_CAPACITY 12
+
+// Arbitrary precision unsigned integer, just wide enough to compare any float
+// interval boundary with a decimal candidate exactly.
+typedef struct BigInt {
+    int count;
+    uint32_t limbs[BIGINT_CAPACITY];
+} BigInt;
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static char* reserve(OutputBuffer* output, int length) {
+    if (output->count + length > OUTPUT_BUFFER_CAPACITY) {
+        flush_output(output);
+    }
+    return output->data + output->count;
+}
+
+static int format_uint64(char* out, uint64_t value) {
+    char digits[20];
+    int start = sizeof(digits);
+
+    while (value >= 100) {
+        int pair = (int)(value % 100) * 2;
+        value /= 100;
+        digits[--start] = digit_pairs[pair + 1];
+        digits[--start] = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        int pair = (int)value * 2;
+        digits[--start] = digit_pairs[pair + 1];
+        digits[--start] = digit_pairs[pair];
+    }
+    else {
+        digits[--start] = (char)('0' + value);
+    }
+
+    int length = sizeof(digits) - start;
+    memcpy(out, digits + start, length);
+    return length;
+}
+
+// mantissa * 2^exponent for values that do not fit into 64 bits, accumulated in base 10^9
+static int format_big_integer(char* out, uint32_t mantissa, int exponent) {
+    uint32_t limbs[6] = { mantissa };
+    int count = 1;
+
+    while (exponent > 0) {
+        int shift = exponent < 29 ? exponent : 29;
+        uint64_t carry = 0;
+        for (int i = 0; i < count; ++i) {
+            uint64_t x = ((uint64_t)limbs[i] << shift) + carry;
+            limbs[i] = (uint32_t)(x % 1000000000);
+            carry = x / 1000000000;
+        }
+        if (carry != 0) limbs[count++] = (uint32_t)carry;
+        exponent -= shift;
+    }
+
+    int length = format_uint64(out, limbs[count - 1]);
+    for (int i = count - 2; i >= 0; --i) {
+        uint32_t limb = limbs[i];
+        for (int j = 8; j >= 0; --j) {
+            out[length + j] = (char)('0' + limb % 10);
+            limb /= 10;
+        }
+        length += 9;
+    }
+    return length;
+}
+
+// Splits a float into sign, mantissa and binary exponent; returns false for NaN and infinity.
+static bool decompose_float(float value, bool* negative, uint32_t* mantissa, int* exponent) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    *negative = (bits >> 31) != 0;
+    int biased = (bits >> 23) & 0xFF;
+    uint32_t fraction = bits & 0x7FFFFF;
+
+    if (biased == 0xFF) {
+        *mantissa = fraction;
+        return false;
+    }
+    if (biased == 0) {
+        *mantissa = fraction;
+        *exponent = -149;
+    }
+    else {
+        *mantissa = fraction | 0x800000;
+        *exponent = biased - 150;
+    }
+    return true;
+}
+
+// Same output as printf("%f"), rounding the exact binary value half to even.
+static int format_fixed(char* out, float value) {
+    bool negative;
+    uint32_t mantissa;
+    int exponent;
+    bool finite = decompose_float(value, &negative, &mantissa, &exponent);
+
+    int length = 0;
+    if (negative) out[length++] = '-';
+    if (!finite) {
+        memcpy(out + length, mantissa != 0 ? "nan" : "inf", 3);
+        return length + 3;
+    }
+
+    uint64_t integer = 0;
+    uint64_t decimals = 0;
+    if (exponent >= 0) {
+        if (exponent > 39) {
+            length += format_big_integer(out + length, mantissa, exponent);
+            memcpy(out + length, ".000000", 7);
+            return length + 7;
+        }
+        integer = (uint64_t)mantissa << exponent;
+    }
+    else if (exponent > -64) {
+        int shift = -exponent;
+        uint64_t mask = (1ull << shift) - 1;
+        integer = (uint64_t)mantissa >> shift;
+
+        uint64_t scaled = ((uint64_t)mantissa & mask) * 1000000;
+        decimals = scaled >> shift;
+        uint64_t rest = scaled & mask;
+        uint64_t half = 1ull << (shift - 1);
+        if (rest > half || (rest == half && (decimals & 1))) ++decimals;
+        if (decimals == 1000000) {
+            decimals = 0;
+            ++integer;
+        }
+    }
+
+    length += format_uint64(out + length, integer);
+    out[length++] = '.';
+    for (int i = 5; i >= 0; --i) {
+        out[length + i] = (char)('0' + decimals % 10);
+        decimals /= 10;
+    }
+    return length + 6;
+}
+
+static void bigint_set(BigInt* number, uint64_t value) {
+    number->limbs[0] = (uint32_t)value;
+    number->limbs[1] = (uint32_t)(value >> 32);
+    number->count = number->limbs[1] != 0 ? 2 : 1;
+}
+
+static void bigint_multiply(BigInt* number, uint32_t factor) {
+    uint64_t carry = 0;
+    for (int i = 0; i < number->count; ++i) {
+        uint64_t x = (uint64_t)number->limbs[i] * factor + carry;
+        number->limbs[i] = (uint32_t)x;
+        carry = x >> 32;
+    }
+    if (carry != 0) number->limbs[number->count++] = (uint32_t)carry;
+}
+
+static void bigint_multiply_pow5(BigInt* number, int power) {
+    for (; power >= 13; power -= 13) bigint_multiply(number, 1220703125);
+    static const uint32_t small_pow5[] = { 1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625 };
+    bigint_multiply(number, small_pow5[power]);
+}
+
+static void bigint_shift_left(BigInt* number, int bits) {
+    int words = bits / 32;
+    bits %= 32;
+
+    if (bits != 0) {
+        uint32_t carry = 0;
+        for (int i = 0; i < number->count; ++i) {
+            uint32_t limb = number->limbs[i];
+            number->limbs[i] = (limb << bits) | carry;
+            carry = limb >> (32 - bits);
+        }
+        if (carry != 0) number->limbs[number->count++] = carry;
+    }
+    if (words != 0) {
+        for (int i = number->count - 1; i >= 0; --i) number->limbs[i + words] = number->limbs[i];
+        for (int i = 0; i < words; ++i) number->limbs[i] = 0;
+        number->count += words;
+    }
+}
+
+static int bigint_compare(const BigInt* a, const BigInt* b) {
+    if (a->count != b->count) return a->count < b->count ? -1 : 1;
+    for (int i = a->count - 1; i >= 0; --i) {
+        if (a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// Sign of (decimal * 10^decimal_exponent - binary * 2^binary_exponent), computed exactly.
+static int compare_scaled(uint64_t decimal, int decimal_exponent, uint64_t binary, int binary_exponent) {
+    BigInt left;
+    BigInt right;
+    bigint_set(&left, decimal);
+    bigint_set(&right, binary);
+
+    if (decimal_exponent >= 0) bigint_multiply_pow5(&left, decimal_exponent);
+    else bigint_multiply_pow5(&right, -decimal_exponent);
+
+    int common = decimal_exponent < binary_exponent ? decimal_exponent : binary_exponent;
+    bigint_shift_left(&left, decimal_exponent - common);
+    bigint_shift_left(&right, binary_exponent - common);
+    return bigint_compare(&left, &right);
+}
+
+// Shortest decimal that reads back as the same float, closest to it when several qualify.
+// Candidates come from a double approximation and are verified against the exact rounding
+// interval, so the result does not depend on the accuracy of the approximation.
+static int format_shortest(char* out, float value) {
+    bool negative;
+    uint32_t mantissa;
+    int exponent;
+    bool finite = decompose_float(value, &negative, &mantissa, &exponent);
+
+    int length = 0;
+    if (negative) out[length++] = '-';
+    if (!finite) {
+        memcpy(out + length, mantissa != 0 ? "nan" : "inf", 3);
+        return length + 3;
+    }
+    if (mantissa == 0) {
+        memcpy(out + length, "0.0", 3);
+        return length + 3;
+    }
+
+    bool inclusive = (mantissa & 1) == 0;
+    uint64_t upper = 2 * (uint64_t)mantissa + 1;
+    int upper_exponent = exponent - 1;
+    uint64_t lower = 2 * (uint64_t)mantissa - 1;
+    int lower_exponent = exponent - 1;
+    if (mantissa == 0x800000 && exponent > -149) {
+        lower = 4 * (uint64_t)mantissa - 1;
+        lower_exponent = exponent - 2;
+    }
+
+    double magnitude = ldexp(mantissa, exponent);
+    int leading = (int)floor(log10(magnitude));
+    if (pow(10.0, leading) > magnitude) --leading;
+    else if (pow(10.0, leading + 1) <= magnitude) ++leading;
+
+    uint64_t digits = 0;
+    int decimal_exponent = 0;
+    for (int precision = 1; precision <= 9 && digits == 0; ++precision) {
+        int k = leading - precision + 1;
+        uint64_t approximation = (uint64_t)(magnitude / pow(10.0, k) + 0.5);
+
+        for (uint64_t candidate = approximation > 1 ? approximation - 1 : 1; candidate <= approximation + 1; ++candidate) {
+            int above_lower = compare_scaled(candidate, k, lower, lower_exponent);
+            int below_upper = compare_scaled(candidate, k, upper, upper_exponent);
+            if (above_lower < 0 || (above_lower == 0 && !inclusive)) continue;
+            if (below_upper > 0 || (below_upper == 0 && !inclusive)) break;
+
+            if (digits != 0) {
+                // both neighbours round-trip; keep the one nearer to the exact value
+                int midpoint = compare_scaled(2 * digits + 1, k, mantissa, exponent + 1);
+                if (midpoint > 0 || (midpoint == 0 && (digits & 1) == 0)) break;
+            }
+            digits = candidate;
+            decimal_exponent = k;
+        }
+    }
+
+    while (digits % 10 == 0) {
+        digits /= 10;
+        ++decimal_exponent;
+    }
+
+    char buffer[20];
+    int count = format_uint64(buffer, digits);
+    int point = decimal_exponent + count - 1;
+
+    if (point < -5 || point >= 21) {
+        out[length++] = buffer[0];
+        if (count > 1) {
+            out[length++] = '.';
+            memcpy(out + length, buffer + 1, count - 1);
+            length += count - 1;
+        }
+        out[length++] = 'e';
+        out[length++] = point < 0 ? '-' : '+';
+        return length + format_uint64(out + length, point < 0 ? -point : point);
+    }
+    if (point < 0) {
+        out[length++] = '0';
+        out[length++] = '.';
+        for (int i = -1; i > point; --i) out[length++] = '0';
+        memcpy(out + length, buffer, count);
+        return length + count;
+    }
+
+    int integer_digits = point + 1;
+    for (int i = 0; i < integer_digits; ++i) out[length++] = i < count ? buffer[i] : '0';
+    out[length++] = '.';
+    if (count > integer_digits) {
+        memcpy(out + length, buffer + integer_digits, count - integer_digits);
+        return length + count - integer_digits;
+    }
+    out[length++] = '0';
+    return length;
+}
+
+void write_bytes(OutputBuffer* output, const char* bytes, int length) {
+    if (output->count + length > OUTPUT_BUFFER_CAPACITY) {
+        flush_output(output);
+        if (length > OUTPUT_BUFFER_CAPACITY) {
+            fwrite(bytes, sizeof(char), length, output->file != NULL ? output->file : stdout);
+            return;
+        }
+    }
+    memcpy(output->data + output->count, bytes, length);
+    output->count += length;
+}
+
+void write_char(OutputBuffer* output, char c) {
+    if (output->count == OUTPUT_BUFFER_CAPACITY) flush_output(output);
+    output->data[output->count++] = c;
+}
+
+void write_int(OutputBuffer* output, int32_t value) {
+    char* out = reserve(output, 11);
+    int length = 0;
+    uint64_t magnitude = (uint64_t)value;
+    if (value < 0) {
+        out[length++] = '-';
+        magnitude = (uint64_t)(-(int64_t)value);
+    }
+    output->count += length + format_uint64(out + length, magnitude);
+}
+
+void write_float(OutputBuffer* output, float value) {
+    char* out = reserve(output, 64);
+    output->count += output->shortest_floats ? format_shortest(out, value) : format_fixed(out, value);
+}
+
+void flush_output(OutputBuffer* output) {
+    if (output->count == 0) return;
+
+    FILE* file = output->file != NULL ? output->file : stdout;
+    fwrite(output->data, sizeof(char), output->count, file);
+    fflush(file);
+    output->count = 0;
+}
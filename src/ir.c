@@ -0,0 +1,933 @@
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
+#include "cstring.h"
+#include "intrinsic.h"
+#include "ir.h"
+#include "lexer.h"
+#include "memory.h"
+#include "native.h"
+#include "parser.h"
+#include "semantic.h"
+#include "value.h"
+
+// SSA construction follows Braun et al., "Simple and Efficient Construction of Static Single
+// Assignment Form": locals are looked up per block and phis are only created where a read
+// reaches a join, blocks whose predecessors are not all known yet get placeholder phis.
+typedef struct Lowering {
+    IRFunction* function;
+    int current;
+} Lowering;
+
+static _Thread_local Lowering lowering = { 0 };
+
+static void lower_statement(ASTNode* node);
+static int lower_expression(ASTNode* node);
+
+static IRInstr* instr_at(int value) {
+    return &lowering.function->instrs[value];
+}
+
+static IRBlock* block_at(int block) {
+    return &lowering.function->blocks[block];
+}
+
+static int new_instr(IROp op, ValueType type, int line) {
+    IRFunction* function = lowering.function;
+    if (function->capacity < function->count + 1) {
+        int old_capacity = function->capacity;
+        function->capacity = GROW_CAPACITY(old_capacity);
+        function->instrs = GROW_ARRAY(IRInstr, function->instrs, old_capacity, function->capacity);
+        function->forward = GROW_ARRAY(int, function->forward, old_capacity, function->capacity);
+    }
+
+    int value = function->count++;
+    function->instrs[value] = (IRInstr){
+        .op = op,
+        .type = type,
+        .index = -1,
+        .block = -1,
+        .line = line,
+        .targets = { -1, -1 },
+    };
+    function->forward[value] = value;
+    return value;
+}
+
+static void add_operand(int value, int operand) {
+    IRInstr* instr = instr_at(value);
+    if (instr->capacity < instr->count + 1) {
+        int old_capacity = instr->capacity;
+        instr->capacity = GROW_CAPACITY(old_capacity);
+        instr->operands = GROW_ARRAY(int, instr->operands, old_capacity, instr->capacity);
+    }
+    instr->operands[instr->count++] = operand;
+}
+
+static void insert_into_block(int block, int value, int position) {
+    IRBlock* target = block_at(block);
+    if (target->capacity < target->count + 1) {
+        int old_capacity = target->capacity;
+        target->capacity = GROW_CAPACITY(old_capacity);
+        target->instrs = GROW_ARRAY(int, target->instrs, old_capacity, target->capacity);
+    }
+    memmove(&target->instrs[position + 1], &target->instrs[position], sizeof(int) * (target->count - position));
+    target->instrs[position] = value;
+    ++target->count;
+    instr_at(value)->block = block;
+}
+
+static bool is_terminator(IROp op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN || op == IR_TAIL_CALL;
+}
+
+static bool is_terminated(int block) {
+    IRBlock* target = block_at(block);
+    return target->count > 0 && is_terminator(instr_at(target->instrs[target->count - 1])->op);
+}
+
+static int append(int value) {
+    insert_into_block(lowering.current, value, block_at(lowering.current)->count);
+    return value;
+}
+
+static void add_pred(int block, int pred) {
+    IRBlock* target = block_at(block);
+    if (target->pred_capacity < target->pred_count + 1) {
+        int old_capacity = target->pred_capacity;
+        target->pred_capacity = GROW_CAPACITY(old_capacity);
+        target->preds = GROW_ARRAY(int, target->preds, old_capacity, target->pred_capacity);
+    }
+    target->preds[target->pred_count++] = pred;
+}
+
+static int new_block(IRFunction* function, int after) {
+    if (function->block_capacity < function->block_count + 1) {
+        int old_capacity = function->block_capacity;
+        function->block_capacity = GROW_CAPACITY(old_capacity);
+        function->blocks = GROW_ARRAY(IRBlock, function->blocks, old_capacity, function->block_capacity);
+        function->layout = GROW_ARRAY(int, function->layout, old_capacity, function->block_capacity);
+    }
+
+    int block = function->block_count++;
+    function->blocks[block] = (IRBlock){ 0 };
+
+    int position = 0;
+    if (after != -1) {
+        while (function->layout[position] != after) ++position;
+        ++position;
+    }
+    memmove(&function->layout[position + 1], &function->layout[position], sizeof(int) * (block - position));
+    function->layout[position] = block;
+    return block;
+}
+
+static int new_block_after(int after) {
+    int block = new_block(lowering.function, after);
+    IRBlock* created = block_at(block);
+    created->definitions = malloc(sizeof(int) * MAX_LOCALS);
+    for (int i = 0; i < MAX_LOCALS; ++i) created->definitions[i] = -1;
+    return block;
+}
+
+static void jump(int target, int line) {
+    int value = new_instr(IR_JUMP, VALUE_NONE, line);
+    instr_at(value)->targets[0] = target;
+    append(value);
+    add_pred(target, lowering.current);
+}
+
+static void branch(int condition, int if_true, int if_false, int line) {
+    int value = new_instr(IR_BRANCH, VALUE_NONE, line);
+    add_operand(value, condition);
+    instr_at(value)->targets[0] = if_true;
+    instr_at(value)->targets[1] = if_false;
+    append(value);
+    add_pred(if_true, lowering.current);
+    add_pred(if_false, lowering.current);
+}
+
+static bool values_identical(Value a, Value b) {
+    if (a.type != b.type) return false;
+    switch (a.type) {
+        case VALUE_BOOL:  return AS_BOOL(a) == AS_BOOL(b);
+        case VALUE_INT:   return AS_INT(a) == AS_INT(b);
+        case VALUE_FLOAT: return memcmp(&AS_FLOAT(a), &AS_FLOAT(b), sizeof(float)) == 0;
+        case VALUE_STRING: return AS_STRING(a) == AS_STRING(b);
+        default:          return true;
+    }
+}
+
+// Constants live in the entry block and are shared, codegen rematerializes them at every use.
+static int constant(Value value, int line) {
+    return add_ir_constant(lowering.function, value, line);
+}
+
+int add_ir_constant(IRFunction* function, Value value, int line) {
+    IRFunction* previous = lowering.function;
+    lowering.function = function;
+    IRBlock* entry = block_at(0);
+    for (int i = 0; i < entry->count; ++i) {
+        IRInstr* instr = instr_at(entry->instrs[i]);
+        if (instr->op == IR_CONST && !instr->removed && values_identical(instr->constant, value)) {
+            lowering.function = previous;
+            return entry->instrs[i];
+        }
+    }
+
+    int result = new_instr(IR_CONST, value.type, line);
+    instr_at(result)->constant = value;
+    int position = is_terminated(0) ? block_at(0)->count - 1 : block_at(0)->count;
+    insert_into_block(0, result, position);
+    lowering.function = previous;
+    return result;
+}
+
+static int default_constant(ValueType type, int line) {
+    switch (type) {
+        case VALUE_BOOL:  return constant(BOOL_VALUE(false), line);
+        case VALUE_INT:   return constant(INT_VALUE(0), line);
+        case VALUE_FLOAT: return constant(FLOAT_VALUE(0.f), line);
+        case VALUE_STRING: return constant(STRING_VALUE(intern_cstring("", 0)), line);
+        default:          return constant(NONE_VALUE(), line);
+    }
+}
+
+int insert_ir_instr(IRFunction* function, int block, int position, IROp op, ValueType type, int line) {
+    IRFunction* previous = lowering.function;
+    lowering.function = function;
+    int value = new_instr(op, type, line);
+    insert_into_block(block, value, position);
+    lowering.function = previous;
+    return value;
+}
+
+void add_ir_operand(IRFunction* function, int value, int operand) {
+    IRFunction* previous = lowering.function;
+    lowering.function = function;
+    add_operand(value, operand);
+    lowering.function = previous;
+}
+
+int resolve_value(IRFunction* function, int value) {
+    int root = value;
+    while (function->forward[root] != root) root = function->forward[root];
+    while (function->forward[value] != root) {
+        int next = function->forward[value];
+        function->forward[value] = root;
+        value = next;
+    }
+    return root;
+}
+
+static int new_phi(int block, ValueType type) {
+    int phi = new_instr(IR_PHI, type, 0);
+    IRBlock* target = block_at(block);
+    int position = 0;
+    while (position < target->count && instr_at(target->instrs[position])->op == IR_PHI) ++position;
+    insert_into_block(block, phi, position);
+    return phi;
+}
+
+static void write_variable(int slot, int block, int value) {
+    block_at(block)->definitions[slot] = value;
+}
+
+static int read_variable(int slot, ValueType type, int block);
+
+// A phi whose operands are all the same value (or itself) is replaced by that value.
+static int remove_trivial_phi(int phi) {
+    IRFunction* function = lowering.function;
+    int same = -1;
+    IRInstr* instr = instr_at(phi);
+    for (int i = 0; i < instr->count; ++i) {
+        int operand = resolve_value(function, instr->operands[i]);
+        if (operand == same || operand == phi) continue;
+        if (same != -1) return phi;
+        same = operand;
+    }
+    if (same == -1) same = default_constant(instr->type, instr->line);
+
+    instr_at(phi)->removed = true;
+    function->forward[phi] = same;
+    return same;
+}
+
+static int add_phi_operands(int slot, int phi) {
+    int block = instr_at(phi)->block;
+    ValueType type = instr_at(phi)->type;
+    for (int i = 0; i < block_at(block)->pred_count; ++i) {
+        int operand = read_variable(slot, type, block_at(block)->preds[i]);
+        add_operand(phi, operand);
+    }
+    return remove_trivial_phi(phi);
+}
+
+static int read_variable(int slot, ValueType type, int block) {
+    IRBlock* target = block_at(block);
+    if (target->definitions[slot] != -1) return resolve_value(lowering.function, target->definitions[slot]);
+
+    int value;
+    if (!target->sealed) {
+        value = new_phi(block, type);
+        target = block_at(block);
+        if (target->incomplete_capacity < target->incomplete_count + 2) {
+            int old_capacity = target->incomplete_capacity;
+            target->incomplete_capacity = GROW_CAPACITY(old_capacity);
+            target->incomplete = GROW_ARRAY(int, target->incomplete, old_capacity, target->incomplete_capacity);
+        }
+        target->incomplete[target->incomplete_count++] = slot;
+        target->incomplete[target->incomplete_count++] = value;
+    }
+    else if (target->pred_count == 0) {
+        // only reachable through dead code
+        value = default_constant(type, 0);
+    }
+    else if (target->pred_count == 1) {
+        value = read_variable(slot, type, target->preds[0]);
+    }
+    else {
+        value = new_phi(block, type);
+        write_variable(slot, block, value);
+        value = add_phi_operands(slot, value);
+    }
+    write_variable(slot, block, value);
+    return value;
+}
+
+static void seal_block(int block) {
+    IRBlock* target = block_at(block);
+    for (int i = 0; i < target->incomplete_count; i += 2) {
+        add_phi_operands(block_at(block)->incomplete[i], block_at(block)->incomplete[i + 1]);
+    }
+    target = block_at(block);
+    free(target->incomplete);
+    target->incomplete = NULL;
+    target->incomplete_count = 0;
+    target->incomplete_capacity = 0;
+    target->sealed = true;
+}
+
+// Code after a return still gets lowered, into a block nothing jumps to.
+static void start_dead_block() {
+    lowering.current = new_block_after(lowering.current);
+    seal_block(lowering.current);
+}
+
+static void lower_condition(ASTNode* node, int if_true, int if_false) {
+    if (node->type == AST_NODE_LITERAL && node->literal.type == VALUE_BOOL) {
+        jump(AS_BOOL(node->literal) ? if_true : if_false, node->line);
+        return;
+    }
+    if (node->type == AST_NODE_UNARY && node->unary.op == TOKEN_BANG) {
+        lower_condition(node->unary.right, if_false, if_true);
+        return;
+    }
+    if (node->type == AST_NODE_BINARY && (node->binary.op == TOKEN_AND || node->binary.op == TOKEN_OR)) {
+        int right = new_block_after(lowering.current);
+        if (node->binary.op == TOKEN_AND) lower_condition(node->binary.left, right, if_false);
+        else lower_condition(node->binary.left, if_true, right);
+        seal_block(right);
+        lowering.current = right;
+        lower_condition(node->binary.right, if_true, if_false);
+        return;
+    }
+    branch(lower_expression(node), if_true, if_false, node->line);
+}
+
+// `a and b` is b when a holds and false otherwise, `a or b` is b when a fails and true otherwise.
+static int lower_logical(ASTNode* node) {
+    bool is_and = node->binary.op == TOKEN_AND;
+    int right = new_block_after(lowering.current);
+    int join = new_block_after(right);
+
+    if (is_and) lower_condition(node->binary.left, right, join);
+    else lower_condition(node->binary.left, join, right);
+    seal_block(right);
+
+    lowering.current = right;
+    int value = lower_expression(node->binary.right);
+    int right_end = lowering.current;
+    jump(join, node->line);
+    seal_block(join);
+
+    lowering.current = join;
+    int short_circuit = constant(BOOL_VALUE(!is_and), node->line);
+    int phi = new_phi(join, VALUE_BOOL);
+    instr_at(phi)->line = node->line;
+    for (int i = 0; i < block_at(join)->pred_count; ++i) {
+        add_operand(phi, block_at(join)->preds[i] == right_end ? value : short_circuit);
+    }
+    return phi;
+}
+
+static int lower_new_array(int length, ValueType type, int line) {
+    int value = new_instr(IR_NEW_ARRAY, type, line);
+    add_operand(value, length);
+    return append(value);
+}
+
+static int lower_expression(ASTNode* node) {
+    switch (node->type) {
+        case AST_NODE_LITERAL: return constant(node->literal, node->line);
+        case AST_NODE_VARIABLE: {
+            if (!node->variable.is_global) {
+                return read_variable(node->variable.slot, node->inferred_type, lowering.current);
+            }
+            int value = new_instr(IR_GLOAD, node->inferred_type, node->line);
+            instr_at(value)->index = node->variable.slot;
+            return append(value);
+        }
+        case AST_NODE_BINARY: {
+            if (node->binary.op == TOKEN_AND || node->binary.op == TOKEN_OR) return lower_logical(node);
+            int left = lower_expression(node->binary.left);
+            int right = lower_expression(node->binary.right);
+            int value = new_instr(IR_BINARY, node->inferred_type, node->line);
+            instr_at(value)->token = node->binary.op;
+            add_operand(value, left);
+            add_operand(value, right);
+            return append(value);
+        }
+        case AST_NODE_UNARY: {
+            int right = lower_expression(node->unary.right);
+            int value = new_instr(IR_UNARY, node->inferred_type, node->line);
+            instr_at(value)->token = node->unary.op;
+            add_operand(value, right);
+            return append(value);
+        }
+        case AST_NODE_CAST: {
+            int expression = lower_expression(node->cast.expression);
+            if (instr_at(expression)->type == node->cast.target_type) return expression;
+            int value = new_instr(IR_CAST, node->cast.target_type, node->line);
+            add_operand(value, expression);
+            return append(value);
+        }
+        case AST_NODE_CALL: {
+            int* arguments = malloc(sizeof(int) * (node->call.count + 1));
+            for (int i = 0; i < node->call.count; ++i) {
+                arguments[i] = lower_expression(node->call.arguments[i]);
+            }
+            IROp op = IR_CALL;
+            int index = node->call.index;
+            if (node->call.builtin == BUILTIN_RESUME) {
+                op = IR_RESUME;
+                index = -1;
+            }
+            else if (node->call.builtin != -1) {
+                op = IR_BUILTIN;
+                index = node->call.builtin;
+            }
+            else if (node->call.class_index != -1) {
+                op = IR_NEW_OBJECT;
+                index = node->call.class_index;
+            }
+            else if (node->call.native != -1) {
+                op = IR_CALL_NATIVE;
+                index = node->call.native;
+            }
+            else if (node->call.intrinsic != -1) {
+                op = IR_INTRINSIC;
+                index = node->call.intrinsic;
+            }
+            int value = new_instr(op, node->inferred_type, node->line);
+            instr_at(value)->index = index;
+            for (int i = 0; i < node->call.count; ++i) add_operand(value, arguments[i]);
+            free(arguments);
+            return append(value);
+        }
+        case AST_NODE_ARRAY: {
+            if (node->array.length != NULL) {
+                return lower_new_array(lower_expression(node->array.length), node->inferred_type, node->line);
+            }
+            int* elements = malloc(sizeof(int) * node->array.count);
+            for (int i = 0; i < node->array.count; ++i) {
+                elements[i] = lower_expression(node->array.elements[i]);
+            }
+            int value = new_instr(IR_ARRAY, node->inferred_type, node->line);
+            for (int i = 0; i < node->array.count; ++i) add_operand(value, elements[i]);
+            free(elements);
+            return append(value);
+        }
+        case AST_NODE_MAP: {
+            int* entries = malloc(sizeof(int) * 2 * node->map.count);
+            for (int i = 0; i < node->map.count; ++i) {
+                entries[2 * i] = lower_expression(node->map.keys[i]);
+                entries[2 * i + 1] = lower_expression(node->map.values[i]);
+            }
+            int value = new_instr(IR_MAP, node->inferred_type, node->line);
+            for (int i = 0; i < 2 * node->map.count; ++i) add_operand(value, entries[i]);
+            free(entries);
+            return append(value);
+        }
+        case AST_NODE_SUBSCRIPT: {
+            int array = lower_expression(node->subscript.array);
+            int index = lower_expression(node->subscript.index);
+            bool is_map = IS_MAP_TYPE(node->subscript.array->inferred_type);
+            int value = new_instr(is_map ? IR_MAP_GET : IR_LOAD_ELEMENT, node->inferred_type, node->line);
+            add_operand(value, array);
+            add_operand(value, index);
+            return append(value);
+        }
+        case AST_NODE_GET_FIELD: {
+            int object = lower_expression(node->get_field.object);
+            int value = new_instr(IR_GET_FIELD, node->inferred_type, node->line);
+            instr_at(value)->constant = STRING_VALUE(intern_cstring(node->get_field.name.start, node->get_field.name.length));
+            add_operand(value, object);
+            return append(value);
+        }
+        case AST_NODE_INVOKE: {
+            int* arguments = malloc(sizeof(int) * (node->invoke.count + 1));
+            arguments[0] = lower_expression(node->invoke.object);
+            for (int i = 0; i < node->invoke.count; ++i) {
+                arguments[i + 1] = lower_expression(node->invoke.arguments[i]);
+            }
+            int value = new_instr(IR_INVOKE, node->inferred_type, node->line);
+            instr_at(value)->constant = STRING_VALUE(intern_cstring(node->invoke.name.start, node->invoke.name.length));
+            for (int i = 0; i <= node->invoke.count; ++i) add_operand(value, arguments[i]);
+            free(arguments);
+            return append(value);
+        }
+        default: return default_constant(VALUE_NONE, node->line);
+    }
+}
+
+static void store(int slot, bool is_global, int value, int line) {
+    if (!is_global) {
+        write_variable(slot, lowering.current, value);
+        return;
+    }
+    int store = new_instr(IR_GSTORE, VALUE_NONE, line);
+    instr_at(store)->index = slot;
+    add_operand(store, value);
+    append(store);
+}
+
+static void lower_if(ASTNode* node) {
+    int then_block = new_block_after(lowering.current);
+    int else_block = node->if_.else_branch != NULL ? new_block_after(then_block) : -1;
+    int join = new_block_after(else_block != -1 ? else_block : then_block);
+
+    lower_condition(node->if_.condition, then_block, else_block != -1 ? else_block : join);
+    seal_block(then_block);
+    lowering.current = then_block;
+    lower_statement(node->if_.then_branch);
+    jump(join, node->line);
+
+    if (else_block != -1) {
+        seal_block(else_block);
+        lowering.current = else_block;
+        lower_statement(node->if_.else_branch);
+        jump(join, node->line);
+    }
+    seal_block(join);
+    lowering.current = join;
+}
+
+// The body is laid out before the condition, so every iteration ends in a single branch back.
+static void lower_loop(ASTNode* condition, ASTNode* body, ASTNode* increment, int line) {
+    int body_block = new_block_after(lowering.current);
+    int header = new_block_after(body_block);
+    int exit = new_block_after(header);
+
+    jump(header, line);
+    lowering.current = header;
+    if (condition != NULL) lower_condition(condition, body_block, exit);
+    else jump(body_block, line);
+    seal_block(body_block);
+
+    lowering.current = body_block;
+    lower_statement(body);
+    if (increment != NULL) lower_statement(increment);
+    jump(header, line);
+
+    seal_block(header);
+    seal_block(exit);
+    lowering.current = exit;
+}
+
+static void lower_return(ASTNode* node) {
+    ASTNode* value = node->return_.value;
+    int terminator;
+    if (value != NULL && value->type == AST_NODE_CALL && value->call.is_tail) {
+        int call = lower_expression(value);
+        // reuse the call's operands for the frame-replacing jump
+        terminator = new_instr(IR_TAIL_CALL, VALUE_NONE, node->line);
+        instr_at(terminator)->index = instr_at(call)->index;
+        for (int i = 0; i < instr_at(call)->count; ++i) add_operand(terminator, instr_at(call)->operands[i]);
+        IRBlock* block = block_at(lowering.current);
+        --block->count;
+        instr_at(call)->removed = true;
+    }
+    else {
+        terminator = new_instr(IR_RETURN, VALUE_NONE, node->line);
+        if (value != NULL) add_operand(terminator, lower_expression(value));
+    }
+    append(terminator);
+    start_dead_block();
+}
+
+static void lower_statement(ASTNode* node) {
+    switch (node->type) {
+        case AST_NODE_VAR_DECL: {
+            int value;
+            if (node->var_decl.initializer != NULL) value = lower_expression(node->var_decl.initializer);
+            // every declaration gets an array or map of its own, so the default is no constant
+            else if (IS_ARRAY_TYPE(node->inferred_type)) {
+                value = lower_new_array(constant(INT_VALUE(0), node->line), node->inferred_type, node->line);
+            }
+            else if (IS_MAP_TYPE(node->inferred_type)) {
+                value = append(new_instr(IR_MAP, node->inferred_type, node->line));
+            }
+            else value = default_constant(node->inferred_type, node->line);
+            store(node->var_decl.slot, node->var_decl.is_global, value, node->line);
+        } break;
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            int array = lower_expression(node->subscript_assignment.array);
+            int index = lower_expression(node->subscript_assignment.index);
+            int value = lower_expression(node->subscript_assignment.value);
+            bool is_map = IS_MAP_TYPE(node->subscript_assignment.array->inferred_type);
+            int store = new_instr(is_map ? IR_MAP_SET : IR_STORE_ELEMENT, VALUE_NONE, node->line);
+            add_operand(store, array);
+            add_operand(store, index);
+            add_operand(store, value);
+            append(store);
+        } break;
+        case AST_NODE_SET_FIELD: {
+            int object = lower_expression(node->set_field.object);
+            int value = lower_expression(node->set_field.value);
+            int store = new_instr(IR_SET_FIELD, VALUE_NONE, node->line);
+            instr_at(store)->constant = STRING_VALUE(intern_cstring(node->set_field.name.start, node->set_field.name.length));
+            add_operand(store, object);
+            add_operand(store, value);
+            append(store);
+        } break;
+        case AST_NODE_ASSIGNMENT: {
+            int value = lower_expression(node->assignment.value);
+            store(node->assignment.slot, node->assignment.is_global, value, node->line);
+        } break;
+        case AST_NODE_PRINT: {
+            int value = lower_expression(node->print.expression);
+            int print = new_instr(IR_PRINT, VALUE_NONE, node->line);
+            add_operand(print, value);
+            append(print);
+        } break;
+        case AST_NODE_EXPRESSION_STATEMENT: {
+            lower_expression(node->expression_statement.expression);
+        } break;
+        case AST_NODE_BLOCK: {
+            for (int i = 0; i < node->block.count; ++i) {
+                lower_statement(node->block.statements[i]);
+            }
+        } break;
+        case AST_NODE_IF: {
+            lower_if(node);
+        } break;
+        case AST_NODE_WHILE: {
+            lower_loop(node->while_.condition, node->while_.body, NULL, node->line);
+        } break;
+        case AST_NODE_FOR: {
+            if (node->for_.initializer != NULL) lower_statement(node->for_.initializer);
+            lower_loop(node->for_.condition, node->for_.body, node->for_.increment, node->line);
+        } break;
+        case AST_NODE_RETURN: {
+            lower_return(node);
+        } break;
+        case AST_NODE_YIELD: {
+            int value = lower_expression(node->yield_.value);
+            int yield = new_instr(IR_YIELD, VALUE_NONE, node->line);
+            add_operand(yield, value);
+            append(yield);
+        } break;
+        default: break;
+    }
+}
+
+static void begin_lowering(IRFunction* function) {
+    *function = (IRFunction){ 0 };
+    lowering.function = function;
+    lowering.current = new_block_after(-1);
+    seal_block(lowering.current);
+}
+
+static void end_lowering(int line) {
+    int value = new_instr(IR_RETURN, VALUE_NONE, line);
+    append(value);
+
+    IRFunction* function = lowering.function;
+    for (int i = 0; i < function->block_count; ++i) {
+        free(function->blocks[i].definitions);
+        function->blocks[i].definitions = NULL;
+    }
+    lowering.function = NULL;
+}
+
+void lower_program(IRFunction* function, ASTNode* program, bool echo) {
+    begin_lowering(function);
+    function->name = "<script>";
+    function->length = 8;
+
+    for (int i = 0; i < program->block.count; ++i) {
+        ASTNode* statement = program->block.statements[i];
+        if (statement->type == AST_NODE_FUNCTION) continue;
+
+        // bare expressions at top level print their value when echoing
+        if (echo && statement->type == AST_NODE_EXPRESSION_STATEMENT && statement->inferred_type != VALUE_NONE) {
+            int value = lower_expression(statement->expression_statement.expression);
+            int print = new_instr(IR_PRINT, VALUE_NONE, statement->line);
+            add_operand(print, value);
+            append(print);
+            continue;
+        }
+        lower_statement(statement);
+    }
+    end_lowering(program->line);
+}
+
+void lower_function(IRFunction* function, ASTNode* declaration) {
+    begin_lowering(function);
+    function->name = declaration->function.name.start;
+    function->length = declaration->function.name.length;
+    function->arity = declaration->function.arity;
+    function->is_generator = IS_GENERATOR_TYPE(declaration->function.return_type);
+
+    for (int i = 0; i < declaration->function.arity; ++i) {
+        int param = new_instr(IR_PARAM, declaration->function.params[i].type, declaration->line);
+        instr_at(param)->index = i;
+        append(param);
+        write_variable(i, lowering.current, param);
+    }
+    lower_statement(declaration->function.body);
+    end_lowering(declaration->line);
+}
+
+void free_ir(IRFunction* function) {
+    for (int i = 0; i < function->count; ++i) {
+        free(function->instrs[i].operands);
+    }
+    for (int i = 0; i < function->block_count; ++i) {
+        IRBlock* block = &function->blocks[i];
+        free(block->instrs);
+        free(block->preds);
+        free(block->definitions);
+        free(block->incomplete);
+    }
+    free(function->instrs);
+    free(function->forward);
+    free(function->blocks);
+    free(function->layout);
+    *function = (IRFunction){ 0 };
+}
+
+int terminator(IRFunction* function, int block) {
+    IRBlock* target = &function->blocks[block];
+    return target->instrs[target->count - 1];
+}
+
+int successor_count(IRFunction* function, int block) {
+    switch (function->instrs[terminator(function, block)].op) {
+        case IR_JUMP:   return 1;
+        case IR_BRANCH: return 2;
+        default:        return 0;
+    }
+}
+
+int successor(IRFunction* function, int block, int index) {
+    return function->instrs[terminator(function, block)].targets[index];
+}
+
+bool has_side_effects(IRInstr* instr) {
+    switch (instr->op) {
+        case IR_GSTORE:
+        case IR_CALL:
+        case IR_CALL_NATIVE:
+        case IR_PRINT:
+        case IR_STORE_ELEMENT:
+        case IR_BUILTIN:
+        case IR_STORE_UNCHECKED:
+        case IR_GUARD_LENGTH:
+        case IR_SET_FIELD:
+        case IR_INVOKE:
+        case IR_MAP_SET:
+        case IR_RESUME:
+        case IR_YIELD:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RETURN:
+        case IR_TAIL_CALL: return true;
+        default:           return false;
+    }
+}
+
+static bool has_phis(IRFunction* function, int block) {
+    IRBlock* target = &function->blocks[block];
+    for (int i = 0; i < target->count; ++i) {
+        IRInstr* instr = &function->instrs[target->instrs[i]];
+        if (instr->op != IR_PHI) return false;
+        if (!instr->removed) return true;
+    }
+    return false;
+}
+
+// Phi copies are emitted at the end of a predecessor, which is only correct when that
+// predecessor has a single successor. Edges from branches into blocks with phis get a block of their own.
+void split_critical_edges(IRFunction* function) {
+    lowering.function = function;
+    int block_count = function->block_count;
+    for (int block = 0; block < block_count; ++block) {
+        if (function->blocks[block].removed || successor_count(function, block) != 2) continue;
+
+        for (int k = 0; k < 2; ++k) {
+            int target = successor(function, block, k);
+            if (function->blocks[target].pred_count < 2 || !has_phis(function, target)) continue;
+
+            int target_position = 0;
+            while (function->layout[target_position] != target) ++target_position;
+            int split = new_block(function, target_position > 0 ? function->layout[target_position - 1] : -1);
+            function->blocks[split].sealed = true;
+
+            int value = new_instr(IR_JUMP, VALUE_NONE, function->instrs[terminator(function, block)].line);
+            function->instrs[value].targets[0] = target;
+            insert_into_block(split, value, 0);
+            add_pred(split, block);
+
+            IRBlock* successor_block = &function->blocks[target];
+            for (int i = 0; i < successor_block->pred_count; ++i) {
+                if (successor_block->preds[i] == block) {
+                    successor_block->preds[i] = split;
+                    break;
+                }
+            }
+            function->instrs[terminator(function, block)].targets[k] = split;
+        }
+    }
+    lowering.function = NULL;
+}
+
+static const char* op_name(IRInstr* instr) {
+    switch (instr->op) {
+        case IR_CONST:     return "const";
+        case IR_PARAM:     return "param";
+        case IR_PHI:       return "phi";
+        case IR_GLOAD:     return "gload";
+        case IR_GSTORE:    return "gstore";
+        case IR_BINARY:
+        case IR_UNARY:     return token_as_cstr(instr->token);
+        case IR_CAST:      return "cast";
+        case IR_SHL:       return "shl";
+        case IR_DIV_MAGIC: return "divmagic";
+        case IR_INTRINSIC: return "intrinsic";
+        case IR_CALL:      return "call";
+        case IR_CALL_NATIVE: return "native";
+        case IR_PRINT:     return "print";
+        case IR_NEW_ARRAY: return "newarray";
+        case IR_ARRAY:     return "array";
+        case IR_LOAD_ELEMENT: return "load";
+        case IR_STORE_ELEMENT: return "store";
+        case IR_BUILTIN:   return "builtin";
+        case IR_LOAD_UNCHECKED: return "uload";
+        case IR_STORE_UNCHECKED: return "ustore";
+        case IR_GUARD_LENGTH: return "guardlen";
+        case IR_NEW_OBJECT: return "new";
+        case IR_GET_FIELD: return "getfield";
+        case IR_SET_FIELD: return "setfield";
+        case IR_INVOKE:    return "invoke";
+        case IR_MAP:       return "map";
+        case IR_MAP_GET:   return "mapget";
+        case IR_MAP_SET:   return "mapset";
+        case IR_RESUME:    return "resume";
+        case IR_YIELD:     return "yield";
+        case IR_JUMP:      return "jump";
+        case IR_BRANCH:    return "branch";
+        case IR_RETURN:    return "return";
+        case IR_TAIL_CALL: return "tailcall";
+        default:           return "?";
+    }
+}
+
+static const char* type_name(ValueType type) {
+    switch (type) {
+        case VALUE_BOOL:  return "bool";
+        case VALUE_INT:   return "int";
+        case VALUE_FLOAT: return "float";
+        case VALUE_STRING: return "string";
+        case VALUE_BOOL_ARRAY: return "bool[]";
+        case VALUE_INT_ARRAY: return "int[]";
+        case VALUE_FLOAT_ARRAY: return "float[]";
+        case VALUE_OBJECT: return "object";
+        case VALUE_BOOL_MAP: return "map[string]bool";
+        case VALUE_INT_MAP: return "map[string]int";
+        case VALUE_FLOAT_MAP: return "map[string]float";
+        case VALUE_STRING_MAP: return "map[string]string";
+        case VALUE_BOOL_GENERATOR: return "gen bool";
+        case VALUE_INT_GENERATOR: return "gen int";
+        case VALUE_FLOAT_GENERATOR: return "gen float";
+        case VALUE_STRING_GENERATOR: return "gen string";
+        default:          return "none";
+    }
+}
+
+void dump_ir(IRFunction* function, FILE* file) {
+    fprintf(file, "func %.*s(%d):\n", function->length, function->name, function->arity);
+    for (int l = 0; l < function->block_count; ++l) {
+        int block = function->layout[l];
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) continue;
+
+        fprintf(file, "b%d:", block);
+        if (target->pred_count > 0) {
+            fprintf(file, " ; preds");
+            for (int i = 0; i < target->pred_count; ++i) fprintf(file, " b%d", target->preds[i]);
+        }
+        fprintf(file, "\n");
+
+        for (int i = 0; i < target->count; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = &function->instrs[value];
+            if (instr->removed) continue;
+
+            fprintf(file, "    ");
+            if (instr->type != VALUE_NONE) fprintf(file, "v%d: %s = ", value, type_name(instr->type));
+            fprintf(file, "%s", op_name(instr));
+
+            switch (instr->op) {
+                case IR_CONST: {
+                    switch (instr->constant.type) {
+                        case VALUE_BOOL:  fprintf(file, " %s", AS_BOOL(instr->constant) ? "true" : "false"); break;
+                        case VALUE_INT:   fprintf(file, " %d", AS_INT(instr->constant)); break;
+                        case VALUE_FLOAT: fprintf(file, " %g", AS_FLOAT(instr->constant)); break;
+                        case VALUE_STRING: {
+                            CString* string = AS_STRING(instr->constant);
+                            fprintf(file, " \"%.*s\"", string->length, string->data);
+                        } break;
+                        default:          fprintf(file, " none"); break;
+                    }
+                } break;
+                case IR_PARAM:
+                case IR_SHL:
+                case IR_DIV_MAGIC:
+                case IR_GLOAD:
+                case IR_GSTORE:
+                case IR_CALL:
+                case IR_NEW_OBJECT:
+                case IR_TAIL_CALL: fprintf(file, " #%d", instr->index); break;
+                case IR_BUILTIN: fprintf(file, " %s", array_builtin_name(instr->index)); break;
+                case IR_CALL_NATIVE: fprintf(file, " %s", native_function(instr->index)->name); break;
+                case IR_INTRINSIC: fprintf(file, " %s", intrinsic_name(instr->index)); break;
+                case IR_GET_FIELD:
+                case IR_SET_FIELD:
+                case IR_INVOKE: {
+                    CString* name = AS_STRING(instr->constant);
+                    fprintf(file, " .%.*s", name->length, name->data);
+                } break;
+                default: break;
+            }
+            for (int j = 0; j < instr->count; ++j) {
+                fprintf(file, "%s v%d", j > 0 || instr->index != -1 ? "," : "", resolve_value(function, instr->operands[j]));
+                if (instr->op == IR_PHI) fprintf(file, " (b%d)", target->preds[j]);
+            }
+            if (instr->op == IR_JUMP) fprintf(file, " b%d", instr->targets[0]);
+            if (instr->op == IR_BRANCH) fprintf(file, ", b%d, b%d", instr->targets[0], instr->targets[1]);
+            fprintf(file, "\n");
+        }
+    }
+}
@@ -0,0 +1,1033 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
+#include "intrinsic.h"
+#include "ir.h"
+#include "lexer.h"
+#include "memory.h"
+#include "optimizer.h"
+#include "semantic.h"
+#include "value.h"
+#include "vm.h"
+
+typedef struct Dominators {
+    int count;
+    int* order;          // reachable blocks in reverse postorder
+    int* index;          // block -> position in order
+    int* idom;
+    int* first_child;
+    int* next_sibling;
+} Dominators;
+
+// Scoped hash set of available expressions, entries are dropped in reverse order when a
+// dominator subtree is left, which keeps linear probing valid without tombstones.
+typedef struct ExpressionTable {
+    int capacity;
+    int* values;
+    int undo_count;
+    int* undo;
+} ExpressionTable;
+
+static void replace_value(IRFunction* function, int value, int with) {
+    function->forward[value] = with;
+    function->instrs[value].removed = true;
+}
+
+static void remove_pred(IRFunction* function, int block, int position) {
+    IRBlock* target = &function->blocks[block];
+    for (int i = 0; i < target->count; ++i) {
+        IRInstr* instr = &function->instrs[target->instrs[i]];
+        if (instr->op != IR_PHI) break;
+        memmove(&instr->operands[position], &instr->operands[position + 1], sizeof(int) * (instr->count - position - 1));
+        --instr->count;
+    }
+    memmove(&target->preds[position], &target->preds[position + 1], sizeof(int) * (target->pred_count - position - 1));
+    --target->pred_count;
+}
+
+static void remove_edge(IRFunction* function, int from, int to) {
+    IRBlock* target = &function->blocks[to];
+    for (int i = 0; i < target->pred_count; ++i) {
+        if (target->preds[i] == from) {
+            remove_pred(function, to, i);
+            return;
+        }
+    }
+}
+
+static bool remove_unreachable(IRFunction* function) {
+    int count = function->block_count;
+    bool* reached = calloc(count, sizeof(bool));
+    int* stack = malloc(sizeof(int) * count);
+    int top = 0;
+
+    reached[0] = true;
+    stack[top++] = 0;
+    while (top > 0) {
+        int block = stack[--top];
+        for (int k = 0; k < successor_count(function, block); ++k) {
+            int next = successor(function, block, k);
+            if (reached[next]) continue;
+            reached[next] = true;
+            stack[top++] = next;
+        }
+    }
+
+    bool changed = false;
+    for (int block = 0; block < count; ++block) {
+        IRBlock* target = &function->blocks[block];
+        if (reached[block] || target->removed) continue;
+
+        for (int k = 0; k < successor_count(function, block); ++k) {
+            int next = successor(function, block, k);
+            if (reached[next]) remove_edge(function, block, next);
+        }
+        for (int i = 0; i < target->count; ++i) {
+            function->instrs[target->instrs[i]].removed = true;
+        }
+        target->removed = true;
+        changed = true;
+    }
+
+    free(stack);
+    free(reached);
+    return changed;
+}
+
+static IRInstr* operand_at(IRFunction* function, IRInstr* instr, int index) {
+    return &function->instrs[instr->operands[index]];
+}
+
+static bool is_int_constant(IRInstr* instr, int value) {
+    return instr->op == IR_CONST && instr->type == VALUE_INT && AS_INT(instr->constant) == value;
+}
+
+// x + 0, x - 0, x * 1 and x / 1 on integers, float identities do not hold for -0 and NaN.
+static int integer_identity(IRFunction* function, IRInstr* instr) {
+    if (instr->type != VALUE_INT) return -1;
+    IRInstr* left = operand_at(function, instr, 0);
+    IRInstr* right = operand_at(function, instr, 1);
+    switch (instr->token) {
+        case TOKEN_PLUS: {
+            if (is_int_constant(right, 0)) return instr->operands[0];
+            if (is_int_constant(left, 0)) return instr->operands[1];
+        } break;
+        case TOKEN_MINUS: {
+            if (is_int_constant(right, 0)) return instr->operands[0];
+        } break;
+        case TOKEN_ASTERISK: {
+            if (is_int_constant(right, 1)) return instr->operands[0];
+            if (is_int_constant(left, 1)) return instr->operands[1];
+        } break;
+        case TOKEN_SLASH: {
+            if (is_int_constant(right, 1)) return instr->operands[0];
+        } break;
+        default: break;
+    }
+    return -1;
+}
+
+// Propagates copies and constants through one instruction, true when something changed.
+static bool simplify_instr(IRFunction* function, int value) {
+    IRInstr* instr = &function->instrs[value];
+    for (int i = 0; i < instr->count; ++i) {
+        instr->operands[i] = resolve_value(function, instr->operands[i]);
+    }
+
+    int replacement = -1;
+    Value result;
+    switch (instr->op) {
+        case IR_PHI: {
+            int same = -1;
+            for (int i = 0; i < instr->count; ++i) {
+                int operand = instr->operands[i];
+                if (operand == same || operand == value) continue;
+                if (same != -1) return false;
+                same = operand;
+            }
+            if (same == -1) return false;
+            replacement = same;
+        } break;
+        case IR_BINARY: {
+            IRInstr* left = operand_at(function, instr, 0);
+            IRInstr* right = operand_at(function, instr, 1);
+            if (left->op == IR_CONST && right->op == IR_CONST &&
+                fold_binary_constants(instr->token, left->constant, right->constant, &result)) {
+                replacement = add_ir_constant(function, result, instr->line);
+            }
+            else {
+                replacement = integer_identity(function, instr);
+            }
+        } break;
+        case IR_UNARY: {
+            IRInstr* right = operand_at(function, instr, 0);
+            if (right->op == IR_CONST && fold_unary_constant(instr->token, right->constant, &result)) {
+                replacement = add_ir_constant(function, result, instr->line);
+            }
+        } break;
+        case IR_CAST: {
+            IRInstr* expression = operand_at(function, instr, 0);
+            if (expression->type == instr->type) {
+                replacement = instr->operands[0];
+            }
+            else if (expression->op == IR_CONST && fold_cast_constant(instr->type, expression->constant, &result)) {
+                replacement = add_ir_constant(function, result, instr->line);
+            }
+        } break;
+        case IR_INTRINSIC: {
+            Value arguments[MAX_INTRINSIC_ARITY];
+            for (int i = 0; i < instr->count; ++i) {
+                IRInstr* argument = operand_at(function, instr, i);
+                if (argument->op != IR_CONST) return false;
+                arguments[i] = argument->constant;
+            }
+            if (fold_intrinsic_constants(instr->index, instr->type, arguments, &result)) {
+                replacement = add_ir_constant(function, result, instr->line);
+            }
+        } break;
+        case IR_BRANCH: {
+            IRInstr* condition = operand_at(function, instr, 0);
+            if (condition->op != IR_CONST) return false;
+
+            int taken = instr->targets[AS_BOOL(condition->constant) ? 0 : 1];
+            int other = instr->targets[AS_BOOL(condition->constant) ? 1 : 0];
+            instr->op = IR_JUMP;
+            instr->count = 0;
+            instr->targets[0] = taken;
+            instr->targets[1] = -1;
+            remove_edge(function, instr->block, other);
+            return true;
+        }
+        default: break;
+    }
+
+    if (replacement == -1) return false;
+    replace_value(function, value, replacement);
+    return true;
+}
+
+static bool simplify(IRFunction* function) {
+    bool changed_any = false;
+    bool changed;
+    do {
+        changed = false;
+        for (int l = 0; l < function->block_count; ++l) {
+            int block = function->layout[l];
+            if (function->blocks[block].removed) continue;
+            // constants may be added to the entry block while it is walked, so re-read the count
+            for (int i = 0; i < function->blocks[block].count; ++i) {
+                int value = function->blocks[block].instrs[i];
+                if (!function->instrs[value].removed && simplify_instr(function, value)) changed = true;
+            }
+        }
+        if (remove_unreachable(function)) changed = true;
+        changed_any = changed_any || changed;
+    } while (changed);
+    return changed_any;
+}
+
+// One past the highest global the function loads or stores.
+static int count_globals(IRFunction* function) {
+    int count = 0;
+    for (int i = 0; i < function->count; ++i) {
+        IRInstr* instr = &function->instrs[i];
+        if ((instr->op == IR_GLOAD || instr->op == IR_GSTORE) && instr->index >= count) count = instr->index + 1;
+    }
+    return count;
+}
+
+// Within a block a global keeps the value last stored to or loaded from it until a call, a method call
+// or a generator switch, which all run code that may store it.
+static void forward_globals(IRFunction* function) {
+    int global_count = count_globals(function);
+    if (global_count == 0) return;
+    int* known = malloc(sizeof(int) * global_count);
+    for (int block = 0; block < function->block_count; ++block) {
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) continue;
+
+        for (int i = 0; i < global_count; ++i) known[i] = -1;
+        for (int i = 0; i < target->count; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = &function->instrs[value];
+            if (instr->removed) continue;
+
+            switch (instr->op) {
+                case IR_GSTORE: {
+                    known[instr->index] = resolve_value(function, instr->operands[0]);
+                } break;
+                case IR_GLOAD: {
+                    if (known[instr->index] != -1) replace_value(function, value, known[instr->index]);
+                    else known[instr->index] = value;
+                } break;
+                case IR_CALL:
+                case IR_INVOKE:
+                case IR_RESUME:
+                case IR_YIELD: {
+                    for (int j = 0; j < global_count; ++j) known[j] = -1;
+                } break;
+                default: break;
+            }
+        }
+    }
+    free(known);
+}
+
+// Integer division may still stop the program, so it is kept unless the divisor is known to be harmless.
+// Element loads check their index, sized arrays their length, field reads that the instance has the field
+// and map reads that the map has the key.
+static bool may_trap(IRFunction* function, IRInstr* instr) {
+    if (instr->op == IR_LOAD_ELEMENT || instr->op == IR_NEW_ARRAY || instr->op == IR_GET_FIELD ||
+        instr->op == IR_MAP_GET) return true;
+    if (instr->op != IR_BINARY || instr->token != TOKEN_SLASH || instr->type != VALUE_INT) return false;
+    IRInstr* divisor = &function->instrs[resolve_value(function, instr->operands[1])];
+    return divisor->op != IR_CONST || AS_INT(divisor->constant) == 0 || AS_INT(divisor->constant) == -1;
+}
+
+static void eliminate_dead_code(IRFunction* function) {
+    bool* live = calloc(function->count, sizeof(bool));
+    int* worklist = malloc(sizeof(int) * function->count);
+    int top = 0;
+
+    for (int block = 0; block < function->block_count; ++block) {
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) continue;
+        for (int i = 0; i < target->count; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = &function->instrs[value];
+            if (instr->removed || !(has_side_effects(instr) || may_trap(function, instr))) continue;
+            live[value] = true;
+            worklist[top++] = value;
+        }
+    }
+
+    while (top > 0) {
+        IRInstr* instr = &function->instrs[worklist[--top]];
+        for (int i = 0; i < instr->count; ++i) {
+            int operand = resolve_value(function, instr->operands[i]);
+            if (live[operand]) continue;
+            live[operand] = true;
+            worklist[top++] = operand;
+        }
+    }
+
+    for (int value = 0; value < function->count; ++value) {
+        if (!live[value]) function->instrs[value].removed = true;
+    }
+    free(worklist);
+    free(live);
+}
+
+static void compact(IRFunction* function) {
+    for (int block = 0; block < function->block_count; ++block) {
+        IRBlock* target = &function->blocks[block];
+        if (target->removed) {
+            target->count = 0;
+            continue;
+        }
+
+        int kept = 0;
+        for (int i = 0; i < target->count; ++i) {
+            int value = target->instrs[i];
+            IRInstr* instr = &function->instrs[value];
+            if (instr->removed) continue;
+            for (int j = 0; j < instr->count; ++j) {
+                instr->operands[j] = resolve_value(function, instr->operands[j]);
+            }
+            target->instrs[kept++] = value;
+        }
+        target->count = kept;
+    }
+}
+
+static int intersect(Dominators* dominators, int a, int b) {
+    while (a != b) {
+        while (dominators->index[a] > dominators->index[b]) a = dominators->idom[a];
+        while (dominators->index[b] > dominators->index[a]) b = dominators->idom[b];
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+static void compute_dominators(IRFunction* function, Dominators* dominators) {
+    int count = function->block_count;
+    dominators->order = malloc(sizeof(int) * count);
+    dominators->index = malloc(sizeof(int) * count);
+    dominators->idom = malloc(sizeof(int) * count);
+    dominators->first_child = malloc(sizeof(int) * count);
+    dominators->next_sibling = malloc(sizeof(int) * count);
+    for (int i = 0; i < count; ++i) {
+        dominators->index[i] = -1;
+        dominators->idom[i] = -1;
+        dominators->first_child[i] = -1;
+        dominators->next_sibling[i] = -1;
+    }
+
+    int* stack = malloc(sizeof(int) * count);
+    int* next = calloc(count, sizeof(int));
+    bool* visited = calloc(count, sizeof(bool));
+    int* postorder = malloc(sizeof(int) * count);
+    int post_count = 0;
+    int top = 0;
+
+    stack[top++] = 0;
+    visited[0] = true;
+    while (top > 0) {
+        int block = stack[top - 1];
+        if (next[block] < successor_count(function, block)) {
+            int target = successor(function, block, next[block]++);
+            if (!visited[target]) {
+                visited[target] = true;
+                stack[top++] = target;
+            }
+        }
+        else {
+            postorder[post_count++] = block;
+            --top;
+        }
+    }
+
+    dominators->count = post_count;
+    for (int i = 0; i < post_count; ++i) {
+        dominators->order[i] = postorder[post_count - 1 - i];
+        dominators->index[dominators->order[i]] = i;
+    }
+
+    dominators->idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < post_count; ++i) {
+            int block = dominators->order[i];
+            IRBlock* target = &function->blocks[block];
+            int idom = -1;
+            for (int j = 0; j < target->pred_count; ++j) {
+                int pred = target->preds[j];
+                if (dominators->idom[pred] == -1) continue;
+                idom = idom == -1 ? pred : intersect(dominators, pred, idom);
+            }
+            if (dominators->idom[block] != idom) {
+                dominators->idom[block] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = post_count - 1; i > 0; --i) {
+        int block = dominators->order[i];
+        int parent = dominators->idom[block];
+        dominators->next_sibling[block] = dominators->first_child[parent];
+        dominators->first_child[parent] = block;
+    }
+
+    free(postorder);
+    free(visited);
+    free(next);
+    free(stack);
+}
+
+static void free_dominators(Dominators* dominators) {
+    free(dominators->order);
+    free(dominators->index);
+    free(dominators->idom);
+    free(dominators->first_child);
+    free(dominators->next_sibling);
+}
+
+static bool dominates(Dominators* dominators, int a, int b) {
+    while (b != a && b != 0) b = dominators->idom[b];
+    return b == a;
+}
+
+static bool is_commutative(IRInstr* instr) {
+    if (instr->op != IR_BINARY) return false;
+    switch (instr->token) {
+        case TOKEN_PLUS:
+        case TOKEN_ASTERISK:
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_BANG_EQUAL: return true;
+        default:               return false;
+    }
+}
+
+static bool is_expression(IRInstr* instr) {
+    return instr->op == IR_BINARY || instr->op == IR_UNARY || instr->op == IR_CAST || instr->op == IR_INTRINSIC;
+}
+
+// Operands are compared in sorted order for commutative operators but never reordered,
+// evaluation order of the original instruction stays intact.
+static void expression_operands(IRInstr* instr, int* first, int* second) {
+    *first = instr->operands[0];
+    *second = instr->count > 1 ? instr->operands[1] : -1;
+    if (is_commutative(instr) && *second < *first) {
+        int swap = *first;
+        *first = *second;
+        *second = swap;
+    }
+}
+
+static uint32_t hash_expression(IRInstr* instr) {
+    int first, second;
+    expression_operands(instr, &first, &second);
+    uint32_t hash = 2166136261u;
+    // fma's addend is the only third operand
+    int third = instr->count > 2 ? instr->operands[2] : -1;
+    int parts[] = { instr->op, instr->token, instr->type, instr->index, first, second, third };
+    for (int i = 0; i < 7; ++i) {
+        hash ^= (uint32_t)parts[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool same_expression(IRInstr* a, IRInstr* b) {
+    if (a->op != b->op || a->token != b->token || a->type != b->type || a->index != b->index ||
+        a->count != b->count) return false;
+    int a_first, a_second, b_first, b_second;
+    expression_operands(a, &a_first, &a_second);
+    expression_operands(b, &b_first, &b_second);
+    return a_first == b_first && a_second == b_second && (a->count < 3 || a->operands[2] == b->operands[2]);
+}
+
+static void eliminate_in_subtree(IRFunction* function, Dominators* dominators, ExpressionTable* table, int block) {
+    int mark = table->undo_count;
+    IRBlock* target = &function->blocks[block];
+    for (int i = 0; i < target->count; ++i) {
+        int value = target->instrs[i];
+        IRInstr* instr = &function->instrs[value];
+        if (instr->removed || !is_expression(instr)) continue;
+        for (int j = 0; j < instr->count; ++j) {
+            instr->operands[j] = resolve_value(function, instr->operands[j]);
+        }
+
+        int slot = (int)(hash_expression(instr) & (uint32_t)(table->capacity - 1));
+        while (table->values[slot] != -1 && !same_expression(&function->instrs[table->values[slot]], instr)) {
+            slot = (slot + 1) & (table->capacity - 1);
+        }
+        if (table->values[slot] != -1) {
+            replace_value(function, value, table->values[slot]);
+            continue;
+        }
+        table->values[slot] = value;
+        table->undo[table->undo_count++] = slot;
+    }
+
+    for (int child = dominators->first_child[block]; child != -1; child = dominators->next_sibling[child]) {
+        eliminate_in_subtree(function, dominators, table, child);
+    }
+    while (table->undo_count > mark) {
+        table->values[table->undo[--table->undo_count]] = -1;
+    }
+}
+
+// An expression dominated by an identical one reuses its value.
+static void eliminate_common_subexpressions(IRFunction* function, Dominators* dominators) {
+    ExpressionTable table = { .capacity = 16 };
+    while (table.capacity < function->count * 2) table.capacity *= 2;
+    table.values = malloc(sizeof(int) * table.capacity);
+    table.undo = malloc(sizeof(int) * function->count);
+    for (int i = 0; i < table.capacity; ++i) table.values[i] = -1;
+
+    eliminate_in_subtree(function, dominators, &table, 0);
+
+    free(table.undo);
+    free(table.values);
+}
+
+static void move_to_block(IRFunction* function, int block, int position, int destination) {
+    IRBlock* source = &function->blocks[block];
+    int value = source->instrs[position];
+    memmove(&source->instrs[position], &source->instrs[position + 1], sizeof(int) * (source->count - position - 1));
+    --source->count;
+
+    // the destination's terminator stays last
+    IRBlock* target = &function->blocks[destination];
+    if (target->capacity < target->count + 1) {
+        int old_capacity = target->capacity;
+        target->capacity = GROW_CAPACITY(old_capacity);
+        target->instrs = GROW_ARRAY(int, target->instrs, old_capacity, target->capacity);
+    }
+    target->instrs[target->count] = target->instrs[target->count - 1];
+    target->instrs[target->count - 1] = value;
+    ++target->count;
+    function->instrs[value].block = destination;
+}
+
+static bool is_invariant(IRFunction* function, IRInstr* instr, bool* in_loop, bool loop_calls, bool* stored) {
+    if (instr->op == IR_GLOAD) {
+        if (loop_calls || stored[instr->index]) return false;
+    }
+    else if (!is_expression(instr) || may_trap(function, instr)) {
+        return false;
+    }
+    for (int i = 0; i < instr->count; ++i) {
+        int operand = resolve_value(function, instr->operands[i]);
+        if (in_loop[function->instrs[operand].block]) return false;
+    }
+    return true;
+}
+
+// Marks the blocks of the natural loop of the back edge latch -> header.
+static void collect_loop(IRFunction* function, int header, int latch, bool* in_loop) {
+    int block_count = function->block_count;
+    memset(in_loop, 0, sizeof(bool) * block_count);
+    int* worklist = malloc(sizeof(int) * block_count);
+    int top = 0;
+
+    in_loop[header] = true;
+    if (!in_loop[latch]) {
+        in_loop[latch] = true;
+        worklist[top++] = latch;
+    }
+    while (top > 0) {
+        IRBlock* block = &function->blocks[worklist[--top]];
+        for (int i = 0; i < block->pred_count; ++i) {
+            int pred = block->preds[i];
+            if (in_loop[pred]) continue;
+            in_loop[pred] = true;
+            worklist[top++] = pred;
+        }
+    }
+    free(worklist);
+}
+
+// The only block entering the loop from outside, -1 unless it falls straight into the header.
+static int find_preheader(IRFunction* function, int header, bool* in_loop) {
+    int preheader = -1;
+    IRBlock* head = &function->blocks[header];
+    for (int i = 0; i < head->pred_count; ++i) {
+        if (in_loop[head->preds[i]]) continue;
+        if (preheader != -1) return -1;
+        preheader = head->preds[i];
+    }
+    if (preheader == -1 || successor_count(function, preheader) != 1) return -1;
+    return preheader;
+}
+
+// Moves computations that give the same result on every iteration to the block entering the loop.
+static bool hoist_from_loop(IRFunction* function, Dominators* dominators, int header, int latch, bool* in_loop) {
+    collect_loop(function, header, latch, in_loop);
+    int preheader = find_preheader(function, header, in_loop);
+    if (preheader == -1) return false;
+    int block_count = function->block_count;
+
+    bool loop_calls = false;
+    bool* stored = calloc(count_globals(function) + 1, sizeof(bool));
+    for (int block = 0; block < block_count; ++block) {
+        if (!in_loop[block]) continue;
+        IRBlock* target = &function->blocks[block];
+        for (int i = 0; i < target->count; ++i) {
+            IRInstr* instr = &function->instrs[target->instrs[i]];
+            if (instr->removed) continue;
+            if (instr->op == IR_CALL || instr->op == IR_TAIL_CALL || instr->op == IR_INVOKE ||
+                instr->op == IR_RESUME || instr->op == IR_YIELD) loop_calls = true;
+            if (instr->op == IR_GSTORE) stored[instr->index] = true;
+        }
+    }
+
+    bool hoisted = false;
+    for (int i = 0; i < dominators->count; ++i) {
+        int block = dominators->order[i];
+        if (!in_loop[block]) continue;
+        IRBlock* target = &function->blocks[block];
+        for (int j = 0; j < target->count;) {
+            IRInstr* instr = &function->instrs[target->instrs[j]];
+            if (instr->removed || !is_invariant(function, instr, in_loop, loop_calls, stored)) {
+                ++j;
+                continue;
+            }
+            move_to_block(function, block, j, preheader);
+            target = &function->blocks[block];
+            hoisted = true;
+        }
+    }
+    free(stored);
+    return hoisted;
+}
+
+static void hoist_loop_invariants(IRFunction* function, Dominators* dominators) {
+    bool* in_loop = malloc(sizeof(bool) * function->block_count);
+    // an inner loop's preheader belongs to the outer loop, repeat until nothing moves
+    bool hoisted = true;
+    for (int round = 0; hoisted && round < 8; ++round) {
+        hoisted = false;
+        for (int i = 0; i < dominators->count; ++i) {
+            int block = dominators->order[i];
+            for (int k = 0; k < successor_count(function, block); ++k) {
+                int target = successor(function, block, k);
+                if (dominates(dominators, target, block) &&
+                    hoist_from_loop(function, dominators, target, block, in_loop)) {
+                    hoisted = true;
+                }
+            }
+        }
+    }
+    free(in_loop);
+}
+
+// A loop counter: a phi of header starting at a non-negative value and stepping by one while it stays
+// below bound. Every block dominated by body, the true target of the header's test, sees it below bound.
+typedef struct Induction {
+    int header;
+    int latch;
+    int start;
+    int bound;
+    int body;
+} Induction;
+
+static bool is_non_negative(IRFunction* function, int value) {
+    IRInstr* instr = &function->instrs[value];
+    if (instr->op == IR_CONST) return instr->type == VALUE_INT && AS_INT(instr->constant) >= 0;
+    return instr->op == IR_BUILTIN && instr->index == BUILTIN_LEN;
+}
+
+static bool find_induction(IRFunction* function, Dominators* dominators, int value, Induction* induction) {
+    value = resolve_value(function, value);
+    IRInstr* phi = &function->instrs[value];
+    if (phi->op != IR_PHI || phi->type != VALUE_INT || phi->count != 2) return false;
+    int header = phi->block;
+    IRBlock* head = &function->blocks[header];
+    int back = dominates(dominators, header, head->preds[0]) ? 0 : 1;
+    if (!dominates(dominators, header, head->preds[back]) || dominates(dominators, header, head->preds[1 - back])) {
+        return false;
+    }
+
+    int start = resolve_value(function, phi->operands[1 - back]);
+    IRInstr* step = &function->instrs[resolve_value(function, phi->operands[back])];
+    if (step->op != IR_BINARY || step->token != TOKEN_PLUS || step->type != VALUE_INT) return false;
+    int left = resolve_value(function, step->operands[0]);
+    int right = resolve_value(function, step->operands[1]);
+    if (!(left == value && is_int_constant(&function->instrs[right], 1)) &&
+        !(right == value && is_int_constant(&function->instrs[left], 1))) {
+        return false;
+    }
+
+    IRInstr* test = &function->instrs[terminator(function, header)];
+    if (test->op != IR_BRANCH) return false;
+    IRInstr* condition = &function->instrs[resolve_value(function, test->operands[0])];
+    if (condition->op != IR_BINARY) return false;
+    left = resolve_value(function, condition->operands[0]);
+    right = resolve_value(function, condition->operands[1]);
+    int bound;
+    if (condition->token == TOKEN_LESS && left == value) bound = right;
+    else if (condition->token == TOKEN_GREATER && right == value) bound = left;
+    else return false;
+
+    // the step only runs below the bound, so it cannot wrap around
+    int body = test->targets[0];
+    if (function->blocks[body].pred_count != 1 || !dominates(dominators, body, step->block)) return false;
+    if (!is_non_negative(function, start)) return false;
+    *induction = (Induction){ header, head->preds[back], start, bound, body };
+    return true;
+}
+
+// An access whose index is a loop counter, placed where the counter is known to be below its bound.
+static bool is_counted_access(IRFunction* function, Dominators* dominators, IRInstr* access, Induction* induction) {
+    return find_induction(function, dominators, access->operands[1], induction) &&
+        dominates(dominators, induction->body, access->block);
+}
+
+// bound <= length of array, because bound is len(array) or the array was created with at least bound elements.
+static bool within_length(IRFunction* function, int bound, int array) {
+    bound = resolve_value(function, bound);
+    IRInstr* limit = &function->instrs[bound];
+    IRInstr* source = &function->instrs[resolve_value(function, array)];
+    if (limit->op == IR_BUILTIN && limit->index == BUILTIN_LEN &&
+        resolve_value(function, limit->operands[0]) == resolve_value(function, array)) {
+        return true;
+    }
+
+    int length;
+    if (source->op == IR_NEW_ARRAY) {
+        int size = resolve_value(function, source->operands[0]);
+        if (size == bound) return true;
+        if (function->instrs[size].op != IR_CONST) return false;
+        length = AS_INT(function->instrs[size].constant);
+    }
+    else if (source->op == IR_ARRAY) {
+        length = source->count;
+    }
+    else {
+        return false;
+    }
+    return limit->op == IR_CONST && AS_INT(limit->constant) <= length;
+}
+
+static void drop_check(IRInstr* access) {
+    access->op = access->op == IR_LOAD_ELEMENT ? IR_LOAD_UNCHECKED : IR_STORE_UNCHECKED;
+}
+
+// Checked accesses the guard of this loop can cover: indexed by its counter on every iteration,
+// with the array and the bound computed before the loop.
+static bool is_guardable(IRFunction* function, Dominators* dominators, IRInstr* access, int header, int latch, bool* in_loop) {
+    Induction induction;
+    return is_counted_access(function, dominators, access, &induction) && induction.header == header &&
+        dominates(dominators, access->block, latch) &&
+        !in_loop[function->instrs[resolve_value(function, access->operands[0])].block] &&
+        !in_loop[function->instrs[induction.bound].block];
+}
+
+// A loop that leaves only through its counter test, holds no inner loop and cannot print, call or stop
+// other than through its element accesses runs into an out of range index exactly when a guard before it
+// fails: the counter then reaches the array's length. The guard stops the program at the same error up
+// front, only the stores the loop would have made before failing are skipped.
+static void guard_loop(IRFunction* function, Dominators* dominators, int header, int latch, bool* in_loop) {
+    collect_loop(function, header, latch, in_loop);
+    int preheader = find_preheader(function, header, in_loop);
+    if (preheader == -1) return;
+    IRInstr* test = &function->instrs[terminator(function, header)];
+    if (test->op != IR_BRANCH) return;
+    int exit = test->targets[1];
+
+    int guardable = 0;
+    for (int block = 0; block < function->block_count; ++block) {
+        if (!in_loop[block]) continue;
+        IRBlock* target = &function->blocks[block];
+        for (int i = 0; i < target->count; ++i) {
+            IRInstr* instr = &function->instrs[target->instrs[i]];
+            if (instr->removed) continue;
+            switch (instr->op) {
+                case IR_CALL:
+                case IR_CALL_NATIVE:
+                case IR_TAIL_CALL:
+                case IR_RETURN:
+                case IR_PRINT:
+                case IR_BUILTIN:
+                case IR_NEW_ARRAY:
+                case IR_GUARD_LENGTH:
+                case IR_NEW_OBJECT:
+                case IR_GET_FIELD:
+                case IR_SET_FIELD:
+                case IR_INVOKE:
+                case IR_MAP_GET:
+                case IR_RESUME:
+                case IR_YIELD: return;
+                case IR_BINARY: {
+                    if (may_trap(function, instr)) return;
+                } break;
+                case IR_LOAD_ELEMENT:
+                case IR_STORE_ELEMENT: {
+                    if (!is_guardable(function, dominators, instr, header, latch, in_loop)) return;
+                    ++guardable;
+                } break;
+                default: break;
+            }
+        }
+        for (int i = 0; i < successor_count(function, block); ++i) {
+            int next = successor(function, block, i);
+            if (!in_loop[next] && !(block == header && next == exit)) return;
+            if (in_loop[next] && dominates(dominators, next, block) && !(block == latch && next == header)) return;
+        }
+    }
+    if (guardable == 0) return;
+
+    for (int block = 0; block < function->block_count; ++block) {
+        if (!in_loop[block]) continue;
+        for (int i = 0; i < function->blocks[block].count; ++i) {
+            int value = function->blocks[block].instrs[i];
+            IRInstr* access = &function->instrs[value];
+            if (access->removed || (access->op != IR_LOAD_ELEMENT && access->op != IR_STORE_ELEMENT)) continue;
+
+            Induction induction;
+            is_counted_access(function, dominators, access, &induction);
+            int array = resolve_value(function, access->operands[0]);
+            IRBlock* entry = &function->blocks[preheader];
+            bool guarded = false;
+            for (int j = 0; j < entry->count && !guarded; ++j) {
+                IRInstr* guard = &function->instrs[entry->instrs[j]];
+                guarded = guard->op == IR_GUARD_LENGTH && !guard->removed &&
+                    resolve_value(function, guard->operands[0]) == array;
+            }
+            drop_check(access);
+            if (guarded) continue;
+
+            // inserting may move the instructions, nothing is read through the old pointers below
+            int guard = insert_ir_instr(function, preheader, entry->count - 1, IR_GUARD_LENGTH, VALUE_NONE, access->line);
+            add_ir_operand(function, guard, array);
+            add_ir_operand(function, guard, induction.start);
+            add_ir_operand(function, guard, induction.bound);
+        }
+    }
+}
+
+// Element accesses indexed by a loop counter that stays below the array's length skip their bounds
+// check, other counted accesses share one length guard per array ahead of a loop that allows it.
+static void eliminate_bounds_checks(IRFunction* function, Dominators* dominators) {
+    for (int i = 0; i < dominators->count; ++i) {
+        IRBlock* target = &function->blocks[dominators->order[i]];
+        for (int j = 0; j < target->count; ++j) {
+            IRInstr* access = &function->instrs[target->instrs[j]];
+            if (access->removed || (access->op != IR_LOAD_ELEMENT && access->op != IR_STORE_ELEMENT)) continue;
+            Induction induction;
+            if (is_counted_access(function, dominators, access, &induction) &&
+                within_length(function, induction.bound, access->operands[0])) {
+                drop_check(access);
+            }
+        }
+    }
+
+    // inner loops first, their guards then keep the enclosing loop checked
+    bool* in_loop = malloc(sizeof(bool) * function->block_count);
+    for (int i = dominators->count - 1; i >= 0; --i) {
+        int header = dominators->order[i];
+        IRBlock* head = &function->blocks[header];
+        int latch = -1;
+        for (int j = 0; j < head->pred_count; ++j) {
+            if (!dominates(dominators, header, head->preds[j])) continue;
+            latch = latch == -1 ? head->preds[j] : -2;
+        }
+        if (latch >= 0) guard_loop(function, dominators, header, latch, in_loop);
+    }
+    free(in_loop);
+}
+
+typedef struct Magic {
+    int32_t multiplier;
+    int shift;
+} Magic;
+
+// Hacker's Delight, 10-1: n / d == (mulhi(n, multiplier) (+/- n) >> shift) + 1 if that is negative.
+// d must not be -1, 0, 1 or INT32_MIN.
+static Magic signed_magic(int32_t d) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = (uint32_t)(d < 0 ? -d : d);
+    uint32_t t = two31 + ((uint32_t)d >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    int p = 31;
+    uint32_t q1 = two31 / anc;
+    uint32_t r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad;
+    uint32_t r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    Magic magic = { .multiplier = (int32_t)(q2 + 1), .shift = p - 32 };
+    if (d < 0) magic.multiplier = -magic.multiplier;
+    return magic;
+}
+
+static int power_of_two(int32_t value) {
+    if (value < 2 || (value & (value - 1)) != 0) return -1;
+    int shift = 0;
+    while ((1 << shift) != value) ++shift;
+    return shift;
+}
+
+static int insert_shift(IRFunction* function, int block, int* position, IROp op, int operand, int shift, int line) {
+    int value = insert_ir_instr(function, block, (*position)++, op, VALUE_INT, line);
+    function->instrs[value].index = shift;
+    add_ir_operand(function, value, operand);
+    return value;
+}
+
+// Truncating division by a constant as one multiply-high, the correction and shift travel in index.
+static int divide_by_constant(IRFunction* function, int block, int* position, int dividend, int32_t divisor, int line) {
+    Magic magic = signed_magic(divisor);
+    int mode = magic.shift;
+    if (divisor > 0 && magic.multiplier < 0) mode |= DIV_MAGIC_ADD;
+    else if (divisor < 0 && magic.multiplier > 0) mode |= DIV_MAGIC_SUB;
+
+    int value = insert_ir_instr(function, block, (*position)++, IR_DIV_MAGIC, VALUE_INT, line);
+    function->instrs[value].index = mode;
+    add_ir_operand(function, value, dividend);
+    add_ir_operand(function, value, add_ir_constant(function, INT_VALUE(magic.multiplier), line));
+    return value;
+}
+
+// Integer multiplies by powers of two become shifts and divisions by constants become a fused
+// multiply-high, both bit-exact with the wrapping, truncating originals. The division stays a single
+// instruction so the interpreter pays one dispatch for it, same as the divide it replaces.
+static void reduce_strength(IRFunction* function) {
+    for (int block = 0; block < function->block_count; ++block) {
+        if (function->blocks[block].removed) continue;
+
+        for (int i = 0; i < function->blocks[block].count; ++i) {
+            int value = function->blocks[block].instrs[i];
+            IRInstr* instr = &function->instrs[value];
+            if (instr->removed || instr->op != IR_BINARY || instr->type != VALUE_INT) continue;
+
+            int left = resolve_value(function, instr->operands[0]);
+            int right = resolve_value(function, instr->operands[1]);
+            IRInstr* right_instr = &function->instrs[right];
+            IRInstr* left_instr = &function->instrs[left];
+            int line = instr->line;
+            int position = i;
+            int replacement = -1;
+
+            if (instr->token == TOKEN_ASTERISK) {
+                if (left_instr->op == IR_CONST && right_instr->op != IR_CONST) {
+                    int swap = left;
+                    left = right;
+                    right = swap;
+                    right_instr = &function->instrs[right];
+                }
+                int shift = right_instr->op == IR_CONST ? power_of_two(AS_INT(right_instr->constant)) : -1;
+                if (shift != -1) replacement = insert_shift(function, block, &position, IR_SHL, left, shift, line);
+            }
+            else if (instr->token == TOKEN_SLASH && right_instr->op == IR_CONST) {
+                int32_t divisor = AS_INT(right_instr->constant);
+                if (divisor != 0 && divisor != 1 && divisor != -1 && divisor != INT32_MIN) {
+                    replacement = divide_by_constant(function, block, &position, left, divisor, line);
+                }
+            }
+
+            if (replacement == -1) continue;
+            replace_value(function, value, replacement);
+            i = position;
+        }
+    }
+}
+
+static bool eliminates_bounds_checks = true;
+
+void set_bounds_check_elimination(bool enabled) {
+    eliminates_bounds_checks = enabled;
+}
+
+void optimize_ir(IRFunction* function, int level) {
+    if (level < 1) return;
+
+    remove_unreachable(function);
+    simplify(function);
+    forward_globals(function);
+    simplify(function);
+
+    if (level >= 2) {
+        Dominators dominators = { 0 };
+        compute_dominators(function, &dominators);
+        eliminate_common_subexpressions(function, &dominators);
+        hoist_loop_invariants(function, &dominators);
+        free_dominators(&dominators);
+        // hoisted loads may now follow a store in the preheader
+        forward_globals(function);
+        simplify(function);
+    }
+
+    if (eliminates_bounds_checks) {
+        // simplify may have folded branches, so the dominators are computed afresh
+        Dominators dominators = { 0 };
+        compute_dominators(function, &dominators);
+        eliminate_bounds_checks(function, &dominators);
+        free_dominators(&dominators);
+    }
+
+    reduce_strength(function);
+    eliminate_dead_code(function);
+    compact(function);
+}
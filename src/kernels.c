@@ -0,0 +1,443 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "kernels.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#define LANES 8
+
+static bool has_avx2() {
+    static _Thread_local int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2");
+    }
+    return supported;
+}
+#endif
+
+// Integer arithmetic goes through uint32_t, which wraps where int32_t overflow would be undefined.
+static int32_t wrap_add(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static int32_t wrap_mul(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a * (uint32_t)b);
+}
+
+static int32_t sum_ints_scalar(const int32_t* values, int count, int32_t sum) {
+    for (int i = 0; i < count; ++i) sum = wrap_add(sum, values[i]);
+    return sum;
+}
+
+static float sum_floats_scalar(const float* values, int count, float sum) {
+    for (int i = 0; i < count; ++i) sum += values[i];
+    return sum;
+}
+
+static int32_t min_ints_scalar(const int32_t* values, int count, int32_t min) {
+    for (int i = 0; i < count; ++i) min = values[i] < min ? values[i] : min;
+    return min;
+}
+
+static float min_floats_scalar(const float* values, int count, float min) {
+    for (int i = 0; i < count; ++i) min = values[i] < min ? values[i] : min;
+    return min;
+}
+
+static int32_t max_ints_scalar(const int32_t* values, int count, int32_t max) {
+    for (int i = 0; i < count; ++i) max = values[i] > max ? values[i] : max;
+    return max;
+}
+
+static float max_floats_scalar(const float* values, int count, float max) {
+    for (int i = 0; i < count; ++i) max = values[i] > max ? values[i] : max;
+    return max;
+}
+
+static int32_t dot_ints_scalar(const int32_t* a, const int32_t* b, int count, int32_t sum) {
+    for (int i = 0; i < count; ++i) sum = wrap_add(sum, wrap_mul(a[i], b[i]));
+    return sum;
+}
+
+static float dot_floats_scalar(const float* a, const float* b, int count, float sum) {
+    for (int i = 0; i < count; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+static void scale_ints_scalar(int32_t* out, const int32_t* values, int32_t factor, int count) {
+    for (int i = 0; i < count; ++i) out[i] = wrap_mul(values[i], factor);
+}
+
+static void scale_floats_scalar(float* out, const float* values, float factor, int count) {
+    for (int i = 0; i < count; ++i) out[i] = values[i] * factor;
+}
+
+static void add_ints_scalar(int32_t* out, const int32_t* a, const int32_t* b, int count) {
+    for (int i = 0; i < count; ++i) out[i] = wrap_add(a[i], b[i]);
+}
+
+static void add_floats_scalar(float* out, const float* a, const float* b, int count) {
+    for (int i = 0; i < count; ++i) out[i] = a[i] + b[i];
+}
+
+static void mul_ints_scalar(int32_t* out, const int32_t* a, const int32_t* b, int count) {
+    for (int i = 0; i < count; ++i) out[i] = wrap_mul(a[i], b[i]);
+}
+
+static void mul_floats_scalar(float* out, const float* a, const float* b, int count) {
+    for (int i = 0; i < count; ++i) out[i] = a[i] * b[i];
+}
+
+static void prefix_sum_ints_scalar(int32_t* out, const int32_t* values, int count, int32_t sum) {
+    for (int i = 0; i < count; ++i) out[i] = sum = wrap_add(sum, values[i]);
+}
+
+static void prefix_sum_floats_scalar(float* out, const float* values, int count, float sum) {
+    for (int i = 0; i < count; ++i) out[i] = sum += values[i];
+}
+
+#ifdef __x86_64__
+// Horizontal reductions fold the upper half onto the lower one until a single lane is left.
+AVX2 static int32_t reduce_add_ints(__m256i v) {
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+AVX2 static float reduce_add_floats(__m256 v) {
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(x);
+}
+
+AVX2 static int32_t reduce_min_ints(__m256i v) {
+    __m128i x = _mm_min_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_min_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_min_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+AVX2 static int32_t reduce_max_ints(__m256i v) {
+    __m128i x = _mm_max_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_max_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_max_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+AVX2 static float reduce_min_floats(__m256 v) {
+    __m128 x = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_min_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(x);
+}
+
+AVX2 static float reduce_max_floats(__m256 v) {
+    __m128 x = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_max_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(x);
+}
+
+AVX2 static int32_t sum_ints_avx2(const int32_t* values, int count) {
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i*)(values + i)));
+    }
+    return sum_ints_scalar(values + i, count - i, reduce_add_ints(sum));
+}
+
+AVX2 static float sum_floats_avx2(const float* values, int count) {
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) sum = _mm256_add_ps(sum, _mm256_loadu_ps(values + i));
+    return sum_floats_scalar(values + i, count - i, reduce_add_floats(sum));
+}
+
+AVX2 static int32_t min_ints_avx2(const int32_t* values, int count) {
+    __m256i min = _mm256_set1_epi32(values[0]);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        min = _mm256_min_epi32(min, _mm256_loadu_si256((const __m256i*)(values + i)));
+    }
+    return min_ints_scalar(values + i, count - i, reduce_min_ints(min));
+}
+
+AVX2 static float min_floats_avx2(const float* values, int count) {
+    __m256 min = _mm256_set1_ps(values[0]);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) min = _mm256_min_ps(_mm256_loadu_ps(values + i), min);
+    return min_floats_scalar(values + i, count - i, reduce_min_floats(min));
+}
+
+AVX2 static int32_t max_ints_avx2(const int32_t* values, int count) {
+    __m256i max = _mm256_set1_epi32(values[0]);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        max = _mm256_max_epi32(max, _mm256_loadu_si256((const __m256i*)(values + i)));
+    }
+    return max_ints_scalar(values + i, count - i, reduce_max_ints(max));
+}
+
+AVX2 static float max_floats_avx2(const float* values, int count) {
+    __m256 max = _mm256_set1_ps(values[0]);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) max = _mm256_max_ps(_mm256_loadu_ps(values + i), max);
+    return max_floats_scalar(values + i, count - i, reduce_max_floats(max));
+}
+
+AVX2 static int32_t dot_ints_avx2(const int32_t* a, const int32_t* b, int count) {
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                             _mm256_loadu_si256((const __m256i*)(b + i)));
+        sum = _mm256_add_epi32(sum, product);
+    }
+    return dot_ints_scalar(a + i, b + i, count - i, reduce_add_ints(sum));
+}
+
+// Multiplies and adds stay separate instructions, a fused multiply-add would round differently.
+AVX2 static float dot_floats_avx2(const float* a, const float* b, int count) {
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    return dot_floats_scalar(a + i, b + i, count - i, reduce_add_floats(sum));
+}
+
+AVX2 static void scale_ints_avx2(int32_t* out, const int32_t* values, int32_t factor, int count) {
+    __m256i factors = _mm256_set1_epi32(factor);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(values + i)), factors);
+        _mm256_storeu_si256((__m256i*)(out + i), product);
+    }
+    scale_ints_scalar(out + i, values + i, factor, count - i);
+}
+
+AVX2 static void scale_floats_avx2(float* out, const float* values, float factor, int count) {
+    __m256 factors = _mm256_set1_ps(factor);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(values + i), factors));
+    }
+    scale_floats_scalar(out + i, values + i, factor, count - i);
+}
+
+AVX2 static void add_ints_avx2(int32_t* out, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256i sum = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                       _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), sum);
+    }
+    add_ints_scalar(out + i, a + i, b + i, count - i);
+}
+
+AVX2 static void add_floats_avx2(float* out, const float* a, const float* b, int count) {
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    add_floats_scalar(out + i, a + i, b + i, count - i);
+}
+
+AVX2 static void mul_ints_avx2(int32_t* out, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                             _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), product);
+    }
+    mul_ints_scalar(out + i, a + i, b + i, count - i);
+}
+
+AVX2 static void mul_floats_avx2(float* out, const float* a, const float* b, int count) {
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    mul_floats_scalar(out + i, a + i, b + i, count - i);
+}
+
+// Scans each 128-bit half with two shifted adds, carries the low half's total into the high half
+// and then adds the running total of the previous blocks.
+AVX2 static __m256i scan_ints(__m256i x) {
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+    __m256i low_total = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_add_epi32(x, _mm256_permute2x128_si256(low_total, low_total, 0x08));
+}
+
+AVX2 static void prefix_sum_ints_avx2(int32_t* out, const int32_t* values, int count) {
+    __m256i total = _mm256_setzero_si256();
+    __m256i last = _mm256_set1_epi32(LANES - 1);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256i x = _mm256_add_epi32(scan_ints(_mm256_loadu_si256((const __m256i*)(values + i))), total);
+        _mm256_storeu_si256((__m256i*)(out + i), x);
+        total = _mm256_permutevar8x32_epi32(x, last);
+    }
+    prefix_sum_ints_scalar(out + i, values + i, count - i, _mm256_extract_epi32(total, 0));
+}
+
+AVX2 static void prefix_sum_floats_avx2(float* out, const float* values, int count) {
+    __m256 total = _mm256_setzero_ps();
+    __m256i last = _mm256_set1_epi32(LANES - 1);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        __m256 x = _mm256_loadu_ps(values + i);
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+        __m256 low_total = _mm256_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+        x = _mm256_add_ps(x, _mm256_permute2f128_ps(low_total, low_total, 0x08));
+        x = _mm256_add_ps(x, total);
+        _mm256_storeu_ps(out + i, x);
+        total = _mm256_permutevar8x32_ps(x, last);
+    }
+    prefix_sum_floats_scalar(out + i, values + i, count - i, _mm256_cvtss_f32(total));
+}
+
+#endif
+
+int32_t sum_ints(const int32_t* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return sum_ints_avx2(values, count);
+#endif
+    return sum_ints_scalar(values, count, 0);
+}
+
+float sum_floats(const float* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return sum_floats_avx2(values, count);
+#endif
+    return sum_floats_scalar(values, count, 0.0f);
+}
+
+int32_t min_ints(const int32_t* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return min_ints_avx2(values, count);
+#endif
+    return min_ints_scalar(values, count, values[0]);
+}
+
+float min_floats(const float* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return min_floats_avx2(values, count);
+#endif
+    return min_floats_scalar(values, count, values[0]);
+}
+
+int32_t max_ints(const int32_t* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return max_ints_avx2(values, count);
+#endif
+    return max_ints_scalar(values, count, values[0]);
+}
+
+float max_floats(const float* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return max_floats_avx2(values, count);
+#endif
+    return max_floats_scalar(values, count, values[0]);
+}
+
+int32_t dot_ints(const int32_t* a, const int32_t* b, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return dot_ints_avx2(a, b, count);
+#endif
+    return dot_ints_scalar(a, b, count, 0);
+}
+
+float dot_floats(const float* a, const float* b, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) return dot_floats_avx2(a, b, count);
+#endif
+    return dot_floats_scalar(a, b, count, 0.0f);
+}
+
+void scale_ints(int32_t* out, const int32_t* values, int32_t factor, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        scale_ints_avx2(out, values, factor, count);
+        return;
+    }
+#endif
+    scale_ints_scalar(out, values, factor, count);
+}
+
+void scale_floats(float* out, const float* values, float factor, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        scale_floats_avx2(out, values, factor, count);
+        return;
+    }
+#endif
+    scale_floats_scalar(out, values, factor, count);
+}
+
+void add_ints(int32_t* out, const int32_t* a, const int32_t* b, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        add_ints_avx2(out, a, b, count);
+        return;
+    }
+#endif
+    add_ints_scalar(out, a, b, count);
+}
+
+void add_floats(float* out, const float* a, const float* b, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        add_floats_avx2(out, a, b, count);
+        return;
+    }
+#endif
+    add_floats_scalar(out, a, b, count);
+}
+
+void mul_ints(int32_t* out, const int32_t* a, const int32_t* b, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        mul_ints_avx2(out, a, b, count);
+        return;
+    }
+#endif
+    mul_ints_scalar(out, a, b, count);
+}
+
+void mul_floats(float* out, const float* a, const float* b, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        mul_floats_avx2(out, a, b, count);
+        return;
+    }
+#endif
+    mul_floats_scalar(out, a, b, count);
+}
+
+void prefix_sum_ints(int32_t* out, const int32_t* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        prefix_sum_ints_avx2(out, values, count);
+        return;
+    }
+#endif
+    prefix_sum_ints_scalar(out, values, count, 0);
+}
+
+void prefix_sum_floats(float* out, const float* values, int count) {
+#ifdef __x86_64__
+    if (has_avx2()) {
+        prefix_sum_floats_avx2(out, values, count);
+        return;
+    }
+#endif
+    prefix_sum_floats_scalar(out, values, count, 0.0f);
+}
@@ -12,7 +12,7 @@ typedef struct Lexer {
     int line;
 } Lexer;
 
-static Lexer lexer;
+static _Thread_local Lexer lexer;
 
 static bool is_at_end() {
     return *lexer.current == '\0';
@@ -87,6 +87,8 @@ static Token read_number() {
 
 static Token read_string() {
     while (peek() != '"' && !is_at_end()) {
+        // the parser decodes escapes, the lexer only has to step over an escaped quote
+        if (peek() == '\\' && lexer.current[1] != '\0') advance();
         if (peek() == '\n') ++lexer.line;
         advance();
     }
@@ -112,16 +114,25 @@ static Token read_keyword_or_identifier() {
         "float",
         "for",
         "func",
+        "gen",
         "if",
+        "in",
+        "inline",
         "int",
+        "map",
+        "noinline",
         "null",
+        "object",
         "or",
         "print",
+        "pure",
         "return",
+        "string",
         "this",
         "true",
         "var",
         "while",
+        "yield",
     };
     const int keywords_amount = sizeof(keywords) / sizeof(keywords[0]);
 
@@ -234,9 +245,9 @@ const char* token_as_cstr(TokenType type) {
         "IDENTIFIER", "INT_LITERAL", "FLOAT_LITERAL", "STRING_LITERAL",
 
         "and", "bool", "class", "const", "else",
-        "false", "float", "for", "func", "if",
-        "int", "null", "or", "print", "return",
-        "this", "true", "var", "while",
+        "false", "float", "for", "func", "gen", "if", "in",
+        "inline", "int", "map", "noinline", "null", "object", "or", "print", "pure", "return",
+        "string", "this", "true", "var", "while", "yield",
 
         "ERROR",
     };
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "make_node.h"
+#include "memory.h"
 
 ASTNode* make_node_binary(int line, ASTNode* left, TokenType op, ASTNode* right) {
     ASTNode* node = malloc(sizeof(ASTNode));
@@ -40,3 +41,329 @@ ASTNode* make_node_cast(int line, ValueType target_type, ASTNode* expression) {
     node->cast.expression = expression;
     return node;
 }
+
+ASTNode* make_node_variable(int line, Token name) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_VARIABLE;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->variable.name = name;
+    node->variable.slot = -1;
+    node->variable.is_global = false;
+    return node;
+}
+
+ASTNode* make_node_assignment(int line, Token name, ASTNode* value) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_ASSIGNMENT;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->assignment.name = name;
+    node->assignment.slot = -1;
+    node->assignment.is_global = false;
+    node->assignment.value = value;
+    return node;
+}
+
+ASTNode* make_node_var_decl(int line, Token name, bool is_const, ValueType declared_type, ASTNode* initializer) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_VAR_DECL;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->var_decl.name = name;
+    node->var_decl.slot = -1;
+    node->var_decl.is_global = false;
+    node->var_decl.is_const = is_const;
+    node->var_decl.declared_type = declared_type;
+    node->var_decl.initializer = initializer;
+    return node;
+}
+
+ASTNode* make_node_print(int line, ASTNode* expression) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_PRINT;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->print.expression = expression;
+    return node;
+}
+
+ASTNode* make_node_expression_statement(int line, ASTNode* expression) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_EXPRESSION_STATEMENT;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->expression_statement.expression = expression;
+    return node;
+}
+
+ASTNode* make_node_block(int line) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_BLOCK;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->block.statements = NULL;
+    node->block.count = 0;
+    node->block.capacity = 0;
+    node->block.local_count = 0;
+    return node;
+}
+
+ASTNode* make_node_if(int line, ASTNode* condition, ASTNode* then_branch, ASTNode* else_branch) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_IF;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->if_.condition = condition;
+    node->if_.then_branch = then_branch;
+    node->if_.else_branch = else_branch;
+    return node;
+}
+
+ASTNode* make_node_while(int line, ASTNode* condition, ASTNode* body) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_WHILE;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->while_.condition = condition;
+    node->while_.body = body;
+    return node;
+}
+
+ASTNode* make_node_for(int line, ASTNode* initializer, ASTNode* condition, ASTNode* increment, ASTNode* body) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_FOR;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->for_.initializer = initializer;
+    node->for_.condition = condition;
+    node->for_.increment = increment;
+    node->for_.body = body;
+    node->for_.local_count = 0;
+    return node;
+}
+
+ASTNode* make_node_function(int line, Token name) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_FUNCTION;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->function.name = name;
+    node->function.params = NULL;
+    node->function.arity = 0;
+    node->function.capacity = 0;
+    node->function.return_type = VALUE_NONE;
+    node->function.hint = INLINE_DEFAULT;
+    node->function.is_pure = false;
+    node->function.body = NULL;
+    node->function.index = -1;
+    return node;
+}
+
+ASTNode* make_node_call(int line, Token name) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_CALL;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->call.name = name;
+    node->call.arguments = NULL;
+    node->call.count = 0;
+    node->call.capacity = 0;
+    node->call.index = -1;
+    node->call.builtin = -1;
+    node->call.class_index = -1;
+    node->call.native = -1;
+    node->call.intrinsic = -1;
+    node->call.is_tail = false;
+    return node;
+}
+
+ASTNode* make_node_return(int line, ASTNode* value) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_RETURN;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->return_.value = value;
+    return node;
+}
+
+ASTNode* make_node_yield(int line, ASTNode* value) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_YIELD;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->yield_.value = value;
+    return node;
+}
+
+ASTNode* make_node_array(int line, ValueType element_type, ASTNode* length) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_ARRAY;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->array.element_type = element_type;
+    node->array.length = length;
+    node->array.elements = NULL;
+    node->array.count = 0;
+    node->array.capacity = 0;
+    return node;
+}
+
+ASTNode* make_node_subscript(int line, ASTNode* array, ASTNode* index) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_SUBSCRIPT;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->subscript.array = array;
+    node->subscript.index = index;
+    return node;
+}
+
+ASTNode* make_node_subscript_assignment(int line, ASTNode* array, ASTNode* index, ASTNode* value) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_SUBSCRIPT_ASSIGNMENT;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->subscript_assignment.array = array;
+    node->subscript_assignment.index = index;
+    node->subscript_assignment.value = value;
+    return node;
+}
+
+ASTNode* make_node_class(int line, Token name) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_CLASS;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->class_.name = name;
+    node->class_.fields = NULL;
+    node->class_.field_count = 0;
+    node->class_.field_capacity = 0;
+    node->class_.methods = NULL;
+    node->class_.method_count = 0;
+    node->class_.method_capacity = 0;
+    node->class_.index = -1;
+    return node;
+}
+
+ASTNode* make_node_get_field(int line, ASTNode* object, Token name) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_GET_FIELD;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->get_field.object = object;
+    node->get_field.name = name;
+    return node;
+}
+
+ASTNode* make_node_set_field(int line, ASTNode* object, Token name, ASTNode* value) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_SET_FIELD;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->set_field.object = object;
+    node->set_field.name = name;
+    node->set_field.value = value;
+    return node;
+}
+
+ASTNode* make_node_invoke(int line, ASTNode* object, Token name) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_INVOKE;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->invoke.object = object;
+    node->invoke.name = name;
+    node->invoke.arguments = NULL;
+    node->invoke.count = 0;
+    node->invoke.capacity = 0;
+    node->invoke.function = -1;
+    return node;
+}
+
+ASTNode* make_node_map(int line, ValueType value_type) {
+    ASTNode* node = malloc(sizeof(ASTNode));
+    node->type = AST_NODE_MAP;
+    node->inferred_type = VALUE_NONE;
+    node->line = line;
+    node->map.value_type = value_type;
+    node->map.keys = NULL;
+    node->map.values = NULL;
+    node->map.count = 0;
+    node->map.capacity = 0;
+    return node;
+}
+
+void append_to_block(ASTNode* block, ASTNode* statement) {
+    if (block->block.capacity < block->block.count + 1) {
+        int old_capacity = block->block.capacity;
+        block->block.capacity = GROW_CAPACITY(old_capacity);
+        block->block.statements = GROW_ARRAY(ASTNode*, block->block.statements, old_capacity, block->block.capacity);
+    }
+    block->block.statements[block->block.count++] = statement;
+}
+
+void append_parameter(ASTNode* function, Token name, ValueType type) {
+    if (function->function.capacity < function->function.arity + 1) {
+        int old_capacity = function->function.capacity;
+        function->function.capacity = GROW_CAPACITY(old_capacity);
+        function->function.params = GROW_ARRAY(Parameter, function->function.params, old_capacity, function->function.capacity);
+    }
+    function->function.params[function->function.arity++] = (Parameter){ .name = name, .type = type };
+}
+
+void append_argument(ASTNode* call, ASTNode* argument) {
+    if (call->call.capacity < call->call.count + 1) {
+        int old_capacity = call->call.capacity;
+        call->call.capacity = GROW_CAPACITY(old_capacity);
+        call->call.arguments = GROW_ARRAY(ASTNode*, call->call.arguments, old_capacity, call->call.capacity);
+    }
+    call->call.arguments[call->call.count++] = argument;
+}
+
+void append_element(ASTNode* array, ASTNode* element) {
+    if (array->array.capacity < array->array.count + 1) {
+        int old_capacity = array->array.capacity;
+        array->array.capacity = GROW_CAPACITY(old_capacity);
+        array->array.elements = GROW_ARRAY(ASTNode*, array->array.elements, old_capacity, array->array.capacity);
+    }
+    array->array.elements[array->array.count++] = element;
+}
+
+void append_field(ASTNode* klass, Token name, ValueType type) {
+    if (klass->class_.field_capacity < klass->class_.field_count + 1) {
+        int old_capacity = klass->class_.field_capacity;
+        klass->class_.field_capacity = GROW_CAPACITY(old_capacity);
+        klass->class_.fields = GROW_ARRAY(Parameter, klass->class_.fields, old_capacity, klass->class_.field_capacity);
+    }
+    klass->class_.fields[klass->class_.field_count++] = (Parameter){ .name = name, .type = type };
+}
+
+void append_method(ASTNode* klass, ASTNode* method) {
+    if (klass->class_.method_capacity < klass->class_.method_count + 1) {
+        int old_capacity = klass->class_.method_capacity;
+        klass->class_.method_capacity = GROW_CAPACITY(old_capacity);
+        klass->class_.methods = GROW_ARRAY(ASTNode*, klass->class_.methods, old_capacity, klass->class_.method_capacity);
+    }
+    klass->class_.methods[klass->class_.method_count++] = method;
+}
+
+void append_invoke_argument(ASTNode* invoke, ASTNode* argument) {
+    if (invoke->invoke.capacity < invoke->invoke.count + 1) {
+        int old_capacity = invoke->invoke.capacity;
+        invoke->invoke.capacity = GROW_CAPACITY(old_capacity);
+        invoke->invoke.arguments = GROW_ARRAY(ASTNode*, invoke->invoke.arguments, old_capacity, invoke->invoke.capacity);
+    }
+    invoke->invoke.arguments[invoke->invoke.count++] = argument;
+}
+
+void append_entry(ASTNode* map, ASTNode* key, ASTNode* value) {
+    if (map->map.capacity < map->map.count + 1) {
+        int old_capacity = map->map.capacity;
+        map->map.capacity = GROW_CAPACITY(old_capacity);
+        map->map.keys = GROW_ARRAY(ASTNode*, map->map.keys, old_capacity, map->map.capacity);
+        map->map.values = GROW_ARRAY(ASTNode*, map->map.values, old_capacity, map->map.capacity);
+    }
+    map->map.keys[map->map.count] = key;
+    map->map.values[map->map.count++] = value;
+}
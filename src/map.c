@@ -0,0 +1,134 @@
+#include <string.h>
+#include "gc.h"
+#include "map.h"
+#include "memory.h"
+#include "rope.h"
+
+// marks a slot whose key was removed, lookups probe past it and inserts reuse it
+static CString tombstone = { 0 };
+#define TOMBSTONE (&tombstone)
+
+Map* new_map(ValueType value_type) {
+    Map* map = allocate_tenured_object(sizeof(Map), OBJ_MAP);
+    map->value_type = value_type;
+    map->count = 0;
+    map->used = 0;
+    map->capacity = 0;
+    map->slots = NULL;
+    return map;
+}
+
+size_t map_size(Map* map) {
+    return sizeof(Map) + sizeof(MapSlot) * map->capacity;
+}
+
+void free_map(Map* map) {
+    reallocate(map->slots, sizeof(MapSlot) * map->capacity, 0);
+    reallocate(map, sizeof(Map), 0);
+}
+
+// Young strings are copied out of the nursery before they are stored, equal old strings are reused.
+static CString* tenured(CString* string) {
+    return string->obj.color == COLOR_YOUNG ? tenure_runtime_cstring(string) : string;
+}
+
+// Returns the slot holding key, or the free slot it belongs in.
+static MapSlot* find_slot(MapSlot* slots, int capacity, CString* key) {
+    int index = key->hash & (capacity - 1);
+    MapSlot* free_slot = NULL;
+    for (;;) {
+        MapSlot* slot = &slots[index];
+        if (slot->key == NULL) return free_slot != NULL ? free_slot : slot;
+        if (slot->key == TOMBSTONE) {
+            if (free_slot == NULL) free_slot = slot;
+        }
+        else if (cstrings_equal(slot->key, key)) {
+            return slot;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static bool is_key(CString* key) {
+    return key != NULL && key != TOMBSTONE;
+}
+
+// Rehashing also drops tombstones, the map only doubles when live keys fill half of it.
+static void grow_map(Map* map) {
+    int capacity = map->capacity;
+    if (map->count + 1 > capacity * MAP_MAX_LOAD / 2) capacity = GROW_CAPACITY(capacity);
+
+    MapSlot* slots = GROW_ARRAY(MapSlot, NULL, 0, capacity);
+    memset(slots, 0, sizeof(MapSlot) * capacity);
+    for (int i = 0; i < map->capacity; ++i) {
+        MapSlot* slot = &map->slots[i];
+        if (!is_key(slot->key)) continue;
+
+        int index = slot->key->hash & (capacity - 1);
+        while (slots[index].key != NULL) index = (index + 1) & (capacity - 1);
+        slots[index] = *slot;
+    }
+    reallocate(map->slots, sizeof(MapSlot) * map->capacity, 0);
+    map->slots = slots;
+    map->capacity = capacity;
+    map->used = map->count;
+}
+
+bool map_get(Map* map, CString* key, Value* value) {
+    if (map->count == 0) return false;
+    MapSlot* slot = find_slot(map->slots, map->capacity, key);
+    if (!is_key(slot->key)) return false;
+    *value = map_slot_value(map, (int)(slot - map->slots));
+    return true;
+}
+
+void map_set(Map* map, CString* key, Value value) {
+    if (map->used + 1 > map->capacity * MAP_MAX_LOAD) grow_map(map);
+
+    MapSlot* slot = find_slot(map->slots, map->capacity, key);
+    if (!is_key(slot->key)) {
+        if (slot->key == NULL) ++map->used;
+        ++map->count;
+        slot->key = tenured(key);
+        write_barrier(&map->obj, STRING_VALUE(slot->key));
+    }
+    switch (map->value_type) {
+        case VALUE_BOOL:  slot->as.bool_ = AS_BOOL(value); break;
+        case VALUE_INT:   slot->as.int_ = AS_INT(value); break;
+        case VALUE_FLOAT: slot->as.float_ = AS_FLOAT(value); break;
+        default: {
+            slot->as.string_ = tenured(flatten_string(value));
+            write_barrier(&map->obj, STRING_VALUE(slot->as.string_));
+        } break;
+    }
+}
+
+bool map_remove(Map* map, CString* key) {
+    if (map->count == 0) return false;
+    MapSlot* slot = find_slot(map->slots, map->capacity, key);
+    if (!is_key(slot->key)) return false;
+    slot->key = TOMBSTONE;
+    --map->count;
+    return true;
+}
+
+int next_map_slot(Map* map, int start) {
+    for (int i = start < 0 ? 0 : start; i < map->capacity; ++i) {
+        if (is_key(map->slots[i].key)) return i;
+    }
+    return -1;
+}
+
+Value map_slot_key(Map* map, int slot) {
+    return STRING_VALUE(map->slots[slot].key);
+}
+
+Value map_slot_value(Map* map, int slot) {
+    MapSlot* target = &map->slots[slot];
+    switch (map->value_type) {
+        case VALUE_BOOL:  return BOOL_VALUE(target->as.bool_);
+        case VALUE_INT:   return INT_VALUE(target->as.int_);
+        case VALUE_FLOAT: return FLOAT_VALUE(target->as.float_);
+        default:          return STRING_VALUE(target->as.string_);
+    }
+}
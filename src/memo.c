@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include "memo.h"
+
+// Arguments are bools, ints and floats, floats compare by their bits so -0 and NaN find their own results.
+static uint32_t key_bits(Value value) {
+    switch (value.type) {
+        case VALUE_BOOL: return AS_BOOL(value) ? 1 : 0;
+        case VALUE_INT:  return (uint32_t)AS_INT(value);
+        default: {
+            float f = AS_FLOAT(value);
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            return bits;
+        }
+    }
+}
+
+static uint32_t hash_arguments(const Value* arguments, int arity) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < arity; ++i) {
+        hash ^= key_bits(arguments[i]);
+        hash *= 16777619u;
+    }
+    // the low bits pick the set, fold the high ones in
+    return hash ^ (hash >> 16);
+}
+
+static bool same_arguments(const Value* key, const Value* arguments, int arity) {
+    for (int i = 0; i < arity; ++i) {
+        if (key_bits(key[i]) != key_bits(arguments[i])) return false;
+    }
+    return true;
+}
+
+MemoCache* new_memo_cache(int arity) {
+    MemoCache* cache = calloc(1, sizeof(MemoCache) + sizeof(Value) * arity * MEMO_SETS * MEMO_WAYS);
+    cache->arity = arity;
+    return cache;
+}
+
+void free_memo_cache(MemoCache* cache) {
+    free(cache);
+}
+
+bool memo_lookup(MemoCache* cache, const Value* arguments, Value* result, MemoEntry** entry, uint64_t* claim) {
+    int arity = cache->arity;
+    int first = (int)(hash_arguments(arguments, arity) & (MEMO_SETS - 1)) * MEMO_WAYS;
+    int victim = first;
+    for (int i = first; i < first + MEMO_WAYS; ++i) {
+        MemoEntry* candidate = &cache->entries[i];
+        if (candidate->used != 0 && same_arguments(&cache->keys[i * arity], arguments, arity)) {
+            if (candidate->claim == 0) {
+                candidate->used = ++cache->tick;
+                *result = candidate->result;
+                ++cache->hits;
+                return true;
+            }
+            // a call with the same arguments is still running, the latest one fills the entry
+            victim = i;
+            break;
+        }
+        if (candidate->used < cache->entries[victim].used) victim = i;
+    }
+
+    MemoEntry* claimed = &cache->entries[victim];
+    if (claimed->used != 0 && !same_arguments(&cache->keys[victim * arity], arguments, arity)) ++cache->evictions;
+    ++cache->misses;
+    claimed->used = ++cache->tick;
+    claimed->claim = claimed->used;
+    memcpy(&cache->keys[victim * arity], arguments, sizeof(Value) * arity);
+    *entry = claimed;
+    *claim = claimed->claim;
+    return false;
+}
+
+void memo_fill(MemoEntry* entry, uint64_t claim, Value result) {
+    if (entry->claim != claim) return;
+    entry->claim = 0;
+    entry->result = result;
+}
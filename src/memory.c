@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include "memory.h"
 
+static _Thread_local size_t bytes_allocated = 0;
+
 void* reallocate(void* pointer, size_t old_size, size_t new_size) {
-    (void) old_size;
+    bytes_allocated = old_size > bytes_allocated ? new_size : bytes_allocated - old_size + new_size;
     if (new_size == 0) {
         free(pointer);
         return NULL;
@@ -15,3 +17,7 @@ void* reallocate(void* pointer, size_t old_size, size_t new_size) {
     }
     return result;
 }
+
+size_t allocated_bytes() {
+    return bytes_allocated;
+}
@@ -0,0 +1,39 @@
+#include <string.h>
+#include "native.h"
+
+static NativeFunction natives[MAX_NATIVES];
+static int native_count = 0;
+
+// Ropes and slices only exist at run time and NONE is only a result.
+static bool crosses_boundary(ValueType type) {
+    return type != VALUE_NONE && type != VALUE_ROPE && type != VALUE_SLICE;
+}
+
+int register_native(const char* name, NativeFn function, ValueType return_type, int arity, const ValueType* param_types) {
+    int length = (int)strlen(name);
+    if (native_count == MAX_NATIVES || find_native(name, length) != -1) return -1;
+    if (arity < 0 || arity > MAX_NATIVE_PARAMS) return -1;
+    if (return_type != VALUE_NONE && !crosses_boundary(return_type)) return -1;
+    for (int i = 0; i < arity; ++i) {
+        if (!crosses_boundary(param_types[i])) return -1;
+    }
+
+    NativeFunction* native = &natives[native_count];
+    native->name = name;
+    native->function = function;
+    native->return_type = return_type;
+    native->arity = arity;
+    if (arity > 0) memcpy(native->param_types, param_types, sizeof(ValueType) * arity);
+    return native_count++;
+}
+
+int find_native(const char* name, int length) {
+    for (int i = 0; i < native_count; ++i) {
+        if ((int)strlen(natives[i].name) == length && memcmp(natives[i].name, name, length) == 0) return i;
+    }
+    return -1;
+}
+
+const NativeFunction* native_function(int index) {
+    return &natives[index];
+}
@@ -0,0 +1,570 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "cstring.h"
+#include "lexer.h"
+#include "make_node.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "value.h"
+
+typedef enum VisitState {
+    UNVISITED,
+    VISITING,
+    DONE,
+} VisitState;
+
+typedef struct Candidate {
+    ASTNode* declaration;
+    // the returned expression of single-return bodies, NULL for everything else
+    ASTNode* expression;
+    VisitState state;
+    bool recursive;
+    bool inlinable;
+} Candidate;
+
+// Candidates are indexed by function index, functions declared by earlier REPL lines have no entry.
+typedef struct Optimizer {
+    Candidate* candidates;
+    int count;
+} Optimizer;
+
+static _Thread_local Optimizer optimizer = { 0 };
+
+static ASTNode* optimize_node(ASTNode* node);
+
+static int count_nodes(ASTNode* node) {
+    switch (node->type) {
+        case AST_NODE_BINARY: return 1 + count_nodes(node->binary.left) + count_nodes(node->binary.right);
+        case AST_NODE_UNARY:  return 1 + count_nodes(node->unary.right);
+        case AST_NODE_CAST:   return 1 + count_nodes(node->cast.expression);
+        case AST_NODE_CALL: {
+            int count = 1;
+            for (int i = 0; i < node->call.count; ++i) count += count_nodes(node->call.arguments[i]);
+            return count;
+        }
+        case AST_NODE_SUBSCRIPT: return 1 + count_nodes(node->subscript.array) + count_nodes(node->subscript.index);
+        case AST_NODE_GET_FIELD: return 1 + count_nodes(node->get_field.object);
+        case AST_NODE_INVOKE: {
+            int count = 1 + count_nodes(node->invoke.object);
+            for (int i = 0; i < node->invoke.count; ++i) count += count_nodes(node->invoke.arguments[i]);
+            return count;
+        }
+        case AST_NODE_ARRAY: {
+            int count = 1 + (node->array.length != NULL ? count_nodes(node->array.length) : 0);
+            for (int i = 0; i < node->array.count; ++i) count += count_nodes(node->array.elements[i]);
+            return count;
+        }
+        case AST_NODE_MAP: {
+            int count = 1;
+            for (int i = 0; i < node->map.count; ++i) count += count_nodes(node->map.keys[i]) + count_nodes(node->map.values[i]);
+            return count;
+        }
+        default:              return 1;
+    }
+}
+
+// Element and field reads see what calls store and every array or map expression yields a new one,
+// so they keep their place and evaluation count like calls do.
+static bool has_calls(ASTNode* node) {
+    switch (node->type) {
+        case AST_NODE_BINARY: return has_calls(node->binary.left) || has_calls(node->binary.right);
+        case AST_NODE_UNARY:  return has_calls(node->unary.right);
+        case AST_NODE_CAST:   return has_calls(node->cast.expression);
+        case AST_NODE_CALL: {
+            // intrinsics are arithmetic
+            if (node->call.intrinsic == -1) return true;
+            for (int i = 0; i < node->call.count; ++i) {
+                if (has_calls(node->call.arguments[i])) return true;
+            }
+            return false;
+        }
+        case AST_NODE_INVOKE:
+        case AST_NODE_GET_FIELD:
+        case AST_NODE_SUBSCRIPT:
+        case AST_NODE_ARRAY:
+        case AST_NODE_MAP:    return true;
+        default:              return false;
+    }
+}
+
+static int count_uses(ASTNode* node, int slot) {
+    switch (node->type) {
+        case AST_NODE_BINARY:   return count_uses(node->binary.left, slot) + count_uses(node->binary.right, slot);
+        case AST_NODE_UNARY:    return count_uses(node->unary.right, slot);
+        case AST_NODE_CAST:     return count_uses(node->cast.expression, slot);
+        case AST_NODE_VARIABLE: return !node->variable.is_global && node->variable.slot == slot;
+        case AST_NODE_CALL: {
+            int count = 0;
+            for (int i = 0; i < node->call.count; ++i) count += count_uses(node->call.arguments[i], slot);
+            return count;
+        }
+        case AST_NODE_SUBSCRIPT: {
+            return count_uses(node->subscript.array, slot) + count_uses(node->subscript.index, slot);
+        }
+        case AST_NODE_GET_FIELD: return count_uses(node->get_field.object, slot);
+        case AST_NODE_INVOKE: {
+            int count = count_uses(node->invoke.object, slot);
+            for (int i = 0; i < node->invoke.count; ++i) count += count_uses(node->invoke.arguments[i], slot);
+            return count;
+        }
+        case AST_NODE_ARRAY: {
+            int count = node->array.length != NULL ? count_uses(node->array.length, slot) : 0;
+            for (int i = 0; i < node->array.count; ++i) count += count_uses(node->array.elements[i], slot);
+            return count;
+        }
+        case AST_NODE_MAP: {
+            int count = 0;
+            for (int i = 0; i < node->map.count; ++i) {
+                count += count_uses(node->map.keys[i], slot) + count_uses(node->map.values[i], slot);
+            }
+            return count;
+        }
+        default:                return 0;
+    }
+}
+
+// Copies an expression. With arguments, the copy is a callee body: parameters are replaced by
+// copies of the arguments and the remaining nodes are attributed to the call site's line.
+static ASTNode* copy_expression(ASTNode* node, ASTNode** arguments, int line) {
+    if (arguments != NULL && node->type == AST_NODE_VARIABLE && !node->variable.is_global) {
+        return copy_expression(arguments[node->variable.slot], NULL, 0);
+    }
+
+    ASTNode* copy = malloc(sizeof(ASTNode));
+    *copy = *node;
+    if (arguments != NULL) copy->line = line;
+
+    switch (node->type) {
+        case AST_NODE_BINARY: {
+            copy->binary.left = copy_expression(node->binary.left, arguments, line);
+            copy->binary.right = copy_expression(node->binary.right, arguments, line);
+        } break;
+        case AST_NODE_UNARY: {
+            copy->unary.right = copy_expression(node->unary.right, arguments, line);
+        } break;
+        case AST_NODE_CAST: {
+            copy->cast.expression = copy_expression(node->cast.expression, arguments, line);
+        } break;
+        case AST_NODE_CALL: {
+            copy->call.arguments = malloc(sizeof(ASTNode*) * node->call.capacity);
+            for (int i = 0; i < node->call.count; ++i) {
+                copy->call.arguments[i] = copy_expression(node->call.arguments[i], arguments, line);
+            }
+            // whether the copy ends up in return position is decided where it lands
+            copy->call.is_tail = false;
+        } break;
+        case AST_NODE_SUBSCRIPT: {
+            copy->subscript.array = copy_expression(node->subscript.array, arguments, line);
+            copy->subscript.index = copy_expression(node->subscript.index, arguments, line);
+        } break;
+        case AST_NODE_GET_FIELD: {
+            copy->get_field.object = copy_expression(node->get_field.object, arguments, line);
+        } break;
+        case AST_NODE_INVOKE: {
+            copy->invoke.object = copy_expression(node->invoke.object, arguments, line);
+            copy->invoke.arguments = malloc(sizeof(ASTNode*) * node->invoke.capacity);
+            for (int i = 0; i < node->invoke.count; ++i) {
+                copy->invoke.arguments[i] = copy_expression(node->invoke.arguments[i], arguments, line);
+            }
+        } break;
+        case AST_NODE_ARRAY: {
+            if (node->array.length != NULL) copy->array.length = copy_expression(node->array.length, arguments, line);
+            copy->array.elements = malloc(sizeof(ASTNode*) * node->array.capacity);
+            for (int i = 0; i < node->array.count; ++i) {
+                copy->array.elements[i] = copy_expression(node->array.elements[i], arguments, line);
+            }
+        } break;
+        case AST_NODE_MAP: {
+            copy->map.keys = malloc(sizeof(ASTNode*) * node->map.capacity);
+            copy->map.values = malloc(sizeof(ASTNode*) * node->map.capacity);
+            for (int i = 0; i < node->map.count; ++i) {
+                copy->map.keys[i] = copy_expression(node->map.keys[i], arguments, line);
+                copy->map.values[i] = copy_expression(node->map.values[i], arguments, line);
+            }
+        } break;
+        default: break;
+    }
+    return copy;
+}
+
+static Candidate* find_candidate(int index) {
+    if (index < 0 || index >= optimizer.count) return NULL;
+    Candidate* candidate = &optimizer.candidates[index];
+    return candidate->declaration != NULL ? candidate : NULL;
+}
+
+static void visit_function(Candidate* candidate) {
+    ASTNode* declaration = candidate->declaration;
+    candidate->state = VISITING;
+    declaration->function.body = optimize_node(declaration->function.body);
+    candidate->state = DONE;
+
+    ASTNode* body = declaration->function.body;
+    if (body->type != AST_NODE_BLOCK || body->block.count != 1) return;
+    ASTNode* statement = body->block.statements[0];
+    if (statement->type != AST_NODE_RETURN || statement->return_.value == NULL) return;
+
+    candidate->expression = statement->return_.value;
+    InlineHint hint = declaration->function.hint;
+    candidate->inlinable = !candidate->recursive && hint != INLINE_NEVER &&
+        (hint == INLINE_ALWAYS || count_nodes(candidate->expression) <= INLINE_NODE_BUDGET);
+}
+
+// Arguments are evaluated where their parameter is used, so an argument with side effects must
+// be used exactly once and be the only thing with side effects, otherwise the order would change.
+static bool can_substitute(Candidate* candidate, ASTNode* call) {
+    ASTNode* expression = candidate->expression;
+    int effects = has_calls(expression) ? 1 : 0;
+
+    for (int i = 0; i < call->call.count; ++i) {
+        ASTNode* argument = call->call.arguments[i];
+        int uses = count_uses(expression, i);
+        if (has_calls(argument)) {
+            if (uses != 1 || ++effects > 1) return false;
+        }
+        else if (uses > 1 && count_nodes(argument) * (uses - 1) > INLINE_DUPLICATION_BUDGET) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static ASTNode* inline_call(ASTNode* call) {
+    Candidate* candidate = find_candidate(call->call.index);
+    if (candidate == NULL) return call;
+
+    if (candidate->state == VISITING) {
+        candidate->recursive = true;
+        return call;
+    }
+    if (candidate->state == UNVISITED) visit_function(candidate);
+    if (!candidate->inlinable || !can_substitute(candidate, call)) return call;
+
+    ASTNode* inlined = copy_expression(candidate->expression, call->call.arguments, call->line);
+    free_ast(call);
+    // arguments may turn parts of the body into constants
+    return optimize_node(inlined);
+}
+
+static ASTNode* make_constant(ASTNode* node, Value value) {
+    ASTNode* constant = make_node_literal(node->line, value);
+    constant->inferred_type = value.type;
+    free_ast(node);
+    return constant;
+}
+
+static bool is_literal(ASTNode* node) {
+    return node->type == AST_NODE_LITERAL;
+}
+
+// Integer arithmetic wraps like the VM's does on every target we run on.
+static bool fold_int(TokenType op, int32_t a, int32_t b, Value* result) {
+    switch (op) {
+        case TOKEN_PLUS:          *result = INT_VALUE((int32_t)((uint32_t)a + (uint32_t)b)); return true;
+        case TOKEN_MINUS:         *result = INT_VALUE((int32_t)((uint32_t)a - (uint32_t)b)); return true;
+        case TOKEN_ASTERISK:      *result = INT_VALUE((int32_t)((uint32_t)a * (uint32_t)b)); return true;
+        case TOKEN_SLASH: {
+            // leave the trap to run time
+            if (b == 0 || (a == INT32_MIN && b == -1)) return false;
+            *result = INT_VALUE(a / b);
+            return true;
+        }
+        case TOKEN_EQUAL_EQUAL:   *result = BOOL_VALUE(a == b); return true;
+        case TOKEN_BANG_EQUAL:    *result = BOOL_VALUE(a != b); return true;
+        case TOKEN_LESS:          *result = BOOL_VALUE(a < b); return true;
+        case TOKEN_LESS_EQUAL:    *result = BOOL_VALUE(a <= b); return true;
+        case TOKEN_GREATER:       *result = BOOL_VALUE(a > b); return true;
+        case TOKEN_GREATER_EQUAL: *result = BOOL_VALUE(a >= b); return true;
+        default:                  return false;
+    }
+}
+
+static bool fold_float(TokenType op, float a, float b, Value* result) {
+    switch (op) {
+        case TOKEN_PLUS:          *result = FLOAT_VALUE(a + b); return true;
+        case TOKEN_MINUS:         *result = FLOAT_VALUE(a - b); return true;
+        case TOKEN_ASTERISK:      *result = FLOAT_VALUE(a * b); return true;
+        case TOKEN_SLASH:         *result = FLOAT_VALUE(a / b); return true;
+        case TOKEN_EQUAL_EQUAL:   *result = BOOL_VALUE(a == b); return true;
+        case TOKEN_BANG_EQUAL:    *result = BOOL_VALUE(a != b); return true;
+        case TOKEN_LESS:          *result = BOOL_VALUE(a < b); return true;
+        case TOKEN_LESS_EQUAL:    *result = BOOL_VALUE(a <= b); return true;
+        case TOKEN_GREATER:       *result = BOOL_VALUE(a > b); return true;
+        case TOKEN_GREATER_EQUAL: *result = BOOL_VALUE(a >= b); return true;
+        default:                  return false;
+    }
+}
+
+bool fold_binary_constants(TokenType op, Value a, Value b, Value* result) {
+    switch (a.type) {
+        case VALUE_INT:   return fold_int(op, AS_INT(a), AS_INT(b), result);
+        case VALUE_FLOAT: return fold_float(op, AS_FLOAT(a), AS_FLOAT(b), result);
+        case VALUE_BOOL: {
+            if (op == TOKEN_EQUAL_EQUAL) *result = BOOL_VALUE(AS_BOOL(a) == AS_BOOL(b));
+            else if (op == TOKEN_BANG_EQUAL) *result = BOOL_VALUE(AS_BOOL(a) != AS_BOOL(b));
+            else return false;
+            return true;
+        }
+        case VALUE_STRING: {
+            // interned, so identity is equality and a folded concatenation is the string the VM would build
+            if (op == TOKEN_EQUAL_EQUAL) *result = BOOL_VALUE(AS_STRING(a) == AS_STRING(b));
+            else if (op == TOKEN_BANG_EQUAL) *result = BOOL_VALUE(AS_STRING(a) != AS_STRING(b));
+            else if (op == TOKEN_PLUS) *result = STRING_VALUE(concat_cstrings(AS_STRING(a), AS_STRING(b)));
+            else return false;
+            return true;
+        }
+        default:          return false;
+    }
+}
+
+bool fold_unary_constant(TokenType op, Value value, Value* result) {
+    if (op == TOKEN_BANG && value.type == VALUE_BOOL) *result = BOOL_VALUE(!AS_BOOL(value));
+    else if (op == TOKEN_MINUS && value.type == VALUE_INT) *result = INT_VALUE((int32_t)(0u - (uint32_t)AS_INT(value)));
+    else if (op == TOKEN_MINUS && value.type == VALUE_FLOAT) *result = FLOAT_VALUE(-AS_FLOAT(value));
+    else return false;
+    return true;
+}
+
+// Mirrors the VM's conversion instructions, float to int only where the conversion is defined.
+bool fold_cast_constant(ValueType target, Value value, Value* result) {
+    switch (target) {
+        case VALUE_BOOL: {
+            if (value.type == VALUE_INT) *result = BOOL_VALUE(AS_INT(value) != 0);
+            else if (value.type == VALUE_FLOAT) *result = BOOL_VALUE(AS_FLOAT(value) != 0.f);
+            else *result = value;
+        } break;
+        case VALUE_INT: {
+            float f = AS_FLOAT(value);
+            if (value.type == VALUE_BOOL) *result = INT_VALUE(AS_BOOL(value) ? 1 : 0);
+            else if (value.type == VALUE_INT) *result = value;
+            else if (!isnan(f) && f > -2147483904.f && f < 2147483648.f) *result = INT_VALUE((int32_t)f);
+            else return false;
+        } break;
+        case VALUE_FLOAT: {
+            if (value.type == VALUE_BOOL) *result = FLOAT_VALUE(AS_BOOL(value) ? 1.f : 0.f);
+            else if (value.type == VALUE_INT) *result = FLOAT_VALUE((float)AS_INT(value));
+            else *result = value;
+        } break;
+        default: return false;
+    }
+    return true;
+}
+
+// The same operations the VM's intrinsic instructions perform.
+bool fold_intrinsic_constants(MathIntrinsic intrinsic, ValueType type, const Value* arguments, Value* result) {
+    if (type == VALUE_INT) {
+        int32_t a = AS_INT(arguments[0]);
+        switch (intrinsic) {
+            case INTRINSIC_ABS: *result = INT_VALUE(INT_ABS(a)); break;
+            case INTRINSIC_MIN: *result = INT_VALUE(MIN_OF(a, AS_INT(arguments[1]))); break;
+            case INTRINSIC_MAX: *result = INT_VALUE(MAX_OF(a, AS_INT(arguments[1]))); break;
+            default:            return false;
+        }
+        return true;
+    }
+    float a = AS_FLOAT(arguments[0]);
+    switch (intrinsic) {
+        case INTRINSIC_SQRT:  *result = FLOAT_VALUE(sqrtf(a)); break;
+        case INTRINSIC_ABS:   *result = FLOAT_VALUE(fabsf(a)); break;
+        case INTRINSIC_MIN:   *result = FLOAT_VALUE(MIN_OF(a, AS_FLOAT(arguments[1]))); break;
+        case INTRINSIC_MAX:   *result = FLOAT_VALUE(MAX_OF(a, AS_FLOAT(arguments[1]))); break;
+        case INTRINSIC_FLOOR: *result = FLOAT_VALUE(floorf(a)); break;
+        case INTRINSIC_FMA:   *result = FLOAT_VALUE(fmaf(a, AS_FLOAT(arguments[1]), AS_FLOAT(arguments[2]))); break;
+        case INTRINSIC_SIN:   *result = FLOAT_VALUE(sinf(a)); break;
+        case INTRINSIC_COS:   *result = FLOAT_VALUE(cosf(a)); break;
+        case INTRINSIC_TAN:   *result = FLOAT_VALUE(tanf(a)); break;
+        default:              return false;
+    }
+    return true;
+}
+
+static ASTNode* fold_binary(ASTNode* node) {
+    ASTNode* left = node->binary.left;
+    ASTNode* right = node->binary.right;
+    TokenType op = node->binary.op;
+
+    // a constant left operand decides and/or on its own or hands the result to the right one
+    if ((op == TOKEN_AND || op == TOKEN_OR) && is_literal(left)) {
+        bool decides = AS_BOOL(left->literal) == (op == TOKEN_OR);
+        if (decides) return make_constant(node, left->literal);
+        node->binary.right = NULL;
+        free_ast(node);
+        return right;
+    }
+
+    Value result;
+    if (is_literal(left) && is_literal(right) && fold_binary_constants(op, left->literal, right->literal, &result)) {
+        return make_constant(node, result);
+    }
+    return node;
+}
+
+static ASTNode* fold_unary(ASTNode* node) {
+    Value result;
+    if (is_literal(node->unary.right) && fold_unary_constant(node->unary.op, node->unary.right->literal, &result)) {
+        return make_constant(node, result);
+    }
+    return node;
+}
+
+static ASTNode* fold_cast(ASTNode* node) {
+    Value result;
+    if (is_literal(node->cast.expression) && fold_cast_constant(node->cast.target_type, node->cast.expression->literal, &result)) {
+        return make_constant(node, result);
+    }
+    return node;
+}
+
+static ASTNode* fold_intrinsic(ASTNode* node) {
+    Value arguments[MAX_INTRINSIC_ARITY];
+    for (int i = 0; i < node->call.count; ++i) {
+        if (!is_literal(node->call.arguments[i])) return node;
+        arguments[i] = node->call.arguments[i]->literal;
+    }
+    Value result;
+    if (fold_intrinsic_constants(node->call.intrinsic, node->inferred_type, arguments, &result)) {
+        return make_constant(node, result);
+    }
+    return node;
+}
+
+static ASTNode* optimize_node(ASTNode* node) {
+    if (node == NULL) return NULL;
+
+    switch (node->type) {
+        case AST_NODE_BINARY: {
+            node->binary.left = optimize_node(node->binary.left);
+            node->binary.right = optimize_node(node->binary.right);
+            return fold_binary(node);
+        }
+        case AST_NODE_UNARY: {
+            node->unary.right = optimize_node(node->unary.right);
+            return fold_unary(node);
+        }
+        case AST_NODE_CAST: {
+            node->cast.expression = optimize_node(node->cast.expression);
+            return fold_cast(node);
+        }
+        case AST_NODE_CALL: {
+            for (int i = 0; i < node->call.count; ++i) {
+                node->call.arguments[i] = optimize_node(node->call.arguments[i]);
+            }
+            if (node->call.intrinsic != -1) return fold_intrinsic(node);
+            return inline_call(node);
+        }
+        case AST_NODE_ARRAY: {
+            node->array.length = optimize_node(node->array.length);
+            for (int i = 0; i < node->array.count; ++i) {
+                node->array.elements[i] = optimize_node(node->array.elements[i]);
+            }
+        } break;
+        case AST_NODE_MAP: {
+            for (int i = 0; i < node->map.count; ++i) {
+                node->map.keys[i] = optimize_node(node->map.keys[i]);
+                node->map.values[i] = optimize_node(node->map.values[i]);
+            }
+        } break;
+        case AST_NODE_SUBSCRIPT: {
+            node->subscript.array = optimize_node(node->subscript.array);
+            node->subscript.index = optimize_node(node->subscript.index);
+        } break;
+        case AST_NODE_GET_FIELD: {
+            node->get_field.object = optimize_node(node->get_field.object);
+        } break;
+        case AST_NODE_SET_FIELD: {
+            node->set_field.object = optimize_node(node->set_field.object);
+            node->set_field.value = optimize_node(node->set_field.value);
+        } break;
+        case AST_NODE_INVOKE: {
+            node->invoke.object = optimize_node(node->invoke.object);
+            for (int i = 0; i < node->invoke.count; ++i) {
+                node->invoke.arguments[i] = optimize_node(node->invoke.arguments[i]);
+            }
+        } break;
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            node->subscript_assignment.array = optimize_node(node->subscript_assignment.array);
+            node->subscript_assignment.index = optimize_node(node->subscript_assignment.index);
+            node->subscript_assignment.value = optimize_node(node->subscript_assignment.value);
+        } break;
+        case AST_NODE_ASSIGNMENT: {
+            node->assignment.value = optimize_node(node->assignment.value);
+        } break;
+        case AST_NODE_VAR_DECL: {
+            node->var_decl.initializer = optimize_node(node->var_decl.initializer);
+        } break;
+        case AST_NODE_PRINT: {
+            node->print.expression = optimize_node(node->print.expression);
+        } break;
+        case AST_NODE_EXPRESSION_STATEMENT: {
+            node->expression_statement.expression = optimize_node(node->expression_statement.expression);
+        } break;
+        case AST_NODE_BLOCK: {
+            for (int i = 0; i < node->block.count; ++i) {
+                node->block.statements[i] = optimize_node(node->block.statements[i]);
+            }
+        } break;
+        case AST_NODE_IF: {
+            node->if_.condition = optimize_node(node->if_.condition);
+            node->if_.then_branch = optimize_node(node->if_.then_branch);
+            node->if_.else_branch = optimize_node(node->if_.else_branch);
+        } break;
+        case AST_NODE_WHILE: {
+            node->while_.condition = optimize_node(node->while_.condition);
+            node->while_.body = optimize_node(node->while_.body);
+        } break;
+        case AST_NODE_FOR: {
+            node->for_.initializer = optimize_node(node->for_.initializer);
+            node->for_.condition = optimize_node(node->for_.condition);
+            node->for_.increment = optimize_node(node->for_.increment);
+            node->for_.body = optimize_node(node->for_.body);
+        } break;
+        case AST_NODE_FUNCTION: {
+            Candidate* candidate = find_candidate(node->function.index);
+            if (candidate != NULL && candidate->state == UNVISITED) visit_function(candidate);
+        } break;
+        // methods are dispatched at run time and never inlined, only their bodies are optimized
+        case AST_NODE_CLASS: {
+            for (int i = 0; i < node->class_.method_count; ++i) {
+                ASTNode* method = node->class_.methods[i];
+                method->function.body = optimize_node(method->function.body);
+            }
+        } break;
+        case AST_NODE_RETURN: {
+            ASTNode* value = optimize_node(node->return_.value);
+            // inlining can leave a different call, or none, in return position
+            if (value != NULL && value->type == AST_NODE_CALL && value->call.index != -1) value->call.is_tail = true;
+            node->return_.value = value;
+        } break;
+        case AST_NODE_YIELD: {
+            node->yield_.value = optimize_node(node->yield_.value);
+        } break;
+        default: break;
+    }
+    return node;
+}
+
+void optimize_ast(ASTNode* program) {
+    int count = 0;
+    for (int i = 0; i < program->block.count; ++i) {
+        ASTNode* statement = program->block.statements[i];
+        if (statement->type == AST_NODE_FUNCTION && statement->function.index >= count) {
+            count = statement->function.index + 1;
+        }
+    }
+
+    optimizer.count = count;
+    optimizer.candidates = calloc(count > 0 ? count : 1, sizeof(Candidate));
+    for (int i = 0; i < program->block.count; ++i) {
+        ASTNode* statement = program->block.statements[i];
+        if (statement->type == AST_NODE_FUNCTION && statement->function.index >= 0) {
+            optimizer.candidates[statement->function.index].declaration = statement;
+        }
+    }
+
+    optimize_node(program);
+
+    free(optimizer.candidates);
+    optimizer.candidates = NULL;
+    optimizer.count = 0;
+}
@@ -1,6 +1,8 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "cstring.h"
 #include "lexer.h"
 #include "make_node.h"
 #include "parser.h"
@@ -13,7 +15,7 @@ typedef struct Parser {
     bool panic_mode;
 } Parser;
 
-static Parser parser = { 0 };
+static _Thread_local Parser parser = { 0 };
 
 inline static Token* previous_token() {
     return parser.current - 1;
@@ -67,15 +69,557 @@ static void consume_expected(TokenType token, const char* error_if_fail) {
     ++parser.current;
 }
 
+static bool check(TokenType type) {
+    return parser.current->type == type;
+}
+
+static bool is_type_token(TokenType type) {
+    return type == TOKEN_BOOL || type == TOKEN_INT || type == TOKEN_FLOAT;
+}
+
+static bool is_assignment_token(TokenType type) {
+    switch (type) {
+        case TOKEN_EQUAL:
+        case TOKEN_PLUS_EQUAL:
+        case TOKEN_MINUS_EQUAL:
+        case TOKEN_ASTERISK_EQUAL:
+        case TOKEN_SLASH_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Statements may omit the semicolon only when nothing follows them, which keeps
+// single expressions in the REPL and batch mode terse.
+static void consume_statement_end() {
+    if (match(1, TOKEN_SEMICOLON) || check(TOKEN_EOF)) return;
+    error_at_current("expected ';' after statement");
+}
+
+static void synchronize() {
+    parser.panic_mode = false;
+
+    while (!check(TOKEN_EOF)) {
+        if (parser.current != parser.tokens->tokens && previous_token()->type == TOKEN_SEMICOLON) return;
+        switch (parser.current->type) {
+            case TOKEN_VAR:
+            case TOKEN_CONST:
+            case TOKEN_PRINT:
+            case TOKEN_IF:
+            case TOKEN_WHILE:
+            case TOKEN_FOR:
+            case TOKEN_FUNC:
+            case TOKEN_CLASS:
+            case TOKEN_INLINE:
+            case TOKEN_NOINLINE:
+            case TOKEN_PURE:
+            case TOKEN_RETURN:
+            case TOKEN_YIELD:
+            case TOKEN_LEFT_BRACE:
+                return;
+            default:
+                ++parser.current;
+        }
+    }
+}
+
+static ASTNode* parse_declaration();
+static ASTNode* parse_statement();
 static ASTNode* parse_expression();
+static ASTNode* parse_or();
+static ASTNode* parse_and();
+static ASTNode* parse_equality();
+static ASTNode* parse_comparison();
 static ASTNode* parse_term();
 static ASTNode* parse_factor();
 static ASTNode* parse_unary();
 static ASTNode* parse_cast();
+static ASTNode* parse_subscript();
 static ASTNode* parse_primary();
 
+static ValueType element_type_of(TokenType type) {
+    switch (type) {
+        case TOKEN_BOOL:  return VALUE_BOOL;
+        case TOKEN_INT:   return VALUE_INT;
+        case TOKEN_FLOAT: return VALUE_FLOAT;
+        default:          return VALUE_NONE;
+    }
+}
+
+// `map[string]int` maps strings to unboxed ints, values may also be bools, floats or strings.
+static ValueType parse_map_type() {
+    consume_expected(TOKEN_LEFT_BRACKET, "expected '[' after 'map'");
+    consume_expected(TOKEN_STRING, "map keys must be strings");
+    consume_expected(TOKEN_RIGHT_BRACKET, "expected ']' after map key type");
+    if (match(3, TOKEN_BOOL, TOKEN_INT, TOKEN_FLOAT)) return MAP_TYPE_OF(element_type_of(previous_token()->type));
+    if (match(1, TOKEN_STRING)) return VALUE_STRING_MAP;
+    error_at_current("map values must be bools, ints, floats or strings");
+    return VALUE_NONE;
+}
+
+// `gen int` is what a generator function returns and for-in consumes: the ints it yields one at a time.
+static ValueType parse_generator_type() {
+    if (match(4, TOKEN_BOOL, TOKEN_INT, TOKEN_FLOAT, TOKEN_STRING)) {
+        ValueType yield_type = previous_token()->type == TOKEN_STRING ? VALUE_STRING : element_type_of(previous_token()->type);
+        if (check(TOKEN_LEFT_BRACKET)) error_at_current("generators of arrays are not supported");
+        return GENERATOR_TYPE_OF(yield_type);
+    }
+    error_at_current("generators yield bools, ints, floats or strings");
+    return VALUE_NONE;
+}
+
+// A trailing `[]` makes an array of bools, ints or floats.
+static ValueType parse_type() {
+    if (match(3, TOKEN_BOOL, TOKEN_INT, TOKEN_FLOAT)) {
+        ValueType type = element_type_of(previous_token()->type);
+        if (!match(1, TOKEN_LEFT_BRACKET)) return type;
+        consume_expected(TOKEN_RIGHT_BRACKET, "expected ']' after '[' in array type");
+        return ARRAY_TYPE_OF(type);
+    }
+    if (match(1, TOKEN_STRING)) {
+        if (check(TOKEN_LEFT_BRACKET)) error_at_current("arrays of strings are not supported");
+        return VALUE_STRING;
+    }
+    if (match(1, TOKEN_OBJECT)) {
+        if (check(TOKEN_LEFT_BRACKET)) error_at_current("arrays of objects are not supported");
+        return VALUE_OBJECT;
+    }
+    if (match(1, TOKEN_MAP)) {
+        return parse_map_type();
+    }
+    if (match(1, TOKEN_GEN)) {
+        return parse_generator_type();
+    }
+    error_at_current("expected type name");
+    return VALUE_NONE;
+}
+
+static ASTNode* parse_var_declaration() {
+    bool is_const = previous_token()->type == TOKEN_CONST;
+    int line = previous_token()->line;
+
+    consume_expected(TOKEN_IDENTIFIER, "expected variable name");
+    Token name = *previous_token();
+
+    ValueType declared_type = VALUE_NONE;
+    ASTNode* initializer = NULL;
+    if (match(1, TOKEN_COLON_EQUAL)) {
+        initializer = parse_expression();
+    }
+    else {
+        consume_expected(TOKEN_COLON, "expected ':' or ':=' after variable name");
+        declared_type = parse_type();
+        if (match(1, TOKEN_EQUAL)) {
+            initializer = parse_expression();
+        }
+        else if (is_const) {
+            error_at_current("constant must be initialized");
+        }
+    }
+    consume_statement_end();
+
+    return make_node_var_decl(line, name, is_const, declared_type, initializer);
+}
+
+static ASTNode* parse_block() {
+    ASTNode* block = make_node_block(previous_token()->line);
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+        append_to_block(block, parse_declaration());
+    }
+    consume_expected(TOKEN_RIGHT_BRACE, "expected '}' after block");
+    return block;
+}
+
+// func name(a: int, b: float): int { ... }, the return type is omitted for functions without a result.
+// Methods take the instance as a hidden first parameter named `this`.
+static ASTNode* parse_function_declaration(bool is_method) {
+    int line = previous_token()->line;
+    consume_expected(TOKEN_IDENTIFIER, "expected function name");
+    ASTNode* function = make_node_function(line, *previous_token());
+    if (is_method) {
+        append_parameter(function, (Token){ .type = TOKEN_THIS, .start = "this", .length = 4, .line = line }, VALUE_OBJECT);
+    }
+
+    consume_expected(TOKEN_LEFT_PAREN, "expected '(' after function name");
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            consume_expected(TOKEN_IDENTIFIER, "expected parameter name");
+            Token name = *previous_token();
+            consume_expected(TOKEN_COLON, "expected ':' after parameter name");
+            append_parameter(function, name, parse_type());
+        } while (match(1, TOKEN_COMMA));
+    }
+    consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after parameters");
+
+    if (match(1, TOKEN_COLON)) {
+        function->function.return_type = parse_type();
+    }
+    consume_expected(TOKEN_LEFT_BRACE, "expected '{' before function body");
+    function->function.body = parse_block();
+    return function;
+}
+
+// class Name { field: type; ... func method(...) { ... } }
+static ASTNode* parse_class_declaration() {
+    int line = previous_token()->line;
+    consume_expected(TOKEN_IDENTIFIER, "expected class name");
+    ASTNode* klass = make_node_class(line, *previous_token());
+
+    consume_expected(TOKEN_LEFT_BRACE, "expected '{' before class body");
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF) && !parser.panic_mode) {
+        if (match(1, TOKEN_FUNC)) {
+            append_method(klass, parse_function_declaration(true));
+            continue;
+        }
+        consume_expected(TOKEN_IDENTIFIER, "expected field or method declaration");
+        Token name = *previous_token();
+        consume_expected(TOKEN_COLON, "expected ':' after field name");
+        append_field(klass, name, parse_type());
+        consume_expected(TOKEN_SEMICOLON, "expected ';' after field");
+    }
+    consume_expected(TOKEN_RIGHT_BRACE, "expected '}' after class body");
+    return klass;
+}
+
+static TokenType compound_operator(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS_EQUAL:     return TOKEN_PLUS;
+        case TOKEN_MINUS_EQUAL:    return TOKEN_MINUS;
+        case TOKEN_ASTERISK_EQUAL: return TOKEN_ASTERISK;
+        case TOKEN_SLASH_EQUAL:    return TOKEN_SLASH;
+        default:                   return TOKEN_PLUS;
+    }
+}
+
+// `x op= value` is desugared into `x = x op value`, so the analyzer types it like any binary operation.
+static ASTNode* parse_assignment() {
+    Token name = *parser.current;
+    parser.current += 2;
+    Token* op = previous_token();
+
+    ASTNode* value = parse_expression();
+    if (op->type != TOKEN_EQUAL) {
+        value = make_node_binary(op->line, make_node_variable(name.line, name), compound_operator(op->type), value);
+    }
+    return make_node_assignment(name.line, name, value);
+}
+
+// Copies an operand of `a[i] op= value` so it can be read again, NULL when evaluating it twice
+// could differ from evaluating it once.
+static ASTNode* copy_operand(ASTNode* node) {
+    if (node == NULL) return NULL;
+    switch (node->type) {
+        case AST_NODE_LITERAL: return make_node_literal(node->line, node->literal);
+        case AST_NODE_VARIABLE: return make_node_variable(node->line, node->variable.name);
+        case AST_NODE_UNARY: {
+            ASTNode* right = copy_operand(node->unary.right);
+            return right == NULL ? NULL : make_node_unary(node->line, node->unary.op, right);
+        }
+        case AST_NODE_CAST: {
+            ASTNode* expression = copy_operand(node->cast.expression);
+            return expression == NULL ? NULL : make_node_cast(node->line, node->cast.target_type, expression);
+        }
+        case AST_NODE_BINARY: {
+            ASTNode* left = copy_operand(node->binary.left);
+            ASTNode* right = copy_operand(node->binary.right);
+            if (left != NULL && right != NULL) return make_node_binary(node->line, left, node->binary.op, right);
+            free_ast(left);
+            free_ast(right);
+            return NULL;
+        }
+        case AST_NODE_GET_FIELD: {
+            ASTNode* object = copy_operand(node->get_field.object);
+            return object == NULL ? NULL : make_node_get_field(node->line, object, node->get_field.name);
+        }
+        case AST_NODE_SUBSCRIPT: {
+            ASTNode* array = copy_operand(node->subscript.array);
+            ASTNode* index = copy_operand(node->subscript.index);
+            if (array != NULL && index != NULL) return make_node_subscript(node->line, array, index);
+            free_ast(array);
+            free_ast(index);
+            return NULL;
+        }
+        default: return NULL;
+    }
+}
+
+// `a[i] = value` once the target has been parsed as an expression, op= is desugared like for variables.
+static ASTNode* parse_subscript_assignment(ASTNode* target) {
+    Token* op = parser.current++;
+    ASTNode* value = parse_expression();
+    if (op->type != TOKEN_EQUAL) {
+        ASTNode* current = copy_operand(target);
+        if (current == NULL) {
+            error_at(op, "compound assignment to an element needs an array and index without calls");
+        }
+        else {
+            value = make_node_binary(op->line, current, compound_operator(op->type), value);
+        }
+    }
+    ASTNode* assignment = make_node_subscript_assignment(target->line, target->subscript.array,
+                                                         target->subscript.index, value);
+    free(target);
+    return assignment;
+}
+
+// `o.field = value`, like an element assignment.
+static ASTNode* parse_field_assignment(ASTNode* target) {
+    Token* op = parser.current++;
+    ASTNode* value = parse_expression();
+    if (op->type != TOKEN_EQUAL) {
+        ASTNode* current = copy_operand(target);
+        if (current == NULL) {
+            error_at(op, "compound assignment to a field needs an object without calls");
+        }
+        else {
+            value = make_node_binary(op->line, current, compound_operator(op->type), value);
+        }
+    }
+    ASTNode* assignment = make_node_set_field(target->line, target->get_field.object, target->get_field.name, value);
+    free(target);
+    return assignment;
+}
+
+// Assignment or expression without the terminating semicolon, as used in `for` clauses.
+static ASTNode* parse_simple_statement() {
+    if (check(TOKEN_IDENTIFIER) && is_assignment_token(next_token()->type)) {
+        return parse_assignment();
+    }
+    int line = parser.current->line;
+    ASTNode* expression = parse_expression();
+    if (expression != NULL && expression->type == AST_NODE_SUBSCRIPT && is_assignment_token(parser.current->type)) {
+        return parse_subscript_assignment(expression);
+    }
+    if (expression != NULL && expression->type == AST_NODE_GET_FIELD && is_assignment_token(parser.current->type)) {
+        return parse_field_assignment(expression);
+    }
+    return make_node_expression_statement(line, expression);
+}
+
+static ASTNode* parse_if() {
+    int line = previous_token()->line;
+    consume_expected(TOKEN_LEFT_PAREN, "expected '(' after 'if'");
+    ASTNode* condition = parse_expression();
+    consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after condition");
+
+    ASTNode* then_branch = parse_statement();
+    ASTNode* else_branch = NULL;
+    if (match(1, TOKEN_ELSE)) {
+        else_branch = parse_statement();
+    }
+    return make_node_if(line, condition, then_branch, else_branch);
+}
+
+static ASTNode* parse_while() {
+    int line = previous_token()->line;
+    consume_expected(TOKEN_LEFT_PAREN, "expected '(' after 'while'");
+    ASTNode* condition = parse_expression();
+    consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after condition");
+
+    ASTNode* body = parse_statement();
+    return make_node_while(line, condition, body);
+}
+
+static ASTNode* slot_call(int line, const char* builtin, Token map, ASTNode* slot) {
+    ASTNode* call = make_node_call(line, (Token){ TOKEN_IDENTIFIER, builtin, (int)strlen(builtin), line });
+    append_argument(call, make_node_variable(line, map));
+    append_argument(call, slot);
+    return call;
+}
+
+// `for (key in m) body` walks the slots of a map through locals that source code cannot name:
+// { var $map := m; for (var $slot := $next($map, 0); $slot != -1; $slot = $next($map, $slot + 1)) { var key := $key($map, $slot); body } }
+// Keys added by the body may or may not be visited.
+static ASTNode* parse_for_in(int line) {
+    Token key = *parser.current;
+    parser.current += 2;
+    ASTNode* iterable = parse_expression();
+    consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after for-in clause");
+    ASTNode* body = parse_statement();
+
+    Token map = { TOKEN_IDENTIFIER, "$map", 4, line };
+    Token slot = { TOKEN_IDENTIFIER, "$slot", 5, line };
+    ASTNode* initializer = make_node_var_decl(line, slot, false, VALUE_NONE,
+                                              slot_call(line, "$next", map, make_node_literal(line, INT_VALUE(0))));
+    ASTNode* condition = make_node_binary(line, make_node_variable(line, slot), TOKEN_BANG_EQUAL,
+                                          make_node_literal(line, INT_VALUE(-1)));
+    ASTNode* following = make_node_binary(line, make_node_variable(line, slot), TOKEN_PLUS,
+                                          make_node_literal(line, INT_VALUE(1)));
+    ASTNode* increment = make_node_assignment(line, slot, slot_call(line, "$next", map, following));
+
+    ASTNode* loop_body = make_node_block(line);
+    append_to_block(loop_body, make_node_var_decl(line, key, false, VALUE_NONE,
+                                                  slot_call(line, "$key", map, make_node_variable(line, slot))));
+    append_to_block(loop_body, body);
+
+    ASTNode* loop = make_node_block(line);
+    append_to_block(loop, make_node_var_decl(line, map, false, VALUE_NONE, iterable));
+    append_to_block(loop, make_node_for(line, initializer, condition, increment, loop_body));
+    return loop;
+}
+
+static ASTNode* parse_for() {
+    int line = previous_token()->line;
+    consume_expected(TOKEN_LEFT_PAREN, "expected '(' after 'for'");
+    if (check(TOKEN_IDENTIFIER) && next_token()->type == TOKEN_IN) return parse_for_in(line);
+
+    ASTNode* initializer = NULL;
+    if (match(2, TOKEN_VAR, TOKEN_CONST)) {
+        initializer = parse_var_declaration();
+    }
+    else if (!match(1, TOKEN_SEMICOLON)) {
+        initializer = parse_simple_statement();
+        consume_expected(TOKEN_SEMICOLON, "expected ';' after loop initializer");
+    }
+
+    ASTNode* condition = NULL;
+    if (!check(TOKEN_SEMICOLON)) {
+        condition = parse_expression();
+    }
+    consume_expected(TOKEN_SEMICOLON, "expected ';' after loop condition");
+
+    ASTNode* increment = NULL;
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        increment = parse_simple_statement();
+    }
+    consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after for clauses");
+
+    ASTNode* body = parse_statement();
+    return make_node_for(line, initializer, condition, increment, body);
+}
+
+static ASTNode* parse_statement() {
+    if (match(1, TOKEN_IF)) {
+        return parse_if();
+    }
+    if (match(1, TOKEN_WHILE)) {
+        return parse_while();
+    }
+    if (match(1, TOKEN_FOR)) {
+        return parse_for();
+    }
+    if (match(1, TOKEN_PRINT)) {
+        int line = previous_token()->line;
+        ASTNode* expression = parse_expression();
+        consume_statement_end();
+        return make_node_print(line, expression);
+    }
+    if (match(1, TOKEN_RETURN)) {
+        int line = previous_token()->line;
+        ASTNode* value = NULL;
+        if (!check(TOKEN_SEMICOLON) && !check(TOKEN_EOF)) {
+            value = parse_expression();
+        }
+        consume_statement_end();
+        return make_node_return(line, value);
+    }
+    if (match(1, TOKEN_YIELD)) {
+        int line = previous_token()->line;
+        ASTNode* value = parse_expression();
+        consume_statement_end();
+        return make_node_yield(line, value);
+    }
+    if (match(1, TOKEN_LEFT_BRACE)) {
+        return parse_block();
+    }
+    if (check(TOKEN_IDENTIFIER) && is_assignment_token(next_token()->type)) {
+        ASTNode* assignment = parse_assignment();
+        consume_statement_end();
+        return assignment;
+    }
+
+    int line = parser.current->line;
+    ASTNode* expression = parse_expression();
+    if (expression != NULL && expression->type == AST_NODE_SUBSCRIPT && is_assignment_token(parser.current->type)) {
+        ASTNode* assignment = parse_subscript_assignment(expression);
+        consume_statement_end();
+        return assignment;
+    }
+    if (expression != NULL && expression->type == AST_NODE_GET_FIELD && is_assignment_token(parser.current->type)) {
+        ASTNode* assignment = parse_field_assignment(expression);
+        consume_statement_end();
+        return assignment;
+    }
+    consume_statement_end();
+    return make_node_expression_statement(line, expression);
+}
+
+static ASTNode* parse_declaration() {
+    ASTNode* statement = NULL;
+    if (match(2, TOKEN_VAR, TOKEN_CONST)) {
+        statement = parse_var_declaration();
+    }
+    else if (match(1, TOKEN_FUNC)) {
+        statement = parse_function_declaration(false);
+    }
+    else if (match(1, TOKEN_CLASS)) {
+        statement = parse_class_declaration();
+    }
+    else if (match(3, TOKEN_PURE, TOKEN_INLINE, TOKEN_NOINLINE)) {
+        // `pure` goes first, an inlining hint may follow it
+        bool is_pure = previous_token()->type == TOKEN_PURE;
+        InlineHint hint = INLINE_DEFAULT;
+        if (!is_pure || match(2, TOKEN_INLINE, TOKEN_NOINLINE)) {
+            hint = previous_token()->type == TOKEN_INLINE ? INLINE_ALWAYS : INLINE_NEVER;
+        }
+        consume_expected(TOKEN_FUNC, hint == INLINE_DEFAULT ? "expected 'func' after 'pure'" : "expected 'func' after inlining hint");
+        statement = parse_function_declaration(false);
+        statement->function.hint = hint;
+        statement->function.is_pure = is_pure;
+    }
+    else {
+        statement = parse_statement();
+    }
+
+    if (parser.panic_mode) synchronize();
+    return statement;
+}
+
 static ASTNode* parse_expression() {
-    return parse_term();
+    return parse_or();
+}
+
+static ASTNode* parse_or() {
+    ASTNode* left = parse_and();
+    while (match(1, TOKEN_OR)) {
+        int line = previous_token()->line;
+        ASTNode* right = parse_and();
+        left = make_node_binary(line, left, TOKEN_OR, right);
+    }
+    return left;
+}
+
+static ASTNode* parse_and() {
+    ASTNode* left = parse_equality();
+    while (match(1, TOKEN_AND)) {
+        int line = previous_token()->line;
+        ASTNode* right = parse_equality();
+        left = make_node_binary(line, left, TOKEN_AND, right);
+    }
+    return left;
+}
+
+static ASTNode* parse_equality() {
+    ASTNode* left = parse_comparison();
+    while (match(2, TOKEN_EQUAL_EQUAL, TOKEN_BANG_EQUAL)) {
+        int line = previous_token()->line;
+        TokenType op = previous_token()->type;
+        ASTNode* right = parse_comparison();
+        left = make_node_binary(line, left, op, right);
+    }
+    return left;
+}
+
+static ASTNode* parse_comparison() {
+    ASTNode* left = parse_term();
+    while (match(4, TOKEN_LESS, TOKEN_LESS_EQUAL, TOKEN_GREATER, TOKEN_GREATER_EQUAL)) {
+        int line = previous_token()->line;
+        TokenType op = previous_token()->type;
+        ASTNode* right = parse_term();
+        left = make_node_binary(line, left, op, right);
+    }
+    return left;
 }
 
 static ASTNode* parse_term() {
@@ -111,22 +655,68 @@ static ASTNode* parse_unary() {
 }
 
 static ASTNode* parse_cast() {
-    if (parser.current->type == TOKEN_LEFT_PAREN && next_token()->type) {
+    if (parser.current->type == TOKEN_LEFT_PAREN && is_type_token(next_token()->type)) {
         int line = parser.current->line;
         parser.current += 2;
-        TokenType type = previous_token()->type;
-        ValueType value_type = VALUE_NONE;
-        switch (type) {
-            case TOKEN_BOOL: value_type = VALUE_BOOL; break;
-            case TOKEN_INT: value_type = VALUE_INT; break;
-            case TOKEN_FLOAT: value_type = VALUE_FLOAT; break;
-            default: break;
-        }
+        ValueType value_type = element_type_of(previous_token()->type);
         consume_expected(TOKEN_RIGHT_PAREN, "expected closing parenthesis after cast");
         ASTNode* expression = parse_cast();
         return make_node_cast(line, value_type, expression);
     }
-    return parse_primary();
+    return parse_subscript();
+}
+
+// Postfix element accesses, field accesses and method calls.
+static ASTNode* parse_subscript() {
+    ASTNode* expression = parse_primary();
+    while (match(2, TOKEN_LEFT_BRACKET, TOKEN_DOT)) {
+        int line = previous_token()->line;
+        if (previous_token()->type == TOKEN_LEFT_BRACKET) {
+            ASTNode* index = parse_expression();
+            consume_expected(TOKEN_RIGHT_BRACKET, "expected ']' after index");
+            expression = make_node_subscript(line, expression, index);
+            continue;
+        }
+
+        consume_expected(TOKEN_IDENTIFIER, "expected field or method name after '.'");
+        Token name = *previous_token();
+        if (!match(1, TOKEN_LEFT_PAREN)) {
+            expression = make_node_get_field(line, expression, name);
+            continue;
+        }
+        expression = make_node_invoke(line, expression, name);
+        if (!check(TOKEN_RIGHT_PAREN)) {
+            do {
+                append_invoke_argument(expression, parse_expression());
+            } while (match(1, TOKEN_COMMA));
+        }
+        consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after arguments");
+    }
+    return expression;
+}
+
+// Decodes the escapes of a string literal token, quotes excluded, into an interned string.
+static CString* parse_string_literal(Token* token) {
+    const char* source = token->start + 1;
+    int length = token->length - 2;
+    char* data = malloc(length + 1);
+    int count = 0;
+    for (int i = 0; i < length; ++i) {
+        char c = source[i];
+        if (c == '\\' && i + 1 < length) {
+            switch (source[++i]) {
+                case 'n':  c = '\n'; break;
+                case 't':  c = '\t'; break;
+                case 'r':  c = '\r'; break;
+                case '0':  c = '\0'; break;
+                default:   c = source[i]; break;
+            }
+        }
+        data[count++] = c;
+    }
+    CString* string = intern_cstring(data, count);
+    free(data);
+    return string;
 }
 
 static ASTNode* parse_primary() {
@@ -138,17 +728,73 @@ static ASTNode* parse_primary() {
         float value = strtof(previous_token()->start, NULL);
         return make_node_literal(previous_token()->line, FLOAT_VALUE(value));
     }
+    if (match(1, TOKEN_STRING_LITERAL)) {
+        return make_node_literal(previous_token()->line, STRING_VALUE(parse_string_literal(previous_token())));
+    }
     if (match(1, TOKEN_TRUE)) {
         return make_node_literal(previous_token()->line, BOOL_VALUE(true));
     }
     if (match(1, TOKEN_FALSE)) {
         return make_node_literal(previous_token()->line, BOOL_VALUE(false));
     }
+    if (match(1, TOKEN_THIS)) {
+        return make_node_variable(previous_token()->line, *previous_token());
+    }
+    if (match(1, TOKEN_IDENTIFIER)) {
+        Token name = *previous_token();
+        if (!match(1, TOKEN_LEFT_PAREN)) {
+            return make_node_variable(name.line, name);
+        }
+
+        ASTNode* call = make_node_call(name.line, name);
+        if (!check(TOKEN_RIGHT_PAREN)) {
+            do {
+                append_argument(call, parse_expression());
+            } while (match(1, TOKEN_COMMA));
+        }
+        consume_expected(TOKEN_RIGHT_PAREN, "expected ')' after arguments");
+        return call;
+    }
     if (match(1, TOKEN_LEFT_PAREN)) {
         ASTNode* inside = parse_expression();
         consume_expected(TOKEN_RIGHT_PAREN, "expected closing parenthesis");
         return inside;
     }
+    // `int[n]` is a zero-filled array of n ints
+    if (is_type_token(parser.current->type) && next_token()->type == TOKEN_LEFT_BRACKET) {
+        int line = parser.current->line;
+        ValueType element_type = element_type_of(parser.current->type);
+        parser.current += 2;
+        ASTNode* length = parse_expression();
+        consume_expected(TOKEN_RIGHT_BRACKET, "expected ']' after array length");
+        return make_node_array(line, element_type, length);
+    }
+    // `map[string]int{}` is an empty map, entries are written `key: value`
+    if (match(1, TOKEN_MAP)) {
+        int line = previous_token()->line;
+        ASTNode* map = make_node_map(line, MAP_VALUE_TYPE_OF(parse_map_type()));
+        consume_expected(TOKEN_LEFT_BRACE, "expected '{' after map type");
+        if (!check(TOKEN_RIGHT_BRACE)) {
+            do {
+                ASTNode* key = parse_expression();
+                consume_expected(TOKEN_COLON, "expected ':' after map key");
+                append_entry(map, key, parse_expression());
+            } while (match(1, TOKEN_COMMA));
+        }
+        consume_expected(TOKEN_RIGHT_BRACE, "expected '}' after map entries");
+        return map;
+    }
+    // the analyzer takes the element type of a literal from its elements
+    if (match(1, TOKEN_LEFT_BRACKET)) {
+        ASTNode* array = make_node_array(previous_token()->line, VALUE_NONE, NULL);
+        if (!check(TOKEN_RIGHT_BRACKET)) {
+            do {
+                append_element(array, parse_expression());
+            } while (match(1, TOKEN_COMMA));
+        }
+        consume_expected(TOKEN_RIGHT_BRACKET, "expected ']' after array elements");
+        return array;
+    }
 
     if (parser.current->type == TOKEN_ERROR) {
         error_at_current(parser.current->start);
@@ -165,23 +811,124 @@ bool parse(TokenArray* token_array, ASTNode** output) {
     parser.had_error = false;
     parser.panic_mode = false;
 
-    *output = parse_expression();
+    ASTNode* program = make_node_block(parser.current->line);
+    while (!check(TOKEN_EOF)) {
+        append_to_block(program, parse_declaration());
+    }
+    *output = program;
 
     return !parser.had_error;
 }
 
 void free_ast(ASTNode* root) {
+    if (root == NULL) return;
+
     switch (root->type) {
         case AST_NODE_BINARY: {
-            free(root->binary.left);
-            free(root->binary.right);
+            free_ast(root->binary.left);
+            free_ast(root->binary.right);
         } break;
         case AST_NODE_UNARY: {
-            free(root->unary.right);
+            free_ast(root->unary.right);
         } break;
         case AST_NODE_LITERAL: break;
         case AST_NODE_CAST: {
-            free(root->cast.expression);
+            free_ast(root->cast.expression);
+        } break;
+        case AST_NODE_VARIABLE: break;
+        case AST_NODE_ASSIGNMENT: {
+            free_ast(root->assignment.value);
+        } break;
+        case AST_NODE_VAR_DECL: {
+            free_ast(root->var_decl.initializer);
+        } break;
+        case AST_NODE_PRINT: {
+            free_ast(root->print.expression);
+        } break;
+        case AST_NODE_EXPRESSION_STATEMENT: {
+            free_ast(root->expression_statement.expression);
+        } break;
+        case AST_NODE_BLOCK: {
+            for (int i = 0; i < root->block.count; ++i) {
+                free_ast(root->block.statements[i]);
+            }
+            free(root->block.statements);
+        } break;
+        case AST_NODE_IF: {
+            free_ast(root->if_.condition);
+            free_ast(root->if_.then_branch);
+            free_ast(root->if_.else_branch);
+        } break;
+        case AST_NODE_WHILE: {
+            free_ast(root->while_.condition);
+            free_ast(root->while_.body);
+        } break;
+        case AST_NODE_FOR: {
+            free_ast(root->for_.initializer);
+            free_ast(root->for_.condition);
+            free_ast(root->for_.increment);
+            free_ast(root->for_.body);
+        } break;
+        case AST_NODE_FUNCTION: {
+            free(root->function.params);
+            free_ast(root->function.body);
+        } break;
+        case AST_NODE_CALL: {
+            for (int i = 0; i < root->call.count; ++i) {
+                free_ast(root->call.arguments[i]);
+            }
+            free(root->call.arguments);
+        } break;
+        case AST_NODE_RETURN: {
+            free_ast(root->return_.value);
+        } break;
+        case AST_NODE_YIELD: {
+            free_ast(root->yield_.value);
+        } break;
+        case AST_NODE_ARRAY: {
+            free_ast(root->array.length);
+            for (int i = 0; i < root->array.count; ++i) {
+                free_ast(root->array.elements[i]);
+            }
+            free(root->array.elements);
+        } break;
+        case AST_NODE_SUBSCRIPT: {
+            free_ast(root->subscript.array);
+            free_ast(root->subscript.index);
+        } break;
+        case AST_NODE_MAP: {
+            for (int i = 0; i < root->map.count; ++i) {
+                free_ast(root->map.keys[i]);
+                free_ast(root->map.values[i]);
+            }
+            free(root->map.keys);
+            free(root->map.values);
+        } break;
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            free_ast(root->subscript_assignment.array);
+            free_ast(root->subscript_assignment.index);
+            free_ast(root->subscript_assignment.value);
+        } break;
+        case AST_NODE_CLASS: {
+            free(root->class_.fields);
+            for (int i = 0; i < root->class_.method_count; ++i) {
+                free_ast(root->class_.methods[i]);
+            }
+            free(root->class_.methods);
+        } break;
+        case AST_NODE_GET_FIELD: {
+            free_ast(root->get_field.object);
+        } break;
+        case AST_NODE_SET_FIELD: {
+            free_ast(root->set_field.object);
+            free_ast(root->set_field.value);
+        } break;
+        case AST_NODE_INVOKE: {
+            free_ast(root->invoke.object);
+            for (int i = 0; i < root->invoke.count; ++i) {
+                free_ast(root->invoke.arguments[i]);
+            }
+            free(root->invoke.arguments);
         } break;
         default: {
             fprintf(stderr, "unknown AST node type: %d\n", root->type);
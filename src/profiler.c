@@ -0,0 +1,226 @@
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "chunk.h"
+#include "class.h"
+#include "memory.h"
+#include "profiler.h"
+
+// Samples are written by the SIGPROF handler and drained by the interpreter thread, at a safepoint
+// once the buffer is half full and when the timer is disarmed. The handler is the only producer,
+// so a single atomic head index is enough to keep the ring buffer consistent without locks.
+// offsets[0] is the executing instruction, the rest are call sites from the innermost caller outwards.
+typedef struct Sample {
+    uint32_t depth;
+    bool truncated;
+    uint32_t offsets[PROFILER_MAX_DEPTH];
+} Sample;
+
+typedef struct SampleBuffer {
+    Sample samples[PROFILER_BUFFER_CAPACITY];
+    atomic_uint head;
+    unsigned int tail;
+    atomic_uint dropped;
+} SampleBuffer;
+
+typedef struct FoldedStack {
+    char* frames;
+    int count;
+} FoldedStack;
+
+typedef struct Profiler {
+    bool enabled;
+    Chunk* chunk;
+    const uint8_t* const* volatile ip;
+    const CallFrame* volatile frames;
+    const volatile int* frame_count;
+    const uint8_t* volatile code;
+
+    int count;
+    int capacity;
+    FoldedStack* stacks;
+    // inline cache counters are formatted when sampling ends, the chunk is gone by the time they print
+    int cache_count;
+    int cache_capacity;
+    char** caches;
+} Profiler;
+
+static SampleBuffer buffer = { 0 };
+static Profiler profiler = { 0 };
+volatile sig_atomic_t samples_pending = 0;
+
+static void handle_sigprof(int signal) {
+    (void) signal;
+    const uint8_t* const* ip = profiler.ip;
+    if (ip == NULL) return;
+
+    unsigned int head = atomic_load_explicit(&buffer.head, memory_order_relaxed);
+    if (head - buffer.tail >= PROFILER_BUFFER_CAPACITY) {
+        atomic_fetch_add_explicit(&buffer.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    // ip and the return addresses point past the opcode that is executing or made the call
+    Sample* sample = &buffer.samples[head % PROFILER_BUFFER_CAPACITY];
+    sample->offsets[0] = (uint32_t)(*ip - profiler.code - 1);
+    int frame = *profiler.frame_count - 1;
+    uint32_t depth = 1;
+    for (; frame > 0 && depth < PROFILER_MAX_DEPTH; --frame) {
+        sample->offsets[depth++] = (uint32_t)(profiler.frames[frame].return_ip - profiler.code - 1);
+    }
+    sample->depth = depth;
+    sample->truncated = frame > 0;
+    atomic_store_explicit(&buffer.head, head + 1, memory_order_release);
+    if (head + 1 - buffer.tail >= PROFILER_BUFFER_CAPACITY / 2) samples_pending = 1;
+}
+
+static void set_timer(int interval_usec) {
+    struct itimerval timer = { 0 };
+    timer.it_interval.tv_usec = interval_usec;
+    timer.it_value.tv_usec = interval_usec;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+static void add_folded_stack(const char* frames) {
+    for (int i = 0; i < profiler.count; ++i) {
+        if (strcmp(profiler.stacks[i].frames, frames) == 0) {
+            ++profiler.stacks[i].count;
+            return;
+        }
+    }
+
+    if (profiler.capacity < profiler.count + 1) {
+        int old_capacity = profiler.capacity;
+        profiler.capacity = GROW_CAPACITY(old_capacity);
+        profiler.stacks = GROW_ARRAY(FoldedStack, profiler.stacks, old_capacity, profiler.capacity);
+    }
+    profiler.stacks[profiler.count++] = (FoldedStack){ .frames = strdup(frames), .count = 1 };
+}
+
+static int append_frame(char* frames, int length, int capacity, uint32_t offset) {
+    Chunk* chunk = profiler.chunk;
+    int line = offset < (uint32_t)chunk->count ? chunk->lines[offset] : 0;
+    Function* function = function_at(chunk, (int)offset);
+    const char* separator = length > 0 ? ";" : "";
+
+    int written = function == NULL
+        ? snprintf(frames + length, capacity - length, "%s<script>:%d", separator, line)
+        : snprintf(frames + length, capacity - length, "%s%.*s:%d", separator, function->length, function->name, line);
+    return written < capacity - length ? length + written : capacity - 1;
+}
+
+// Frames are folded outermost first, as flame graph tools expect.
+static void resolve_sample(Sample* sample) {
+    char frames[PROFILER_MAX_DEPTH * 64];
+    int length = 0;
+    if (sample->truncated) {
+        length = snprintf(frames, sizeof(frames), "[truncated]");
+    }
+    for (int i = (int)sample->depth - 1; i >= 0; --i) {
+        length = append_frame(frames, length, sizeof(frames), sample->offsets[i]);
+    }
+    add_folded_stack(frames);
+}
+
+void drain_samples() {
+    samples_pending = 0;
+    unsigned int head = atomic_load_explicit(&buffer.head, memory_order_acquire);
+    while (buffer.tail != head) {
+        resolve_sample(&buffer.samples[buffer.tail % PROFILER_BUFFER_CAPACITY]);
+        ++buffer.tail;
+    }
+}
+
+static void add_cache_report(const char* report) {
+    if (profiler.cache_capacity < profiler.cache_count + 1) {
+        int old_capacity = profiler.cache_capacity;
+        profiler.cache_capacity = GROW_CAPACITY(old_capacity);
+        profiler.caches = GROW_ARRAY(char*, profiler.caches, old_capacity, profiler.cache_capacity);
+    }
+    profiler.caches[profiler.cache_count++] = strdup(report);
+}
+
+// One line per site that ran, named after the frame it sits in like the folded stacks.
+static void report_inline_caches() {
+    static const char* kinds[] = { "getfield", "setfield", "invoke" };
+    Chunk* chunk = profiler.chunk;
+    for (int i = 0; i < chunk->cache_count; ++i) {
+        InlineCache* cache = &chunk->caches[i];
+        uint64_t hits = atomic_load_explicit(&cache->hits, memory_order_relaxed);
+        uint64_t misses = atomic_load_explicit(&cache->misses, memory_order_relaxed);
+        if (hits + misses == 0) continue;
+
+        char site[128];
+        append_frame(site, 0, sizeof(site), (uint32_t)cache->offset);
+        char report[256];
+        snprintf(report, sizeof(report), "inline cache %s %s '%.*s' %s: %llu hits, %llu misses",
+                 site, kinds[cache->kind], cache->name->length, cache->name->data, inline_cache_state(cache),
+                 (unsigned long long)hits, (unsigned long long)misses);
+        add_cache_report(report);
+    }
+}
+
+void enable_sampling_profiler() {
+    profiler.enabled = true;
+
+    struct sigaction action = { 0 };
+    action.sa_handler = handle_sigprof;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+}
+
+void begin_sampling(const uint8_t* const* ip, const CallFrame* frames, const int* frame_count, Chunk* chunk) {
+    if (!profiler.enabled) return;
+
+    profiler.chunk = chunk;
+    profiler.code = chunk->code;
+    profiler.frames = frames;
+    profiler.frame_count = frame_count;
+    profiler.ip = ip;
+    set_timer(PROFILER_INTERVAL_USEC);
+}
+
+void end_sampling() {
+    if (!profiler.enabled || profiler.ip == NULL) return;
+
+    set_timer(0);
+    profiler.ip = NULL;
+    drain_samples();
+    report_inline_caches();
+    profiler.chunk = NULL;
+}
+
+void print_folded_samples(FILE* file) {
+    for (int i = 0; i < profiler.count; ++i) {
+        fprintf(file, "%s %d\n", profiler.stacks[i].frames, profiler.stacks[i].count);
+    }
+    // these end in a word, so flame graph tools skip them as malformed stacks
+    for (int i = 0; i < profiler.cache_count; ++i) {
+        fprintf(file, "%s\n", profiler.caches[i]);
+    }
+
+    unsigned int dropped = atomic_load(&buffer.dropped);
+    if (dropped > 0) {
+        fprintf(stderr, "profiler::print_folded_samples: dropped %u of %u samples\n", dropped, buffer.tail + dropped);
+    }
+}
+
+void free_samples() {
+    for (int i = 0; i < profiler.count; ++i) {
+        free(profiler.stacks[i].frames);
+    }
+    free(profiler.stacks);
+    for (int i = 0; i < profiler.cache_count; ++i) {
+        free(profiler.caches[i]);
+    }
+    free(profiler.caches);
+
+    profiler.count = 0;
+    profiler.capacity = 0;
+    profiler.stacks = NULL;
+    profiler.cache_count = 0;
+    profiler.cache_capacity = 0;
+    profiler.caches = NULL;
+}
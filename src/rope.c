@@ -0,0 +1,106 @@
+#include <string.h>
+#include "cstring.h"
+#include "gc.h"
+#include "memory.h"
+#include "rope.h"
+#include "value.h"
+
+static int string_length(Value value) {
+    return IS_ROPE(value) ? AS_ROPE(value)->length : AS_STRING(value)->length;
+}
+
+// A flattened rope stands for its string, which keeps later ropes built on top of it shallow.
+static Value settled(Value value) {
+    if (IS_ROPE(value) && AS_ROPE(value)->flat != NULL) return STRING_VALUE(AS_ROPE(value)->flat);
+    return value;
+}
+
+Value concat_strings(Value left, Value right) {
+    left = settled(left);
+    right = settled(right);
+    int length = string_length(left) + string_length(right);
+    if (length < ROPE_MIN_LENGTH && IS_STRING(left) && IS_STRING(right)) {
+        return STRING_VALUE(concat_runtime_cstrings(AS_STRING(left), AS_STRING(right)));
+    }
+    if (string_length(left) == 0) return right;
+    if (string_length(right) == 0) return left;
+
+    Rope* rope = allocate_object(sizeof(Rope), OBJ_ROPE);
+    rope->length = length;
+    rope->flat = NULL;
+    rope->left = left;
+    rope->right = right;
+    write_barrier(&rope->obj, left);
+    write_barrier(&rope->obj, right);
+    return ROPE_VALUE(rope);
+}
+
+// Leaves are copied from the back, so the stack stays shallow for the left-leaning ropes appends build.
+static CString* flatten_rope(Rope* root) {
+    char* data = reallocate(NULL, 0, root->length + 1);
+    int end = root->length;
+
+    int count = 0;
+    int capacity = 0;
+    Value* pending = NULL;
+    Value node = ROPE_VALUE(root);
+    for (;;) {
+        node = settled(node);
+        if (IS_ROPE(node)) {
+            if (capacity < count + 1) {
+                int old_capacity = capacity;
+                capacity = GROW_CAPACITY(old_capacity);
+                pending = GROW_ARRAY(Value, pending, old_capacity, capacity);
+            }
+            pending[count++] = AS_ROPE(node)->left;
+            node = AS_ROPE(node)->right;
+            continue;
+        }
+
+        CString* leaf = AS_STRING(node);
+        end -= leaf->length;
+        memcpy(data + end, leaf->data, leaf->length);
+        if (count == 0) break;
+        node = pending[--count];
+    }
+    reallocate(pending, sizeof(Value) * capacity, 0);
+
+    CString* flat = intern_runtime_cstring(data, root->length);
+    reallocate(data, root->length + 1, 0);
+    return flat;
+}
+
+CString* flatten_string(Value value) {
+    if (IS_STRING(value)) return AS_STRING(value);
+
+    Rope* rope = AS_ROPE(value);
+    if (rope->flat == NULL) {
+        rope->flat = flatten_rope(rope);
+        write_barrier(&rope->obj, STRING_VALUE(rope->flat));
+        rope->left = NONE_VALUE();
+        rope->right = NONE_VALUE();
+    }
+    return rope->flat;
+}
+
+// Slices are compared in place, they are never copied just to be compared.
+static bool slice_equal(Slice* slice, Value other) {
+    const char* data;
+    if (IS_SLICE(other)) {
+        if (AS_SLICE(other)->length != slice->length) return false;
+        data = AS_SLICE(other)->data;
+    }
+    else {
+        if (string_length(other) != slice->length) return false;
+        data = flatten_string(other)->data;
+    }
+    return memcmp(slice->data, data, slice->length) == 0;
+}
+
+bool strings_equal(Value left, Value right) {
+    if (IS_STRING(left) && IS_STRING(right)) return cstrings_equal(AS_STRING(left), AS_STRING(right));
+    if (IS_SLICE(left)) return slice_equal(AS_SLICE(left), right);
+    if (IS_SLICE(right)) return slice_equal(AS_SLICE(right), left);
+    if (string_length(left) != string_length(right)) return false;
+    return cstrings_equal(flatten_string(left), flatten_string(right));
+}
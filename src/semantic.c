@@ -1,16 +1,35 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
+#include "intrinsic.h"
 #include "lexer.h"
 #include "make_node.h"
+#include "memory.h"
+#include "native.h"
 #include "parser.h"
 #include "semantic.h"
 #include "value.h"
 
+typedef struct Local {
+    Token name;
+    ValueType type;
+    bool is_const;
+    int depth;
+} Local;
+
 typedef struct Analyzer {
     bool had_error;
     bool panic_mode;
+
+    SymbolTable* globals;
+    ASTNode* function;
+    Local locals[MAX_LOCALS];
+    int local_count;
+    int scope_depth;
 } Analyzer;
 
-static Analyzer analyzer = { 0 };
+static _Thread_local Analyzer analyzer = { 0 };
 
 static void error(ASTNode* node, const char* message) {
     if (analyzer.panic_mode) return;
@@ -19,13 +38,1084 @@ static void error(ASTNode* node, const char* message) {
     fprintf(stderr, "[line %d] error: %s\n", node->line, message);
 }
 
+// Pure functions are memoized, so nothing they do may be observable besides their result.
+static bool in_pure_function() {
+    return analyzer.function != NULL && analyzer.function->function.is_pure;
+}
+
+// Generator functions run their body as they are resumed, calling one only captures the arguments.
+static bool in_generator() {
+    return analyzer.function != NULL && IS_GENERATOR_TYPE(analyzer.function->function.return_type);
+}
+
+static bool is_scalar(ValueType type) {
+    return type == VALUE_BOOL || type == VALUE_INT || type == VALUE_FLOAT;
+}
+
+static bool names_equal(const char* name, int length, Token* token) {
+    return length == token->length && memcmp(name, token->start, length) == 0;
+}
+
+static int find_local(Token* name) {
+    for (int i = analyzer.local_count - 1; i >= 0; --i) {
+        if (names_equal(analyzer.locals[i].name.start, analyzer.locals[i].name.length, name)) return i;
+    }
+    return -1;
+}
+
+static int find_global(Token* name) {
+    SymbolTable* table = analyzer.globals;
+    for (int i = 0; i < table->count; ++i) {
+        if (names_equal(table->globals[i].name, table->globals[i].length, name)) return i;
+    }
+    return -1;
+}
+
+static int declare_global(ASTNode* node, Token* name, ValueType type, bool is_const) {
+    SymbolTable* table = analyzer.globals;
+    if (find_global(name) != -1) {
+        error(node, "variable already declared");
+        return -1;
+    }
+    if (table->count == MAX_GLOBALS) {
+        error(node, "too many global variables");
+        return -1;
+    }
+
+    if (table->capacity < table->count + 1) {
+        int old_capacity = table->capacity;
+        table->capacity = GROW_CAPACITY(old_capacity);
+        table->globals = GROW_ARRAY(GlobalSymbol, table->globals, old_capacity, table->capacity);
+    }
+
+    GlobalSymbol* symbol = &table->globals[table->count];
+    symbol->name = malloc(name->length);
+    memcpy(symbol->name, name->start, name->length);
+    symbol->length = name->length;
+    symbol->type = type;
+    symbol->is_const = is_const;
+    return table->count++;
+}
+
+static int find_function(Token* name) {
+    SymbolTable* table = analyzer.globals;
+    for (int i = 0; i < table->function_count; ++i) {
+        if (names_equal(table->functions[i].name, table->functions[i].length, name)) return i;
+    }
+    return -1;
+}
+
+static int find_class(Token* name) {
+    SymbolTable* table = analyzer.globals;
+    for (int i = 0; i < table->class_count; ++i) {
+        if (names_equal(table->classes[i].name, table->classes[i].length, name)) return i;
+    }
+    return -1;
+}
+
+// Methods are declared under their qualified name, which plain calls never spell.
+static int declare_function(ASTNode* node, Token* name) {
+    SymbolTable* table = analyzer.globals;
+    if (find_function(name) != -1) {
+        error(node, "function already declared");
+        return -1;
+    }
+    if (find_class(name) != -1) {
+        error(node, "function name is already used by a class");
+        return -1;
+    }
+    if (table->function_count == MAX_FUNCTIONS) {
+        error(node, "too many functions");
+        return -1;
+    }
+
+    if (table->function_capacity < table->function_count + 1) {
+        int old_capacity = table->function_capacity;
+        table->function_capacity = GROW_CAPACITY(old_capacity);
+        table->functions = GROW_ARRAY(FunctionSymbol, table->functions, old_capacity, table->function_capacity);
+    }
+
+    FunctionSymbol* symbol = &table->functions[table->function_count];
+    symbol->name = malloc(name->length);
+    memcpy(symbol->name, name->start, name->length);
+    symbol->length = name->length;
+    symbol->arity = node->function.arity;
+    symbol->param_types = malloc(sizeof(ValueType) * node->function.arity);
+    for (int i = 0; i < node->function.arity; ++i) {
+        symbol->param_types[i] = node->function.params[i].type;
+    }
+    symbol->return_type = node->function.return_type;
+    symbol->is_pure = node->function.is_pure;
+    return table->function_count++;
+}
+
+// Returns the type every class gives the field called name, VALUE_NONE when none declares it.
+static ValueType find_field_type(Token* name) {
+    SymbolTable* table = analyzer.globals;
+    for (int i = 0; i < table->class_count; ++i) {
+        ClassSymbol* klass = &table->classes[i];
+        for (int j = 0; j < klass->field_count; ++j) {
+            if (names_equal(klass->fields[j].name, klass->fields[j].length, name)) return klass->fields[j].type;
+        }
+    }
+    return VALUE_NONE;
+}
+
+// Returns the function index of some method called name, all of them share its signature. -1 when none exists.
+static int find_method(Token* name) {
+    SymbolTable* table = analyzer.globals;
+    for (int i = 0; i < table->class_count; ++i) {
+        ClassSymbol* klass = &table->classes[i];
+        for (int j = 0; j < klass->method_count; ++j) {
+            if (names_equal(klass->methods[j].name, klass->methods[j].length, name)) return klass->methods[j].function;
+        }
+    }
+    return -1;
+}
+
+static bool same_signature(FunctionSymbol* function, FunctionSymbol* other) {
+    if (function->arity != other->arity || function->return_type != other->return_type) return false;
+    // both take `this` first
+    for (int i = 1; i < function->arity; ++i) {
+        if (function->param_types[i] != other->param_types[i]) return false;
+    }
+    return true;
+}
+
+static void declare_method(ASTNode* klass, ClassSymbol* symbol, ASTNode* method) {
+    Token* name = &method->function.name;
+    for (int i = 0; i < symbol->method_count; ++i) {
+        if (names_equal(symbol->methods[i].name, symbol->methods[i].length, name)) {
+            error(method, "method already declared");
+            return;
+        }
+    }
+
+    Token* class_name = &klass->class_.name;
+    int length = class_name->length + 1 + name->length;
+    char* qualified = malloc(length);
+    memcpy(qualified, class_name->start, class_name->length);
+    qualified[class_name->length] = '.';
+    memcpy(qualified + class_name->length + 1, name->start, name->length);
+    int index = declare_function(method, &(Token){ .type = TOKEN_IDENTIFIER, .start = qualified, .length = length });
+    free(qualified);
+    if (index == -1) return;
+
+    int other = find_method(name);
+    if (other != -1 && !same_signature(&analyzer.globals->functions[index], &analyzer.globals->functions[other])) {
+        error(method, "method declared with a different signature in another class");
+        return;
+    }
+    method->function.index = index;
+    MethodSymbol* method_symbol = &symbol->methods[symbol->method_count++];
+    method_symbol->name = malloc(name->length);
+    memcpy(method_symbol->name, name->start, name->length);
+    method_symbol->length = name->length;
+    method_symbol->function = index;
+}
+
+static int declare_class(ASTNode* node) {
+    SymbolTable* table = analyzer.globals;
+    Token* name = &node->class_.name;
+    if (find_class(name) != -1) {
+        error(node, "class already declared");
+        return -1;
+    }
+    if (find_function(name) != -1) {
+        error(node, "class name is already used by a function");
+        return -1;
+    }
+    if (table->class_count == MAX_CLASSES) {
+        error(node, "too many classes");
+        return -1;
+    }
+    // construction passes every field as an argument
+    if (node->class_.field_count > UINT8_MAX) {
+        error(node, "too many fields");
+        return -1;
+    }
+    for (int i = 0; i < node->class_.field_count; ++i) {
+        Parameter* field = &node->class_.fields[i];
+        for (int j = 0; j < i; ++j) {
+            if (names_equal(node->class_.fields[j].name.start, node->class_.fields[j].name.length, &field->name)) {
+                error(node, "field already declared");
+                return -1;
+            }
+        }
+        ValueType type = find_field_type(&field->name);
+        if (type != VALUE_NONE && type != field->type) {
+            error(node, "field declared with a different type in another class");
+            return -1;
+        }
+    }
+
+    if (table->class_capacity < table->class_count + 1) {
+        int old_capacity = table->class_capacity;
+        table->class_capacity = GROW_CAPACITY(old_capacity);
+        table->classes = GROW_ARRAY(ClassSymbol, table->classes, old_capacity, table->class_capacity);
+    }
+
+    ClassSymbol* symbol = &table->classes[table->class_count];
+    symbol->name = malloc(name->length);
+    memcpy(symbol->name, name->start, name->length);
+    symbol->length = name->length;
+    symbol->field_count = node->class_.field_count;
+    symbol->fields = malloc(sizeof(FieldSymbol) * node->class_.field_count);
+    for (int i = 0; i < node->class_.field_count; ++i) {
+        Parameter* field = &node->class_.fields[i];
+        symbol->fields[i].name = malloc(field->name.length);
+        memcpy(symbol->fields[i].name, field->name.start, field->name.length);
+        symbol->fields[i].length = field->name.length;
+        symbol->fields[i].type = field->type;
+    }
+    symbol->method_count = 0;
+    symbol->methods = malloc(sizeof(MethodSymbol) * node->class_.method_count);
+    ++table->class_count;
+    for (int i = 0; i < node->class_.method_count; ++i) {
+        declare_method(node, symbol, node->class_.methods[i]);
+    }
+    return table->class_count - 1;
+}
+
+static int declare_local(ASTNode* node, Token* name, ValueType type, bool is_const) {
+    for (int i = analyzer.local_count - 1; i >= 0 && analyzer.locals[i].depth == analyzer.scope_depth; --i) {
+        if (names_equal(analyzer.locals[i].name.start, analyzer.locals[i].name.length, name)) {
+            error(node, "variable already declared in this scope");
+            return -1;
+        }
+    }
+    if (analyzer.local_count == MAX_LOCALS) {
+        error(node, "too many local variables");
+        return -1;
+    }
+
+    analyzer.locals[analyzer.local_count] = (Local){
+        .name = *name,
+        .type = type,
+        .is_const = is_const,
+        .depth = analyzer.scope_depth,
+    };
+    return analyzer.local_count++;
+}
+
+// Resolves a name to its slot, innermost local first. Returns false for undeclared names.
+static bool resolve(Token* name, int* slot, bool* is_global, ValueType* type, bool* is_const) {
+    int local = find_local(name);
+    if (local != -1) {
+        *slot = local;
+        *is_global = false;
+        *type = analyzer.locals[local].type;
+        *is_const = analyzer.locals[local].is_const;
+        return true;
+    }
+
+    int global = find_global(name);
+    if (global != -1) {
+        *slot = global;
+        *is_global = true;
+        *type = analyzer.globals->globals[global].type;
+        *is_const = analyzer.globals->globals[global].is_const;
+        return true;
+    }
+    return false;
+}
+
+// Returns the expression converted to the target type, or NULL when no implicit conversion exists.
+static ASTNode* coerce(ASTNode* expression, ValueType target) {
+    ValueType type = expression->inferred_type;
+    if (type == target) return expression;
+    if (type == VALUE_INT && target == VALUE_FLOAT) {
+        ASTNode* cast = make_node_cast(expression->line, VALUE_FLOAT, expression);
+        cast->inferred_type = VALUE_FLOAT;
+        return cast;
+    }
+    return NULL;
+}
+
+static void analyze_ast(ASTNode* root);
+
+static void require_value(ASTNode* expression) {
+    if (expression->type == AST_NODE_CALL && (expression->call.index != -1 || expression->call.native != -1) &&
+        expression->inferred_type == VALUE_NONE) {
+        error(expression, "function does not return a value");
+    }
+    if (expression->type == AST_NODE_INVOKE && expression->invoke.function != -1 && expression->inferred_type == VALUE_NONE) {
+        error(expression, "method does not return a value");
+    }
+}
+
+static void analyze_var_decl(ASTNode* root) {
+    ValueType type = root->var_decl.declared_type;
+    ASTNode* initializer = root->var_decl.initializer;
+
+    if (initializer != NULL) {
+        analyze_ast(initializer);
+        require_value(initializer);
+        if (type == VALUE_NONE) {
+            type = initializer->inferred_type;
+        }
+        else if (initializer->inferred_type != VALUE_NONE) {
+            ASTNode* coerced = coerce(initializer, type);
+            if (coerced == NULL) error(root, "incompatible type in variable declaration");
+            else root->var_decl.initializer = coerced;
+        }
+    }
+    if (type == VALUE_NONE) return;
+    // there is no empty object to start from
+    if (type == VALUE_OBJECT && initializer == NULL) {
+        error(root, "object variable must be initialized");
+        return;
+    }
+    if (IS_GENERATOR_TYPE(type) && initializer == NULL) {
+        error(root, "generator variable must be initialized");
+        return;
+    }
+
+    Token* name = &root->var_decl.name;
+    root->inferred_type = type;
+    if (analyzer.scope_depth == 0) {
+        root->var_decl.slot = declare_global(root, name, type, root->var_decl.is_const);
+        root->var_decl.is_global = true;
+    }
+    else {
+        root->var_decl.slot = declare_local(root, name, type, root->var_decl.is_const);
+        root->var_decl.is_global = false;
+    }
+}
+
+static void analyze_assignment(ASTNode* root) {
+    analyze_ast(root->assignment.value);
+    require_value(root->assignment.value);
+
+    ValueType type;
+    bool is_const;
+    if (!resolve(&root->assignment.name, &root->assignment.slot, &root->assignment.is_global, &type, &is_const)) {
+        error(root, "undefined variable");
+        return;
+    }
+    if (is_const) {
+        error(root, "cannot assign to a constant");
+        return;
+    }
+    if (root->assignment.is_global && in_pure_function()) {
+        error(root, "pure functions cannot assign to globals");
+        return;
+    }
+
+    ASTNode* value = root->assignment.value;
+    if (value->inferred_type == VALUE_NONE) return;
+
+    ASTNode* coerced = coerce(value, type);
+    if (coerced == NULL) {
+        error(root, "incompatible type in assignment");
+        return;
+    }
+    root->assignment.value = coerced;
+    root->inferred_type = type;
+}
+
+// Mixed int/float operands are compared as floats, bools and strings only support (in)equality.
+static void analyze_comparison(ASTNode* root) {
+    ASTNode* left = root->binary.left;
+    ASTNode* right = root->binary.right;
+    ValueType left_type = left->inferred_type;
+    ValueType right_type = right->inferred_type;
+    root->inferred_type = VALUE_BOOL;
+
+    if (left_type == VALUE_NONE || right_type == VALUE_NONE) return;
+
+    if (IS_ARRAY_TYPE(left_type) || IS_ARRAY_TYPE(right_type)) {
+        error(root, "arrays cannot be compared");
+        return;
+    }
+    if (IS_MAP_TYPE(left_type) || IS_MAP_TYPE(right_type)) {
+        error(root, "maps cannot be compared");
+        return;
+    }
+    if (left_type == VALUE_OBJECT || right_type == VALUE_OBJECT) {
+        error(root, "objects cannot be compared");
+        return;
+    }
+    if (IS_GENERATOR_TYPE(left_type) || IS_GENERATOR_TYPE(right_type)) {
+        error(root, "generators cannot be compared");
+        return;
+    }
+    if (left_type == VALUE_BOOL || right_type == VALUE_BOOL ||
+        left_type == VALUE_STRING || right_type == VALUE_STRING) {
+        bool equality = root->binary.op == TOKEN_EQUAL_EQUAL || root->binary.op == TOKEN_BANG_EQUAL;
+        if (left_type != right_type || !equality) {
+            error(root, "incompatible types for comparison");
+        }
+        return;
+    }
+
+    if (left_type == VALUE_INT && right_type == VALUE_FLOAT) {
+        root->binary.left = coerce(left, VALUE_FLOAT);
+    }
+    else if (left_type == VALUE_FLOAT && right_type == VALUE_INT) {
+        root->binary.right = coerce(right, VALUE_FLOAT);
+    }
+}
+
+static void analyze_condition(ASTNode* condition) {
+    analyze_ast(condition);
+    ValueType type = condition->inferred_type;
+    if (type != VALUE_BOOL && type != VALUE_NONE) {
+        error(condition, "condition must be a bool");
+    }
+}
+
+static void begin_scope() {
+    ++analyzer.scope_depth;
+}
+
+// Returns how many locals went out of scope.
+static int end_scope(int locals_before) {
+    int count = analyzer.local_count - locals_before;
+    analyzer.local_count = locals_before;
+    --analyzer.scope_depth;
+    return count;
+}
+
+static void analyze_for(ASTNode* root) {
+    begin_scope();
+    int locals_before = analyzer.local_count;
+
+    if (root->for_.initializer != NULL) analyze_ast(root->for_.initializer);
+    if (root->for_.condition != NULL) analyze_condition(root->for_.condition);
+    if (root->for_.increment != NULL) analyze_ast(root->for_.increment);
+    analyze_ast(root->for_.body);
+
+    root->for_.local_count = end_scope(locals_before);
+}
+
+// Conservative: loops may run zero times, so only returns and if/else with both sides returning count.
+static bool always_returns(ASTNode* root) {
+    if (root == NULL) return false;
+    switch (root->type) {
+        case AST_NODE_RETURN: return true;
+        case AST_NODE_IF:     return always_returns(root->if_.then_branch) && always_returns(root->if_.else_branch);
+        case AST_NODE_BLOCK: {
+            for (int i = 0; i < root->block.count; ++i) {
+                if (always_returns(root->block.statements[i])) return true;
+            }
+            return false;
+        }
+        default:              return false;
+    }
+}
+
+static void analyze_function(ASTNode* root) {
+    if (analyzer.scope_depth != 0) {
+        error(root, "functions can only be declared at top level");
+        return;
+    }
+    if (root->function.index == -1) return;  // already reported while declaring
+
+    // results are cached by argument values, which only works for values without identity
+    if (root->function.is_pure) {
+        bool scalar = is_scalar(root->function.return_type);
+        for (int i = 0; i < root->function.arity; ++i) scalar = scalar && is_scalar(root->function.params[i].type);
+        if (!scalar) error(root, "pure functions take and return only bool, int and float values");
+    }
+
+    analyzer.function = root;
+    begin_scope();
+    int locals_before = analyzer.local_count;
+
+    // parameters occupy the first slots of the frame, right where the caller pushed the arguments
+    for (int i = 0; i < root->function.arity; ++i) {
+        Parameter* param = &root->function.params[i];
+        declare_local(root, &param->name, param->type, false);
+    }
+    analyze_ast(root->function.body);
+
+    end_scope(locals_before);
+    analyzer.function = NULL;
+
+    ValueType return_type = root->function.return_type;
+    if (return_type != VALUE_NONE && !IS_GENERATOR_TYPE(return_type) && !always_returns(root->function.body)) {
+        analyzer.panic_mode = false;
+        error(root, "function must return a value on every path");
+    }
+}
+
+// has and remove take a map and a key, the slot builtins a map and a slot index. The result type is
+// set up front, so a for-in over something else reports one error instead of one per hidden local.
+static void analyze_map_builtin(ASTNode* root, ArrayBuiltin builtin) {
+    switch (builtin) {
+        case BUILTIN_NEXT_SLOT: root->inferred_type = VALUE_INT; break;
+        case BUILTIN_SLOT_KEY:  root->inferred_type = VALUE_STRING; break;
+        default:                root->inferred_type = VALUE_BOOL; break;
+    }
+    ValueType type = root->call.arguments[0]->inferred_type;
+    ASTNode* argument = root->call.arguments[1];
+    // a for-in over a generator resumes it for every value and reads the one it yielded
+    if (IS_GENERATOR_TYPE(type) && (builtin == BUILTIN_NEXT_SLOT || builtin == BUILTIN_SLOT_KEY)) {
+        root->call.builtin = builtin == BUILTIN_NEXT_SLOT ? BUILTIN_RESUME : BUILTIN_SLOT_KEY;
+        if (builtin == BUILTIN_SLOT_KEY) root->inferred_type = YIELD_TYPE_OF(type);
+        return;
+    }
+    if (!IS_MAP_TYPE(type)) {
+        // $key only appears next to $next, which already reported the loop
+        if (builtin != BUILTIN_SLOT_KEY) {
+            error(root->call.arguments[0],
+                  builtin == BUILTIN_NEXT_SLOT ? "only maps and generators can be iterated" : "incompatible argument type");
+        }
+        return;
+    }
+    ValueType argument_type = builtin == BUILTIN_HAS || builtin == BUILTIN_REMOVE ? VALUE_STRING : VALUE_INT;
+    if (argument->inferred_type == VALUE_NONE) return;
+    if (argument->inferred_type != argument_type) {
+        error(argument, "incompatible argument type");
+        return;
+    }
+
+    root->call.builtin = builtin;
+}
+
+// lines(path) streams the lines of a file, or of stdin for "-". The result type is set up front like
+// the one of the slot builtins.
+static void analyze_lines(ASTNode* root) {
+    root->inferred_type = VALUE_STRING_GENERATOR;
+    if (in_pure_function()) {
+        error(root, "pure functions cannot read files");
+        return;
+    }
+    if (root->call.arguments[0]->inferred_type != VALUE_STRING) {
+        error(root->call.arguments[0], "incompatible argument type");
+        return;
+    }
+    root->call.builtin = BUILTIN_LINES;
+}
+
+// Builtins take an int[] or float[] first, len takes any array or map. The second argument of scale
+// is an element, the one of dot, add and mul an array of the same type.
+static void analyze_builtin(ASTNode* root, ArrayBuiltin builtin) {
+    if (root->call.count != array_builtin_arity(builtin)) {
+        error(root, "wrong number of arguments");
+        return;
+    }
+    ValueType type = root->call.arguments[0]->inferred_type;
+    if (type == VALUE_NONE) return;
+    if (builtin == BUILTIN_LINES) {
+        analyze_lines(root);
+        return;
+    }
+    if (builtin >= BUILTIN_HAS) {
+        analyze_map_builtin(root, builtin);
+        return;
+    }
+    if (builtin == BUILTIN_LEN && IS_MAP_TYPE(type)) {
+        root->call.builtin = builtin;
+        root->inferred_type = VALUE_INT;
+        return;
+    }
+    bool numeric = type == VALUE_INT_ARRAY || type == VALUE_FLOAT_ARRAY;
+    if (builtin == BUILTIN_LEN ? !IS_ARRAY_TYPE(type) : !numeric) {
+        error(root->call.arguments[0], "incompatible argument type");
+        return;
+    }
+
+    ValueType element_type = ELEMENT_TYPE_OF(type);
+    if (root->call.count == 2) {
+        ASTNode* argument = root->call.arguments[1];
+        ASTNode* coerced = coerce(argument, builtin == BUILTIN_SCALE ? element_type : type);
+        if (coerced == NULL) {
+            error(argument, "incompatible argument type");
+            return;
+        }
+        root->call.arguments[1] = coerced;
+    }
+
+    root->call.builtin = builtin;
+    switch (builtin) {
+        case BUILTIN_LEN: root->inferred_type = VALUE_INT; break;
+        case BUILTIN_SUM:
+        case BUILTIN_MIN:
+        case BUILTIN_MAX:
+        case BUILTIN_DOT: root->inferred_type = element_type; break;
+        default:          root->inferred_type = type; break;
+    }
+}
+
+// `Name(a, b)` constructs an instance of class Name from one argument per field, in declaration order.
+static void analyze_constructor(ASTNode* root, int index) {
+    ClassSymbol* klass = &analyzer.globals->classes[index];
+    if (root->call.count != klass->field_count) {
+        error(root, "wrong number of arguments");
+        return;
+    }
+    for (int i = 0; i < root->call.count; ++i) {
+        ASTNode* argument = root->call.arguments[i];
+        if (argument->inferred_type == VALUE_NONE) return;
+        ASTNode* coerced = coerce(argument, klass->fields[i].type);
+        if (coerced == NULL) {
+            error(argument, "incompatible argument type");
+            return;
+        }
+        root->call.arguments[i] = coerced;
+    }
+    root->call.class_index = index;
+    root->inferred_type = VALUE_OBJECT;
+}
+
+// Arguments are converted to the registered parameter types, so the native reads them unchecked.
+static void analyze_native(ASTNode* root, int index) {
+    const NativeFunction* native = native_function(index);
+    if (root->call.count != native->arity) {
+        error(root, "wrong number of arguments");
+        return;
+    }
+    for (int i = 0; i < root->call.count; ++i) {
+        ASTNode* argument = root->call.arguments[i];
+        if (argument->inferred_type == VALUE_NONE) return;
+        ASTNode* coerced = coerce(argument, native->param_types[i]);
+        if (coerced == NULL) {
+            error(argument, "incompatible argument type");
+            return;
+        }
+        root->call.arguments[i] = coerced;
+    }
+    root->call.native = index;
+    root->inferred_type = native->return_type;
+}
+
+// Typed like arithmetic: abs, min and max stay int when every argument is, anything else works on floats.
+static void analyze_intrinsic(ASTNode* root, MathIntrinsic intrinsic) {
+    if (root->call.count != intrinsic_arity(intrinsic)) {
+        error(root, "wrong number of arguments");
+        return;
+    }
+    ValueType type = intrinsic_has_int(intrinsic) ? VALUE_INT : VALUE_FLOAT;
+    for (int i = 0; i < root->call.count; ++i) {
+        ASTNode* argument = root->call.arguments[i];
+        if (argument->inferred_type == VALUE_NONE) return;
+        if (argument->inferred_type == VALUE_FLOAT) type = VALUE_FLOAT;
+        else if (argument->inferred_type != VALUE_INT) {
+            error(argument, "incompatible argument type");
+            return;
+        }
+    }
+    for (int i = 0; i < root->call.count; ++i) {
+        root->call.arguments[i] = coerce(root->call.arguments[i], type);
+    }
+    root->call.intrinsic = intrinsic;
+    root->inferred_type = type;
+}
+
+static void analyze_call(ASTNode* root) {
+    for (int i = 0; i < root->call.count; ++i) {
+        analyze_ast(root->call.arguments[i]);
+        require_value(root->call.arguments[i]);
+    }
+
+    int index = find_function(&root->call.name);
+    if (index == -1) {
+        int class_index = find_class(&root->call.name);
+        if (class_index != -1) {
+            analyze_constructor(root, class_index);
+            return;
+        }
+        int native = find_native(root->call.name.start, root->call.name.length);
+        if (native != -1) {
+            if (in_pure_function()) error(root, "pure functions can only call pure functions");
+            else analyze_native(root, native);
+            return;
+        }
+        int builtin = find_array_builtin(root->call.name.start, root->call.name.length);
+        int intrinsic = find_intrinsic(root->call.name.start, root->call.name.length);
+        // min and max of one argument are the array reductions
+        if (intrinsic != -1 && (builtin == -1 || root->call.count == intrinsic_arity(intrinsic))) {
+            analyze_intrinsic(root, intrinsic);
+        }
+        else if (builtin != -1) analyze_builtin(root, builtin);
+        else error(root, "undefined function");
+        return;
+    }
+    FunctionSymbol* function = &analyzer.globals->functions[index];
+    if (in_pure_function() && !function->is_pure) {
+        error(root, "pure functions can only call pure functions");
+        return;
+    }
+    if (root->call.count != function->arity) {
+        error(root, "wrong number of arguments");
+        return;
+    }
+
+    for (int i = 0; i < root->call.count; ++i) {
+        ASTNode* argument = root->call.arguments[i];
+        ASTNode* coerced = coerce(argument, function->param_types[i]);
+        if (coerced == NULL) {
+            error(argument, "incompatible argument type");
+            return;
+        }
+        root->call.arguments[i] = coerced;
+    }
+    root->call.index = index;
+    root->inferred_type = function->return_type;
+}
+
+static void analyze_return(ASTNode* root) {
+    ASTNode* function = analyzer.function;
+    if (function == NULL) {
+        error(root, "cannot return from top-level code");
+        return;
+    }
+
+    ASTNode* value = root->return_.value;
+    ValueType return_type = function->function.return_type;
+    if (IS_GENERATOR_TYPE(return_type)) {
+        if (value != NULL) error(root, "generators cannot return a value");
+        return;
+    }
+    if (value == NULL) {
+        if (return_type != VALUE_NONE) error(root, "missing return value");
+        return;
+    }
+    if (return_type == VALUE_NONE) {
+        error(root, "function without a return type cannot return a value");
+        return;
+    }
+
+    analyze_ast(value);
+    require_value(value);
+    if (value->inferred_type == VALUE_NONE) return;
+    ASTNode* coerced = coerce(value, return_type);
+    if (coerced == NULL) {
+        error(root, "incompatible return type");
+        return;
+    }
+    root->return_.value = coerced;
+    // a call whose result is returned as-is can reuse the caller's frame
+    if (coerced->type == AST_NODE_CALL && coerced->call.index != -1) coerced->call.is_tail = true;
+}
+
+// The value goes to the for-in that resumed the generator, which continues after the yield next time.
+static void analyze_yield(ASTNode* root) {
+    if (!in_generator()) {
+        error(root, "yield outside of a generator function");
+        return;
+    }
+    ASTNode* value = root->yield_.value;
+    analyze_ast(value);
+    require_value(value);
+    if (value->inferred_type == VALUE_NONE) return;
+    ASTNode* coerced = coerce(value, YIELD_TYPE_OF(analyzer.function->function.return_type));
+    if (coerced == NULL) {
+        error(root, "incompatible type in yield");
+        return;
+    }
+    root->yield_.value = coerced;
+}
+
+// A literal's elements share one type, ints are widened when floats are among them.
+static void analyze_array(ASTNode* root) {
+    if (root->array.length != NULL) {
+        analyze_ast(root->array.length);
+        require_value(root->array.length);
+        ValueType type = root->array.length->inferred_type;
+        if (type != VALUE_INT && type != VALUE_NONE) error(root, "array length must be an int");
+        root->inferred_type = ARRAY_TYPE_OF(root->array.element_type);
+        return;
+    }
+    if (root->array.count == 0) {
+        error(root, "empty array literal has no element type, use int[0] and the like");
+        return;
+    }
+    if (root->array.count > UINT8_MAX) {
+        error(root, "too many elements in array literal");
+        return;
+    }
+
+    ValueType element_type = VALUE_NONE;
+    for (int i = 0; i < root->array.count; ++i) {
+        ASTNode* element = root->array.elements[i];
+        analyze_ast(element);
+        require_value(element);
+        ValueType type = element->inferred_type;
+        if (type == VALUE_NONE) return;
+        if (type != VALUE_BOOL && type != VALUE_INT && type != VALUE_FLOAT) {
+            error(element, "array elements must be bools, ints or floats");
+            return;
+        }
+        if (element_type == VALUE_NONE || (element_type == VALUE_INT && type == VALUE_FLOAT)) element_type = type;
+    }
+    for (int i = 0; i < root->array.count; ++i) {
+        ASTNode* coerced = coerce(root->array.elements[i], element_type);
+        if (coerced == NULL) {
+            error(root->array.elements[i], "array elements must have the same type");
+            return;
+        }
+        root->array.elements[i] = coerced;
+    }
+    root->array.element_type = element_type;
+    root->inferred_type = ARRAY_TYPE_OF(element_type);
+}
+
+// Values are coerced to the value type of the map, more entries than OP_MAP can count are an error.
+static void analyze_map(ASTNode* root) {
+    if (root->map.count > UINT8_MAX) {
+        error(root, "too many entries in map literal");
+        return;
+    }
+    ValueType value_type = root->map.value_type;
+    for (int i = 0; i < root->map.count; ++i) {
+        ASTNode* key = root->map.keys[i];
+        ASTNode* value = root->map.values[i];
+        analyze_ast(key);
+        require_value(key);
+        analyze_ast(value);
+        require_value(value);
+        if (key->inferred_type == VALUE_NONE || value->inferred_type == VALUE_NONE) return;
+        if (key->inferred_type != VALUE_STRING) {
+            error(key, "map keys must be strings");
+            return;
+        }
+        ASTNode* coerced = coerce(value, value_type);
+        if (coerced == NULL) {
+            error(value, "incompatible type in map literal");
+            return;
+        }
+        root->map.values[i] = coerced;
+    }
+    root->inferred_type = MAP_TYPE_OF(value_type);
+}
+
+// Returns the type of the element `array[index]` refers to, VALUE_NONE after an error. Maps are indexed by key.
+static ValueType analyze_element(ASTNode* root, ASTNode* array, ASTNode* index) {
+    analyze_ast(array);
+    require_value(array);
+    analyze_ast(index);
+    require_value(index);
+    if (array->inferred_type == VALUE_NONE || index->inferred_type == VALUE_NONE) return VALUE_NONE;
+
+    if (IS_MAP_TYPE(array->inferred_type)) {
+        if (index->inferred_type != VALUE_STRING) {
+            error(root, "map key must be a string");
+            return VALUE_NONE;
+        }
+        return MAP_VALUE_TYPE_OF(array->inferred_type);
+    }
+    if (!IS_ARRAY_TYPE(array->inferred_type)) {
+        error(root, "only arrays and maps can be indexed");
+        return VALUE_NONE;
+    }
+    if (index->inferred_type != VALUE_INT) {
+        error(root, "array index must be an int");
+        return VALUE_NONE;
+    }
+    return ELEMENT_TYPE_OF(array->inferred_type);
+}
+
+static void analyze_subscript_assignment(ASTNode* root) {
+    ValueType type = analyze_element(root, root->subscript_assignment.array, root->subscript_assignment.index);
+    analyze_ast(root->subscript_assignment.value);
+    require_value(root->subscript_assignment.value);
+
+    ASTNode* value = root->subscript_assignment.value;
+    if (type == VALUE_NONE || value->inferred_type == VALUE_NONE) return;
+    ASTNode* coerced = coerce(value, type);
+    if (coerced == NULL) {
+        error(root, "incompatible type in assignment");
+        return;
+    }
+    root->subscript_assignment.value = coerced;
+}
+
+// Returns the type of the object's field called name, VALUE_NONE after an error.
+static ValueType analyze_field(ASTNode* root, ASTNode* object, Token* name) {
+    analyze_ast(object);
+    require_value(object);
+    if (object->inferred_type == VALUE_NONE) return VALUE_NONE;
+    if (object->inferred_type != VALUE_OBJECT) {
+        error(root, "only objects have fields");
+        return VALUE_NONE;
+    }
+    ValueType type = find_field_type(name);
+    if (type == VALUE_NONE) error(root, "undefined field");
+    return type;
+}
+
+static void analyze_set_field(ASTNode* root) {
+    ValueType type = analyze_field(root, root->set_field.object, &root->set_field.name);
+    analyze_ast(root->set_field.value);
+    require_value(root->set_field.value);
+
+    ASTNode* value = root->set_field.value;
+    if (type == VALUE_NONE || value->inferred_type == VALUE_NONE) return;
+    ASTNode* coerced = coerce(value, type);
+    if (coerced == NULL) {
+        error(root, "incompatible type in assignment");
+        return;
+    }
+    root->set_field.value = coerced;
+}
+
+static void analyze_invoke(ASTNode* root) {
+    ASTNode* object = root->invoke.object;
+    analyze_ast(object);
+    require_value(object);
+    for (int i = 0; i < root->invoke.count; ++i) {
+        analyze_ast(root->invoke.arguments[i]);
+        require_value(root->invoke.arguments[i]);
+    }
+    if (object->inferred_type == VALUE_NONE) return;
+    if (object->inferred_type != VALUE_OBJECT) {
+        error(root, "only objects have methods");
+        return;
+    }
+    if (in_pure_function()) {
+        error(root, "pure functions can only call pure functions");
+        return;
+    }
+
+    int index = find_method(&root->invoke.name);
+    if (index == -1) {
+        error(root, "undefined method");
+        return;
+    }
+    FunctionSymbol* function = &analyzer.globals->functions[index];
+    if (root->invoke.count != function->arity - 1) {
+        error(root, "wrong number of arguments");
+        return;
+    }
+    for (int i = 0; i < root->invoke.count; ++i) {
+        ASTNode* argument = root->invoke.arguments[i];
+        ASTNode* coerced = coerce(argument, function->param_types[i + 1]);
+        if (coerced == NULL) {
+            error(argument, "incompatible argument type");
+            return;
+        }
+        root->invoke.arguments[i] = coerced;
+    }
+    root->invoke.function = index;
+    root->inferred_type = function->return_type;
+}
+
+static bool reads_local(ASTNode* node, int slot) {
+    return node->type == AST_NODE_VARIABLE && !node->variable.is_global && node->variable.slot == slot;
+}
+
+// True when the local is only printed or compared with == and != in node, and nothing in it can resume
+// a generator: no calls of user functions or methods, no yields and no for-in over a generator.
+static bool only_borrows(ASTNode* node, int slot) {
+    if (node == NULL) return true;
+    switch (node->type) {
+        case AST_NODE_VARIABLE: return !reads_local(node, slot);
+        case AST_NODE_BINARY: {
+            bool compares = node->binary.op == TOKEN_EQUAL_EQUAL || node->binary.op == TOKEN_BANG_EQUAL;
+            return ((compares && reads_local(node->binary.left, slot)) || only_borrows(node->binary.left, slot)) &&
+                   ((compares && reads_local(node->binary.right, slot)) || only_borrows(node->binary.right, slot));
+        }
+        case AST_NODE_PRINT: {
+            return reads_local(node->print.expression, slot) || only_borrows(node->print.expression, slot);
+        }
+        case AST_NODE_UNARY:      return only_borrows(node->unary.right, slot);
+        case AST_NODE_CAST:       return only_borrows(node->cast.expression, slot);
+        case AST_NODE_ASSIGNMENT: return only_borrows(node->assignment.value, slot);
+        case AST_NODE_VAR_DECL:   return only_borrows(node->var_decl.initializer, slot);
+        case AST_NODE_EXPRESSION_STATEMENT: return only_borrows(node->expression_statement.expression, slot);
+        case AST_NODE_RETURN:     return only_borrows(node->return_.value, slot);
+        case AST_NODE_BLOCK: {
+            for (int i = 0; i < node->block.count; ++i) {
+                if (!only_borrows(node->block.statements[i], slot)) return false;
+            }
+            return true;
+        }
+        case AST_NODE_IF: {
+            return only_borrows(node->if_.condition, slot) && only_borrows(node->if_.then_branch, slot) &&
+                   only_borrows(node->if_.else_branch, slot);
+        }
+        case AST_NODE_WHILE: return only_borrows(node->while_.condition, slot) && only_borrows(node->while_.body, slot);
+        case AST_NODE_FOR: {
+            return only_borrows(node->for_.initializer, slot) && only_borrows(node->for_.condition, slot) &&
+                   only_borrows(node->for_.increment, slot) && only_borrows(node->for_.body, slot);
+        }
+        case AST_NODE_CALL: {
+            if (node->call.index != -1 || node->call.builtin == BUILTIN_RESUME) return false;
+            for (int i = 0; i < node->call.count; ++i) {
+                if (!only_borrows(node->call.arguments[i], slot)) return false;
+            }
+            return true;
+        }
+        case AST_NODE_ARRAY: {
+            if (!only_borrows(node->array.length, slot)) return false;
+            for (int i = 0; i < node->array.count; ++i) {
+                if (!only_borrows(node->array.elements[i], slot)) return false;
+            }
+            return true;
+        }
+        case AST_NODE_MAP: {
+            for (int i = 0; i < node->map.count; ++i) {
+                if (!only_borrows(node->map.keys[i], slot) || !only_borrows(node->map.values[i], slot)) return false;
+            }
+            return true;
+        }
+        case AST_NODE_SUBSCRIPT: return only_borrows(node->subscript.array, slot) && only_borrows(node->subscript.index, slot);
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            return only_borrows(node->subscript_assignment.array, slot) &&
+                   only_borrows(node->subscript_assignment.index, slot) &&
+                   only_borrows(node->subscript_assignment.value, slot);
+        }
+        case AST_NODE_GET_FIELD: return only_borrows(node->get_field.object, slot);
+        case AST_NODE_SET_FIELD: return only_borrows(node->set_field.object, slot) && only_borrows(node->set_field.value, slot);
+        case AST_NODE_LITERAL:   return true;
+        default:                 return false;
+    }
+}
+
+// A for-in body starts with its variable. Over strings a generator yields, the variable may borrow
+// the value in place of an owned copy when the rest of the body only prints or compares it: a line
+// from lines() then stays a slice of the reader's buffer, which the next line overwrites.
+static void borrow_loop_variable(ASTNode* root) {
+    ASTNode* first = root->block.statements[0];
+    if (first->type != AST_NODE_VAR_DECL || first->var_decl.is_global || first->var_decl.initializer == NULL) return;
+    ASTNode* initializer = first->var_decl.initializer;
+    if (initializer->type != AST_NODE_CALL || initializer->call.builtin != BUILTIN_SLOT_KEY) return;
+    if (initializer->call.arguments[0]->inferred_type != VALUE_STRING_GENERATOR) return;
+
+    for (int i = 1; i < root->block.count; ++i) {
+        if (!only_borrows(root->block.statements[i], first->var_decl.slot)) return;
+    }
+    initializer->call.builtin = BUILTIN_SLOT_VIEW;
+}
+
+static void analyze_block(ASTNode* root) {
+    begin_scope();
+    int locals_before = analyzer.local_count;
+
+    // top-level functions and classes are visible before their declaration, so they can use each other
+    if (analyzer.scope_depth == 0) {
+        for (int i = 0; i < root->block.count; ++i) {
+            ASTNode* statement = root->block.statements[i];
+            if (statement->type == AST_NODE_FUNCTION) {
+                statement->function.index = declare_function(statement, &statement->function.name);
+            }
+            else if (statement->type == AST_NODE_CLASS) {
+                analyzer.panic_mode = false;
+                statement->class_.index = declare_class(statement);
+            }
+        }
+        analyzer.panic_mode = false;
+    }
+
+    for (int i = 0; i < root->block.count; ++i) {
+        analyzer.panic_mode = false;
+        analyze_ast(root->block.statements[i]);
+    }
+    if (root->block.count > 0 && !analyzer.had_error) borrow_loop_variable(root);
+
+    root->block.local_count = end_scope(locals_before);
+}
+
 static void analyze_ast(ASTNode* root) {
     switch (root->type) {
         case AST_NODE_BINARY: {
             ASTNode* left = root->binary.left;
             ASTNode* right = root->binary.right;
-            analyze(left);
-            analyze(right);
+            analyze_ast(left);
+            analyze_ast(right);
 
             switch (root->binary.op) {
                 case TOKEN_PLUS:
@@ -38,21 +1128,43 @@ static void analyze_ast(ASTNode* root) {
                         root->inferred_type = VALUE_FLOAT;
                     else if (left->inferred_type == VALUE_INT && right->inferred_type == VALUE_FLOAT) {
                         root->binary.left = make_node_cast(left->line, VALUE_FLOAT, left);
+                        root->binary.left->inferred_type = VALUE_FLOAT;
                         root->inferred_type = VALUE_FLOAT;
                     }
                     else if (left->inferred_type == VALUE_FLOAT && right->inferred_type == VALUE_INT) {
                         root->binary.right = make_node_cast(right->line, VALUE_FLOAT, right);
+                        root->binary.right->inferred_type = VALUE_FLOAT;
                         root->inferred_type = VALUE_FLOAT;
                     }
+                    else if (root->binary.op == TOKEN_PLUS &&
+                             left->inferred_type == VALUE_STRING && right->inferred_type == VALUE_STRING) {
+                        root->inferred_type = VALUE_STRING;
+                    }
                     else {
                         error(root, "incompatible types for binary operation");
                     }
+                    break;
+                case TOKEN_EQUAL_EQUAL:
+                case TOKEN_BANG_EQUAL:
+                case TOKEN_LESS:
+                case TOKEN_LESS_EQUAL:
+                case TOKEN_GREATER:
+                case TOKEN_GREATER_EQUAL:
+                    analyze_comparison(root);
+                    break;
+                case TOKEN_AND:
+                case TOKEN_OR:
+                    if (left->inferred_type != VALUE_BOOL || right->inferred_type != VALUE_BOOL) {
+                        error(root, "logical operators require bool operands");
+                    }
+                    root->inferred_type = VALUE_BOOL;
+                    break;
                 default: break;
             }
         } break;
         case AST_NODE_UNARY: {
             ASTNode* right = root->unary.right;
-            analyze(right);
+            analyze_ast(right);
 
             switch (root->unary.op) {
                 case TOKEN_BANG: {
@@ -77,15 +1189,161 @@ static void analyze_ast(ASTNode* root) {
             root->inferred_type = root->literal.type;
         } break;
         case AST_NODE_CAST: {
-            analyze(root->cast.expression);
+            analyze_ast(root->cast.expression);
+            if (root->cast.expression->inferred_type == VALUE_STRING) {
+                error(root, "cannot cast a string");
+            }
+            else if (IS_ARRAY_TYPE(root->cast.expression->inferred_type)) {
+                error(root, "cannot cast an array");
+            }
+            else if (IS_MAP_TYPE(root->cast.expression->inferred_type)) {
+                error(root, "cannot cast a map");
+            }
+            else if (root->cast.expression->inferred_type == VALUE_OBJECT) {
+                error(root, "cannot cast an object");
+            }
+            else if (IS_GENERATOR_TYPE(root->cast.expression->inferred_type)) {
+                error(root, "cannot cast a generator");
+            }
             root->inferred_type = root->cast.target_type;
         } break;
+        case AST_NODE_VARIABLE: {
+            bool is_const;
+            if (!resolve(&root->variable.name, &root->variable.slot, &root->variable.is_global, &root->inferred_type, &is_const)) {
+                error(root, root->variable.name.type == TOKEN_THIS ? "'this' outside of a method" : "undefined variable");
+            }
+            // constant scalars and strings are the only globals whose value cannot change between calls
+            else if (root->variable.is_global && in_pure_function() &&
+                     !(is_const && (is_scalar(root->inferred_type) || root->inferred_type == VALUE_STRING))) {
+                error(root, "pure functions cannot read mutable globals");
+            }
+        } break;
+        case AST_NODE_ASSIGNMENT: {
+            analyze_assignment(root);
+        } break;
+        case AST_NODE_VAR_DECL: {
+            analyze_var_decl(root);
+        } break;
+        case AST_NODE_PRINT: {
+            analyze_ast(root->print.expression);
+            require_value(root->print.expression);
+            if (in_pure_function()) error(root, "pure functions cannot print");
+        } break;
+        case AST_NODE_EXPRESSION_STATEMENT: {
+            analyze_ast(root->expression_statement.expression);
+            root->inferred_type = root->expression_statement.expression->inferred_type;
+        } break;
+        case AST_NODE_BLOCK: {
+            analyze_block(root);
+        } break;
+        case AST_NODE_IF: {
+            analyze_condition(root->if_.condition);
+            analyze_ast(root->if_.then_branch);
+            if (root->if_.else_branch != NULL) analyze_ast(root->if_.else_branch);
+        } break;
+        case AST_NODE_WHILE: {
+            analyze_condition(root->while_.condition);
+            analyze_ast(root->while_.body);
+        } break;
+        case AST_NODE_FOR: {
+            analyze_for(root);
+        } break;
+        case AST_NODE_FUNCTION: {
+            analyze_function(root);
+        } break;
+        case AST_NODE_CALL: {
+            analyze_call(root);
+        } break;
+        case AST_NODE_RETURN: {
+            analyze_return(root);
+        } break;
+        case AST_NODE_YIELD: {
+            analyze_yield(root);
+        } break;
+        case AST_NODE_ARRAY: {
+            analyze_array(root);
+        } break;
+        case AST_NODE_MAP: {
+            analyze_map(root);
+        } break;
+        case AST_NODE_SUBSCRIPT: {
+            root->inferred_type = analyze_element(root, root->subscript.array, root->subscript.index);
+        } break;
+        case AST_NODE_SUBSCRIPT_ASSIGNMENT: {
+            analyze_subscript_assignment(root);
+        } break;
+        case AST_NODE_CLASS: {
+            if (analyzer.scope_depth != 0) {
+                error(root, "classes can only be declared at top level");
+                break;
+            }
+            for (int i = 0; i < root->class_.method_count; ++i) {
+                analyzer.panic_mode = false;
+                analyze_function(root->class_.methods[i]);
+            }
+        } break;
+        case AST_NODE_GET_FIELD: {
+            root->inferred_type = analyze_field(root, root->get_field.object, &root->get_field.name);
+        } break;
+        case AST_NODE_SET_FIELD: {
+            analyze_set_field(root);
+        } break;
+        case AST_NODE_INVOKE: {
+            analyze_invoke(root);
+        } break;
         default: break;
     }
 }
 
-bool analyze(ASTNode* root) {
+bool analyze(ASTNode* root, SymbolTable* globals) {
     analyzer.had_error = false;
+    analyzer.panic_mode = false;
+    analyzer.globals = globals;
+    analyzer.function = NULL;
+    analyzer.local_count = 0;
+    // the program block itself is the global scope
+    analyzer.scope_depth = -1;
+
     analyze_ast(root);
     return !analyzer.had_error;
 }
+
+void truncate_symbol_table(SymbolTable* table, int count, int function_count, int class_count) {
+    for (int i = count; i < table->count; ++i) {
+        free(table->globals[i].name);
+    }
+    table->count = count;
+
+    for (int i = function_count; i < table->function_count; ++i) {
+        free(table->functions[i].name);
+        free(table->functions[i].param_types);
+    }
+    table->function_count = function_count;
+
+    for (int i = class_count; i < table->class_count; ++i) {
+        ClassSymbol* klass = &table->classes[i];
+        free(klass->name);
+        for (int j = 0; j < klass->field_count; ++j) {
+            free(klass->fields[j].name);
+        }
+        free(klass->fields);
+        for (int j = 0; j < klass->method_count; ++j) {
+            free(klass->methods[j].name);
+        }
+        free(klass->methods);
+    }
+    table->class_count = class_count;
+}
+
+void free_symbol_table(SymbolTable* table) {
+    truncate_symbol_table(table, 0, 0, 0);
+    free(table->globals);
+    free(table->functions);
+    free(table->classes);
+    table->capacity = 0;
+    table->globals = NULL;
+    table->function_capacity = 0;
+    table->functions = NULL;
+    table->class_capacity = 0;
+    table->classes = NULL;
+}
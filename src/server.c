@@ -0,0 +1,417 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cache.h"
+#include "chunk.h"
+#include "memory.h"
+#include "server.h"
+#include "vm.h"
+
+typedef struct Buffer {
+    int count;
+    int capacity;
+    char* data;
+} Buffer;
+
+// A connection has at most one request in flight, which keeps responses in request order.
+typedef struct Connection {
+    int fd;
+    bool busy;
+    bool closed;
+    // the peer shut down its side, requests that fully arrived are still answered
+    bool hung_up;
+    Buffer input;
+    Buffer output;
+    int sent;
+    struct Connection* next_closed;
+} Connection;
+
+typedef struct Job {
+    Connection* connection;
+    char* source;
+    int length;
+    InterpretResult result;
+    char* response;
+    int response_length;
+    struct Job* next;
+} Job;
+
+typedef struct JobQueue {
+    Job* head;
+    Job* tail;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} JobQueue;
+
+typedef struct Server {
+    int listener;
+    int epoll;
+    int wakeup;
+
+    JobQueue pending;
+    JobQueue completed;
+
+    // later events of the same epoll_wait batch may still point at these, freed after the batch
+    Connection* closed;
+
+    pthread_mutex_t cache_lock;
+    ChunkCache cache;
+} Server;
+
+static Server server = { 0 };
+
+static void append_to_buffer(Buffer* buffer, const void* data, int length) {
+    if (buffer->capacity < buffer->count + length) {
+        int old_capacity = buffer->capacity;
+        while (buffer->capacity < buffer->count + length) {
+            buffer->capacity = GROW_CAPACITY(buffer->capacity);
+        }
+        buffer->data = GROW_ARRAY(char, buffer->data, old_capacity, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->count, data, length);
+    buffer->count += length;
+}
+
+static void push_job(JobQueue* queue, Job* job) {
+    job->next = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail != NULL) queue->tail->next = job;
+    else queue->head = job;
+    queue->tail = job;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static Job* pop_job(JobQueue* queue, bool wait) {
+    pthread_mutex_lock(&queue->lock);
+    while (wait && queue->head == NULL) {
+        pthread_cond_wait(&queue->ready, &queue->lock);
+    }
+    Job* job = queue->head;
+    if (job != NULL) {
+        queue->head = job->next;
+        if (queue->head == NULL) queue->tail = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+static CacheEntry* acquire_chunk(const char* source, int length, InterpretResult* result) {
+    pthread_mutex_lock(&server.cache_lock);
+    CacheEntry* entry = find_cached_chunk(&server.cache, source, length);
+    pthread_mutex_unlock(&server.cache_lock);
+    if (entry != NULL) {
+        *result = RESULT_OK;
+        return entry;
+    }
+
+    // compile outside of the lock, another worker may finish the same source first
+    Chunk compiled = { 0 };
+    *result = compile_source(source, &compiled);
+    if (*result != RESULT_OK) {
+        free_chunk(&compiled);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&server.cache_lock);
+    entry = find_cached_chunk(&server.cache, source, length);
+    if (entry == NULL) {
+        entry = insert_cached_chunk(&server.cache, source, length, compiled);
+    }
+    else {
+        free_chunk(&compiled);
+    }
+    pthread_mutex_unlock(&server.cache_lock);
+    return entry;
+}
+
+static void* run_worker(void* argument) {
+    (void) argument;
+
+    char* captured = NULL;
+    size_t captured_length = 0;
+    FILE* capture = open_memstream(&captured, &captured_length);
+    set_vm_output(capture);
+
+    for (;;) {
+        Job* job = pop_job(&server.pending, true);
+
+        CacheEntry* entry = acquire_chunk(job->source, job->length, &job->result);
+        if (entry != NULL) {
+            job->result = run_chunk(&entry->chunk);
+
+            pthread_mutex_lock(&server.cache_lock);
+            release_cached_chunk(entry);
+            pthread_mutex_unlock(&server.cache_lock);
+        }
+
+        flush_vm_output();
+        fflush(capture);
+        job->response_length = (int)captured_length;
+        job->response = reallocate(NULL, 0, captured_length + 1);
+        memcpy(job->response, captured, captured_length);
+        fseeko(capture, 0, SEEK_SET);
+
+        push_job(&server.completed, job);
+        uint64_t one = 1;
+        write(server.wakeup, &one, sizeof(one));
+    }
+    return NULL;
+}
+
+static void watch_connection(Connection* connection, int operation) {
+    struct epoll_event event = { 0 };
+    event.events = (connection->hung_up ? 0 : EPOLLIN) | (connection->sent < connection->output.count ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    epoll_ctl(server.epoll, operation, connection->fd, &event);
+}
+
+static void free_connection(Connection* connection) {
+    free(connection->input.data);
+    free(connection->output.data);
+    free(connection);
+}
+
+static void retire_connection(Connection* connection) {
+    connection->next_closed = server.closed;
+    server.closed = connection;
+}
+
+static void free_closed_connections() {
+    while (server.closed != NULL) {
+        Connection* connection = server.closed;
+        server.closed = connection->next_closed;
+        free_connection(connection);
+    }
+}
+
+static void close_connection(Connection* connection) {
+    if (connection->closed) return;
+    epoll_ctl(server.epoll, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->closed = true;
+    if (!connection->busy) retire_connection(connection);
+}
+
+// Closes a hung up connection once its last response is sent, until then it only waits for output.
+static void close_if_drained(Connection* connection) {
+    if (connection->closed || !connection->hung_up) return;
+    if (!connection->busy && connection->output.count == 0) close_connection(connection);
+    else watch_connection(connection, EPOLL_CTL_MOD);
+}
+
+static void dispatch_request(Connection* connection) {
+    if (connection->busy || connection->input.count < (int)sizeof(RequestHeader)) return;
+
+    RequestHeader header;
+    memcpy(&header, connection->input.data, sizeof(header));
+    if (header.length > SERVER_MAX_REQUEST_LENGTH) {
+        fprintf(stderr, "server::dispatch_request: request of %u bytes is too large\n", header.length);
+        close_connection(connection);
+        return;
+    }
+
+    int frame_length = (int)sizeof(header) + (int)header.length;
+    if (connection->input.count < frame_length) return;
+
+    Job* job = reallocate(NULL, 0, sizeof(Job));
+    job->connection = connection;
+    job->length = (int)header.length;
+    job->source = reallocate(NULL, 0, header.length + 1);
+    memcpy(job->source, connection->input.data + sizeof(header), header.length);
+    job->source[header.length] = '\0';
+
+    connection->input.count -= frame_length;
+    memmove(connection->input.data, connection->input.data + frame_length, connection->input.count);
+    connection->busy = true;
+    push_job(&server.pending, job);
+}
+
+static bool send_output(Connection* connection) {
+    while (connection->sent < connection->output.count) {
+        ssize_t count = send(
+            connection->fd,
+            connection->output.data + connection->sent,
+            connection->output.count - connection->sent,
+            MSG_NOSIGNAL
+        );
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        connection->sent += (int)count;
+    }
+    if (connection->sent == connection->output.count) {
+        connection->sent = 0;
+        connection->output.count = 0;
+    }
+    watch_connection(connection, EPOLL_CTL_MOD);
+    return true;
+}
+
+static void receive_input(Connection* connection) {
+    char chunk[16384];
+    for (;;) {
+        ssize_t count = recv(connection->fd, chunk, sizeof(chunk), 0);
+        if (count > 0) {
+            append_to_buffer(&connection->input, chunk, (int)count);
+            continue;
+        }
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (count == 0) {
+            connection->hung_up = true;
+            break;
+        }
+
+        close_connection(connection);
+        return;
+    }
+    dispatch_request(connection);
+    close_if_drained(connection);
+}
+
+static void complete_jobs() {
+    uint64_t count;
+    read(server.wakeup, &count, sizeof(count));
+
+    Job* job;
+    while ((job = pop_job(&server.completed, false)) != NULL) {
+        Connection* connection = job->connection;
+        connection->busy = false;
+
+        if (connection->closed) {
+            retire_connection(connection);
+        }
+        else {
+            ResponseHeader header = { .result = job->result, .length = (uint32_t)job->response_length };
+            append_to_buffer(&connection->output, &header, sizeof(header));
+            append_to_buffer(&connection->output, job->response, job->response_length);
+            if (send_output(connection)) {
+                dispatch_request(connection);
+                close_if_drained(connection);
+            }
+            else {
+                close_connection(connection);
+            }
+        }
+
+        free(job->source);
+        free(job->response);
+        free(job);
+    }
+}
+
+static void accept_connections() {
+    for (;;) {
+        int fd = accept4(server.listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        Connection* connection = reallocate(NULL, 0, sizeof(Connection));
+        *connection = (Connection){ .fd = fd };
+        watch_connection(connection, EPOLL_CTL_ADD);
+    }
+}
+
+static bool open_listener(const char* socket_path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "server::serve: socket path is too long: %s\n", socket_path);
+        return false;
+    }
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+
+    server.listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listener < 0
+        || bind(server.listener, (struct sockaddr*)&address, sizeof(address)) < 0
+        || listen(server.listener, SERVER_LISTEN_BACKLOG) < 0) {
+        fprintf(stderr, "server::serve: cannot listen on %s: %s\n", socket_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int serve(const char* socket_path, int worker_count) {
+    signal(SIGPIPE, SIG_IGN);
+    if (!open_listener(socket_path)) return 1;
+
+    pthread_mutex_init(&server.pending.lock, NULL);
+    pthread_cond_init(&server.pending.ready, NULL);
+    pthread_mutex_init(&server.completed.lock, NULL);
+    pthread_cond_init(&server.completed.ready, NULL);
+    pthread_mutex_init(&server.cache_lock, NULL);
+    init_chunk_cache(&server.cache, CHUNK_CACHE_CAPACITY);
+
+    server.epoll = epoll_create1(EPOLL_CLOEXEC);
+    server.wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct epoll_event event = { .events = EPOLLIN };
+    event.data.ptr = &server.listener;
+    epoll_ctl(server.epoll, EPOLL_CTL_ADD, server.listener, &event);
+    event.data.ptr = &server.wakeup;
+    epoll_ctl(server.epoll, EPOLL_CTL_ADD, server.wakeup, &event);
+
+    for (int i = 0; i < worker_count; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, run_worker, NULL) != 0) {
+            fprintf(stderr, "server::serve: cannot start worker thread\n");
+            return 1;
+        }
+        pthread_detach(thread);
+    }
+    fprintf(stderr, "server: listening on %s with %d workers\n", socket_path, worker_count);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    for (;;) {
+        int count = epoll_wait(server.epoll, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            fprintf(stderr, "server::serve: epoll_wait failed: %s\n", strerror(errno));
+            return 1;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            void* source = events[i].data.ptr;
+            if (source == &server.listener) {
+                accept_connections();
+                continue;
+            }
+            if (source == &server.wakeup) {
+                complete_jobs();
+                continue;
+            }
+
+            Connection* connection = source;
+            if (connection->closed) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                close_connection(connection);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT && !send_output(connection)) {
+                close_connection(connection);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                receive_input(connection);
+            }
+            else {
+                close_if_drained(connection);
+            }
+        }
+        free_closed_connections();
+    }
+}
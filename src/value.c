@@ -1,14 +1,124 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include "array.h"
+#include "class.h"
+#include "io.h"
+#include "map.h"
 #include "memory.h"
+#include "rope.h"
 #include "value.h"
 
+// Boxes an element so arrays print their elements the same way as scalars.
+static Value element_at(Array* array, int index) {
+    switch (array->element_type) {
+        case VALUE_BOOL: return BOOL_VALUE(ARRAY_BOOLS(array)[index]);
+        case VALUE_INT:  return INT_VALUE(ARRAY_INTS(array)[index]);
+        default:         return FLOAT_VALUE(ARRAY_FLOATS(array)[index]);
+    }
+}
+
 void print_value(Value value) {
     switch (value.type) {
         case VALUE_NONE:  printf("NONE"); break;
         case VALUE_BOOL:  printf("%s", AS_BOOL(value) ? "true" : "false"); break;
         case VALUE_INT:   printf("%d", AS_INT(value)); break;
         case VALUE_FLOAT: printf("%f", AS_FLOAT(value)); break;
+        case VALUE_STRING:
+        case VALUE_ROPE: {
+            CString* string = flatten_string(value);
+            printf("%.*s", string->length, string->data);
+        } break;
+        case VALUE_SLICE: printf("%.*s", AS_SLICE(value)->length, AS_SLICE(value)->data); break;
+        case VALUE_BOOL_ARRAY:
+        case VALUE_INT_ARRAY:
+        case VALUE_FLOAT_ARRAY: {
+            Array* array = AS_ARRAY(value);
+            printf("[");
+            for (int i = 0; i < array->length; ++i) {
+                if (i > 0) printf(", ");
+                print_value(element_at(array, i));
+            }
+            printf("]");
+        } break;
+        case VALUE_OBJECT: {
+            CString* name = AS_INSTANCE(value)->klass->name;
+            printf("<%.*s>", name->length, name->data);
+        } break;
+        case VALUE_BOOL_MAP:
+        case VALUE_INT_MAP:
+        case VALUE_FLOAT_MAP:
+        case VALUE_STRING_MAP: {
+            Map* map = AS_MAP(value);
+            printf("{");
+            int first = next_map_slot(map, 0);
+            for (int slot = first; slot != -1; slot = next_map_slot(map, slot + 1)) {
+                CString* key = AS_STRING(map_slot_key(map, slot));
+                if (slot != first) printf(", ");
+                printf("%.*s: ", key->length, key->data);
+                print_value(map_slot_value(map, slot));
+            }
+            printf("}");
+        } break;
+        case VALUE_BOOL_GENERATOR:
+        case VALUE_INT_GENERATOR:
+        case VALUE_FLOAT_GENERATOR:
+        case VALUE_STRING_GENERATOR: printf("<generator>"); break;
+        default: break;
+    }
+}
+
+void write_value(OutputBuffer* output, Value value) {
+    switch (value.type) {
+        case VALUE_NONE:  write_bytes(output, "NONE", 4); break;
+        case VALUE_BOOL: {
+            if (AS_BOOL(value)) write_bytes(output, "true", 4);
+            else write_bytes(output, "false", 5);
+        } break;
+        case VALUE_INT:   write_int(output, AS_INT(value)); break;
+        case VALUE_FLOAT: write_float(output, AS_FLOAT(value)); break;
+        case VALUE_STRING:
+        case VALUE_ROPE: {
+            CString* string = flatten_string(value);
+            write_bytes(output, string->data, string->length);
+        } break;
+        case VALUE_SLICE: write_bytes(output, AS_SLICE(value)->data, AS_SLICE(value)->length); break;
+        case VALUE_BOOL_ARRAY:
+        case VALUE_INT_ARRAY:
+        case VALUE_FLOAT_ARRAY: {
+            Array* array = AS_ARRAY(value);
+            write_bytes(output, "[", 1);
+            for (int i = 0; i < array->length; ++i) {
+                if (i > 0) write_bytes(output, ", ", 2);
+                write_value(output, element_at(array, i));
+            }
+            write_bytes(output, "]", 1);
+        } break;
+        case VALUE_OBJECT: {
+            CString* name = AS_INSTANCE(value)->klass->name;
+            write_bytes(output, "<", 1);
+            write_bytes(output, name->data, name->length);
+            write_bytes(output, ">", 1);
+        } break;
+        case VALUE_BOOL_MAP:
+        case VALUE_INT_MAP:
+        case VALUE_FLOAT_MAP:
+        case VALUE_STRING_MAP: {
+            Map* map = AS_MAP(value);
+            write_bytes(output, "{", 1);
+            int first = next_map_slot(map, 0);
+            for (int slot = first; slot != -1; slot = next_map_slot(map, slot + 1)) {
+                CString* key = AS_STRING(map_slot_key(map, slot));
+                if (slot != first) write_bytes(output, ", ", 2);
+                write_bytes(output, key->data, key->length);
+                write_bytes(output, ": ", 2);
+                write_value(output, map_slot_value(map, slot));
+            }
+            write_bytes(output, "}", 1);
+        } break;
+        case VALUE_BOOL_GENERATOR:
+        case VALUE_INT_GENERATOR:
+        case VALUE_FLOAT_GENERATOR:
+        case VALUE_STRING_GENERATOR: write_bytes(output, "<generator>", 11); break;
         default: break;
     }
 }
@@ -1,33 +1,102 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
 #include "chunk.h"
+#include "class.h"
 #include "compiler.h"
+#include "cstring.h"
+#include "gc.h"
+#include "generator.h"
+#include "intrinsic.h"
+#include "io.h"
 #ifdef DEBUG
 #include "debug.h"
 #endif
 #include "lexer.h"
+#include "map.h"
+#include "memo.h"
+#include "memory.h"
+#include "native.h"
 #include "parser.h"
+#include "profiler.h"
+#include "rope.h"
 #include "semantic.h"
 #include "value.h"
 #include "vm.h"
 
 #define READ_BYTE() (*vm.ip++)
+#define READ_SHORT() (vm.ip += 2, (int16_t)(vm.ip[-2] << 8 | vm.ip[-1]))
+#define READ_UINT16() (vm.ip += 2, (uint16_t)(vm.ip[-2] << 8 | vm.ip[-1]))
 #define BINARY_OP(type, AS_type, out_VALUE, op) \
     do { \
         type b = AS_type(pop()); \
         type a = AS_type(pop()); \
         push(out_VALUE(a op b)); \
     } while (false)
+#define COMPARE_JUMP(type, AS_type, condition) \
+    do { \
+        int16_t offset = READ_SHORT(); \
+        type b = AS_type(pop()); \
+        type a = AS_type(pop()); \
+        if (condition) vm.ip += offset; \
+    } while (false)
+// Back edges and calls bound how long the interpreter runs without passing one, the profiler's buffer is drained there.
+#define SAMPLING_SAFEPOINT() \
+    do { \
+        if (samples_pending) drain_samples(); \
+    } while (false)
+#define COMPARE_LOOP(type, AS_type, op) \
+    do { \
+        uint8_t offset = READ_BYTE(); \
+        type b = AS_type(pop()); \
+        type a = AS_type(pop()); \
+        if (a op b) { \
+            vm.ip -= offset; \
+            SAMPLING_SAFEPOINT(); \
+        } \
+    } while (false)
 
 typedef struct VM {
     Chunk* chunk;
     const uint8_t* ip;
 
+    CallFrame frames[VM_FRAMES_CAPACITY];
+    int frame_count;
+
     Value stack[VM_STACK_CAPACITY];
     Value* stack_top;
+    // grows to the global count of the chunks that run, the first global_count may hold values
+    Value* globals;
+    int global_count;
+    int global_capacity;
+
+    // one per pure function that ran, indexed like the chunk's functions
+    MemoCache* memos[MAX_FUNCTIONS];
+
+    OutputBuffer output;
+    // printed values go here instead of the output while a chunk runs with bindings
+    Value* results;
+    int result_count;
+    int result_capacity;
 } VM;
 
-static VM vm = { 0 };
+// A pure function's memo cache counters, summed over every run of a function with its name.
+typedef struct MemoStats {
+    char* name;
+    int length;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} MemoStats;
+
+static _Thread_local VM vm = { 0 };
+static bool inline_caches_enabled = true;
+static bool memo_stats_enabled = false;
+static _Thread_local MemoStats* memo_stats = NULL;
+static _Thread_local int memo_stats_count = 0;
+static _Thread_local int memo_stats_capacity = 0;
 
 static void push(Value value) {
     *vm.stack_top++ = value;
@@ -37,7 +106,83 @@ static Value pop() {
     return *--vm.stack_top;
 }
 
+static InterpretResult runtime_error(const char* message) {
+    flush_output(&vm.output);
+    int offset = (int)(vm.ip - vm.chunk->code - 1);
+    fprintf(stderr, "[line %d] runtime error: %s\n", vm.chunk->lines[offset], message);
+    return RESULT_RUNTIME_ERROR;
+}
+
+static void count_event(_Atomic uint64_t* counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Returns the field offset or function index cached for id, -1 when the site hasn't seen it.
+static int probe_cache(InlineCache* cache, uint32_t id) {
+    if (!inline_caches_enabled) return -1;
+    int count = atomic_load_explicit(&cache->count, memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        uint64_t entry = atomic_load_explicit(&cache->entries[i], memory_order_relaxed);
+        if ((uint32_t)(entry >> 32) == id) {
+            count_event(&cache->hits);
+            return (int)(uint32_t)entry;
+        }
+    }
+    return -1;
+}
+
+// The entry is published before the count, so a worker that sees the count sees the entry.
+static void fill_cache(InlineCache* cache, uint32_t id, int target) {
+    count_event(&cache->misses);
+    if (!inline_caches_enabled || target == -1) return;
+    int count = atomic_load_explicit(&cache->count, memory_order_relaxed);
+    if (count == INLINE_CACHE_ENTRIES) {
+        atomic_store_explicit(&cache->megamorphic, true, memory_order_relaxed);
+        return;
+    }
+    atomic_store_explicit(&cache->entries[count], (uint64_t)id << 32 | (uint32_t)target, memory_order_relaxed);
+    atomic_store_explicit(&cache->count, count + 1, memory_order_release);
+}
+
+static int field_offset(InlineCache* cache, Instance* instance) {
+    int offset = probe_cache(cache, instance->shape->id);
+    if (offset != -1) return offset;
+    offset = find_field(instance->shape, cache->name);
+    fill_cache(cache, instance->shape->id, offset);
+    return offset;
+}
+
+static int method_function(InlineCache* cache, Class* klass) {
+    int function = probe_cache(cache, klass->id);
+    if (function != -1) return function;
+    function = find_method(klass, cache->name);
+    fill_cache(cache, klass->id, function);
+    return function;
+}
+
+static InterpretResult missing_key(CString* key) {
+    char message[256];
+    snprintf(message, sizeof(message), "key '%.*s' not found", (int)key->length, key->data);
+    return runtime_error(message);
+}
+
+// Fields and methods are checked by name only, so any object may lack the one a site asks for.
+static InterpretResult missing_member(Class* klass, const char* kind, CString* name) {
+    char message[256];
+    snprintf(message, sizeof(message), "%.*s has no %s '%.*s'",
+             (int)klass->name->length, klass->name->data, kind, (int)name->length, name->data);
+    return runtime_error(message);
+}
+
+// Pops the index and the array of an element access, NULL when the index is out of range.
+static Array* pop_element(int* index) {
+    *index = AS_INT(pop());
+    Array* array = AS_ARRAY(pop());
+    return (uint32_t)*index < (uint32_t)array->length ? array : NULL;
+}
+
 static InterpretResult run() {
+    Value* slots = vm.frames[vm.frame_count - 1].slots;
     for (;;) {
         uint8_t instruction;
         switch (instruction = READ_BYTE()) {
@@ -75,6 +220,39 @@ static InterpretResult run() {
                 uint8_t index = READ_BYTE();
                 push(vm.chunk->constant_pool.values[index]);
             } break;
+            case OP_LOADC_W: {
+                uint16_t index = READ_UINT16();
+                push(vm.chunk->constant_pool.values[index]);
+            } break;
+            case OP_POP: {
+                pop();
+            } break;
+            case OP_POPN: {
+                vm.stack_top -= READ_BYTE();
+            } break;
+            case OP_RESERVE: {
+                // the collector scans the whole stack, so reserved slots must not keep stale references
+                uint8_t count = READ_BYTE();
+                for (int i = 0; i < count; ++i) push(NONE_VALUE());
+            } break;
+            case OP_LOAD: {
+                push(slots[READ_BYTE()]);
+            } break;
+            case OP_STORE: {
+                slots[READ_BYTE()] = pop();
+            } break;
+            case OP_GLOAD: {
+                push(vm.globals[READ_BYTE()]);
+            } break;
+            case OP_GSTORE: {
+                vm.globals[READ_BYTE()] = pop();
+            } break;
+            case OP_GLOAD_W: {
+                push(vm.globals[READ_UINT16()]);
+            } break;
+            case OP_GSTORE_W: {
+                vm.globals[READ_UINT16()] = pop();
+            } break;
             case OP_IADD: {
                 BINARY_OP(int, AS_INT, INT_VALUE, +);
             } break;
@@ -94,7 +272,11 @@ static InterpretResult run() {
                 BINARY_OP(float, AS_FLOAT, FLOAT_VALUE, *);
             } break;
             case OP_IDIV: {
-                BINARY_OP(int, AS_INT, INT_VALUE, /);
+                int32_t b = AS_INT(pop());
+                int32_t a = AS_INT(pop());
+                if (b == 0) return runtime_error("division by zero");
+                if (a == INT32_MIN && b == -1) return runtime_error("integer overflow in division");
+                push(INT_VALUE(a / b));
             } break;
             case OP_FDIV: {
                 BINARY_OP(float, AS_FLOAT, FLOAT_VALUE, /);
@@ -105,6 +287,75 @@ static InterpretResult run() {
             case OP_FNEG: {
                 push(FLOAT_VALUE(-AS_FLOAT(pop())));
             } break;
+            case OP_ISHL: {
+                uint8_t shift = READ_BYTE();
+                push(INT_VALUE((int32_t)((uint32_t)AS_INT(pop()) << shift)));
+            } break;
+            case OP_IDIV_MAGIC: {
+                // Only emitted for constant divisors other than 0, 1, -1 and INT32_MIN, so it can't trap
+                uint8_t mode = READ_BYTE();
+                int32_t magic = AS_INT(pop());
+                int32_t dividend = AS_INT(pop());
+                uint32_t high = (uint32_t)(((int64_t)dividend * magic) >> 32);
+                if (mode & DIV_MAGIC_ADD) high += (uint32_t)dividend;
+                else if (mode & DIV_MAGIC_SUB) high -= (uint32_t)dividend;
+                int32_t quotient = (int32_t)high >> (mode & DIV_MAGIC_SHIFT);
+                push(INT_VALUE(quotient + (int32_t)((uint32_t)quotient >> 31)));
+            } break;
+            case OP_FSQRT: {
+                push(FLOAT_VALUE(sqrtf(AS_FLOAT(pop()))));
+            } break;
+            case OP_IABS: {
+                int32_t a = AS_INT(pop());
+                push(INT_VALUE(INT_ABS(a)));
+            } break;
+            case OP_FABS: {
+                push(FLOAT_VALUE(fabsf(AS_FLOAT(pop()))));
+            } break;
+            case OP_IMIN: {
+                int32_t b = AS_INT(pop());
+                int32_t a = AS_INT(pop());
+                push(INT_VALUE(MIN_OF(a, b)));
+            } break;
+            case OP_FMIN: {
+                float b = AS_FLOAT(pop());
+                float a = AS_FLOAT(pop());
+                push(FLOAT_VALUE(MIN_OF(a, b)));
+            } break;
+            case OP_IMAX: {
+                int32_t b = AS_INT(pop());
+                int32_t a = AS_INT(pop());
+                push(INT_VALUE(MAX_OF(a, b)));
+            } break;
+            case OP_FMAX: {
+                float b = AS_FLOAT(pop());
+                float a = AS_FLOAT(pop());
+                push(FLOAT_VALUE(MAX_OF(a, b)));
+            } break;
+            case OP_FFLOOR: {
+                push(FLOAT_VALUE(floorf(AS_FLOAT(pop()))));
+            } break;
+            case OP_FFMA: {
+                float c = AS_FLOAT(pop());
+                float b = AS_FLOAT(pop());
+                float a = AS_FLOAT(pop());
+                push(FLOAT_VALUE(fmaf(a, b, c)));
+            } break;
+            case OP_FSIN: {
+                push(FLOAT_VALUE(sinf(AS_FLOAT(pop()))));
+            } break;
+            case OP_FCOS: {
+                push(FLOAT_VALUE(cosf(AS_FLOAT(pop()))));
+            } break;
+            case OP_FTAN: {
+                push(FLOAT_VALUE(tanf(AS_FLOAT(pop()))));
+            } break;
+            case OP_SCONCAT: {
+                Value b = pop();
+                Value a = pop();
+                push(concat_strings(a, b));
+                gc_safepoint();
+            } break;
             case OP_TRUE: {
                 push(BOOL_VALUE(true));
             } break;
@@ -114,14 +365,411 @@ static InterpretResult run() {
             case OP_NOT: {
                 push(BOOL_VALUE(!AS_BOOL(pop())));
             } break;
+            case OP_IEQ: BINARY_OP(int, AS_INT, BOOL_VALUE, ==); break;
+            case OP_INE: BINARY_OP(int, AS_INT, BOOL_VALUE, !=); break;
+            case OP_ILT: BINARY_OP(int, AS_INT, BOOL_VALUE, <); break;
+            case OP_ILE: BINARY_OP(int, AS_INT, BOOL_VALUE, <=); break;
+            case OP_IGT: BINARY_OP(int, AS_INT, BOOL_VALUE, >); break;
+            case OP_IGE: BINARY_OP(int, AS_INT, BOOL_VALUE, >=); break;
+            case OP_FEQ: BINARY_OP(float, AS_FLOAT, BOOL_VALUE, ==); break;
+            case OP_FNE: BINARY_OP(float, AS_FLOAT, BOOL_VALUE, !=); break;
+            case OP_FLT: BINARY_OP(float, AS_FLOAT, BOOL_VALUE, <); break;
+            case OP_FLE: BINARY_OP(float, AS_FLOAT, BOOL_VALUE, <=); break;
+            case OP_FGT: BINARY_OP(float, AS_FLOAT, BOOL_VALUE, >); break;
+            case OP_FGE: BINARY_OP(float, AS_FLOAT, BOOL_VALUE, >=); break;
+            case OP_BEQ: BINARY_OP(bool, AS_BOOL, BOOL_VALUE, ==); break;
+            case OP_BNE: BINARY_OP(bool, AS_BOOL, BOOL_VALUE, !=); break;
+            case OP_SEQ: {
+                Value b = pop();
+                Value a = pop();
+                push(BOOL_VALUE(strings_equal(a, b)));
+                gc_safepoint();
+            } break;
+            case OP_SNE: {
+                Value b = pop();
+                Value a = pop();
+                push(BOOL_VALUE(!strings_equal(a, b)));
+                gc_safepoint();
+            } break;
+            case OP_NEWARRAY: {
+                ValueType element_type = READ_BYTE();
+                int length = AS_INT(pop());
+                if (length < 0) return runtime_error("negative array length");
+                push(ARRAY_VALUE(new_array(element_type, length)));
+                gc_safepoint();
+            } break;
+            case OP_ARRAY: {
+                ValueType element_type = READ_BYTE();
+                uint8_t count = READ_BYTE();
+                Array* array = new_array(element_type, count);
+                Value* elements = vm.stack_top - count;
+                for (int i = 0; i < count; ++i) {
+                    switch (element_type) {
+                        case VALUE_BOOL: ARRAY_BOOLS(array)[i] = AS_BOOL(elements[i]); break;
+                        case VALUE_INT:  ARRAY_INTS(array)[i] = AS_INT(elements[i]); break;
+                        default:         ARRAY_FLOATS(array)[i] = AS_FLOAT(elements[i]); break;
+                    }
+                }
+                vm.stack_top = elements;
+                push(ARRAY_VALUE(array));
+                gc_safepoint();
+            } break;
+            case OP_BALOAD: {
+                int index;
+                Array* array = pop_element(&index);
+                if (array == NULL) return runtime_error("array index out of range");
+                push(BOOL_VALUE(ARRAY_BOOLS(array)[index]));
+            } break;
+            case OP_IALOAD: {
+                int index;
+                Array* array = pop_element(&index);
+                if (array == NULL) return runtime_error("array index out of range");
+                push(INT_VALUE(ARRAY_INTS(array)[index]));
+            } break;
+            case OP_FALOAD: {
+                int index;
+                Array* array = pop_element(&index);
+                if (array == NULL) return runtime_error("array index out of range");
+                push(FLOAT_VALUE(ARRAY_FLOATS(array)[index]));
+            } break;
+            case OP_BASTORE: {
+                Value value = pop();
+                int index;
+                Array* array = pop_element(&index);
+                if (array == NULL) return runtime_error("array index out of range");
+                ARRAY_BOOLS(array)[index] = AS_BOOL(value);
+            } break;
+            case OP_IASTORE: {
+                Value value = pop();
+                int index;
+                Array* array = pop_element(&index);
+                if (array == NULL) return runtime_error("array index out of range");
+                ARRAY_INTS(array)[index] = AS_INT(value);
+            } break;
+            case OP_FASTORE: {
+                Value value = pop();
+                int index;
+                Array* array = pop_element(&index);
+                if (array == NULL) return runtime_error("array index out of range");
+                ARRAY_FLOATS(array)[index] = AS_FLOAT(value);
+            } break;
+            case OP_BALOAD_UNCHECKED: {
+                Array* array = AS_ARRAY(slots[READ_BYTE()]);
+                push(BOOL_VALUE(ARRAY_BOOLS(array)[AS_INT(slots[READ_BYTE()])]));
+            } break;
+            case OP_IALOAD_UNCHECKED: {
+                Array* array = AS_ARRAY(slots[READ_BYTE()]);
+                push(INT_VALUE(ARRAY_INTS(array)[AS_INT(slots[READ_BYTE()])]));
+            } break;
+            case OP_FALOAD_UNCHECKED: {
+                Array* array = AS_ARRAY(slots[READ_BYTE()]);
+                push(FLOAT_VALUE(ARRAY_FLOATS(array)[AS_INT(slots[READ_BYTE()])]));
+            } break;
+            case OP_BASTORE_UNCHECKED: {
+                Array* array = AS_ARRAY(slots[READ_BYTE()]);
+                ARRAY_BOOLS(array)[AS_INT(slots[READ_BYTE()])] = AS_BOOL(pop());
+            } break;
+            case OP_IASTORE_UNCHECKED: {
+                Array* array = AS_ARRAY(slots[READ_BYTE()]);
+                ARRAY_INTS(array)[AS_INT(slots[READ_BYTE()])] = AS_INT(pop());
+            } break;
+            case OP_FASTORE_UNCHECKED: {
+                Array* array = AS_ARRAY(slots[READ_BYTE()]);
+                ARRAY_FLOATS(array)[AS_INT(slots[READ_BYTE()])] = AS_FLOAT(pop());
+            } break;
+            case OP_GUARD_LENGTH: {
+                int bound = AS_INT(pop());
+                int start = AS_INT(pop());
+                Array* array = AS_ARRAY(pop());
+                if (start < bound && array->length < bound) return runtime_error("array index out of range");
+            } break;
+            case OP_BUILTIN: {
+                ArrayBuiltin builtin = READ_BYTE();
+                Value* arguments = vm.stack_top - array_builtin_arity(builtin);
+                Value result;
+                const char* error = call_array_builtin(builtin, arguments, &result);
+                if (error != NULL) return runtime_error(error);
+                vm.stack_top = arguments;
+                push(result);
+                gc_safepoint();
+            } break;
+            case OP_NEW: {
+                Instance* instance = new_instance(vm.chunk->classes[READ_BYTE()]);
+                Value* fields = vm.stack_top - instance->field_count;
+                for (int i = 0; i < instance->field_count; ++i) {
+                    instance->fields[i] = fields[i];
+                    write_barrier(&instance->obj, fields[i]);
+                }
+                vm.stack_top = fields;
+                push(OBJECT_VALUE(instance));
+                gc_safepoint();
+            } break;
+            case OP_MAP: {
+                ValueType value_type = READ_BYTE();
+                uint8_t count = READ_BYTE();
+                Map* map = new_map(value_type);
+                Value* entries = vm.stack_top - 2 * count;
+                for (int i = 0; i < count; ++i) {
+                    map_set(map, flatten_string(entries[2 * i]), entries[2 * i + 1]);
+                }
+                vm.stack_top = entries;
+                push(MAP_VALUE(map));
+                gc_safepoint();
+            } break;
+            case OP_MAP_GET: {
+                CString* key = flatten_string(pop());
+                Map* map = AS_MAP(vm.stack_top[-1]);
+                if (!map_get(map, key, &vm.stack_top[-1])) return missing_key(key);
+                gc_safepoint();
+            } break;
+            case OP_MAP_SET: {
+                Value value = pop();
+                CString* key = flatten_string(pop());
+                map_set(AS_MAP(pop()), key, value);
+                gc_safepoint();
+            } break;
+            case OP_GET_FIELD: {
+                InlineCache* cache = &vm.chunk->caches[READ_UINT16()];
+                Instance* instance = AS_INSTANCE(vm.stack_top[-1]);
+                int offset = field_offset(cache, instance);
+                if (offset == -1) return missing_member(instance->klass, "field", cache->name);
+                vm.stack_top[-1] = instance->fields[offset];
+            } break;
+            case OP_SET_FIELD: {
+                InlineCache* cache = &vm.chunk->caches[READ_UINT16()];
+                Value value = pop();
+                Instance* instance = AS_INSTANCE(pop());
+                int offset = field_offset(cache, instance);
+                if (offset == -1) return missing_member(instance->klass, "field", cache->name);
+                instance->fields[offset] = value;
+                write_barrier(&instance->obj, value);
+            } break;
+            case OP_INVOKE: {
+                InlineCache* cache = &vm.chunk->caches[READ_UINT16()];
+                int argument_count = READ_BYTE();
+                Instance* receiver = AS_INSTANCE(vm.stack_top[-argument_count - 1]);
+                int index = method_function(cache, receiver->klass);
+                if (index == -1) return missing_member(receiver->klass, "method", cache->name);
+                if (vm.frame_count == VM_FRAMES_CAPACITY ||
+                    vm.stack_top + VM_FRAME_SLOTS > vm.stack + VM_STACK_CAPACITY) {
+                    return runtime_error("stack overflow");
+                }
+                // the receiver becomes the method's first slot, its `this`
+                Function* function = &vm.chunk->functions[index];
+                CallFrame* frame = &vm.frames[vm.frame_count++];
+                frame->return_ip = vm.ip;
+                frame->slots = vm.stack_top - function->arity;
+                frame->memo = NULL;
+                frame->caller_memo = NULL;
+                slots = frame->slots;
+                vm.ip = vm.chunk->code + function->entry;
+                SAMPLING_SAFEPOINT();
+            } break;
+            case OP_JUMP: {
+                int16_t offset = READ_SHORT();
+                vm.ip += offset;
+            } break;
+            case OP_JUMP_IF_FALSE: {
+                int16_t offset = READ_SHORT();
+                if (!AS_BOOL(pop())) vm.ip += offset;
+            } break;
+            case OP_JUMP_IF_TRUE: {
+                int16_t offset = READ_SHORT();
+                if (AS_BOOL(pop())) vm.ip += offset;
+            } break;
+            case OP_IJEQ:  COMPARE_JUMP(int, AS_INT, a == b); break;
+            case OP_IJNE:  COMPARE_JUMP(int, AS_INT, a != b); break;
+            case OP_IJLT:  COMPARE_JUMP(int, AS_INT, a < b); break;
+            case OP_IJLE:  COMPARE_JUMP(int, AS_INT, a <= b); break;
+            case OP_IJGT:  COMPARE_JUMP(int, AS_INT, a > b); break;
+            case OP_IJGE:  COMPARE_JUMP(int, AS_INT, a >= b); break;
+            case OP_FJEQ:  COMPARE_JUMP(float, AS_FLOAT, a == b); break;
+            case OP_FJNE:  COMPARE_JUMP(float, AS_FLOAT, a != b); break;
+            case OP_FJLT:  COMPARE_JUMP(float, AS_FLOAT, a < b); break;
+            case OP_FJLE:  COMPARE_JUMP(float, AS_FLOAT, a <= b); break;
+            case OP_FJGT:  COMPARE_JUMP(float, AS_FLOAT, a > b); break;
+            case OP_FJGE:  COMPARE_JUMP(float, AS_FLOAT, a >= b); break;
+            case OP_FJNLT: COMPARE_JUMP(float, AS_FLOAT, !(a < b)); break;
+            case OP_FJNLE: COMPARE_JUMP(float, AS_FLOAT, !(a <= b)); break;
+            case OP_FJNGT: COMPARE_JUMP(float, AS_FLOAT, !(a > b)); break;
+            case OP_FJNGE: COMPARE_JUMP(float, AS_FLOAT, !(a >= b)); break;
+            case OP_LOOP: {
+                uint8_t offset = READ_BYTE();
+                vm.ip -= offset;
+                SAMPLING_SAFEPOINT();
+            } break;
+            case OP_LOOP_TRUE: {
+                uint8_t offset = READ_BYTE();
+                if (AS_BOOL(pop())) {
+                    vm.ip -= offset;
+                    SAMPLING_SAFEPOINT();
+                }
+            } break;
+            case OP_LOOP_IEQ: COMPARE_LOOP(int, AS_INT, ==); break;
+            case OP_LOOP_INE: COMPARE_LOOP(int, AS_INT, !=); break;
+            case OP_LOOP_ILT: COMPARE_LOOP(int, AS_INT, <); break;
+            case OP_LOOP_ILE: COMPARE_LOOP(int, AS_INT, <=); break;
+            case OP_LOOP_IGT: COMPARE_LOOP(int, AS_INT, >); break;
+            case OP_LOOP_IGE: COMPARE_LOOP(int, AS_INT, >=); break;
+            case OP_LOOP_FEQ: COMPARE_LOOP(float, AS_FLOAT, ==); break;
+            case OP_LOOP_FNE: COMPARE_LOOP(float, AS_FLOAT, !=); break;
+            case OP_LOOP_FLT: COMPARE_LOOP(float, AS_FLOAT, <); break;
+            case OP_LOOP_FLE: COMPARE_LOOP(float, AS_FLOAT, <=); break;
+            case OP_LOOP_FGT: COMPARE_LOOP(float, AS_FLOAT, >); break;
+            case OP_LOOP_FGE: COMPARE_LOOP(float, AS_FLOAT, >=); break;
             case OP_PRINT: {
-                print_value(pop());
-                putchar('\n');
+                if (vm.results != NULL) {
+                    if (vm.result_count == vm.result_capacity) return runtime_error("more results than output columns");
+                    vm.results[vm.result_count++] = pop();
+                    continue;
+                }
+                write_value(&vm.output, pop());
+                write_char(&vm.output, '\n');
+                gc_safepoint();
+            } break;
+            case OP_CALL: {
+                Function* function = &vm.chunk->functions[READ_BYTE()];
+                if (vm.frame_count == VM_FRAMES_CAPACITY ||
+                    vm.stack_top + VM_FRAME_SLOTS > vm.stack + VM_STACK_CAPACITY) {
+                    return runtime_error("stack overflow");
+                }
+                // arguments stay where the caller pushed them and become the callee's first slots
+                CallFrame* frame = &vm.frames[vm.frame_count++];
+                frame->return_ip = vm.ip;
+                frame->slots = vm.stack_top - function->arity;
+                frame->memo = NULL;
+                frame->caller_memo = NULL;
+                slots = frame->slots;
+                vm.ip = vm.chunk->code + function->entry;
+                SAMPLING_SAFEPOINT();
+            } break;
+            case OP_CALL_NATIVE: {
+                const NativeFunction* native = native_function(READ_BYTE());
+                Value* arguments = vm.stack_top - native->arity;
+                Value result = NONE_VALUE();
+                const char* error = native->function(arguments, &result);
+                if (error != NULL) return runtime_error(error);
+                vm.stack_top = arguments;
+                push(result);
+                gc_safepoint();
+            } break;
+            case OP_TAIL_CALL: {
+                // the current frame is reused: arguments replace its slots and the return address is kept
+                Function* function = &vm.chunk->functions[READ_BYTE()];
+                memmove(slots, vm.stack_top - function->arity, sizeof(Value) * function->arity);
+                vm.stack_top = slots + function->arity;
+                vm.ip = vm.chunk->code + function->entry;
+                SAMPLING_SAFEPOINT();
+            } break;
+            case OP_MEMO: {
+                // a pure function's first instruction, its arguments are its only slots so far
+                uint8_t index = READ_BYTE();
+                MemoCache* cache = vm.memos[index];
+                if (cache == NULL) cache = vm.memos[index] = new_memo_cache(vm.chunk->functions[index].arity);
+                CallFrame* frame = &vm.frames[vm.frame_count - 1];
+                Value result;
+                MemoEntry* entry;
+                uint64_t claim;
+                if (!memo_lookup(cache, slots, &result, &entry, &claim)) {
+                    // a pure caller that tail called keeps its entry, only the outermost of a longer
+                    // chain of tail calls is remembered besides the callee's own
+                    if (frame->memo != NULL && frame->caller_memo == NULL) {
+                        frame->caller_memo = frame->memo;
+                        frame->caller_memo_claim = frame->memo_claim;
+                    }
+                    frame->memo = entry;
+                    frame->memo_claim = claim;
+                    break;
+                }
+                // a hit returns right away, filling the entries of pure callers that tail called it
+                if (frame->memo != NULL) memo_fill(frame->memo, frame->memo_claim, result);
+                if (frame->caller_memo != NULL) memo_fill(frame->caller_memo, frame->caller_memo_claim, result);
+                --vm.frame_count;
+                vm.stack_top = frame->slots;
+                vm.ip = frame->return_ip;
+                slots = vm.frames[vm.frame_count - 1].slots;
+                push(result);
+            } break;
+            case OP_GENERATOR: {
+                // a generator function's first instruction, its arguments are its only slots so far
+                ValueType yield_type = READ_BYTE();
+                Generator* generator = new_generator(yield_type, (int)(vm.ip - vm.chunk->code), slots,
+                                                     (int)(vm.stack_top - slots));
+                CallFrame* frame = &vm.frames[--vm.frame_count];
+                vm.stack_top = frame->slots;
+                vm.ip = frame->return_ip;
+                slots = vm.frames[vm.frame_count - 1].slots;
+                push(GENERATOR_VALUE(generator));
+                gc_safepoint();
+            } break;
+            case OP_RESUME: {
+                // the slot only keeps for-in's shape, a generator always continues where it stopped
+                pop();
+                Generator* generator = AS_GENERATOR(vm.stack_top[-1]);
+                if (generator->resume == -1) {
+                    vm.stack_top[-1] = INT_VALUE(-1);
+                    break;
+                }
+                // lines() runs no code, the next line is read in place
+                if (generator->reader != NULL) {
+                    vm.stack_top[-1] = INT_VALUE(next_line(generator) ? 0 : -1);
+                    break;
+                }
+                if (generator->running) return runtime_error("generator is already running");
+                if (vm.frame_count == VM_FRAMES_CAPACITY ||
+                    vm.stack_top + generator->count + VM_FRAME_SLOTS > vm.stack + VM_STACK_CAPACITY) {
+                    return runtime_error("stack overflow");
+                }
+                // the generator stays right below the frame, where YIELD and FINISH find it
+                CallFrame* frame = &vm.frames[vm.frame_count++];
+                frame->return_ip = vm.ip;
+                frame->slots = vm.stack_top;
+                frame->memo = NULL;
+                frame->caller_memo = NULL;
+                if (generator->count > 0) memcpy(vm.stack_top, generator->slots, sizeof(Value) * generator->count);
+                vm.stack_top += generator->count;
+                generator->running = true;
+                slots = frame->slots;
+                vm.ip = vm.chunk->code + generator->resume;
+            } break;
+            case OP_YIELD: {
+                Value value = pop();
+                save_generator(AS_GENERATOR(slots[-1]), (int)(vm.ip - vm.chunk->code), value, slots,
+                               (int)(vm.stack_top - slots));
+                CallFrame* frame = &vm.frames[--vm.frame_count];
+                vm.stack_top = frame->slots;
+                vm.stack_top[-1] = INT_VALUE(0);
+                vm.ip = frame->return_ip;
+                slots = vm.frames[vm.frame_count - 1].slots;
+            } break;
+            case OP_FINISH: {
+                finish_generator(AS_GENERATOR(slots[-1]));
+                CallFrame* frame = &vm.frames[--vm.frame_count];
+                vm.stack_top = frame->slots;
+                vm.stack_top[-1] = INT_VALUE(-1);
+                vm.ip = frame->return_ip;
+                slots = vm.frames[vm.frame_count - 1].slots;
             } break;
             case OP_RETURN: {
-                return RESULT_OK;
+                Value result = pop();
+                CallFrame* frame = &vm.frames[--vm.frame_count];
+                if (frame->memo != NULL) memo_fill(frame->memo, frame->memo_claim, result);
+                if (frame->caller_memo != NULL) memo_fill(frame->caller_memo, frame->caller_memo_claim, result);
+                vm.stack_top = frame->slots;
+                vm.ip = frame->return_ip;
+                slots = vm.frames[vm.frame_count - 1].slots;
+                push(result);
+            } break;
+            case OP_RETURN_VOID: {
+                if (vm.frame_count == 1) return RESULT_OK;
+                CallFrame* frame = &vm.frames[--vm.frame_count];
+                vm.stack_top = frame->slots;
+                vm.ip = frame->return_ip;
+                slots = vm.frames[vm.frame_count - 1].slots;
+                push(NONE_VALUE());
             } break;
             default: {
+                flush_output(&vm.output);
                 fprintf(stderr, "vm::interpret: unknown instruction %d\n", instruction);
                 return RESULT_RUNTIME_ERROR;
             }
@@ -129,7 +777,10 @@ static InterpretResult run() {
     }
 }
 
-InterpretResult interpret(const char* source) {
+static InterpretResult build_program(const char* source, Chunk* chunk, SymbolTable* globals, bool echo) {
+#ifdef DEBUG
+    int start = chunk->count;
+#endif
     TokenArray tokens = lex(source);
 #ifdef DEBUG
     print_tokens(&tokens);
@@ -147,35 +798,212 @@ InterpretResult interpret(const char* source) {
     printf("----------------------------------------------------------------\n");
 #endif
 
-    if (!analyze(ast)) {
+    if (!analyze(ast, globals)) {
         free_ast(ast);
         free_tokens(&tokens);
         return RESULT_ANALYZE_ERROR;
     }
-#ifdef DEBUG
-    print_ast(ast, 0);
-    printf("----------------------------------------------------------------\n");
-#endif
-
-    Chunk chunk = { 0 };
-    if (!compile(ast, &chunk)) {
-        free_chunk(&chunk);
+    if (!compile(ast, chunk, echo)) {
         free_ast(ast);
         free_tokens(&tokens);
         return RESULT_COMPILE_ERROR;
     }
+    chunk->global_count = globals->count;
 #ifdef DEBUG
-    disassemble_chunk(&chunk);
+    disassemble_chunk_from(chunk, start);
     printf("----------------------------------------------------------------\n");
 #endif
 
-    vm.chunk = &chunk;
-    vm.ip = chunk.code;
+    free_ast(ast);
+    free_tokens(&tokens);
+    return RESULT_OK;
+}
+
+// The chunk takes the strings interned for it whether or not it compiled, freeing it releases them.
+static InterpretResult compile_program(const char* source, Chunk* chunk, SymbolTable* globals, bool echo) {
+    InterpretResult result = build_program(source, chunk, globals, echo);
+    take_interned_cstrings(&chunk->strings, &chunk->string_count, &chunk->string_capacity);
+    return result;
+}
+
+InterpretResult compile_source(const char* source, Chunk* chunk) {
+    SymbolTable globals = { 0 };
+    InterpretResult result = compile_program(source, chunk, &globals, true);
+    free_symbol_table(&globals);
+    return result;
+}
+
+static void record_memo_stats(const Function* function, const MemoCache* cache) {
+    MemoStats* stats = NULL;
+    for (int i = 0; i < memo_stats_count && stats == NULL; ++i) {
+        MemoStats* candidate = &memo_stats[i];
+        if (candidate->length == function->length && memcmp(candidate->name, function->name, function->length) == 0) {
+            stats = candidate;
+        }
+    }
+    if (stats == NULL) {
+        if (memo_stats_capacity < memo_stats_count + 1) {
+            int old_capacity = memo_stats_capacity;
+            memo_stats_capacity = GROW_CAPACITY(old_capacity);
+            memo_stats = GROW_ARRAY(MemoStats, memo_stats, old_capacity, memo_stats_capacity);
+        }
+        // the chunk that names the function may be freed before the stats print
+        stats = &memo_stats[memo_stats_count++];
+        *stats = (MemoStats){ .name = malloc(function->length), .length = function->length };
+        memcpy(stats->name, function->name, function->length);
+    }
+    stats->hits += cache->hits;
+    stats->misses += cache->misses;
+    stats->evictions += cache->evictions;
+}
+
+// Results are only reused within one run, a REPL line or a server job starts with empty caches.
+static void free_memo_caches() {
+    for (int i = 0; i < MAX_FUNCTIONS; ++i) {
+        MemoCache* cache = vm.memos[i];
+        if (cache == NULL) continue;
+        if (memo_stats_enabled) record_memo_stats(&vm.chunk->functions[i], cache);
+        free_memo_cache(cache);
+        vm.memos[i] = NULL;
+    }
+}
+
+void forget_run() {
+    if (vm.global_count > 0) memset(vm.globals, 0, sizeof(Value) * vm.global_count);
+    vm.global_count = 0;
     vm.stack_top = vm.stack;
+    gc_settle();
+}
+
+// New globals start out empty, the collector scans them.
+static void reserve_globals(int count) {
+    if (vm.global_capacity < count) {
+        int old_capacity = vm.global_capacity;
+        while (vm.global_capacity < count) vm.global_capacity = GROW_CAPACITY(vm.global_capacity);
+        vm.globals = GROW_ARRAY(Value, vm.globals, old_capacity, vm.global_capacity);
+        memset(vm.globals + old_capacity, 0, sizeof(Value) * (vm.global_capacity - old_capacity));
+    }
+    if (vm.global_count < count) vm.global_count = count;
+}
+
+static InterpretResult run_from(Chunk* chunk, int offset) {
+    reserve_globals(chunk->global_count);
+    vm.chunk = chunk;
+    vm.ip = chunk->code + offset;
+    vm.stack_top = vm.stack;
+    vm.frames[0] = (CallFrame){ .return_ip = NULL, .slots = vm.stack };
+    vm.frame_count = 1;
+    set_gc_roots(vm.stack, &vm.stack_top, vm.globals, vm.global_count);
 
+    begin_sampling(&vm.ip, vm.frames, &vm.frame_count, chunk);
     InterpretResult result = run();
+    free_memo_caches();
+    end_sampling();
+    return result;
+}
+
+InterpretResult run_chunk(Chunk* chunk) {
+    InterpretResult result = run_from(chunk, 0);
+    forget_run();
+    return result;
+}
+
+InterpretResult run_chunk_with(Chunk* chunk, const Value* bindings, int binding_count, Value* results, int result_count) {
+    reserve_globals(chunk->global_count);
+    memcpy(vm.globals, bindings, binding_count * sizeof(Value));
+    vm.results = results;
+    vm.result_count = 0;
+    vm.result_capacity = result_count;
+    InterpretResult result = run_from(chunk, 0);
+    vm.results = NULL;
+    if (result == RESULT_OK && vm.result_count != result_count) {
+        fprintf(stderr, "runtime error: %d results for %d output columns\n", vm.result_count, result_count);
+        return RESULT_RUNTIME_ERROR;
+    }
+    return result;
+}
+
+InterpretResult interpret(const char* source) {
+    Chunk chunk = { 0 };
+    SymbolTable globals = { 0 };
+    InterpretResult result = compile_program(source, &chunk, &globals, false);
+    if (result == RESULT_OK) {
+        result = run_chunk(&chunk);
+    }
+    free_symbol_table(&globals);
     free_chunk(&chunk);
-    free_ast(ast);
-    free_tokens(&tokens);
     return result;
 }
+
+void init_session(Session* session) {
+    *session = (Session){ 0 };
+}
+
+void free_session(Session* session) {
+    free_chunk(&session->chunk);
+    free_symbol_table(&session->globals);
+}
+
+InterpretResult interpret_in_session(Session* session, const char* source) {
+    Chunk* chunk = &session->chunk;
+    int start = chunk->count;
+    int constants_start = chunk->constant_pool.count;
+    int globals_start = session->globals.count;
+    int functions_start = session->globals.function_count;
+    int classes_start = session->globals.class_count;
+    int caches_start = chunk->cache_count;
+
+    InterpretResult result = compile_program(source, chunk, &session->globals, true);
+    if (result != RESULT_OK) {
+        // drop whatever the failed line managed to emit, earlier lines stay intact
+        chunk->count = start;
+        chunk->constant_pool.count = constants_start;
+        truncate_functions(chunk, functions_start);
+        truncate_classes(chunk, classes_start);
+        chunk->cache_count = caches_start;
+        truncate_symbol_table(&session->globals, globals_start, functions_start, classes_start);
+        return result;
+    }
+    return run_from(chunk, start);
+}
+
+void flush_vm_output() {
+    flush_output(&vm.output);
+}
+
+void set_vm_output(FILE* file) {
+    flush_output(&vm.output);
+    vm.output.file = file;
+}
+
+void set_shortest_floats(bool enabled) {
+    vm.output.shortest_floats = enabled;
+}
+
+void set_inline_caches(bool enabled) {
+    inline_caches_enabled = enabled;
+}
+
+void set_memo_stats(bool enabled) {
+    memo_stats_enabled = enabled;
+}
+
+void print_memo_stats(FILE* file) {
+    for (int i = 0; i < memo_stats_count; ++i) {
+        MemoStats* stats = &memo_stats[i];
+        fprintf(
+            file,
+            "memo: '%.*s' %llu hits, %llu misses, %llu evictions\n",
+            stats->length,
+            stats->name,
+            (unsigned long long)stats->hits,
+            (unsigned long long)stats->misses,
+            (unsigned long long)stats->evictions
+        );
+        free(stats->name);
+    }
+    free(memo_stats);
+    memo_stats = NULL;
+    memo_stats_count = 0;
+    memo_stats_capacity = 0;
+}